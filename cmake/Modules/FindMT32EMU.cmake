@@ -13,7 +13,9 @@ include(FindPackageHandleStandardArgs)
 # all listed variables are TRUE
 find_package_handle_standard_args(MT32EMU DEFAULT_MSG MT32EMU_LIBRARY MT32EMU_INCLUDE_DIR)
 
-set(MT32EMU_LIBRARIES ${MT32EMU_LIBRARY})
+# mt32emu is a static library, so its users need to link against the threading library it uses
+find_package(Threads)
+set(MT32EMU_LIBRARIES ${MT32EMU_LIBRARY} ${CMAKE_THREAD_LIBS_INIT})
 set(MT32EMU_INCLUDE_DIRS ${MT32EMU_INCLUDE_DIR})
 
 mark_as_advanced(MT32EMU_LIBRARY MT32EMU_INCLUDE_DIR)
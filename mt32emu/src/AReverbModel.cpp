@@ -47,15 +47,31 @@ const AReverbSettings AReverbModel::REVERB_MODE_2_SETTINGS = {MODE_2_ALLPASSES,
 RingBuffer::RingBuffer(Bit32u newsize) {
 	index = 0;
 	size = newsize;
-	buffer = new float[size];
+	buffer = NULL;
 }
 
 RingBuffer::~RingBuffer() {
-	delete[] buffer;
 	buffer = NULL;
 	size = 0;
 }
 
+Bit32u RingBuffer::getSize() const {
+	return size;
+}
+
+void RingBuffer::setBuffer(float *newBuffer) {
+	index = 0;
+	buffer = newBuffer;
+}
+
+Bit32u RingBuffer::getIndex() const {
+	return index;
+}
+
+void RingBuffer::setIndex(Bit32u newIndex) {
+	index = newIndex;
+}
+
 float RingBuffer::next() {
 	index++;
 	if (index >= size) {
@@ -119,46 +135,59 @@ float Delay::process(float in) {
 }
 
 AReverbModel::AReverbModel(const AReverbSettings *useSettings) : allpasses(NULL), delays(NULL), currentSettings(useSettings) {
+	// FIXME: filter sizes must be multiplied by sample rate to 32000Hz ratio
+	allpasses = new AllpassFilter*[NUM_ALLPASSES];
+	for (Bit32u i = 0; i < NUM_ALLPASSES; i++) {
+		allpasses[i] = new AllpassFilter(currentSettings->allpassSizes[i]);
+	}
+	delays = new Delay*[NUM_DELAYS];
+	for (Bit32u i = 0; i < NUM_DELAYS; i++) {
+		delays[i] = new Delay(currentSettings->delaySizes[i]);
+	}
 }
 
 AReverbModel::~AReverbModel() {
-	close();
+	for (Bit32u i = 0; i < NUM_ALLPASSES; i++) {
+		delete allpasses[i];
+	}
+	delete[] allpasses;
+	for (Bit32u i = 0; i < NUM_DELAYS; i++) {
+		delete delays[i];
+	}
+	delete[] delays;
 }
 
-void AReverbModel::open(unsigned int /*sampleRate*/) {
-	// FIXME: filter sizes must be multiplied by sample rate to 32000Hz ratio
+Bit32u AReverbModel::getBufferSize(unsigned int /*sampleRate*/) const {
+	Bit32u bufferSize = 0;
+	for (Bit32u i = 0; i < NUM_ALLPASSES; i++) {
+		bufferSize += allpasses[i]->getSize();
+	}
+	for (Bit32u i = 0; i < NUM_DELAYS; i++) {
+		bufferSize += delays[i]->getSize();
+	}
+	return bufferSize;
+}
+
+void AReverbModel::open(unsigned int /*sampleRate*/, float *buffer) {
 	// IIR filter values depend on sample rate as well
-	allpasses = new AllpassFilter*[NUM_ALLPASSES];
 	for (Bit32u i = 0; i < NUM_ALLPASSES; i++) {
-		allpasses[i] = new AllpassFilter(currentSettings->allpassSizes[i]);
+		allpasses[i]->setBuffer(buffer);
+		buffer += allpasses[i]->getSize();
 	}
-	delays = new Delay*[NUM_DELAYS];
 	for (Bit32u i = 0; i < NUM_DELAYS; i++) {
-		delays[i] = new Delay(currentSettings->delaySizes[i]);
+		delays[i]->setBuffer(buffer);
+		buffer += delays[i]->getSize();
 	}
 	mute();
 }
 
 void AReverbModel::close() {
-	if (allpasses != NULL) {
-		for (Bit32u i = 0; i < NUM_ALLPASSES; i++) {
-			if (allpasses[i] != NULL) {
-				delete allpasses[i];
-				allpasses[i] = NULL;
-			}
-		}
-		delete[] allpasses;
-		allpasses = NULL;
-	}
-	if (delays != NULL) {
-		for (Bit32u i = 0; i < NUM_DELAYS; i++) {
-			if (delays[i] != NULL) {
-				delete delays[i];
-				delays[i] = NULL;
-			}
-		}
-		delete[] delays;
-		delays = NULL;
+	// The buffer belongs to the caller, the filters just forget about it
+	for (Bit32u i = 0; i < NUM_ALLPASSES; i++) {
+		allpasses[i]->setBuffer(NULL);
+	}
+	for (Bit32u i = 0; i < NUM_DELAYS; i++) {
+		delays[i]->setBuffer(NULL);
 	}
 }
 
@@ -235,3 +264,47 @@ void AReverbModel::process(const float *inLeft, const float *inRight, float *out
 		outRight++;
 	}
 }
+
+struct AReverbState {
+	float decayTime;
+	float wetLevel;
+	float filterhist1;
+	float filterhist2;
+	float combhist;
+	Bit32u allpassIndices[NUM_ALLPASSES];
+	Bit32u delayIndices[NUM_DELAYS];
+};
+
+Bit32u AReverbModel::getStateSize() const {
+	return sizeof(AReverbState);
+}
+
+void AReverbModel::saveState(void *state) const {
+	AReverbState *reverbState = (AReverbState *)state;
+	reverbState->decayTime = decayTime;
+	reverbState->wetLevel = wetLevel;
+	reverbState->filterhist1 = filterhist1;
+	reverbState->filterhist2 = filterhist2;
+	reverbState->combhist = combhist;
+	for (Bit32u i = 0; i < NUM_ALLPASSES; i++) {
+		reverbState->allpassIndices[i] = allpasses[i]->getIndex();
+	}
+	for (Bit32u i = 0; i < NUM_DELAYS; i++) {
+		reverbState->delayIndices[i] = delays[i]->getIndex();
+	}
+}
+
+void AReverbModel::loadState(const void *state) {
+	const AReverbState *reverbState = (const AReverbState *)state;
+	decayTime = reverbState->decayTime;
+	wetLevel = reverbState->wetLevel;
+	filterhist1 = reverbState->filterhist1;
+	filterhist2 = reverbState->filterhist2;
+	combhist = reverbState->combhist;
+	for (Bit32u i = 0; i < NUM_ALLPASSES; i++) {
+		allpasses[i]->setIndex(reverbState->allpassIndices[i]);
+	}
+	for (Bit32u i = 0; i < NUM_DELAYS; i++) {
+		delays[i]->setIndex(reverbState->delayIndices[i]);
+	}
+}
@@ -38,6 +38,11 @@ protected:
 public:
 	RingBuffer(Bit32u size);
 	virtual ~RingBuffer();
+	Bit32u getSize() const;
+	// The buffer must have room for getSize() samples, or be NULL
+	void setBuffer(float *buffer);
+	Bit32u getIndex() const;
+	void setIndex(Bit32u newIndex);
 	float next();
 	bool isEmpty();
 	void mute();
@@ -68,11 +73,15 @@ class AReverbModel : public ReverbModel {
 public:
 	AReverbModel(const AReverbSettings *newSettings);
 	~AReverbModel();
-	void open(unsigned int sampleRate);
+	Bit32u getBufferSize(unsigned int sampleRate) const;
+	void open(unsigned int sampleRate, float *buffer);
 	void close();
 	void setParameters(Bit8u time, Bit8u level);
 	void process(const float *inLeft, const float *inRight, float *outLeft, float *outRight, unsigned long numSamples);
 	bool isActive() const;
+	Bit32u getStateSize() const;
+	void saveState(void *state) const;
+	void loadState(const void *state);
 
 	static const AReverbSettings REVERB_MODE_0_SETTINGS;
 	static const AReverbSettings REVERB_MODE_1_SETTINGS;
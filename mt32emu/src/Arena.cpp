@@ -0,0 +1,87 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdlib>
+#include <cstring>
+
+#include "mt32emu.h"
+
+using namespace MT32Emu;
+
+size_t Arena::alignSize(size_t blockSize) {
+	return (blockSize + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+}
+
+Arena::Arena() {
+	memory = NULL;
+	base = NULL;
+	size = 0;
+	used = 0;
+}
+
+Arena::~Arena() {
+	close();
+}
+
+bool Arena::open(size_t useSize) {
+	close();
+	// Over-allocate so that the usable area can start on an aligned address
+	memory = (Bit8u *)malloc(useSize + ARENA_ALIGNMENT);
+	if (memory == NULL) {
+		return false;
+	}
+	base = memory + ((ARENA_ALIGNMENT - ((size_t)memory & (ARENA_ALIGNMENT - 1))) & (ARENA_ALIGNMENT - 1));
+	// Touching every page here means the render path won't take page faults on first use
+	memset(base, 0, useSize);
+	size = useSize;
+	used = 0;
+	return true;
+}
+
+void Arena::close() {
+	free(memory);
+	memory = NULL;
+	base = NULL;
+	size = 0;
+	used = 0;
+}
+
+void *Arena::allocate(size_t blockSize) {
+	size_t alignedSize = alignSize(blockSize);
+	if (base == NULL || alignedSize > size - used) {
+		return NULL;
+	}
+	void *block = base + used;
+	used += alignedSize;
+	return block;
+}
+
+size_t Arena::getSize() const {
+	return size;
+}
+
+size_t Arena::getUsed() const {
+	return used;
+}
+
+void Arena::copyTo(void *target, size_t len) const {
+	memcpy(target, base, len);
+}
+
+void Arena::copyFrom(const void *source, size_t len) {
+	memcpy(base, source, len);
+}
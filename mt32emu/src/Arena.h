@@ -0,0 +1,75 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_ARENA_H
+#define MT32EMU_ARENA_H
+
+#include <cstddef>
+#include <new>
+
+namespace MT32Emu {
+
+// All blocks handed out by an Arena start on a boundary of this many bytes (a common cache line size).
+const size_t ARENA_ALIGNMENT = 64;
+
+// A single block of memory that per-instance objects and buffers are carved out of.
+// The total size is computed up front and allocated once by open(), so that a Synth's working set is
+// contiguous and nothing needs to be allocated or freed while rendering.
+// Individual blocks are never freed - the whole arena is released at once by close().
+class Arena {
+private:
+	Bit8u *memory; // As returned by malloc()
+	Bit8u *base; // memory, rounded up to ARENA_ALIGNMENT
+	size_t size;
+	size_t used;
+
+	Arena(const Arena &);
+	Arena &operator=(const Arena &);
+
+public:
+	// Returns the space a block of the given size takes up in an arena, including alignment padding.
+	static size_t alignSize(size_t blockSize);
+
+	Arena();
+	~Arena();
+
+	// Allocates the arena, filled with zeros. Returns false if the memory isn't available.
+	bool open(size_t useSize);
+	void close();
+
+	// Returns a block of at least blockSize bytes, aligned to ARENA_ALIGNMENT, or NULL if the arena is exhausted.
+	void *allocate(size_t blockSize);
+
+	// Objects are constructed in place with placement new, e.g. new (arena.allocate(sizeof(Poly))) Poly(part).
+	// Their destructors must be called explicitly before the arena is closed.
+	template <class T>
+	T *allocateArray(size_t count) {
+		return (T *)allocate(count * sizeof(T));
+	}
+
+	size_t getSize() const;
+	size_t getUsed() const;
+
+	// Copy the first len bytes of the arena (no more than getUsed()) out, or back in over the objects living there.
+	// Since everything is copied back to the same addresses, pointers between the objects stay valid.
+	void copyTo(void *target, size_t len) const;
+	void copyFrom(const void *source, size_t len);
+};
+
+}
+
+#endif
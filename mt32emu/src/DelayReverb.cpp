@@ -52,34 +52,29 @@ DelayReverb::DelayReverb() {
 }
 
 DelayReverb::~DelayReverb() {
-	delete[] buf;
 }
 
-void DelayReverb::open(unsigned int newSampleRate) {
-	if (newSampleRate != sampleRate || buf == NULL) {
-		sampleRate = newSampleRate;
-
-		delete[] buf;
+Bit32u DelayReverb::getBufferSize(unsigned int useSampleRate) const {
+	// If we ever need a speedup, set bufSize to EXP2F(ceil(log2(bufSize))) and use & instead of % to find buf indexes
+	return 16384 * useSampleRate / 32000;
+}
 
-		// If we ever need a speedup, set bufSize to EXP2F(ceil(log2(bufSize))) and use & instead of % to find buf indexes
-		bufSize = 16384 * sampleRate / 32000;
-		buf = new float[bufSize];
+void DelayReverb::open(unsigned int newSampleRate, float *buffer) {
+	sampleRate = newSampleRate;
+	bufSize = getBufferSize(sampleRate);
+	buf = buffer;
 
-		recalcParameters();
+	recalcParameters();
 
-		// mute buffer
-		bufIx = 0;
-		if (buf != NULL) {
-			for (unsigned int i = 0; i < bufSize; i++) {
-				buf[i] = 0.0f;
-			}
-		}
+	// mute buffer
+	bufIx = 0;
+	for (unsigned int i = 0; i < bufSize; i++) {
+		buf[i] = 0.0f;
 	}
 	// FIXME: IIR filter value depends on sample rate as well
 }
 
 void DelayReverb::close() {
-	delete[] buf;
 	buf = NULL;
 }
 
@@ -133,6 +128,29 @@ void DelayReverb::process(const float *inLeft, const float *inRight, float *outL
 	}
 }
 
+struct DelayReverbState {
+	Bit8u time;
+	Bit8u level;
+	Bit32u bufIx;
+};
+
+Bit32u DelayReverb::getStateSize() const {
+	return sizeof(DelayReverbState);
+}
+
+void DelayReverb::saveState(void *state) const {
+	DelayReverbState *delayState = (DelayReverbState *)state;
+	delayState->time = time;
+	delayState->level = level;
+	delayState->bufIx = bufIx;
+}
+
+void DelayReverb::loadState(const void *state) {
+	const DelayReverbState *delayState = (const DelayReverbState *)state;
+	bufIx = delayState->bufIx;
+	setParameters(delayState->time, delayState->level);
+}
+
 bool DelayReverb::isActive() const {
 	// Quick hack: Return true iff all samples in the left buffer are the same and
 	// all samples in the right buffers are the same (within the sample output threshold).
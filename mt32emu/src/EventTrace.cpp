@@ -0,0 +1,278 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstring>
+
+#include "mt32emu.h"
+
+using namespace MT32Emu;
+
+// Track numbers used in exported traces: 0 for the synth as a whole, then the parts, then the partials
+static const int TRACK_PART_BASE = 1;
+static const int TRACK_PARTIAL_BASE = 10;
+
+EventTrace::EventTrace() : records(NULL), capacityMask(0), writePos(0), readPos(0), droppedCount(0),
+	stagePartialRecords(false), stagedPartialRecords(NULL) {
+}
+
+EventTrace::~EventTrace() {
+	close();
+}
+
+bool EventTrace::open(Bit32u capacity) {
+	close();
+	if (capacity == 0 || capacity > 0x80000000) {
+		return false;
+	}
+	Bit32u roundedCapacity = 1;
+	while (roundedCapacity < capacity) {
+		roundedCapacity <<= 1;
+	}
+	records = new TraceRecord[roundedCapacity];
+	stagedPartialRecords = new TraceRecord[MT32EMU_MAX_PARTIALS][MAX_STAGED_PARTIAL_RECORDS];
+	capacityMask = roundedCapacity - 1;
+	writePos = 0;
+	readPos = 0;
+	droppedCount = 0;
+	stagePartialRecords = false;
+	memset(stagedPartialRecordCounts, 0, sizeof(stagedPartialRecordCounts));
+	memset(stagedPartialDroppedCounts, 0, sizeof(stagedPartialDroppedCounts));
+	return true;
+}
+
+void EventTrace::close() {
+	delete[] records;
+	records = NULL;
+	delete[] stagedPartialRecords;
+	stagedPartialRecords = NULL;
+}
+
+TraceRecord EventTrace::makeRecord(TraceEventType type, Bit32u sampleStamp, Bit8u part, Bit16u param, Bit32u value) {
+	TraceRecord record;
+	record.sampleStamp = sampleStamp;
+	record.type = (Bit8u)type;
+	record.part = part;
+	record.param = param;
+	record.value = value;
+	return record;
+}
+
+void EventTrace::put(const TraceRecord &record) {
+	Bit32u pos = writePos;
+	if (pos - readPos > capacityMask) {
+		droppedCount = droppedCount + 1;
+		return;
+	}
+	records[pos & capacityMask] = record;
+	// The record must be complete before the reader can see the new position
+	Thread::memoryBarrier();
+	writePos = pos + 1;
+}
+
+void EventTrace::record(TraceEventType type, Bit32u sampleStamp, Bit8u part, Bit16u param, Bit32u value) {
+	if (records == NULL) {
+		return;
+	}
+	put(makeRecord(type, sampleStamp, part, param, value));
+}
+
+void EventTrace::recordPartial(unsigned int partialNum, TraceEventType type, Bit32u sampleStamp, Bit8u part, Bit32u value) {
+	if (records == NULL) {
+		return;
+	}
+	TraceRecord record = makeRecord(type, sampleStamp, part, (Bit16u)partialNum, value);
+	if (!stagePartialRecords) {
+		put(record);
+		return;
+	}
+	// Only the thread rendering the partial gets here, so the partial's staging area needs no locking
+	if (stagedPartialRecordCounts[partialNum] == MAX_STAGED_PARTIAL_RECORDS) {
+		stagedPartialDroppedCounts[partialNum]++;
+		return;
+	}
+	stagedPartialRecords[partialNum][stagedPartialRecordCounts[partialNum]++] = record;
+}
+
+void EventTrace::setStagePartialRecords(bool stage) {
+	stagePartialRecords = stage;
+}
+
+void EventTrace::flushPartialRecords() {
+	if (records == NULL) {
+		return;
+	}
+	for (unsigned int i = 0; i < MT32EMU_MAX_PARTIALS; i++) {
+		for (unsigned int j = 0; j < stagedPartialRecordCounts[i]; j++) {
+			put(stagedPartialRecords[i][j]);
+		}
+		stagedPartialRecordCounts[i] = 0;
+		if (stagedPartialDroppedCounts[i] > 0) {
+			droppedCount = droppedCount + stagedPartialDroppedCounts[i];
+			stagedPartialDroppedCounts[i] = 0;
+		}
+	}
+}
+
+Bit32u EventTrace::drain(TraceRecord *outRecords, Bit32u maxCount) {
+	if (records == NULL) {
+		return 0;
+	}
+	Bit32u pos = readPos;
+	Bit32u available = writePos - pos;
+	// Don't read the records before the position that says they're complete
+	Thread::memoryBarrier();
+	Bit32u count = available < maxCount ? available : maxCount;
+	for (Bit32u i = 0; i < count; i++) {
+		outRecords[i] = records[(pos + i) & capacityMask];
+	}
+	// The records must be copied before the writer can see their slots as free
+	Thread::memoryBarrier();
+	readPos = pos + count;
+	return count;
+}
+
+Bit32u EventTrace::getDroppedCount() const {
+	return droppedCount;
+}
+
+// Appends text to a buffer of limited size, counting all of it (see EventTrace::exportChromeTrace())
+class TraceTextWriter {
+private:
+	char *buffer;
+	Bit32u size;
+	Bit32u length;
+
+public:
+	TraceTextWriter(char *useBuffer, Bit32u useSize) : buffer(useBuffer), size(useSize), length(0) {
+		if (buffer != NULL && size > 0) {
+			buffer[0] = 0;
+		}
+	}
+
+	void write(const char *text) {
+		Bit32u textLen = (Bit32u)strlen(text);
+		if (buffer != NULL && length + 1 < size) {
+			Bit32u copyLen = size - 1 - length;
+			if (copyLen > textLen) {
+				copyLen = textLen;
+			}
+			memcpy(buffer + length, text, copyLen);
+			buffer[length + copyLen] = 0;
+		}
+		length += textLen;
+	}
+
+	Bit32u getLength() const {
+		return length;
+	}
+};
+
+static const char *getTraceEventName(Bit8u type) {
+	switch (type) {
+	case TraceEvent_noteOn:
+		return "noteOn";
+	case TraceEvent_noteOff:
+		return "noteOff";
+	case TraceEvent_partialAlloc:
+		return "partialAlloc";
+	case TraceEvent_partialAbort:
+		return "partialAbort";
+	case TraceEvent_partialSteal:
+		return "partialSteal";
+	case TraceEvent_sysexWrite:
+		return "sysexWrite";
+	case TraceEvent_tvaPhase:
+		return "tvaPhase";
+	case TraceEvent_renderStart:
+	case TraceEvent_renderEnd:
+		return "render";
+	}
+	return "unknown";
+}
+
+static void writeTrackName(TraceTextWriter &writer, int track, const char *name) {
+	char line[128];
+	// Track names are short, the bound only keeps the line within the buffer whatever the caller passes
+	sprintf(line, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%.32s\"}},\n", track, name);
+	writer.write(line);
+}
+
+Bit32u EventTrace::exportChromeTrace(const TraceRecord *traceRecords, Bit32u count, unsigned int sampleRate, char *buffer, Bit32u bufferSize) {
+	TraceTextWriter writer(buffer, bufferSize);
+	char line[256];
+	writer.write("{\"traceEvents\":[\n");
+	writer.write("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"MT32Emu\"}},\n");
+	writeTrackName(writer, 0, "Synth");
+	for (int i = 0; i < 8; i++) {
+		sprintf(line, "Part %d", i + 1);
+		writeTrackName(writer, TRACK_PART_BASE + i, line);
+	}
+	writeTrackName(writer, TRACK_PART_BASE + 8, "Rhythm");
+	for (int i = 0; i < MT32EMU_MAX_PARTIALS; i++) {
+		sprintf(line, "Partial %d", i);
+		writeTrackName(writer, TRACK_PARTIAL_BASE + i, line);
+	}
+
+	for (Bit32u i = 0; i < count; i++) {
+		const TraceRecord &record = traceRecords[i];
+		double timestamp = record.sampleStamp * 1000000.0 / sampleRate;
+		int track = record.part < 9 ? TRACK_PART_BASE + record.part : 0;
+		const char *phase = "i";
+		char args[128];
+		switch (record.type) {
+		case TraceEvent_noteOn:
+			sprintf(args, "\"key\":%u,\"velocity\":%u", (unsigned int)record.param, (unsigned int)record.value);
+			break;
+		case TraceEvent_noteOff:
+			sprintf(args, "\"key\":%u", (unsigned int)record.param);
+			break;
+		case TraceEvent_partialAlloc:
+		case TraceEvent_partialAbort:
+			track = TRACK_PARTIAL_BASE + record.param;
+			sprintf(args, "\"part\":%u", (unsigned int)record.part + 1);
+			break;
+		case TraceEvent_partialSteal:
+			sprintf(args, "\"needed\":%u,\"forPart\":%u", (unsigned int)record.param, (unsigned int)record.value + 1);
+			break;
+		case TraceEvent_sysexWrite:
+			sprintf(args, "\"address\":\"%06x\",\"length\":%u", (unsigned int)record.value, (unsigned int)record.param);
+			break;
+		case TraceEvent_tvaPhase:
+			track = TRACK_PARTIAL_BASE + record.param;
+			sprintf(args, "\"phase\":%u", (unsigned int)record.value);
+			break;
+		case TraceEvent_renderStart:
+			phase = "B";
+			sprintf(args, "\"samples\":%u", (unsigned int)record.value);
+			break;
+		case TraceEvent_renderEnd:
+			phase = "E";
+			args[0] = 0;
+			break;
+		default:
+			args[0] = 0;
+			break;
+		}
+		sprintf(line, "{\"name\":\"%s\",\"ph\":\"%s\",%s\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{%s}},\n",
+			getTraceEventName(record.type), phase, phase[0] == 'i' ? "\"s\":\"t\"," : "", timestamp, track, args);
+		writer.write(line);
+	}
+	// A trailing comma isn't allowed, so the list is closed with an empty metadata event
+	writer.write("{\"name\":\"trace_end\",\"ph\":\"M\",\"pid\":1}\n]}\n");
+	return writer.getLength();
+}
@@ -0,0 +1,121 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_EVENT_TRACE_H
+#define MT32EMU_EVENT_TRACE_H
+
+namespace MT32Emu {
+
+// The meaning of the part, param and value fields of a TraceRecord depends on its type
+enum TraceEventType {
+	// param: key, value: velocity
+	TraceEvent_noteOn,
+	// param: key
+	TraceEvent_noteOff,
+	// param: partial number
+	TraceEvent_partialAlloc,
+	// param: partial number
+	TraceEvent_partialAbort,
+	// A poly of the part was aborted to free partials for a new poly on another (or the same) part.
+	// param: number of partials needed, value: part the partials are needed for
+	TraceEvent_partialSteal,
+	// param: number of bytes written (at most 0xFFFF), value: address as given in the sysex
+	TraceEvent_sysexWrite,
+	// param: partial number, value: new phase (see TVA.h)
+	TraceEvent_tvaPhase,
+	// value: number of samples in the run
+	TraceEvent_renderStart,
+	TraceEvent_renderEnd
+};
+
+// Used in the part field of records that don't belong to a part
+const Bit8u TRACE_NO_PART = 0xFF;
+
+struct TraceRecord {
+	// Samples rendered since the synth was opened (as for SynthCheckpoint::getRenderedSampleCount()), plus the position
+	// within the run for records made while rendering
+	Bit32u sampleStamp;
+	Bit8u type;
+	Bit8u part;
+	Bit16u param;
+	Bit32u value;
+};
+
+// Binary event trace for diagnosing a synth in the field, where the MT32EMU_MONITOR_* debug output is of no use.
+// Records are kept in a ring buffer that is allocated when tracing starts, so recording never allocates memory,
+// formats text or takes a lock. When the ring is full, new records are dropped (and counted) until it is drained.
+// The synth records from the thread it's used on, while drain() may be called from one other thread at the same time.
+// Records made by partials while they're rendered (on worker threads or not) are staged with the partial, and put into
+// the ring by flushPartialRecords() afterwards in partial order, which doesn't depend on the number of threads.
+class EventTrace {
+private:
+	static const unsigned int MAX_STAGED_PARTIAL_RECORDS = 4;
+
+	TraceRecord *records;
+	Bit32u capacityMask;
+	// Only ever increased, by the recording thread and the draining thread respectively.
+	// Both wrap around, which works out because the capacity is a power of two.
+	volatile Bit32u writePos;
+	volatile Bit32u readPos;
+	volatile Bit32u droppedCount;
+
+	bool stagePartialRecords;
+	TraceRecord (*stagedPartialRecords)[MAX_STAGED_PARTIAL_RECORDS];
+	unsigned int stagedPartialRecordCounts[MT32EMU_MAX_PARTIALS];
+	unsigned int stagedPartialDroppedCounts[MT32EMU_MAX_PARTIALS];
+
+	EventTrace(const EventTrace &);
+	EventTrace &operator=(const EventTrace &);
+
+	static TraceRecord makeRecord(TraceEventType type, Bit32u sampleStamp, Bit8u part, Bit16u param, Bit32u value);
+	void put(const TraceRecord &record);
+
+public:
+	EventTrace();
+	~EventTrace();
+
+	// Allocates room for at least the given number of records (rounded up to a power of two) and starts recording.
+	// Returns false if that isn't possible.
+	bool open(Bit32u capacity);
+	// Stops recording and frees the ring, including any records that haven't been drained
+	void close();
+	bool isOpen() const {
+		return records != NULL;
+	}
+
+	void record(TraceEventType type, Bit32u sampleStamp, Bit8u part, Bit16u param, Bit32u value);
+	// Same as record(), for records made by a partial, which may happen on a worker thread
+	void recordPartial(unsigned int partialNum, TraceEventType type, Bit32u sampleStamp, Bit8u part, Bit32u value);
+	// While set, recordPartial() stages the records with the partial instead of putting them into the ring
+	void setStagePartialRecords(bool stage);
+	void flushPartialRecords();
+
+	// Moves up to maxCount of the oldest records into the given array, and returns the number moved
+	Bit32u drain(TraceRecord *outRecords, Bit32u maxCount);
+	// Returns the number of records dropped so far because the ring was full
+	Bit32u getDroppedCount() const;
+
+	// Writes the records as a JSON trace, as read by chrome://tracing and the Perfetto UI, with timestamps converted
+	// from samples to microseconds. Parts and partials each get a track of their own.
+	// Returns the length of the text (without the terminating zero). As with StateWriter, a NULL buffer can be given
+	// to find out the size needed. If the buffer is too small, the text is truncated (but still terminated).
+	static Bit32u exportChromeTrace(const TraceRecord *traceRecords, Bit32u count, unsigned int sampleRate, char *buffer, Bit32u bufferSize);
+};
+
+}
+
+#endif
@@ -23,7 +23,7 @@
 using namespace MT32Emu;
 
 FreeverbModel::FreeverbModel(float useScaleTuning, float useFiltVal, float useWet, Bit8u useRoom, float useDamp) {
-	freeverb = NULL;
+	freeverb = new revmodel(useScaleTuning);
 	scaleTuning = useScaleTuning;
 	filtVal = useFiltVal;
 	wet = useWet;
@@ -35,12 +35,15 @@ FreeverbModel::~FreeverbModel() {
 	delete freeverb;
 }
 
-void FreeverbModel::open(unsigned int /*sampleRate*/) {
+Bit32u FreeverbModel::getBufferSize(unsigned int /*sampleRate*/) const {
+	// FIXME: Should scale with the sample rate, see open()
+	return freeverb->getbuffersize();
+}
+
+void FreeverbModel::open(unsigned int /*sampleRate*/, float *buffer) {
 	// FIXME: scaleTuning must be multiplied by sample rate to 32000Hz ratio
 	// IIR filter values depend on sample rate as well
-	if (freeverb == NULL) {
-		freeverb = new revmodel(scaleTuning);
-	}
+	freeverb->setbuffer(buffer);
 	freeverb->mute();
 
 	// entrance Lowpass filter factor
@@ -51,8 +54,7 @@ void FreeverbModel::open(unsigned int /*sampleRate*/) {
 }
 
 void FreeverbModel::close() {
-	delete freeverb;
-	freeverb = NULL;
+	// The buffer belongs to the caller, there's nothing to free
 }
 
 void FreeverbModel::process(const float *inLeft, const float *inRight, float *outLeft, float *outRight, unsigned long numSamples) {
@@ -72,6 +74,18 @@ void FreeverbModel::setParameters(Bit8u time, Bit8u level) {
 	freeverb->setroomsize(roomTable[8 * room + time]);
 }
 
+Bit32u FreeverbModel::getStateSize() const {
+	return sizeof(revmodelstate);
+}
+
+void FreeverbModel::saveState(void *state) const {
+	freeverb->getstate(*(revmodelstate *)state);
+}
+
+void FreeverbModel::loadState(const void *state) {
+	freeverb->setstate(*(const revmodelstate *)state);
+}
+
 bool FreeverbModel::isActive() const {
 	// FIXME: Not bothering to do this properly since we'll be replacing Freeverb soon...
 	return false;
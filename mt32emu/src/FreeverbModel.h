@@ -32,11 +32,15 @@ class FreeverbModel : public ReverbModel {
 public:
 	FreeverbModel(float useScaleTuning, float useFiltVal, float useWet, Bit8u useRoom, float useDamp);
 	~FreeverbModel();
-	void open(unsigned int sampleRate);
+	Bit32u getBufferSize(unsigned int sampleRate) const;
+	void open(unsigned int sampleRate, float *buffer);
 	void close();
 	void setParameters(Bit8u time, Bit8u level);
 	void process(const float *inLeft, const float *inRight, float *outLeft, float *outRight, unsigned long numSamples);
 	bool isActive() const;
+	Bit32u getStateSize() const;
+	void saveState(void *state) const;
+	void loadState(const void *state);
 };
 
 }
@@ -147,4 +147,22 @@ void LA32Ramp::reset() {
 	interruptRaised = false;
 }
 
+void LA32Ramp::saveState(StateWriter &writer) const {
+	writer.write(current);
+	writer.write(largeTarget);
+	writer.write(largeIncrement);
+	writer.write(descending);
+	writer.write(interruptCountdown);
+	writer.write(interruptRaised);
+}
+
+void LA32Ramp::loadState(StateReader &reader) {
+	reader.read(current);
+	reader.read(largeTarget);
+	reader.read(largeIncrement);
+	reader.read(descending);
+	reader.read(interruptCountdown);
+	reader.read(interruptRaised);
+}
+
 }
@@ -36,6 +36,8 @@ public:
 	Bit32u nextValue();
 	bool checkInterrupt();
 	void reset();
+	void saveState(StateWriter &writer) const;
+	void loadState(StateReader &reader);
 };
 
 }
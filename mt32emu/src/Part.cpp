@@ -67,20 +67,15 @@ Part::Part(Synth *useSynth, unsigned int usePartNum) {
 	pitchBend = 0;
 	activePartialCount = 0;
 	memset(patchCache, 0, sizeof(patchCache));
+	romTimbreCaches = NULL;
+	polys = synth->arena.allocateArray<Poly>(MT32EMU_MAX_POLY);
 	for (int i = 0; i < MT32EMU_MAX_POLY; i++) {
-		freePolys.push_front(new Poly(this));
+		freePolys.prepend(new (&polys[i]) Poly(this));
 	}
 }
 
 Part::~Part() {
-	while (!activePolys.empty()) {
-		delete activePolys.front();
-		activePolys.pop_front();
-	}
-	while (!freePolys.empty()) {
-		delete freePolys.front();
-		freePolys.pop_front();
-	}
+	// The polys live in the synth's arena and have trivial destructors
 }
 
 void Part::setDataEntryMSB(unsigned char midiDataEntryMSB) {
@@ -152,30 +147,20 @@ void Part::reset() {
 }
 
 void RhythmPart::refresh() {
-	// (Re-)cache all the mapped timbres ahead of time
+	// The caches of the mapped timbres are only rebuilt when they're next played, see cacheTimbre()
 	for (unsigned int drumNum = 0; drumNum < synth->controlROMMap->rhythmSettingsCount; drumNum++) {
 		int drumTimbreNum = rhythmTemp[drumNum].timbre;
 		if (drumTimbreNum >= 127) { // 94 on MT-32
 			continue;
 		}
-		PatchCache *cache = drumCache[drumNum];
-		backupCacheToPartials(cache);
-		for (int t = 0; t < 4; t++) {
-			// Common parameters, stored redundantly
-			cache[t].dirty = true;
-			cache[t].reverb = rhythmTemp[drumNum].reverbSwitch > 0;
-		}
+		drumCache[drumNum][0].dirty = true;
 	}
 	updatePitchBenderRange();
 }
 
 void Part::refresh() {
-	backupCacheToPartials(patchCache);
-	for (int t = 0; t < 4; t++) {
-		// Common parameters, stored redundantly
-		patchCache[t].dirty = true;
-		patchCache[t].reverb = patchTemp->patch.reverbSwitch > 0;
-	}
+	// The cache is only rebuilt when the next note is played, see cacheTimbre()
+	patchCache[0].dirty = true;
 	memcpy(currentInstr, timbreTemp->common.name, 10);
 	updatePitchBenderRange();
 }
@@ -209,6 +194,17 @@ void RhythmPart::setTimbre(TimbreParam * /*timbre*/) {
 
 void Part::setTimbre(TimbreParam *timbre) {
 	*timbreTemp = *timbre;
+	romTimbreCaches = NULL;
+}
+
+void Part::setTimbreFromPatch() {
+	unsigned int absTimbreNum = getAbsTimbreNum();
+	setTimbre(&synth->mt32ram.timbres[absTimbreNum].timbre);
+	romTimbreCaches = synth->getROMTimbreCaches(absTimbreNum);
+}
+
+void Part::timbreTempWritten() {
+	romTimbreCaches = NULL;
 }
 
 unsigned int RhythmPart::getAbsTimbreNum() const {
@@ -232,7 +228,7 @@ void Part::setProgram(unsigned int patchNum) {
 	setPatch(&synth->mt32ram.patches[patchNum]);
 	holdpedal = false;
 	allSoundOff();
-	setTimbre(&synth->mt32ram.timbres[getAbsTimbreNum()].timbre);
+	setTimbreFromPatch();
 	refresh();
 }
 
@@ -245,13 +241,33 @@ void Part::backupCacheToPartials(PatchCache cache[4]) {
 	// if so then duplicate the cached data from the part to the partial so that
 	// we can change the part's cache without affecting the partial.
 	// We delay this until now to avoid a copy operation with every note played
-	for (std::list<Poly *>::iterator polyIt = activePolys.begin(); polyIt != activePolys.end(); polyIt++) {
-		(*polyIt)->backupCacheToPartials(cache);
+	for (Poly *poly = activePolys.getFirst(); poly != NULL; poly = poly->getNext()) {
+		poly->backupCacheToPartials(cache);
+	}
+}
+
+// Tells whether the partials playing with one cache entry would behave any differently with the other
+static bool isSamePatchCache(const PatchCache &a, const PatchCache &b) {
+	if (a.playPartial != b.playPartial) {
+		return false;
+	}
+	if (!a.playPartial) {
+		// Nothing is played with the entry, so the rest doesn't matter
+		return true;
 	}
+	return a.PCMPartial == b.PCMPartial
+		&& a.pcm == b.pcm
+		&& a.waveform == b.waveform
+		&& a.structureMix == b.structureMix
+		&& a.structurePosition == b.structurePosition
+		&& a.structurePair == b.structurePair
+		&& a.partialCount == b.partialCount
+		&& a.sustain == b.sustain
+		&& a.reverb == b.reverb
+		&& memcmp(&a.srcPartial, &b.srcPartial, sizeof(TimbreParam::PartialParam)) == 0;
 }
 
-void Part::cacheTimbre(PatchCache cache[4], const TimbreParam *timbre) {
-	backupCacheToPartials(cache);
+void Part::calcPatchCache(PatchCache cache[4], const TimbreParam *timbre, bool reverb) {
 	int partialCount = 0;
 	for (int t = 0; t < 4; t++) {
 		if (((timbre->common.partialMute >> t) & 0x1) == 1) {
@@ -296,8 +312,6 @@ void Part::cacheTimbre(PatchCache cache[4], const TimbreParam *timbre) {
 			break;
 		}
 
-		cache[t].partialParam = &timbre->partial[t];
-
 		cache[t].waveform = timbre->partial[t].wg.waveform;
 	}
 	for (int t = 0; t < 4; t++) {
@@ -305,6 +319,29 @@ void Part::cacheTimbre(PatchCache cache[4], const TimbreParam *timbre) {
 		cache[t].dirty = false;
 		cache[t].partialCount = partialCount;
 		cache[t].sustain = (timbre->common.noSustain == 0);
+		cache[t].reverb = reverb;
+	}
+}
+
+void Part::cacheTimbre(PatchCache cache[4], const TimbreParam *timbre, bool reverb) {
+	// The new cache is worked out on the side. Any partials still playing with the old one only need a backup of it
+	// if something actually changed, which often isn't the case (e.g. after a write that just repeats the same values).
+	PatchCache newCache[4];
+	for (int t = 0; t < 4; t++) {
+		newCache[t] = cache[t];
+	}
+	calcPatchCache(newCache, timbre, reverb);
+	bool changed = false;
+	for (int t = 0; t < 4; t++) {
+		if (!isSamePatchCache(cache[t], newCache[t])) {
+			changed = true;
+		}
+	}
+	if (changed) {
+		backupCacheToPartials(cache);
+	}
+	for (int t = 0; t < 4; t++) {
+		cache[t] = newCache[t];
 	}
 	//synth->printDebug("Res 1: %d 2: %d 3: %d 4: %d", cache[0].waveform, cache[1].waveform, cache[2].waveform, cache[3].waveform);
 
@@ -403,7 +440,7 @@ void RhythmPart::noteOn(unsigned int midiKey, unsigned int velocity) {
 	TimbreParam *timbre = &synth->mt32ram.timbres[absTimbreNum].timbre;
 	memcpy(currentInstr, timbre->common.name, 10);
 	if (drumCache[drumNum][0].dirty) {
-		cacheTimbre(drumCache[drumNum], timbre);
+		cacheTimbre(drumCache[drumNum], timbre, rhythmTemp[drumNum].reverbSwitch > 0);
 	}
 #if MT32EMU_MONITOR_INSTRUMENTS > 0
 	synth->printDebug("%s (%s): Start poly (drum %d, timbre %d): midiKey %u, key %u, velo %u, mod %u, exp %u, bend %u", name, currentInstr, drumNum, absTimbreNum, midiKey, key, velocity, modulation, expression, pitchBend);
@@ -414,13 +451,20 @@ void RhythmPart::noteOn(unsigned int midiKey, unsigned int velocity) {
 	synth->printDebug(" RhythmTemp: timbre %u, outputLevel %u, panpot %u, reverbSwitch %u", rhythmTemp[drumNum].timbre, rhythmTemp[drumNum].outputLevel, rhythmTemp[drumNum].panpot, rhythmTemp[drumNum].reverbSwitch); 
 #endif
 #endif
-	playPoly(drumCache[drumNum], &rhythmTemp[drumNum], midiKey, key, velocity);
+	playPoly(drumCache[drumNum], timbre, &rhythmTemp[drumNum], midiKey, key, velocity);
 }
 
 void Part::noteOn(unsigned int midiKey, unsigned int velocity) {
 	unsigned int key = midiKeyToKey(midiKey);
-	if (patchCache[0].dirty) {
-		cacheTimbre(patchCache, timbreTemp);
+	bool reverb = patchTemp->patch.reverbSwitch > 0;
+	const PatchCache *cache;
+	if (romTimbreCaches != NULL) {
+		cache = &romTimbreCaches[reverb ? 4 : 0];
+	} else {
+		if (patchCache[0].dirty) {
+			cacheTimbre(patchCache, timbreTemp, reverb);
+		}
+		cache = patchCache;
 	}
 #if MT32EMU_MONITOR_INSTRUMENTS > 0
 	synth->printDebug("%s (%s): Start poly: midiKey %u, key %u, velo %u, mod %u, exp %u, bend %u", name, currentInstr, midiKey, key, velocity, modulation, expression, pitchBend);
@@ -429,7 +473,7 @@ void Part::noteOn(unsigned int midiKey, unsigned int velocity) {
 	synth->printDebug(" PatchTemp: outputLevel %u, panpot %u", patchTemp->outputLevel, patchTemp->panpot);
 #endif
 #endif
-	playPoly(patchCache, NULL, midiKey, key, velocity);
+	playPoly(cache, timbreTemp, NULL, midiKey, key, velocity);
 }
 
 void Part::abortPoly(Poly *poly) {
@@ -445,8 +489,7 @@ void Part::abortPoly(Poly *poly) {
 }
 
 bool Part::abortFirstPoly(unsigned int key) {
-	for (std::list<Poly *>::iterator polyIt = activePolys.begin(); polyIt != activePolys.end(); polyIt++) {
-		Poly *poly = *polyIt;
+	for (Poly *poly = activePolys.getFirst(); poly != NULL; poly = poly->getNext()) {
 		if (poly->getKey() == key) {
 			abortPoly(poly);
 			return true;
@@ -456,8 +499,7 @@ bool Part::abortFirstPoly(unsigned int key) {
 }
 
 bool Part::abortFirstPoly(PolyState polyState) {
-	for (std::list<Poly *>::iterator polyIt = activePolys.begin(); polyIt != activePolys.end(); polyIt++) {
-		Poly *poly = *polyIt;
+	for (Poly *poly = activePolys.getFirst(); poly != NULL; poly = poly->getNext()) {
 		if (poly->getState() == polyState) {
 			abortPoly(poly);
 			return true;
@@ -467,14 +509,14 @@ bool Part::abortFirstPoly(PolyState polyState) {
 }
 
 bool Part::abortFirstPoly() {
-	if (activePolys.empty()) {
+	if (activePolys.isEmpty()) {
 		return false;
 	}
-	abortPoly(activePolys.front());
+	abortPoly(activePolys.getFirst());
 	return true;
 }
 
-void Part::playPoly(const PatchCache cache[4], const MemParams::RhythmTemp *rhythmTemp, unsigned int midiKey, unsigned int key, unsigned int velocity) {
+void Part::playPoly(const PatchCache cache[4], const TimbreParam *timbre, const MemParams::RhythmTemp *rhythmTemp, unsigned int midiKey, unsigned int key, unsigned int velocity) {
 	if ((patchTemp->patch.assignMode & 2) == 0) {
 		// Single-assign mode
 		abortFirstPoly(key);
@@ -494,17 +536,16 @@ void Part::playPoly(const PatchCache cache[4], const MemParams::RhythmTemp *rhyt
 		return;
 	}
 
-	if (freePolys.empty()) {
+	if (freePolys.isEmpty()) {
 		synth->printDebug("%s (%s): No free poly to play key %d (velocity %d)", name, currentInstr, midiKey, velocity);
 		return;
 	}
-	Poly *poly = freePolys.front();
-	freePolys.pop_front();
+	Poly *poly = freePolys.takeFirst();
 	if (patchTemp->patch.assignMode & 1) {
 		// Priority to data first received
-		activePolys.push_front(poly);
+		activePolys.prepend(poly);
 	} else {
-		activePolys.push_back(poly);
+		activePolys.append(poly);
 	}
 
 	Partial *partials[4];
@@ -523,7 +564,7 @@ void Part::playPoly(const PatchCache cache[4], const MemParams::RhythmTemp *rhyt
 #if MT32EMU_MONITOR_PARTIALS > 2
 			synth->printDebug("%s (%s): Allocated partial %d", name, currentInstr, partials[x]->debugGetPartialNum());
 #endif
-			partials[x]->startPartial(this, poly, &cache[x], rhythmTemp, partials[cache[x].structurePair]);
+			partials[x]->startPartial(this, poly, &cache[x], &timbre->partial[x], rhythmTemp, partials[cache[x].structurePair]);
 		}
 	}
 #if MT32EMU_MONITOR_PARTIALS > 1
@@ -534,8 +575,7 @@ void Part::playPoly(const PatchCache cache[4], const MemParams::RhythmTemp *rhyt
 void Part::allNotesOff() {
 	// The MIDI specification states - and Mok confirms - that all notes off (0x7B)
 	// should treat the hold pedal as usual.
-	for (std::list<Poly *>::iterator polyIt = activePolys.begin(); polyIt != activePolys.end(); polyIt++) {
-		Poly *poly = *polyIt;
+	for (Poly *poly = activePolys.getFirst(); poly != NULL; poly = poly->getNext()) {
 		// FIXME: This has special handling of key 0 in NoteOff that Mok has not yet confirmed
 		// applies to AllNotesOff.
 		poly->noteOff(holdpedal);
@@ -546,15 +586,13 @@ void Part::allSoundOff() {
 	// MIDI "All sound off" (0x78) should release notes immediately regardless of the hold pedal.
 	// This controller is not actually implemented by the synths, though (according to the docs and Mok) -
 	// we're only using this method internally.
-	for (std::list<Poly *>::iterator polyIt = activePolys.begin(); polyIt != activePolys.end(); polyIt++) {
-		Poly *poly = *polyIt;
+	for (Poly *poly = activePolys.getFirst(); poly != NULL; poly = poly->getNext()) {
 		poly->startDecay();
 	}
 }
 
 void Part::stopPedalHold() {
-	for (std::list<Poly *>::iterator polyIt = activePolys.begin(); polyIt != activePolys.end(); polyIt++) {
-		Poly *poly = *polyIt;
+	for (Poly *poly = activePolys.getFirst(); poly != NULL; poly = poly->getNext()) {
 		poly->stopPedalHold();
 	}
 }
@@ -572,8 +610,7 @@ void Part::stopNote(unsigned int key) {
 	synth->printDebug("%s (%s): stopping key %d", name, currentInstr, key);
 #endif
 
-	for (std::list<Poly *>::iterator polyIt = activePolys.begin(); polyIt != activePolys.end(); polyIt++) {
-		Poly *poly = *polyIt;
+	for (Poly *poly = activePolys.getFirst(); poly != NULL; poly = poly->getNext()) {
 		// Generally, non-sustaining instruments ignore note off. They die away eventually anyway.
 		// Key 0 (only used by special cases on rhythm part) reacts to note off even if non-sustaining or pedal held.
 		if (poly->getKey() == key && (poly->canSustain() || key == 0)) {
@@ -594,8 +631,7 @@ unsigned int Part::getActivePartialCount() const {
 
 unsigned int Part::getActiveNonReleasingPartialCount() const {
 	unsigned int activeNonReleasingPartialCount = 0;
-	for (std::list<Poly *>::const_iterator polyIt = activePolys.begin(); polyIt != activePolys.end(); polyIt++) {
-		Poly *poly = *polyIt;
+	for (Poly *poly = activePolys.getFirst(); poly != NULL; poly = poly->getNext()) {
 		if (poly->getState() != POLY_Releasing) {
 			activeNonReleasingPartialCount += poly->getActivePartialCount();
 		}
@@ -607,7 +643,175 @@ void Part::partialDeactivated(Poly *poly) {
 	activePartialCount--;
 	if (!poly->isActive()) {
 		activePolys.remove(poly);
-		freePolys.push_front(poly);
+		freePolys.prepend(poly);
+	}
+}
+
+Synth *Part::getSynth() const {
+	return synth;
+}
+
+int Part::getPolyNum(const Poly *poly) const {
+	if (poly < polys || poly >= polys + MT32EMU_MAX_POLY) {
+		return -1;
+	}
+	return poly - polys;
+}
+
+Poly *Part::getPolyByNum(int polyNum) {
+	if (polyNum < 0 || polyNum >= MT32EMU_MAX_POLY) {
+		return NULL;
+	}
+	return &polys[polyNum];
+}
+
+int Part::getPatchCacheNum(const PatchCache *cache) const {
+	if (cache >= patchCache && cache < patchCache + 4) {
+		return cache - patchCache;
+	}
+	// The shared caches of the ROM timbres follow
+	const PatchCache *firstROMTimbreCache = synth->getROMTimbreCaches(0);
+	if (cache >= firstROMTimbreCache && cache < firstROMTimbreCache + ROM_TIMBRE_CACHE_COUNT) {
+		return 4 + (cache - firstROMTimbreCache);
+	}
+	return -1;
+}
+
+const PatchCache *Part::getPatchCacheByNum(int cacheNum) const {
+	if (cacheNum < 0 || cacheNum >= 4 + (int)ROM_TIMBRE_CACHE_COUNT) {
+		return NULL;
+	}
+	if (cacheNum >= 4) {
+		return synth->getROMTimbreCaches(0) + (cacheNum - 4);
+	}
+	return &patchCache[cacheNum];
+}
+
+int RhythmPart::getPatchCacheNum(const PatchCache *cache) const {
+	const PatchCache *firstCache = &drumCache[0][0];
+	if (cache < firstCache || cache >= firstCache + 85 * 4) {
+		return -1;
+	}
+	return cache - firstCache;
+}
+
+const PatchCache *RhythmPart::getPatchCacheByNum(int cacheNum) const {
+	if (cacheNum < 0 || cacheNum >= 85 * 4) {
+		return NULL;
+	}
+	return &drumCache[cacheNum / 4][cacheNum % 4];
+}
+
+void Part::savePolyList(StateWriter &writer, const PolyList &polyList) const {
+	Bit32u polyCount = 0;
+	for (const Poly *poly = polyList.getFirst(); poly != NULL; poly = poly->getNext()) {
+		polyCount++;
+	}
+	writer.write(polyCount);
+	for (const Poly *poly = polyList.getFirst(); poly != NULL; poly = poly->getNext()) {
+		writer.write((Bit32s)getPolyNum(poly));
+	}
+}
+
+bool Part::loadPolyList(StateReader &reader, PolyList &polyList, bool polyListed[MT32EMU_MAX_POLY]) {
+	Bit32u polyCount;
+	reader.read(polyCount);
+	if (polyCount > MT32EMU_MAX_POLY) {
+		return false;
+	}
+	polyList = PolyList();
+	for (Bit32u i = 0; i < polyCount; i++) {
+		int polyNum = reader.readIndex(MT32EMU_MAX_POLY);
+		// Each poly must be in exactly one of the lists
+		if (polyNum < 0 || polyListed[polyNum]) {
+			return false;
+		}
+		polyListed[polyNum] = true;
+		polyList.append(&polys[polyNum]);
+	}
+	return true;
+}
+
+void Part::saveState(StateWriter &writer) const {
+	writer.write(holdpedal);
+	writer.write(activePartialCount);
+	for (int t = 0; t < 4; t++) {
+		synth->savePatchCache(writer, patchCache[t]);
+	}
+	writer.write((Bit32s)(romTimbreCaches == NULL ? -1 : getPatchCacheNum(romTimbreCaches)));
+	writer.writeBytes(currentInstr, sizeof(currentInstr));
+	writer.write(modulation);
+	writer.write(expression);
+	writer.write(pitchBend);
+	writer.write(nrpn);
+	writer.write(rpn);
+	writer.write(pitchBenderRange);
+	for (int i = 0; i < MT32EMU_MAX_POLY; i++) {
+		polys[i].saveState(writer);
+	}
+	// The order of the polys within the lists matters, since it decides which poly gets aborted or reused first
+	savePolyList(writer, freePolys);
+	savePolyList(writer, activePolys);
+}
+
+void Part::loadState(StateReader &reader) {
+	reader.read(holdpedal);
+	reader.read(activePartialCount);
+	for (int t = 0; t < 4; t++) {
+		synth->loadPatchCache(reader, patchCache[t]);
+	}
+	Bit32s romTimbreCachesNum;
+	reader.read(romTimbreCachesNum);
+	if (romTimbreCachesNum == -1) {
+		romTimbreCaches = NULL;
+	} else {
+		// Must be one of the shared ROM timbre caches, and the first of its timbre's eight (see Synth::getROMTimbreCaches())
+		romTimbreCaches = getPatchCacheByNum(romTimbreCachesNum);
+		if (romTimbreCachesNum < 4 || (romTimbreCachesNum - 4) % 8 != 0 || romTimbreCaches == NULL) {
+			reader.fail();
+			return;
+		}
+	}
+	reader.readBytes(currentInstr, sizeof(currentInstr));
+	currentInstr[10] = 0;
+	reader.read(modulation);
+	reader.read(expression);
+	reader.read(pitchBend);
+	reader.read(nrpn);
+	reader.read(rpn);
+	reader.read(pitchBenderRange);
+	for (int i = 0; i < MT32EMU_MAX_POLY; i++) {
+		polys[i].loadState(reader);
+	}
+	bool polyListed[MT32EMU_MAX_POLY];
+	memset(polyListed, 0, sizeof(polyListed));
+	if (!loadPolyList(reader, freePolys, polyListed) || !loadPolyList(reader, activePolys, polyListed)) {
+		reader.fail();
+		return;
+	}
+	for (int i = 0; i < MT32EMU_MAX_POLY; i++) {
+		if (!polyListed[i]) {
+			reader.fail();
+			return;
+		}
+	}
+}
+
+void RhythmPart::saveState(StateWriter &writer) const {
+	Part::saveState(writer);
+	for (int drum = 0; drum < 85; drum++) {
+		for (int t = 0; t < 4; t++) {
+			synth->savePatchCache(writer, drumCache[drum][t]);
+		}
+	}
+}
+
+void RhythmPart::loadState(StateReader &reader) {
+	Part::loadState(reader);
+	for (int drum = 0; drum < 85; drum++) {
+		for (int t = 0; t < 4; t++) {
+			synth->loadPatchCache(reader, drumCache[drum][t]);
+		}
 	}
 }
 
@@ -18,8 +18,6 @@
 #ifndef MT32EMU_PART_H
 #define MT32EMU_PART_H
 
-#include <list>
-
 namespace MT32Emu {
 
 class PartialManager;
@@ -37,8 +35,13 @@ private:
 
 	unsigned int activePartialCount;
 	PatchCache patchCache[4];
-	std::list<Poly*> freePolys;
-	std::list<Poly*> activePolys;
+	// While timbreTemp holds an unmodified copy of a timbre from the ROM banks, notes are played with the cache of that
+	// timbre shared through the ROM image (see Synth::getROMTimbreCaches()) instead of patchCache. NULL otherwise.
+	const PatchCache *romTimbreCaches;
+	// The MT32EMU_MAX_POLY polys owned by this part, each of which is in one of the lists below
+	Poly *polys;
+	PolyList freePolys;
+	PolyList activePolys;
 
 	void setPatch(const PatchParam *patch);
 	unsigned int midiKeyToKey(unsigned int midiKey);
@@ -46,6 +49,9 @@ private:
 	void abortPoly(Poly *poly);
 	bool abortFirstPoly(unsigned int key);
 
+	void savePolyList(StateWriter &writer, const PolyList &polyList) const;
+	bool loadPolyList(StateReader &reader, PolyList &polyList, bool polyListed[MT32EMU_MAX_POLY]);
+
 protected:
 	Synth *synth;
 	// Direct pointer into sysex-addressable memory
@@ -60,12 +66,16 @@ protected:
 	Bit16u pitchBenderRange; // (patchTemp->patch.benderRange * 683) at the time of the last MIDI program change or MIDI data entry.
 
 	void backupCacheToPartials(PatchCache cache[4]);
-	void cacheTimbre(PatchCache cache[4], const TimbreParam *timbre);
-	void playPoly(const PatchCache cache[4], const MemParams::RhythmTemp *rhythmTemp, unsigned int midiKey, unsigned int key, unsigned int velocity);
+	// Rebuilds a dirty cache from the timbre and the reverb switch, once a note needs it
+	void cacheTimbre(PatchCache cache[4], const TimbreParam *timbre, bool reverb);
+	void playPoly(const PatchCache cache[4], const TimbreParam *timbre, const MemParams::RhythmTemp *rhythmTemp, unsigned int midiKey, unsigned int key, unsigned int velocity);
 	void stopNote(unsigned int key);
 	const char *getName() const;
 
 public:
+	// Works out the cache for a timbre. Only the fields of the partials that are played are set.
+	static void calcPatchCache(PatchCache cache[4], const TimbreParam *timbre, bool reverb);
+
 	Part(Synth *synth, unsigned int usePartNum);
 	virtual ~Part();
 	void reset();
@@ -94,6 +104,10 @@ public:
 	virtual void refresh();
 	virtual void refreshTimbre(unsigned int absTimbreNum);
 	virtual void setTimbre(TimbreParam *timbre);
+	// Copies the timbre selected by the patch into timbreTemp
+	void setTimbreFromPatch();
+	// Called after sysex wrote to timbreTemp directly, which may no longer match the timbre it was copied from
+	void timbreTempWritten();
 	virtual unsigned int getAbsTimbreNum() const;
 	const char *getCurrentInstr() const;
 	unsigned int getActivePartialCount() const;
@@ -107,6 +121,19 @@ public:
 	// These are rather specialised, and should probably only be used by PartialManager
 	bool abortFirstPoly(PolyState polyState);
 	bool abortFirstPoly();
+
+	Synth *getSynth() const;
+
+	// Polys and patch caches are numbered so that saved states can refer to them.
+	// The getters return -1 or NULL for polys and caches that don't belong to this part.
+	int getPolyNum(const Poly *poly) const;
+	Poly *getPolyByNum(int polyNum);
+	virtual int getPatchCacheNum(const PatchCache *cache) const;
+	virtual const PatchCache *getPatchCacheByNum(int cacheNum) const;
+
+	// See Synth::saveState()
+	virtual void saveState(StateWriter &writer) const;
+	virtual void loadState(StateReader &reader);
 };
 
 class RhythmPart: public Part {
@@ -125,6 +152,10 @@ public:
 	unsigned int getAbsTimbreNum() const;
 	void setPan(unsigned int midiPan);
 	void setProgram(unsigned int patchNum);
+	int getPatchCacheNum(const PatchCache *cache) const;
+	const PatchCache *getPatchCacheByNum(int cacheNum) const;
+	void saveState(StateWriter &writer) const;
+	void loadState(StateReader &reader);
 };
 
 }
@@ -35,16 +35,22 @@ static const float PAN_NUMERATOR_MASTER[] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
 static const float PAN_NUMERATOR_SLAVE[]  = {0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 7.0f, 7.0f, 7.0f, 7.0f, 7.0f, 7.0f, 7.0f};
 
 Partial::Partial(Synth *useSynth, int useDebugPartialNum) :
-	synth(useSynth), debugPartialNum(useDebugPartialNum), sampleNum(0), tva(new TVA(this, &ampRamp)), tvp(new TVP(this)), tvf(new TVF(this, &cutoffModifierRamp)) {
+	synth(useSynth), debugPartialNum(useDebugPartialNum), sampleNum(0), myBuffer(NULL), tva(NULL), tvp(NULL), tvf(NULL) {
+	// The envelope generators are placed in the synth's arena right after the partial itself. None of them need destructing.
+	// The sample buffer comes later, see setBuffer().
+	Arena *arena = &synth->arena;
+	tva = new (arena->allocate(sizeof(TVA))) TVA(this, &ampRamp);
+	tvp = new (arena->allocate(sizeof(TVP))) TVP(this);
+	tvf = new (arena->allocate(sizeof(TVF))) TVF(this, &cutoffModifierRamp);
 	ownerPart = -1;
 	poly = NULL;
 	pair = NULL;
+	outputOwner = this;
+	deactivatedPartialCount = 0;
 }
 
-Partial::~Partial() {
-	delete tva;
-	delete tvp;
-	delete tvf;
+void Partial::setBuffer(float *buffer) {
+	myBuffer = buffer;
 }
 
 // Only used for debugging purposes
@@ -80,10 +86,19 @@ void Partial::deactivate() {
 	}
 	ownerPart = -1;
 	if (poly != NULL) {
-		poly->partialDeactivated(this);
+		if (synth->deferPartialDeactivation) {
+			// Unless they're ring modulating, the two partials of a pair are rendered independently and possibly on different
+			// threads, so in that case the pair is only unlinked by notifyDeactivations()
+			if (pair != NULL && (mixType == 1 || mixType == 2)) {
+				pair->pair = NULL;
+			}
+			outputOwner->deactivatedPartials[outputOwner->deactivatedPartialCount++] = this;
+			return;
+		}
 		if (pair != NULL) {
 			pair->pair = NULL;
 		}
+		poly->partialDeactivated(this);
 	}
 #if MT32EMU_MONITOR_PARTIALS > 2
 	synth->printDebug("[+%lu] [Partial %d] Deactivated", sampleNum, debugPartialNum);
@@ -91,6 +106,21 @@ void Partial::deactivate() {
 #endif
 }
 
+void Partial::notifyDeactivations() {
+	for (unsigned int i = 0; i < deactivatedPartialCount; i++) {
+		Partial *partial = deactivatedPartials[i];
+		if (partial->pair != NULL && partial->mixType != 1 && partial->mixType != 2) {
+			partial->pair->pair = NULL;
+		}
+		partial->poly->partialDeactivated(partial);
+#if MT32EMU_MONITOR_PARTIALS > 2
+		synth->printDebug("[+%lu] [Partial %d] Deactivated", partial->sampleNum, partial->debugPartialNum);
+		synth->printPartialUsage(partial->sampleNum);
+#endif
+	}
+	deactivatedPartialCount = 0;
+}
+
 // DEPRECATED: This should probably go away eventually, it's currently only used as a kludge to protect our old assumptions that
 // rhythm part notes were always played as key MIDDLEC.
 int Partial::getKey() const {
@@ -104,7 +134,7 @@ int Partial::getKey() const {
 	}
 }
 
-void Partial::startPartial(const Part *part, Poly *usePoly, const PatchCache *usePatchCache, const MemParams::RhythmTemp *rhythmTemp, Partial *pairPartial) {
+void Partial::startPartial(const Part *part, Poly *usePoly, const PatchCache *usePatchCache, const TimbreParam::PartialParam *partialParam, const MemParams::RhythmTemp *rhythmTemp, Partial *pairPartial) {
 	if (usePoly == NULL || usePatchCache == NULL) {
 		synth->printDebug("[Partial %d] *** Error: Starting partial for owner %d, usePoly=%s, usePatchCache=%s", debugPartialNum, ownerPart, usePoly == NULL ? "*** NULL ***" : "OK", usePatchCache == NULL ? "*** NULL ***" : "OK");
 		return;
@@ -159,9 +189,9 @@ void Partial::startPartial(const Part *part, Poly *usePoly, const PatchCache *us
 	pcmPosition = 0.0f;
 	pair = pairPartial;
 	alreadyOutputed = false;
-	tva->reset(part, patchCache->partialParam, rhythmTemp);
-	tvp->reset(part, patchCache->partialParam);
-	tvf->reset(patchCache->partialParam, tvp->getBasePitch());
+	tva->reset(part, partialParam, rhythmTemp);
+	tvp->reset(part, partialParam);
+	tvf->reset(partialParam, tvp->getBasePitch());
 }
 
 float Partial::getPCMSample(unsigned int position) {
@@ -478,8 +508,12 @@ Synth *Partial::getSynth() const {
 	return synth;
 }
 
+bool Partial::canProduceOutput() const {
+	return isActive() && !alreadyOutputed && !isRingModulatingSlave();
+}
+
 bool Partial::produceOutput(float *leftBuf, float *rightBuf, unsigned long length) {
-	if (!isActive() || alreadyOutputed || isRingModulatingSlave()) {
+	if (!canProduceOutput()) {
 		return false;
 	}
 	if (poly == NULL) {
@@ -487,6 +521,10 @@ bool Partial::produceOutput(float *leftBuf, float *rightBuf, unsigned long lengt
 		return false;
 	}
 
+	// Counted as LA32 time in Synth::getRenderStats(), along with the mixing below
+	double startTime = synth->profilingEnabled ? Thread::getTime() : 0.0;
+
+	outputOwner = this;
 	float *partialBuf = &myBuffer[0];
 	unsigned long numGenerated = generateSamples(partialBuf, length);
 	if (mixType == 1 || mixType == 2) {
@@ -497,6 +535,7 @@ bool Partial::produceOutput(float *leftBuf, float *rightBuf, unsigned long lengt
 			pairNumGenerated = 0;
 		} else {
 			pairBuf = &pair->myBuffer[0];
+			pair->outputOwner = this;
 			pairNumGenerated = pair->generateSamples(pairBuf, numGenerated);
 			// pair will have been set to NULL if it deactivated within generateSamples()
 			if (pair != NULL) {
@@ -535,6 +574,95 @@ bool Partial::produceOutput(float *leftBuf, float *rightBuf, unsigned long lengt
 		*rightBuf++ = 0.0f;
 		numGenerated++;
 	}
+	if (synth->profilingEnabled) {
+		synth->partialLA32Times[debugPartialNum] += Thread::getTime() - startTime;
+	}
+	return true;
+}
+
+// The parts of generateSamples() that change the state of the partial, without the waveform
+unsigned long Partial::chaseSamples(unsigned long length) {
+	if (!isActive() || alreadyOutputed) {
+		return 0;
+	}
+	if (poly == NULL) {
+		synth->printDebug("[Partial %d] *** ERROR: poly is NULL at Partial::chaseSamples()!", debugPartialNum);
+		return 0;
+	}
+
+	alreadyOutputed = true;
+
+	for (sampleNum = 0; sampleNum < length; sampleNum++) {
+		ampRamp.nextValue();
+		if (ampRamp.checkInterrupt()) {
+			tva->handleInterrupt();
+		}
+		if (!tva->isPlaying()) {
+			deactivate();
+			break;
+		}
+
+		Bit16u pitch = tvp->nextPitch();
+		float freq = synth->tables.pitchToFreq[pitch];
+
+		if (patchCache->PCMPartial) {
+			int len = pcmWave->len;
+			int intPCMPosition = (int)pcmPosition;
+			if (intPCMPosition >= len && !pcmWave->loop) {
+				deactivate();
+				break;
+			}
+			float positionDelta = freq * 2048.0f / synth->myProp.sampleRate;
+			float newPCMPosition = pcmPosition + positionDelta;
+			if (pcmWave->loop) {
+				newPCMPosition = fmod(newPCMPosition, (float)pcmWave->len);
+			}
+			pcmPosition = newPCMPosition;
+		} else {
+			wavePos *= lastFreq / freq;
+			lastFreq = freq;
+
+			cutoffModifierRamp.nextValue();
+			if (cutoffModifierRamp.checkInterrupt()) {
+				tvf->handleInterrupt();
+			}
+
+			float waveLen = synth->myProp.sampleRate / freq;
+			wavePos++;
+			if (wavePos > waveLen) {
+				wavePos -= waveLen;
+			}
+		}
+	}
+	unsigned long chasedSamples = sampleNum;
+	sampleNum = 0;
+	return chasedSamples;
+}
+
+bool Partial::chase(unsigned long length) {
+	if (!canProduceOutput()) {
+		return false;
+	}
+	if (poly == NULL) {
+		synth->printDebug("[Partial %d] *** ERROR: poly is NULL at Partial::chase()!", debugPartialNum);
+		return false;
+	}
+
+	outputOwner = this;
+	unsigned long numChased = chaseSamples(length);
+	if ((mixType == 1 || mixType == 2) && pair != NULL) {
+		pair->outputOwner = this;
+		pair->chaseSamples(numChased);
+		// As in produceOutput()
+		if (pair != NULL) {
+			if (!isActive()) {
+				pair->deactivate();
+				pair = NULL;
+			} else if (!pair->isActive()) {
+				pair = NULL;
+			}
+		}
+	}
 	return true;
 }
 
@@ -547,6 +675,7 @@ bool Partial::shouldReverb() {
 
 void Partial::startAbort() {
 	// This is called when the partial manager needs to terminate partials for re-use by a new Poly.
+	synth->trace.record(TraceEvent_partialAbort, synth->renderedSampleCount, (Bit8u)ownerPart, (Bit16u)debugPartialNum, 0);
 	tva->startAbort();
 }
 
@@ -555,3 +684,69 @@ void Partial::startDecayAll() {
 	tvp->startDecay();
 	tvf->startDecay();
 }
+
+void Partial::saveState(StateWriter &writer) const {
+	writer.write(ownerPart);
+	writer.write(mixType);
+	writer.write(structurePosition);
+	writer.write(stereoVolume.leftVol);
+	writer.write(stereoVolume.rightVol);
+	writer.write(wavePos);
+	writer.write(lastFreq);
+	writer.write(pcmNum);
+	writer.write((Bit32s)(pcmWave == NULL ? -1 : pcmWave - synth->pcmWaves));
+	writer.write(pulseWidthVal);
+	writer.write(pcmPosition);
+	synth->savePolyRef(writer, poly);
+	ampRamp.saveState(writer);
+	cutoffModifierRamp.saveState(writer);
+	// The patch cache is either the partial's own backup, or belongs to one of the parts
+	writer.write(patchCache == &cachebackup);
+	if (patchCache != &cachebackup) {
+		synth->savePatchCacheRef(writer, patchCache);
+	}
+	synth->savePatchCache(writer, cachebackup);
+	synth->savePartialRef(writer, pair);
+	writer.write(alreadyOutputed);
+	tva->saveState(writer);
+	tvp->saveState(writer);
+	tvf->saveState(writer);
+}
+
+void Partial::loadState(StateReader &reader) {
+	reader.read(ownerPart);
+	if (ownerPart < -1 || ownerPart > 8) {
+		reader.fail();
+		ownerPart = -1;
+	}
+	reader.read(mixType);
+	reader.read(structurePosition);
+	reader.read(stereoVolume.leftVol);
+	reader.read(stereoVolume.rightVol);
+	reader.read(wavePos);
+	reader.read(lastFreq);
+	reader.read(pcmNum);
+	int pcmWaveNum = reader.readIndex(synth->controlROMMap->pcmCount);
+	pcmWave = pcmWaveNum < 0 ? NULL : &synth->pcmWaves[pcmWaveNum];
+	reader.read(pulseWidthVal);
+	reader.read(pcmPosition);
+	poly = synth->loadPolyRef(reader);
+	ampRamp.loadState(reader);
+	cutoffModifierRamp.loadState(reader);
+	bool usesCacheBackup;
+	reader.read(usesCacheBackup);
+	if (usesCacheBackup) {
+		patchCache = &cachebackup;
+	} else {
+		patchCache = synth->loadPatchCacheRef(reader);
+	}
+	synth->loadPatchCache(reader, cachebackup);
+	pair = synth->loadPartialRef(reader);
+	reader.read(alreadyOutputed);
+	tva->loadState(reader);
+	tvp->loadState(reader);
+	tvf->loadState(reader);
+	// States are only saved between rendering runs, when no deactivations are pending
+	outputOwner = this;
+	deactivatedPartialCount = 0;
+}
@@ -34,7 +34,7 @@ struct StereoVolume {
 class Partial {
 private:
 	Synth *synth;
-	const int debugPartialNum; // Only used for debugging
+	const int debugPartialNum; // Only used for debugging, and to refer to the partial in saved states
 	// Number of the sample currently being rendered by generateSamples(), or 0 if no run is in progress
 	// This is only kept available for debugging purposes.
 	unsigned long sampleNum; 
@@ -49,7 +49,8 @@ private:
 
 	float lastFreq;
 
-	float myBuffer[MAX_SAMPLES_PER_RUN];
+	// Room for Synth::maxSamplesPerRun samples, allocated from the synth's arena
+	float *myBuffer;
 
 	// Only used for PCM partials
 	int pcmNum;
@@ -64,6 +65,14 @@ private:
 
 	Poly *poly;
 
+	// While the synth renders partials on several threads, deactivate() doesn't notify the poly straight away, since that
+	// touches state shared with other partials. Instead, the partial is queued with the partial whose produceOutput() is
+	// rendering it (itself, or its ring modulation master), and notifyDeactivations() is called afterwards for each partial
+	// in turn, giving the same order of notifications as single-threaded rendering.
+	Partial *outputOwner;
+	Partial *deactivatedPartials[2];
+	unsigned int deactivatedPartialCount;
+
 	LA32Ramp ampRamp;
 	LA32Ramp cutoffModifierRamp;
 
@@ -72,6 +81,8 @@ private:
 
 	float getPCMSample(unsigned int position);
 
+	unsigned long chaseSamples(unsigned long length);
+
 public:
 	const PatchCache *patchCache;
 	TVA *tva;
@@ -84,7 +95,10 @@ public:
 	bool alreadyOutputed;
 
 	Partial(Synth *synth, int debugPartialNum);
-	~Partial();
+
+	// Hands over the buffer the partial generates its samples into (with room for maxSamplesPerRun samples).
+	// It lives in the synth's scratch space, see Synth::initScratchBuffers().
+	void setBuffer(float *buffer);
 
 	int debugGetPartialNum() const;
 	unsigned long debugGetSampleNum() const;
@@ -95,12 +109,16 @@ public:
 	bool isActive() const;
 	void activate(int part);
 	void deactivate(void);
-	void startPartial(const Part *part, Poly *usePoly, const PatchCache *useCache, const MemParams::RhythmTemp *rhythmTemp, Partial *pairPartial);
+	// partialParam points into the live sysex-addressable memory the cache was made from (or would have been, for the shared
+	// caches of the ROM timbres), so that later writes there reach the playing partial.
+	void startPartial(const Part *part, Poly *usePoly, const PatchCache *useCache, const TimbreParam::PartialParam *partialParam, const MemParams::RhythmTemp *rhythmTemp, Partial *pairPartial);
 	void startAbort();
 	void startDecayAll();
 	bool shouldReverb();
 	bool hasRingModulatingSlave() const;
 	bool isRingModulatingSlave() const;
+	bool canProduceOutput() const;
+	void notifyDeactivations();
 	bool isPCM() const;
 	const ControlROMPCMStruct *getControlROMPCMStruct() const;
 	Synth *getSynth() const;
@@ -112,6 +130,15 @@ public:
 
 	// This function writes mono sample output to the provided buffer, and returns the number of samples written
 	unsigned long generateSamples(float *partialBuf, unsigned long length);
+
+	// Same as produceOutput(), except that no samples are generated. Only the state that carries over to later samples
+	// (envelopes, pitch, position in the wave) is advanced, exactly as if the partial had been rendered.
+	// See Synth::chase().
+	bool chase(unsigned long length);
+
+	// See Synth::saveState()
+	void saveState(StateWriter &writer) const;
+	void loadState(StateReader &reader);
 };
 
 }
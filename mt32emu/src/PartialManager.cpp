@@ -26,13 +26,14 @@ PartialManager::PartialManager(Synth *useSynth, Part **useParts) {
 	synth = useSynth;
 	parts = useParts;
 	for (int i = 0; i < MT32EMU_MAX_PARTIALS; i++) {
-		partialTable[i] = new Partial(synth, i);
+		partialTable[i] = new (synth->arena.allocate(sizeof(Partial))) Partial(synth, i);
 	}
 }
 
 PartialManager::~PartialManager(void) {
+	// The partials live in the synth's arena and have trivial destructors
 	for (int i = 0; i < MT32EMU_MAX_PARTIALS; i++) {
-		delete partialTable[i];
+		partialTable[i] = NULL;
 	}
 }
 
@@ -46,10 +47,24 @@ bool PartialManager::shouldReverb(int i) {
 	return partialTable[i]->shouldReverb();
 }
 
+bool PartialManager::canProduceOutput(int i) {
+	return partialTable[i]->canProduceOutput();
+}
+
+void PartialManager::notifyDeactivations() {
+	for (int i = 0; i < MT32EMU_MAX_PARTIALS; i++) {
+		partialTable[i]->notifyDeactivations();
+	}
+}
+
 bool PartialManager::produceOutput(int i, float *leftBuf, float *rightBuf, Bit32u bufferLength) {
 	return partialTable[i]->produceOutput(leftBuf, rightBuf, bufferLength);
 }
 
+bool PartialManager::chase(int i, Bit32u length) {
+	return partialTable[i]->chase(length);
+}
+
 void PartialManager::deactivateAll() {
 	for (int i = 0; i < MT32EMU_MAX_PARTIALS; i++) {
 		partialTable[i]->deactivate();
@@ -77,6 +92,7 @@ Partial *PartialManager::allocPartial(int partNum) {
 	}
 	if (outPartial != NULL) {
 		outPartial->activate(partNum);
+		synth->trace.record(TraceEvent_partialAlloc, synth->renderedSampleCount, (Bit8u)partNum, (Bit16u)outPartial->debugGetPartialNum(), 0);
 	}
 	return outPartial;
 }
@@ -101,9 +117,13 @@ void PartialManager::getPerPartPartialUsage(unsigned int perPartPartialUsage[9])
 	}
 }
 
+void PartialManager::traceSteal(int partNum, unsigned int needed, int forPartNum) {
+	synth->trace.record(TraceEvent_partialSteal, synth->renderedSampleCount, (Bit8u)partNum, (Bit16u)needed, forPartNum);
+}
+
 // This method assumes that getFreePartials() has been called to make numReservedPartialsForPart up-to-date.
 // The rhythm part is considered part -1 for the purposes of the minPart argument (and as this suggests, is checked last, if at all).
-bool PartialManager::abortWhereReserveExceeded(PolyState polyState, int minPart) {
+bool PartialManager::abortWhereReserveExceeded(PolyState polyState, int minPart, unsigned int needed, int forPartNum) {
 	// Abort decaying polys in non-rhythm parts that have exceeded their partial reservation (working backwards from part 7)
 	for (int partNum = 7; partNum >= minPart; partNum--) {
 		int usePartNum = partNum == -1 ? 8 : partNum;
@@ -111,6 +131,7 @@ bool PartialManager::abortWhereReserveExceeded(PolyState polyState, int minPart)
 			// This part has exceeded its reserved partial count.
 			// We go through and look for a poly with the given state and abort the first one we find.
 			if (parts[usePartNum]->abortFirstPoly(polyState)) {
+				traceSteal(usePartNum, needed, forPartNum);
 				return true;
 			}
 		}
@@ -144,7 +165,7 @@ bool PartialManager::freePartials(unsigned int needed, int partNum) {
 
 	for (;;) {
 		// On the MT-32, this is: if (!abortWhereReserveExceeded(POLY_Releasing, -1)) {
-		if (!abortWhereReserveExceeded(POLY_Releasing, 0)) {
+		if (!abortWhereReserveExceeded(POLY_Releasing, 0, needed, partNum)) {
 			break;
 		}
 		if (getFreePartialCount() >= needed) {
@@ -163,7 +184,7 @@ bool PartialManager::freePartials(unsigned int needed, int partNum) {
 			// Only abort held polys in our own part and parts that have a lower priority
 			// (higher part number = lower priority, except for rhythm, which has the highest priority).
 			for (;;) {
-				if (!abortWhereReserveExceeded(POLY_Held, partNum == 8 ? -1 : partNum)) {
+				if (!abortWhereReserveExceeded(POLY_Held, partNum == 8 ? -1 : partNum, needed, partNum)) {
 					break;
 				}
 				if (getFreePartialCount() >= needed) {
@@ -177,7 +198,7 @@ bool PartialManager::freePartials(unsigned int needed, int partNum) {
 	// Abort held polys in all parts (including rhythm only when being called for the rhythm part),
 	// from lowest to highest priority, until we have enough free partials.
 	for (;;) {
-		if (!abortWhereReserveExceeded(POLY_Held, partNum == 8 ? -1 : 0)) {
+		if (!abortWhereReserveExceeded(POLY_Held, partNum == 8 ? -1 : 0, needed, partNum)) {
 			break;
 		}
 		if (getFreePartialCount() >= needed) {
@@ -190,6 +211,7 @@ bool PartialManager::freePartials(unsigned int needed, int partNum) {
 		if (!parts[partNum]->abortFirstPoly()) {
 			break;
 		}
+		traceSteal(partNum, needed, partNum);
 		if (getFreePartialCount() >= needed) {
 			return true;
 		}
@@ -205,3 +227,24 @@ const Partial *PartialManager::getPartial(unsigned int partialNum) const {
 	}
 	return partialTable[partialNum];
 }
+
+Partial *PartialManager::getPartial(unsigned int partialNum) {
+	if (partialNum > MT32EMU_MAX_PARTIALS - 1) {
+		return NULL;
+	}
+	return partialTable[partialNum];
+}
+
+void PartialManager::saveState(StateWriter &writer) const {
+	writer.writeBytes(numReservedPartialsForPart, sizeof(numReservedPartialsForPart));
+	for (int i = 0; i < MT32EMU_MAX_PARTIALS; i++) {
+		partialTable[i]->saveState(writer);
+	}
+}
+
+void PartialManager::loadState(StateReader &reader) {
+	reader.readBytes(numReservedPartialsForPart, sizeof(numReservedPartialsForPart));
+	for (int i = 0; i < MT32EMU_MAX_PARTIALS; i++) {
+		partialTable[i]->loadState(reader);
+	}
+}
@@ -24,13 +24,15 @@ class Synth;
 
 class PartialManager {
 private:
-	Synth *synth; // Only used for sending debug output
+	Synth *synth; // Only used for sending debug output and trace records
 	Part **parts;
 
 	Partial *partialTable[MT32EMU_MAX_PARTIALS];
 	Bit8u numReservedPartialsForPart[9];
 
-	bool abortWhereReserveExceeded(PolyState polyState, int minPart);
+	// needed and forPartNum are those passed to freePartials(), and are only used for tracing
+	bool abortWhereReserveExceeded(PolyState polyState, int minPart, unsigned int needed, int forPartNum);
+	void traceSteal(int partNum, unsigned int needed, int forPartNum);
 
 public:
 
@@ -43,9 +45,17 @@ public:
 	unsigned int setReserve(Bit8u *rset);
 	void deactivateAll();
 	bool produceOutput(int i, float *leftBuf, float *rightBuf, Bit32u bufferLength);
+	bool chase(int i, Bit32u length);
 	bool shouldReverb(int i);
+	bool canProduceOutput(int i);
+	void notifyDeactivations();
 	void clearAlreadyOutputed();
 	const Partial *getPartial(unsigned int partialNum) const;
+	Partial *getPartial(unsigned int partialNum);
+
+	// See Synth::saveState()
+	void saveState(StateWriter &writer) const;
+	void loadState(StateReader &reader);
 };
 
 }
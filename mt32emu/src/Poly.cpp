@@ -29,6 +29,8 @@ Poly::Poly(Part *usePart) {
 		partials[i] = NULL;
 	}
 	state = POLY_Inactive;
+	prev = NULL;
+	next = NULL;
 }
 
 void Poly::reset(unsigned int newKey, unsigned int newVelocity, bool newSustain, Partial **newPartials) {
@@ -171,4 +173,100 @@ void Poly::partialDeactivated(Partial *partial) {
 	part->partialDeactivated(this);
 }
 
+Poly *Poly::getNext() const {
+	return next;
+}
+
+void Poly::saveState(StateWriter &writer) const {
+	const Synth *synth = part->getSynth();
+	writer.write(key);
+	writer.write(velocity);
+	writer.write(activePartialCount);
+	writer.write(sustain);
+	writer.write((Bit8u)state);
+	for (int i = 0; i < 4; i++) {
+		synth->savePartialRef(writer, partials[i]);
+	}
+}
+
+void Poly::loadState(StateReader &reader) {
+	const Synth *synth = part->getSynth();
+	reader.read(key);
+	reader.read(velocity);
+	reader.read(activePartialCount);
+	reader.read(sustain);
+	Bit8u stateValue;
+	reader.read(stateValue);
+	if (stateValue > POLY_Inactive) {
+		reader.fail();
+		stateValue = POLY_Inactive;
+	}
+	state = (PolyState)stateValue;
+	for (int i = 0; i < 4; i++) {
+		partials[i] = synth->loadPartialRef(reader);
+	}
+	// The links are restored as the part puts the poly back into its list
+	prev = NULL;
+	next = NULL;
+}
+
+PolyList::PolyList() : firstPoly(NULL), lastPoly(NULL) {}
+
+bool PolyList::isEmpty() const {
+	return firstPoly == NULL;
+}
+
+Poly *PolyList::getFirst() const {
+	return firstPoly;
+}
+
+Poly *PolyList::getLast() const {
+	return lastPoly;
+}
+
+void PolyList::prepend(Poly *poly) {
+	poly->prev = NULL;
+	poly->next = firstPoly;
+	if (firstPoly == NULL) {
+		lastPoly = poly;
+	} else {
+		firstPoly->prev = poly;
+	}
+	firstPoly = poly;
+}
+
+void PolyList::append(Poly *poly) {
+	poly->prev = lastPoly;
+	poly->next = NULL;
+	if (lastPoly == NULL) {
+		firstPoly = poly;
+	} else {
+		lastPoly->next = poly;
+	}
+	lastPoly = poly;
+}
+
+Poly *PolyList::takeFirst() {
+	Poly *poly = firstPoly;
+	if (poly != NULL) {
+		remove(poly);
+	}
+	return poly;
+}
+
+void PolyList::remove(Poly *poly) {
+	if (poly->prev == NULL) {
+		firstPoly = poly->next;
+	} else {
+		poly->prev->next = poly->next;
+	}
+	if (poly->next == NULL) {
+		lastPoly = poly->prev;
+	} else {
+		poly->next->prev = poly->prev;
+	}
+	poly->prev = NULL;
+	poly->next = NULL;
+}
+
 }
@@ -30,6 +30,7 @@ enum PolyState {
 };
 
 class Poly {
+friend class PolyList;
 private:
 	Part *part;
 	unsigned int key;
@@ -41,6 +42,10 @@ private:
 
 	Partial *partials[4];
 
+	// Links within the PolyList this poly is currently in (each poly is always in exactly one list of its part)
+	Poly *prev;
+	Poly *next;
+
 public:
 	Poly(Part *part);
 	void reset(unsigned int key, unsigned int velocity, bool sustain, Partial **partials);
@@ -60,6 +65,30 @@ public:
 	bool isActive() const;
 
 	void partialDeactivated(Partial *partial);
+
+	Poly *getNext() const;
+
+	// See Synth::saveState()
+	void saveState(StateWriter &writer) const;
+	void loadState(StateReader &reader);
+};
+
+// Intrusive doubly-linked list of polys. The links are stored in the polys themselves, so that moving polys between lists
+// never allocates memory and removal is O(1). Its capacity is thus limited to the MT32EMU_MAX_POLY polys owned by a part.
+class PolyList {
+private:
+	Poly *firstPoly;
+	Poly *lastPoly;
+
+public:
+	PolyList();
+	bool isEmpty() const;
+	Poly *getFirst() const;
+	Poly *getLast() const;
+	void prepend(Poly *poly);
+	void append(Poly *poly);
+	Poly *takeFirst();
+	void remove(Poly *poly);
 };
 
 }
@@ -0,0 +1,398 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+
+#include "mt32emu.h"
+
+using namespace MT32Emu;
+
+// The room set aside in the sysex pool for each event: a DT1 message with 256 bytes of data
+static const Bit32u SYSEX_BYTES_PER_EVENT = 10 + 256;
+
+// Frame numbers wrap around, so they're compared by their difference
+static inline Bit32s frameDiff(Bit32u a, Bit32u b) {
+	return (Bit32s)(a - b);
+}
+
+RenderAhead::RenderAhead() {
+	synth = NULL;
+	aheadFrames = 0;
+	checkpointInterval = 0;
+	quit = false;
+	fifo = NULL;
+	renderBuffer = NULL;
+	playPos = 0;
+	readyPos = 0;
+	synthPos = 0;
+	nextCheckpointPos = 0;
+	events = NULL;
+	eventCount = 0;
+	maxEvents = 0;
+	nextEventIx = 0;
+	sysexPool = NULL;
+	spareSysexPool = NULL;
+	sysexPoolSize = 0;
+	sysexPoolUsed = 0;
+	checkpoints = NULL;
+	checkpointPositions = NULL;
+	checkpointSlots = 0;
+	firstCheckpointIx = 0;
+	checkpointCount = 0;
+	rollbackPending = false;
+	rollbackPos = 0;
+	rollbackCount = 0;
+	underrunFrameCount = 0;
+}
+
+RenderAhead::~RenderAhead() {
+	close();
+}
+
+bool RenderAhead::open(Synth *useSynth, Bit32u useAheadFrames, Bit32u useCheckpointInterval, Bit32u useMaxEvents) {
+	close();
+	if (useSynth == NULL || useAheadFrames == 0 || useCheckpointInterval == 0 || useMaxEvents == 0) {
+		return false;
+	}
+	synth = useSynth;
+	aheadFrames = useAheadFrames;
+	checkpointInterval = useCheckpointInterval;
+	maxEvents = useMaxEvents;
+
+	fifo = new Bit16s[aheadFrames * 2];
+	memset(fifo, 0, aheadFrames * 2 * sizeof(Bit16s));
+	renderBuffer = new Bit16s[checkpointInterval * 2];
+	events = new Event[maxEvents];
+	sysexPoolSize = maxEvents * SYSEX_BYTES_PER_EVENT;
+	sysexPool = new Bit8u[sysexPoolSize];
+	spareSysexPool = new Bit8u[sysexPoolSize];
+
+	// Enough for one checkpoint at or before the play position, and one every checkpointInterval frames after it
+	checkpointSlots = aheadFrames / checkpointInterval + 3;
+	checkpoints = new SynthCheckpoint[checkpointSlots];
+	checkpointPositions = new Bit32u[checkpointSlots];
+	// Saving into every slot now gets all their memory allocated up front, rather than on the render-ahead thread
+	for (Bit32u i = checkpointSlots; i-- > 0;) {
+		if (!synth->saveCheckpoint(checkpoints[i])) {
+			close();
+			return false;
+		}
+	}
+	firstCheckpointIx = 0;
+	checkpointCount = 1;
+	checkpointPositions[0] = 0;
+
+	playPos = 0;
+	readyPos = 0;
+	synthPos = 0;
+	nextCheckpointPos = checkpointInterval;
+	eventCount = 0;
+	nextEventIx = 0;
+	sysexPoolUsed = 0;
+	rollbackPending = false;
+	rollbackCount = 0;
+	underrunFrameCount = 0;
+	quit = false;
+	if (!thread.start(threadMain, this)) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void RenderAhead::close() {
+	if (thread.isStarted()) {
+		mutex.lock();
+		quit = true;
+		mutex.unlock();
+		wakeSemaphore.post();
+		thread.join();
+	}
+	eventCount = 0;
+	delete[] events;
+	events = NULL;
+	delete[] sysexPool;
+	sysexPool = NULL;
+	delete[] spareSysexPool;
+	spareSysexPool = NULL;
+	sysexPoolSize = 0;
+	sysexPoolUsed = 0;
+	delete[] checkpoints;
+	checkpoints = NULL;
+	delete[] checkpointPositions;
+	checkpointPositions = NULL;
+	checkpointSlots = 0;
+	checkpointCount = 0;
+	delete[] fifo;
+	fifo = NULL;
+	delete[] renderBuffer;
+	renderBuffer = NULL;
+	synth = NULL;
+}
+
+bool RenderAhead::queueEvent(Bit32u timestamp, Bit32u msg, const Bit8u *sysex, Bit32u sysexLen) {
+	mutex.lock();
+	if (synth == NULL || eventCount == maxEvents || sysexLen > sysexPoolSize - sysexPoolUsed) {
+		mutex.unlock();
+		return false;
+	}
+	// Whatever has already been played can't be changed
+	if (frameDiff(timestamp, playPos) < 0) {
+		timestamp = playPos;
+	}
+	// Goes after any events with the same timestamp, so that events for the same frame are played in the order they came
+	Bit32u eventIx = eventCount;
+	while (eventIx > 0 && frameDiff(events[eventIx - 1].timestamp, timestamp) > 0) {
+		events[eventIx] = events[eventIx - 1];
+		eventIx--;
+	}
+	Event &event = events[eventIx];
+	event.timestamp = timestamp;
+	event.msg = msg;
+	event.sysexOffset = sysexPoolUsed;
+	event.sysexLen = sysexLen;
+	if (sysexLen > 0) {
+		memcpy(sysexPool + sysexPoolUsed, sysex, sysexLen);
+		sysexPoolUsed += sysexLen;
+	}
+	eventCount++;
+
+	bool late = frameDiff(timestamp, synthPos) < 0 || eventIx < nextEventIx;
+	if (eventIx < nextEventIx) {
+		nextEventIx++;
+	}
+	if (late && (!rollbackPending || frameDiff(timestamp, rollbackPos) < 0)) {
+		rollbackPending = true;
+		rollbackPos = timestamp;
+	}
+	mutex.unlock();
+	wakeSemaphore.post();
+	return true;
+}
+
+bool RenderAhead::playMsg(Bit32u msg, Bit32u timestamp) {
+	return queueEvent(timestamp, msg, NULL, 0);
+}
+
+bool RenderAhead::playSysex(const Bit8u *sysex, Bit32u len, Bit32u timestamp) {
+	if (len == 0) {
+		return false;
+	}
+	return queueEvent(timestamp, 0, sysex, len);
+}
+
+void RenderAhead::render(Bit16s *stream, Bit32u len) {
+	mutex.lock();
+	for (Bit32u i = 0; i < len; i++) {
+		Bit32u pos = playPos + i;
+		if (synth != NULL && frameDiff(pos, readyPos) < 0) {
+			Bit16s *frame = fifo + (pos % aheadFrames) * 2;
+			stream[0] = frame[0];
+			stream[1] = frame[1];
+		} else {
+			stream[0] = 0;
+			stream[1] = 0;
+			if (synth != NULL) {
+				underrunFrameCount++;
+			}
+		}
+		stream += 2;
+	}
+	playPos += len;
+	mutex.unlock();
+	// There's room for more now
+	wakeSemaphore.post();
+}
+
+Bit32u RenderAhead::getPlayPosition() const {
+	mutex.lock();
+	Bit32u pos = playPos;
+	mutex.unlock();
+	return pos;
+}
+
+Bit32u RenderAhead::getRollbackCount() const {
+	mutex.lock();
+	Bit32u count = rollbackCount;
+	mutex.unlock();
+	return count;
+}
+
+Bit32u RenderAhead::getUnderrunFrameCount() const {
+	mutex.lock();
+	Bit32u count = underrunFrameCount;
+	mutex.unlock();
+	return count;
+}
+
+void RenderAhead::threadMain(void *renderAhead) {
+	((RenderAhead *)renderAhead)->run();
+}
+
+// Everything below runs on the render-ahead thread, which is the only one touching the synth.
+// The mutex is held except while the synth is busy rendering, saving or restoring.
+
+void RenderAhead::run() {
+	mutex.lock();
+	while (!quit) {
+		if (rollbackPending) {
+			rollBack();
+			continue;
+		}
+		if (synthPos == nextCheckpointPos) {
+			takeCheckpoint();
+			continue;
+		}
+		playEvents();
+
+		Bit32s roomLeft = frameDiff(playPos + aheadFrames, synthPos);
+		if (roomLeft <= 0) {
+			mutex.unlock();
+			wakeSemaphore.wait();
+			mutex.lock();
+			continue;
+		}
+		// Runs stop at the next checkpoint and the next event
+		Bit32u runLen = nextCheckpointPos - synthPos;
+		if (runLen > (Bit32u)roomLeft) {
+			runLen = roomLeft;
+		}
+		if (nextEventIx < eventCount) {
+			Bit32u framesToEvent = events[nextEventIx].timestamp - synthPos;
+			if (runLen > framesToEvent) {
+				runLen = framesToEvent;
+			}
+		}
+		Bit32u runStartPos = synthPos;
+		synthPos += runLen;
+		mutex.unlock();
+		synth->render(renderBuffer, runLen);
+		mutex.lock();
+		storeFrames(runStartPos, runLen);
+	}
+	mutex.unlock();
+}
+
+void RenderAhead::playEvents() {
+	while (nextEventIx < eventCount && frameDiff(events[nextEventIx].timestamp, synthPos) <= 0) {
+		const Event &event = events[nextEventIx++];
+		if (event.sysexLen > 0) {
+			synth->playSysex(sysexPool + event.sysexOffset, event.sysexLen);
+		} else {
+			synth->playMsg(event.msg);
+		}
+	}
+}
+
+void RenderAhead::storeFrames(Bit32u startPos, Bit32u len) {
+	const Bit16s *source = renderBuffer;
+	for (Bit32u i = 0; i < len; i++) {
+		Bit32u pos = startPos + i;
+		// Frames that have already been played are only rendered to catch the synth up
+		if (frameDiff(pos, playPos) >= 0) {
+			Bit16s *frame = fifo + (pos % aheadFrames) * 2;
+			frame[0] = source[0];
+			frame[1] = source[1];
+		}
+		source += 2;
+	}
+	Bit32u endPos = startPos + len;
+	if (frameDiff(startPos, readyPos) <= 0 && frameDiff(endPos, readyPos) > 0) {
+		readyPos = endPos;
+	}
+}
+
+void RenderAhead::takeCheckpoint() {
+	nextCheckpointPos = synthPos + checkpointInterval;
+	// Only the latest checkpoint at or before the play position is needed from there on
+	while (checkpointCount > 1 && frameDiff(checkpointPositions[(firstCheckpointIx + 1) % checkpointSlots], playPos) <= 0) {
+		firstCheckpointIx = (firstCheckpointIx + 1) % checkpointSlots;
+		checkpointCount--;
+	}
+	retireEvents();
+	if (checkpointCount == checkpointSlots) {
+		// Only happens if the consumer has stalled - rolling back will just take a bit longer
+		return;
+	}
+	Bit32u checkpointIx = (firstCheckpointIx + checkpointCount) % checkpointSlots;
+	Bit32u pos = synthPos;
+	// Nothing else uses a slot beyond the last checkpoint, so it can be saved into without holding the lock
+	mutex.unlock();
+	synth->saveCheckpoint(checkpoints[checkpointIx]);
+	mutex.lock();
+	checkpointPositions[checkpointIx] = pos;
+	checkpointCount++;
+}
+
+// Events from before the first checkpoint will never be played again
+void RenderAhead::retireEvents() {
+	Bit32u firstPos = checkpointPositions[firstCheckpointIx];
+	Bit32u retireCount = 0;
+	bool sysexRetired = false;
+	while (retireCount < nextEventIx && frameDiff(events[retireCount].timestamp, firstPos) < 0) {
+		sysexRetired = sysexRetired || events[retireCount].sysexLen > 0;
+		retireCount++;
+	}
+	if (retireCount == 0) {
+		return;
+	}
+	eventCount -= retireCount;
+	nextEventIx -= retireCount;
+	memmove(events, events + retireCount, eventCount * sizeof(Event));
+	if (sysexRetired) {
+		compactSysexPool();
+	}
+}
+
+// Frees up the room taken by retired sysex messages. The events are in timestamp order rather than the order they came in,
+// so the messages still pending are copied over to the spare pool one by one.
+void RenderAhead::compactSysexPool() {
+	Bit32u newUsed = 0;
+	for (Bit32u i = 0; i < eventCount; i++) {
+		Event &event = events[i];
+		memcpy(spareSysexPool + newUsed, sysexPool + event.sysexOffset, event.sysexLen);
+		event.sysexOffset = newUsed;
+		newUsed += event.sysexLen;
+	}
+	Bit8u *oldPool = sysexPool;
+	sysexPool = spareSysexPool;
+	spareSysexPool = oldPool;
+	sysexPoolUsed = newUsed;
+}
+
+void RenderAhead::rollBack() {
+	// Back to the latest checkpoint at or before the late event
+	while (checkpointCount > 1 && frameDiff(checkpointPositions[(firstCheckpointIx + checkpointCount - 1) % checkpointSlots], rollbackPos) > 0) {
+		checkpointCount--;
+	}
+	Bit32u checkpointIx = (firstCheckpointIx + checkpointCount - 1) % checkpointSlots;
+	synthPos = checkpointPositions[checkpointIx];
+	nextCheckpointPos = synthPos + checkpointInterval;
+	// Frames before the event are still good, but everything from there on has to be rendered again
+	if (frameDiff(readyPos, rollbackPos) > 0) {
+		readyPos = rollbackPos;
+	}
+	nextEventIx = 0;
+	while (nextEventIx < eventCount && frameDiff(events[nextEventIx].timestamp, synthPos) < 0) {
+		nextEventIx++;
+	}
+	rollbackPending = false;
+	rollbackCount++;
+	mutex.unlock();
+	synth->restoreCheckpoint(checkpoints[checkpointIx]);
+	mutex.lock();
+}
@@ -0,0 +1,135 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_RENDER_AHEAD_H
+#define MT32EMU_RENDER_AHEAD_H
+
+namespace MT32Emu {
+
+// Renders a synth well ahead of the audio clock on a thread of its own, so that a live host can keep a deep buffer
+// (to ride out scheduling jitter) without adding the same amount of latency to its MIDI input.
+// Events are stamped with the frame they should be played at, counted on the same clock as render() (see getPlayPosition()).
+// When an event arrives for a frame that has already been rendered ahead, the synth is rolled back to the latest
+// checkpoint before that frame and rendered again from there with the event in place. Frames before the event aren't
+// affected, so they can carry on being played while that happens - events should be stamped a little ahead of
+// getPlayPosition() to leave time for the re-render. Events stamped for frames that have already been played are played
+// as soon as possible.
+// render() and the event methods can be called from any threads.
+class RenderAhead {
+private:
+	struct Event {
+		Bit32u timestamp;
+		Bit32u msg;
+		// Where the sysex message is kept in sysexPool, or 0 bytes long for short messages
+		Bit32u sysexOffset;
+		Bit32u sysexLen;
+	};
+
+	Synth *synth;
+	Bit32u aheadFrames;
+	Bit32u checkpointInterval;
+
+	Thread thread;
+	mutable Mutex mutex;
+	Semaphore wakeSemaphore;
+	bool quit;
+
+	// Rendered frames, interleaved stereo, indexed by frame number modulo aheadFrames
+	Bit16s *fifo;
+	// Room for checkpointInterval frames, for the thread to render into before copying them to the FIFO
+	Bit16s *renderBuffer;
+
+	// The next frame render() will return
+	Bit32u playPos;
+	// Frames before this are in the FIFO (unless they've already been played)
+	Bit32u readyPos;
+	// The frame the synth's state is at, including any run being rendered right now
+	Bit32u synthPos;
+	Bit32u nextCheckpointPos;
+
+	// Pending events in timestamp order. Events are kept until every checkpoint they could be replayed from is gone.
+	Event *events;
+	Bit32u eventCount;
+	Bit32u maxEvents;
+	// The first event the synth hasn't been sent yet
+	Bit32u nextEventIx;
+
+	// The sysex messages of the pending events, copied in as they arrive (sysexPoolUsed bytes so far). When events are
+	// retired, the messages still pending are copied over to spareSysexPool, which then takes the place of sysexPool.
+	// Both are allocated by open(), so that queueing a sysex message doesn't allocate on the caller's thread.
+	Bit8u *sysexPool;
+	Bit8u *spareSysexPool;
+	Bit32u sysexPoolSize;
+	Bit32u sysexPoolUsed;
+
+	// Ring of checkpoints in time order, with the frame each was taken at
+	SynthCheckpoint *checkpoints;
+	Bit32u *checkpointPositions;
+	Bit32u checkpointSlots;
+	Bit32u firstCheckpointIx;
+	Bit32u checkpointCount;
+
+	bool rollbackPending;
+	Bit32u rollbackPos;
+
+	Bit32u rollbackCount;
+	Bit32u underrunFrameCount;
+
+	RenderAhead(const RenderAhead &);
+	RenderAhead &operator=(const RenderAhead &);
+
+	static void threadMain(void *renderAhead);
+	void run();
+	void rollBack();
+	void takeCheckpoint();
+	void retireEvents();
+	void compactSysexPool();
+	void playEvents();
+	void storeFrames(Bit32u startPos, Bit32u len);
+	bool queueEvent(Bit32u timestamp, Bit32u msg, const Bit8u *sysex, Bit32u sysexLen);
+
+public:
+	RenderAhead();
+	~RenderAhead();
+
+	// Starts rendering the synth (which must be open) ahead of the clock. Until close(), the synth must only be used through
+	// this object. Up to useAheadFrames are rendered ahead, with a checkpoint every useCheckpointInterval frames - as each
+	// checkpoint takes about as much memory as the synth (see Synth::getMemoryFootprint()), it helps to keep maxSamplesPerRun
+	// small. Up to useMaxEvents events can be pending at once, along with as many sysex messages of up to 256 data bytes
+	// (or the same number of bytes in fewer, longer messages).
+	bool open(Synth *useSynth, Bit32u useAheadFrames, Bit32u useCheckpointInterval, Bit32u useMaxEvents);
+	// Stops rendering ahead. The synth is left in the state it had reached, ahead of the last frame played.
+	void close();
+
+	// Queue events for the given frame. Return false if there are already too many events (or sysex bytes) pending.
+	// Neither allocates memory, and the sysex message is copied, so they're safe to call from a real-time MIDI thread.
+	bool playMsg(Bit32u msg, Bit32u timestamp);
+	bool playSysex(const Bit8u *sysex, Bit32u len, Bit32u timestamp);
+
+	// Takes the next len frames from the FIFO. Frames that haven't been rendered in time come out as silence.
+	void render(Bit16s *stream, Bit32u len);
+
+	// Returns the number of the next frame render() will return, starting from 0 at open()
+	Bit32u getPlayPosition() const;
+	// Statistics for tuning the buffer depth and checkpoint interval
+	Bit32u getRollbackCount() const;
+	Bit32u getUnderrunFrameCount() const;
+};
+
+}
+
+#endif
@@ -0,0 +1,101 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+
+#include "mt32emu.h"
+
+using namespace MT32Emu;
+
+StateWriter::StateWriter(void *useBuffer, Bit32u useSize) {
+	buffer = (Bit8u *)useBuffer;
+	size = buffer == NULL ? 0 : useSize;
+	pos = 0;
+	overflowed = false;
+}
+
+void StateWriter::writeBytes(const void *data, Bit32u len) {
+	if (buffer != NULL) {
+		if (len > size - pos || overflowed) {
+			overflowed = true;
+		} else {
+			memcpy(buffer + pos, data, len);
+		}
+	}
+	pos += len;
+}
+
+void StateWriter::write(bool value) {
+	Bit8u byteValue = value ? 1 : 0;
+	writeBytes(&byteValue, 1);
+}
+
+Bit32u StateWriter::getPosition() const {
+	return pos;
+}
+
+bool StateWriter::isOverflowed() const {
+	return overflowed;
+}
+
+StateReader::StateReader(const void *useBuffer, Bit32u useSize) {
+	buffer = (const Bit8u *)useBuffer;
+	size = buffer == NULL ? 0 : useSize;
+	pos = 0;
+	failed = false;
+}
+
+void StateReader::readBytes(void *data, Bit32u len) {
+	if (failed || len > size - pos) {
+		failed = true;
+		memset(data, 0, len);
+		return;
+	}
+	memcpy(data, buffer + pos, len);
+	pos += len;
+}
+
+void StateReader::read(bool &value) {
+	Bit8u byteValue;
+	readBytes(&byteValue, 1);
+	if (byteValue > 1) {
+		fail();
+	}
+	value = byteValue == 1;
+}
+
+int StateReader::readIndex(int count) {
+	Bit32s index;
+	readBytes(&index, sizeof(index));
+	if (index < -1 || index >= count) {
+		fail();
+		return -1;
+	}
+	return index;
+}
+
+void StateReader::fail() {
+	failed = true;
+}
+
+bool StateReader::isFailed() const {
+	return failed;
+}
+
+bool StateReader::isComplete() const {
+	return !failed && pos == size;
+}
@@ -0,0 +1,89 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_STATE_STREAM_H
+#define MT32EMU_STATE_STREAM_H
+
+namespace MT32Emu {
+
+// Sequential writer used to save a synth's state (see Synth::saveState()).
+// Values are written field by field in native byte order. With a NULL buffer nothing is stored,
+// and the writer just counts the bytes, which is how the size of a state is determined.
+class StateWriter {
+private:
+	Bit8u *buffer;
+	Bit32u size;
+	Bit32u pos;
+	bool overflowed;
+
+	StateWriter(const StateWriter &);
+	StateWriter &operator=(const StateWriter &);
+
+public:
+	StateWriter(void *useBuffer, Bit32u useSize);
+
+	void writeBytes(const void *data, Bit32u len);
+	void write(bool value);
+
+	template <class T>
+	void write(const T &value) {
+		writeBytes(&value, sizeof(T));
+	}
+
+	// Returns the number of bytes written so far, including any that didn't fit into the buffer
+	Bit32u getPosition() const;
+	// Returns true if the buffer was too small for everything written to it
+	bool isOverflowed() const;
+};
+
+// Sequential reader for states written by StateWriter.
+// Reading past the end of the data, or finding a value that can't be right, puts the reader into a failed state
+// in which all further reads give zeros. The caller checks isFailed() once it's done.
+class StateReader {
+private:
+	const Bit8u *buffer;
+	Bit32u size;
+	Bit32u pos;
+	bool failed;
+
+	StateReader(const StateReader &);
+	StateReader &operator=(const StateReader &);
+
+public:
+	StateReader(const void *useBuffer, Bit32u useSize);
+
+	void readBytes(void *data, Bit32u len);
+	void read(bool &value);
+
+	template <class T>
+	void read(T &value) {
+		readBytes(&value, sizeof(T));
+	}
+
+	// Reads an index written as a Bit32s, where -1 stands for "none".
+	// Anything else outside the range 0 to count - 1 fails the reader, and gives -1.
+	int readIndex(int count);
+
+	void fail();
+	bool isFailed() const;
+	// Returns true if all of the data has been read without failing
+	bool isComplete() const;
+};
+
+}
+
+#endif
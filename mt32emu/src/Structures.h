@@ -184,7 +184,7 @@ struct PCMWaveEntry {
 	Bit32u addr;
 	Bit32u len;
 	bool loop;
-	ControlROMPCMStruct *controlROMPCMStruct;
+	const ControlROMPCMStruct *controlROMPCMStruct;
 };
 
 // This is basically a per-partial, pre-processed combination of timbre and patch/rhythm settings
@@ -205,9 +205,6 @@ struct PatchCache {
 	bool reverb;
 
 	TimbreParam::PartialParam srcPartial;
-
-	// The following directly points into live sysex-addressable memory
-	const TimbreParam::PartialParam *partialParam;
 };
 
 class Partial; // Forward reference for class defined in partial.h
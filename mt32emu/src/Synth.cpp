@@ -46,6 +46,26 @@ const ControlROMMap ControlROMMaps[7] = {
 	// (Note that all but CM-32L ROM actually have 86 entries for rhythmTemp)
 };
 
+// Adds the time until it goes out of scope to a RenderStats counter, if profiling is enabled (see Synth::setProfilingEnabled())
+class ProfilingTimer {
+private:
+	double *counter;
+	double startTime;
+
+	ProfilingTimer(const ProfilingTimer &);
+	ProfilingTimer &operator=(const ProfilingTimer &);
+
+public:
+	ProfilingTimer(bool enabled, double &useCounter) : counter(enabled ? &useCounter : NULL), startTime(enabled ? Thread::getTime() : 0.0) {
+	}
+
+	~ProfilingTimer() {
+		if (counter != NULL) {
+			*counter += Thread::getTime() - startTime;
+		}
+	}
+};
+
 static inline Bit16s *streamOffset(Bit16s *stream, Bit32u pos) {
 	return stream == NULL ? NULL : stream + pos;
 }
@@ -72,14 +92,6 @@ static inline void clearFloats(float *leftBuf, float *rightBuf, Bit32u len) {
 	}
 }
 
-static inline Bit16s clipBit16s(Bit32s a) {
-	// Clamp values above 32767 to 32767, and values below -32768 to -32768
-	if ((a + 32768) & ~65535) {
-		return (a >> 31) ^ 32767;
-	}
-	return a;
-}
-
 static void floatToBit16s_nice(Bit16s *target, const float *source, Bit32u len, float outputGain) {
 	float gain = outputGain * 16384.0f;
 	while (len--) {
@@ -138,10 +150,46 @@ Bit8u Synth::calcSysexChecksum(const Bit8u *data, Bit32u len, Bit8u checksum) {
 	return checksum;
 }
 
-Synth::Synth() {
+ROMImage::ROMImage() {
+	refCount = 1;
+	controlROMMap = NULL;
+	pcmROMData = NULL;
+	pcmROMSize = 0;
+	romTimbreCaches = NULL;
+}
+
+ROMImage::~ROMImage() {
+	delete[] pcmROMData;
+	delete[] romTimbreCaches;
+}
+
+void ROMImage::addRef() {
+	refCountMutex.lock();
+	refCount++;
+	refCountMutex.unlock();
+}
+
+void ROMImage::release() {
+	refCountMutex.lock();
+	bool last = --refCount == 0;
+	refCountMutex.unlock();
+	if (last) {
+		delete this;
+	}
+}
+
+Synth::Synth() : tables(Tables::getInstance()) {
 	isOpen = false;
+	isPartiallyOpen = false;
+	romImage = NULL;
+	controlROMMap = NULL;
+	controlROMData = NULL;
+	pcmROMData = NULL;
+	pcmROMSize = 0;
 	reverbEnabled = true;
 	reverbOverridden = false;
+	streamStatus = 0;
+	bulkWriteActive = false;
 
 #if MT32EMU_USE_AREVERBMODEL == 1
 	reverbModels[0] = new AReverbModel(&AReverbModel::REVERB_MODE_0_SETTINGS);
@@ -155,12 +203,33 @@ Synth::Synth() {
 
 	reverbModels[3] = new DelayReverb();
 	reverbModel = NULL;
+	reverbBuffer = NULL;
+	streamSysex = NULL;
 	setDACInputMode(DACInputMode_NICE);
 	setOutputGain(1.0f);
 	setReverbOutputGain(0.68f);
 	partialManager = NULL;
 	memset(parts, 0, sizeof(parts));
+	memset(&arenaFootprint, 0, sizeof(arenaFootprint));
+	arenaStateSize = 0;
+	memset(partialOutputLeft, 0, sizeof(partialOutputLeft));
+	memset(partialOutputRight, 0, sizeof(partialOutputRight));
+	deferPartialDeactivation = false;
+	memset(reverbStageRuns, 0, sizeof(reverbStageRuns));
+	memset(reverbStageOutput, 0, sizeof(reverbStageOutput));
+	reverbStageEnabled = false;
+	reverbStageBusy = false;
+	reverbStageQuit = false;
+	reverbStageRunIx = 0;
+	reverbStageCurrentRun = NULL;
+	reverbStageOutputPos = 0;
+	reverbStageIdleFrames = 0;
+	chaseMutedReverbModel = NULL;
+	chaseEndSampleCount = 0;
 	renderedSampleCount = 0;
+	profilingEnabled = false;
+	memset(&renderStats, 0, sizeof(renderStats));
+	memset(partialLA32Times, 0, sizeof(partialLA32Times));
 }
 
 Synth::~Synth() {
@@ -274,7 +343,8 @@ LoadResult Synth::loadControlROM(const char *filename) {
 	if (file == NULL) {
 		return LoadResult_NotFound;
 	}
-	bool rc = (file->read(controlROMData, CONTROL_ROM_SIZE) == CONTROL_ROM_SIZE);
+	Bit8u *romData = romImage->controlROMData;
+	bool rc = (file->read(romData, CONTROL_ROM_SIZE) == CONTROL_ROM_SIZE);
 
 	closeFile(file);
 	if (!rc) {
@@ -282,10 +352,10 @@ LoadResult Synth::loadControlROM(const char *filename) {
 	}
 
 	// Control ROM successfully loaded, now check whether it's a known type
-	controlROMMap = NULL;
+	romImage->controlROMMap = NULL;
 	for (unsigned int i = 0; i < sizeof(ControlROMMaps) / sizeof(ControlROMMaps[0]); i++) {
-		if (memcmp(&controlROMData[ControlROMMaps[i].idPos], ControlROMMaps[i].idBytes, ControlROMMaps[i].idLen) == 0) {
-			controlROMMap = &ControlROMMaps[i];
+		if (memcmp(&romData[ControlROMMaps[i].idPos], ControlROMMaps[i].idBytes, ControlROMMaps[i].idLen) == 0) {
+			romImage->controlROMMap = &ControlROMMaps[i];
 			return LoadResult_OK;
 		}
 	}
@@ -299,8 +369,10 @@ LoadResult Synth::loadPCMROM(const char *filename) {
 		return LoadResult_NotFound;
 	}
 	LoadResult rc = LoadResult_OK;
+	float *romData = romImage->pcmROMData;
+	int romSize = romImage->pcmROMSize;
 	int i;
-	for (i = 0; i < pcmROMSize; i++) {
+	for (i = 0; i < romSize; i++) {
 		Bit8u s;
 		if (!file->readBit8u(&s)) {
 			if (!file->isEOF()) {
@@ -340,10 +412,10 @@ LoadResult Synth::loadPCMROM(const char *filename) {
 			lin = -lin;
 		}
 
-		pcmROMData[i] = lin;
+		romData[i] = lin;
 	}
-	if (i != pcmROMSize) {
-		printDebug("PCM ROM file is too short (expected %d, got %d)", pcmROMSize, i);
+	if (i != romSize) {
+		printDebug("PCM ROM file is too short (expected %d, got %d)", romSize, i);
 		rc = LoadResult_Invalid;
 	}
 	closeFile(file);
@@ -351,7 +423,7 @@ LoadResult Synth::loadPCMROM(const char *filename) {
 }
 
 bool Synth::initPCMList(Bit16u mapAddress, Bit16u count) {
-	ControlROMPCMStruct *tps = (ControlROMPCMStruct *)&controlROMData[mapAddress];
+	const ControlROMPCMStruct *tps = (const ControlROMPCMStruct *)&controlROMData[mapAddress];
 	for (int i = 0; i < count; i++) {
 		int rAddr = tps[i].pos * 0x800;
 		int rLenExp = (tps[i].len & 0x70) >> 4;
@@ -417,30 +489,25 @@ bool Synth::initTimbres(Bit16u mapAddress, Bit16u offset, int count, int startTi
 	return true;
 }
 
-bool Synth::open(SynthProperties &useProp) {
-	if (isOpen) {
-		return false;
-	}
-	prerenderReadIx = prerenderWriteIx = 0;
-	myProp = useProp;
-#if MT32EMU_MONITOR_INIT
-	synth->printDebug("Initialising Constant Tables");
-#endif
-	tables.init();
-#if !MT32EMU_REDUCE_REVERB_MEMORY
-	for (int i = 0; i < 4; i++) {
-		reverbModels[i]->open(useProp.sampleRate);
-	}
-#endif
-	if (useProp.baseDir != NULL) {
-		char *baseDirCopy = new char[strlen(useProp.baseDir) + 1];
-		strcpy(baseDirCopy, useProp.baseDir);
-		myProp.baseDir = baseDirCopy;
+void Synth::initROMTimbreCaches() {
+	PatchCache *caches = new PatchCache[ROM_TIMBRE_CACHE_COUNT];
+	// The fields of unplayed partials are left alone by calcPatchCache(), but saved states include them
+	memset(caches, 0, ROM_TIMBRE_CACHE_COUNT * sizeof(PatchCache));
+	for (unsigned int i = 0; i < ROM_TIMBRE_COUNT; i++) {
+		Part::calcPatchCache(&caches[i * 8], &mt32ram.timbres[i].timbre, false);
+		Part::calcPatchCache(&caches[i * 8 + 4], &mt32ram.timbres[i].timbre, true);
 	}
+	romImage->romTimbreCaches = caches;
+}
 
-	// This is to help detect bugs
-	memset(&mt32ram, '?', sizeof(mt32ram));
+const PatchCache *Synth::getROMTimbreCaches(unsigned int absTimbreNum) const {
+	if (absTimbreNum >= ROM_TIMBRE_COUNT) {
+		return NULL;
+	}
+	return &romImage->romTimbreCaches[absTimbreNum * 8];
+}
 
+bool Synth::loadROMs() {
 #if MT32EMU_MONITOR_INIT
 	printDebug("Loading Control ROM");
 #endif
@@ -452,13 +519,11 @@ bool Synth::open(SynthProperties &useProp) {
 		}
 	}
 
-	initMemoryRegions();
-
 	// 512KB PCM ROM for MT-32, etc.
 	// 1MB PCM ROM for CM-32L, LAPC-I, CM-64, CM-500
 	// Note that the size below is given in samples (16-bit), not bytes
-	pcmROMSize = controlROMMap->pcmCount == 256 ? 512 * 1024 : 256 * 1024;
-	pcmROMData = new float[pcmROMSize];
+	romImage->pcmROMSize = romImage->controlROMMap->pcmCount == 256 ? 512 * 1024 : 256 * 1024;
+	romImage->pcmROMData = new float[romImage->pcmROMSize];
 
 #if MT32EMU_MONITOR_INIT
 	printDebug("Loading PCM ROM");
@@ -470,11 +535,75 @@ bool Synth::open(SynthProperties &useProp) {
 			return false;
 		}
 	}
+	return true;
+}
+
+bool Synth::open(SynthProperties &useProp) {
+	if (isOpen) {
+		return false;
+	}
+	// From here on, a failure is cleaned up by close(), which tears down whatever has been set up so far
+	isPartiallyOpen = true;
+	prerenderReadIx = prerenderWriteIx = 0;
+	chaseMutedReverbModel = NULL;
+	streamStatus = 0;
+	bulkWriteActive = false;
+	myProp = useProp;
+	maxSamplesPerRun = useProp.maxSamplesPerRun > 0 ? useProp.maxSamplesPerRun : MAX_SAMPLES_PER_RUN;
+	maxPrerenderSamples = useProp.maxPrerenderSamples > 0 ? useProp.maxPrerenderSamples : MAX_PRERENDER_SAMPLES;
+	maxSampleRate = useProp.maxSampleRate > useProp.sampleRate ? useProp.maxSampleRate : useProp.sampleRate;
+	if (useProp.baseDir != NULL) {
+		char *baseDirCopy = new char[strlen(useProp.baseDir) + 1];
+		strcpy(baseDirCopy, useProp.baseDir);
+		myProp.baseDir = baseDirCopy;
+	}
+
+	// This is to help detect bugs
+	memset(&mt32ram, '?', sizeof(mt32ram));
+
+	if (useProp.romImage != NULL) {
+		romImage = useProp.romImage;
+		romImage->addRef();
+	} else {
+		romImage = new ROMImage();
+		if (!loadROMs()) {
+			close();
+			return false;
+		}
+	}
+	controlROMMap = romImage->controlROMMap;
+	controlROMData = romImage->controlROMData;
+	pcmROMData = romImage->pcmROMData;
+	pcmROMSize = romImage->pcmROMSize;
+
+	// Everything else that lives as long as the synth is open goes into the arena, which is sized from the Control ROM map
+#if MT32EMU_MONITOR_INIT
+	printDebug("Initialising Instance Arena");
+#endif
+	if (!initArena()) {
+		close();
+		return false;
+	}
+
+	partialManager = new (arena.allocate(sizeof(PartialManager))) PartialManager(this, parts);
+
+	if (myProp.renderThreads > 1 && !workerPool.open(myProp.renderThreads - 1)) {
+		printDebug("Unable to start %d render threads, rendering on the calling thread only", myProp.renderThreads - 1);
+	}
+
+#if !MT32EMU_REDUCE_REVERB_MEMORY
+	for (Bit8u i = 0; i < 4; i++) {
+		openReverbModel(i);
+	}
+#endif
+
+	initMemoryRegions();
 
 #if MT32EMU_MONITOR_INIT
 	printDebug("Initialising Timbre Bank A");
 #endif
 	if (!initTimbres(controlROMMap->timbreAMap, controlROMMap->timbreAOffset, 0x40, 0, controlROMMap->timbreACompressed)) {
+		close();
 		return false;
 	}
 
@@ -482,13 +611,20 @@ bool Synth::open(SynthProperties &useProp) {
 	printDebug("Initialising Timbre Bank B");
 #endif
 	if (!initTimbres(controlROMMap->timbreBMap, controlROMMap->timbreBOffset, 0x40, 64, controlROMMap->timbreBCompressed)) {
+		close();
 		return false;
 	}
 
+	// A ROM image shared through SynthProperties::romImage comes from a synth that has already done this
+	if (romImage->romTimbreCaches == NULL) {
+		initROMTimbreCaches();
+	}
+
 #if MT32EMU_MONITOR_INIT
 	printDebug("Initialising Timbre Bank R");
 #endif
 	if (!initTimbres(controlROMMap->timbreRMap, 0, controlROMMap->timbreRCount, 192, true)) {
+		close();
 		return false;
 	}
 
@@ -498,9 +634,7 @@ bool Synth::open(SynthProperties &useProp) {
 	// CM-64 seems to initialise all bytes in this bank to 0.
 	memset(&mt32ram.timbres[128], 0, sizeof(mt32ram.timbres[128]) * 64);
 
-	partialManager = new PartialManager(this, parts);
-
-	pcmWaves = new PCMWaveEntry[controlROMMap->pcmCount];
+	pcmWaves = arena.allocateArray<PCMWaveEntry>(controlROMMap->pcmCount);
 
 #if MT32EMU_MONITOR_INIT
 	printDebug("Initialising PCM List");
@@ -565,16 +699,23 @@ bool Synth::open(SynthProperties &useProp) {
 		patchTemp->dummyv[1] = 127;
 
 		if (i < 8) {
-			parts[i] = new Part(this, i);
+			parts[i] = new (arena.allocate(sizeof(Part))) Part(this, i);
 			parts[i]->setProgram(controlROMData[controlROMMap->programSettings + i]);
 		} else {
-			parts[i] = new RhythmPart(this, i);
+			parts[i] = new (arena.allocate(sizeof(RhythmPart))) RhythmPart(this, i);
 		}
 	}
 
 	// For resetting mt32 mid-execution
 	mt32default = mt32ram;
 
+	initScratchBuffers();
+
+	if (myProp.pipelineReverb && !startReverbStage()) {
+		printDebug("Unable to start the reverb stage thread, rendering reverb on the calling thread");
+	}
+
+	isPartiallyOpen = false;
 	isOpen = true;
 	isEnabled = false;
 
@@ -585,23 +726,37 @@ bool Synth::open(SynthProperties &useProp) {
 }
 
 void Synth::close() {
-	if (!isOpen) {
+	if (!isOpen && !isPartiallyOpen) {
 		return;
 	}
 
-	delete partialManager;
-	partialManager = NULL;
+	stopReverbStage();
+
+	// These live in the arena, so they're only destroyed here; their memory goes when the arena is closed below.
+	// After a failed open(), they may not have been constructed yet.
+	if (partialManager != NULL) {
+		partialManager->~PartialManager();
+		partialManager = NULL;
+	}
 
 	for (int i = 0; i < 9; i++) {
-		delete parts[i];
-		parts[i] = NULL;
+		if (parts[i] != NULL) {
+			parts[i]->~Part();
+			parts[i] = NULL;
+		}
 	}
 
 	delete[] myProp.baseDir;
 	myProp.baseDir = NULL;
 
-	delete[] pcmWaves;
-	delete[] pcmROMData;
+	pcmWaves = NULL;
+	if (romImage != NULL) {
+		romImage->release();
+		romImage = NULL;
+	}
+	controlROMMap = NULL;
+	controlROMData = NULL;
+	pcmROMData = NULL;
 
 	deleteMemoryRegions();
 
@@ -609,9 +764,63 @@ void Synth::close() {
 		reverbModels[i]->close();
 	}
 	reverbModel = NULL;
+	reverbBuffer = NULL;
+	streamSysex = NULL;
+
+	workerPool.close();
+	memset(partialOutputLeft, 0, sizeof(partialOutputLeft));
+	memset(partialOutputRight, 0, sizeof(partialOutputRight));
+	memset(reverbStageRuns, 0, sizeof(reverbStageRuns));
+	memset(reverbStageOutput, 0, sizeof(reverbStageOutput));
+	arena.close();
+	memset(&arenaFootprint, 0, sizeof(arenaFootprint));
+	arenaStateSize = 0;
+	isPartiallyOpen = false;
 	isOpen = false;
 }
 
+void Synth::reset() {
+	if (!isOpen) {
+		return;
+	}
+	resetDevice();
+	// Unlike the device reset, nothing from before is heard afterwards
+	prerenderReadIx = prerenderWriteIx = 0;
+	muteReverb();
+	chaseMutedReverbModel = NULL;
+	// Any partly received message or unfinished bulk write is dropped as well
+	streamStatus = 0;
+	bulkWriteActive = false;
+}
+
+bool Synth::reconfigure(unsigned int newSampleRate) {
+	if (!isOpen || newSampleRate == 0 || newSampleRate > maxSampleRate) {
+		return false;
+	}
+	// Like reset(), except that the memory is kept
+	partialManager->deactivateAll();
+	for (int i = 0; i < 9; i++) {
+		parts[i]->reset();
+	}
+	prerenderReadIx = prerenderWriteIx = 0;
+	chaseMutedReverbModel = NULL;
+	streamStatus = 0;
+	bulkWriteActive = false;
+
+	myProp.sampleRate = newSampleRate;
+	for (unsigned int i = 0; i < MT32EMU_MAX_PARTIALS; i++) {
+		partialManager->getPartial(i)->tvp->refreshSampleRate();
+	}
+	// Opens the reverb models again at the new rate; the buffer was sized for maxSampleRate by initArena()
+	muteReverb();
+	refreshSystem();
+	for (int i = 0; i < 9; i++) {
+		parts[i]->timbreTempWritten();
+		parts[i]->refresh();
+	}
+	return true;
+}
+
 void Synth::playMsg(Bit32u msg) {
 	// FIXME: Implement active sensing
 	unsigned char code     = (unsigned char)((msg & 0x0000F0) >> 4);
@@ -634,20 +843,27 @@ void Synth::playMsg(Bit32u msg) {
 
 void Synth::playMsgOnPart(unsigned char part, unsigned char code, unsigned char note, unsigned char velocity) {
 	Bit32u bend;
+	ProfilingTimer timer(profilingEnabled, renderStats.eventTime);
+	if (profilingEnabled) {
+		renderStats.eventCount++;
+	}
 
 	//printDebug("Synth::playMsgOnPart(%02x, %02x, %02x, %02x)", part, code, note, velocity);
 	switch (code) {
 	case 0x8:
 		//printDebug("Note OFF - Part %d", part);
 		// The MT-32 ignores velocity for note off
+		trace.record(TraceEvent_noteOff, renderedSampleCount, part, note, 0);
 		parts[part]->noteOff(note);
 		break;
 	case 0x9:
 		//printDebug("Note ON - Part %d, Note %d Vel %d", part, note, velocity);
 		if (velocity == 0) {
 			// MIDI defines note-on with velocity 0 as being the same as note-off with velocity 40
+			trace.record(TraceEvent_noteOff, renderedSampleCount, part, note, 0);
 			parts[part]->noteOff(note);
 		} else {
+			trace.record(TraceEvent_noteOn, renderedSampleCount, part, note, velocity);
 			parts[part]->noteOn(note, velocity);
 		}
 		break;
@@ -734,6 +950,88 @@ void Synth::playMsgOnPart(unsigned char part, unsigned char code, unsigned char
 	//midiOutShortMsg(m_out, msg);
 }
 
+// Returns the number of data bytes following the status byte of a (non-sysex) MIDI message
+static unsigned int getMidiDataLength(Bit8u status) {
+	switch (status & 0xF0) {
+	case 0xC0:
+	case 0xD0:
+		return 1;
+	case 0xF0:
+		switch (status) {
+		case 0xF1:
+		case 0xF3:
+			return 1;
+		case 0xF2:
+			return 2;
+		default:
+			return 0;
+		}
+	default:
+		return 2;
+	}
+}
+
+void Synth::parseStream(const Bit8u *stream, Bit32u len) {
+	for (Bit32u i = 0; i < len; i++) {
+		Bit8u b = stream[i];
+		if (b >= 0xF8) {
+			// Real-time message: it doesn't disturb the message it may appear in, and the MT-32 ignores it
+			continue;
+		}
+		if (b & 0x80) {
+			if (streamStatus == 0xF0) {
+				if (b == 0xF7) {
+					if (streamSysexLen < MAX_STREAM_SYSEX_SIZE) {
+						streamSysex[streamSysexLen++] = b;
+						playSysex(streamSysex, streamSysexLen);
+					} else {
+						printDebug("parseStream: Sysex message is too long (%d bytes), ignored", streamSysexLen + 1);
+					}
+					streamStatus = 0;
+					continue;
+				}
+				printDebug("parseStream: Sysex message interrupted by status byte 0x%02x, ignored", b);
+			}
+			streamStatus = b;
+			streamDataCount = 0;
+			if (b == 0xF0) {
+				streamSysex[0] = b;
+				streamSysexLen = 1;
+			} else if (getMidiDataLength(b) == 0) {
+				// Tune request, undefined or stray End Of Exclusive - nothing to do, except that running status is cancelled
+				streamStatus = 0;
+			}
+			continue;
+		}
+		if (streamStatus == 0xF0) {
+			if (streamSysexLen < MAX_STREAM_SYSEX_SIZE) {
+				streamSysex[streamSysexLen] = b;
+			}
+			streamSysexLen++;
+			continue;
+		}
+		if (streamStatus == 0) {
+			continue;
+		}
+		streamData[streamDataCount++] = b;
+		unsigned int dataLength = getMidiDataLength(streamStatus);
+		if (streamDataCount < dataLength) {
+			continue;
+		}
+		streamDataCount = 0;
+		if (streamStatus < 0xF0) {
+			Bit32u msg = streamStatus | (streamData[0] << 8);
+			if (dataLength == 2) {
+				msg |= streamData[1] << 16;
+			}
+			playMsg(msg);
+		} else {
+			// System common messages don't concern the MT-32, and don't leave a running status behind
+			streamStatus = 0;
+		}
+	}
+}
+
 void Synth::playSysex(const Bit8u *sysex, Bit32u len) {
 	if (len < 2) {
 		printDebug("playSysex: Message is too short for sysex (%d bytes)", len);
@@ -776,6 +1074,10 @@ void Synth::playSysexWithoutFraming(const Bit8u *sysex, Bit32u len) {
 }
 
 void Synth::playSysexWithoutHeader(unsigned char device, unsigned char command, const Bit8u *sysex, Bit32u len) {
+	ProfilingTimer timer(profilingEnabled, renderStats.eventTime);
+	if (profilingEnabled) {
+		renderStats.eventCount++;
+	}
 	if (device > 0x10) {
 		// We have device ID 0x10 (default, but changeable, on real MT-32), < 0x10 is for channels
 		printDebug("playSysexWithoutHeader: Message is not intended for this device ID (provided: %02x, expected: 0x10 or channel)", (int)device);
@@ -784,7 +1086,7 @@ void Synth::playSysexWithoutHeader(unsigned char device, unsigned char command,
 	// This is checked early in the real devices (before any sysex length checks or further processing)
 	// FIXME: Response to SYSEX_CMD_DAT reset with partials active (and in general) is untested.
 	if ((command == SYSEX_CMD_DT1 || command == SYSEX_CMD_DAT) && sysex[0] == 0x7F) {
-		reset();
+		resetDevice();
 		return;
 	}
 	if (len < 4) {
@@ -890,26 +1192,82 @@ void Synth::writeSysex(unsigned char device, const Bit8u *sysex, Bit32u len) {
 	}
 
 	// Process device-global sysex (possibly converted from channel-specific sysex above)
+	writeMemory(addr, sysex, len);
+}
+
+void Synth::writeMemory(Bit32u addr, const Bit8u *data, Bit32u len) {
 	for (;;) {
 		// Find the appropriate memory region
 		const MemoryRegion *region = findMemoryRegion(addr);
 
 		if (region == NULL) {
-			printDebug("Sysex write to unrecognised address %06x, len %d", MT32EMU_SYSEXMEMADDR(addr), len);
+			printDebug("Memory write to unrecognised address %06x, len %d", MT32EMU_SYSEXMEMADDR(addr), len);
 			break;
 		}
-		writeMemoryRegion(region, addr, region->getClampedLen(addr, len), sysex);
+		writeMemoryRegion(region, addr, region->getClampedLen(addr, len), data);
 
 		Bit32u next = region->next(addr, len);
 		if (next == 0) {
 			break;
 		}
 		addr += next;
-		sysex += next;
+		data += next;
 		len -= next;
 	}
 }
 
+void Synth::beginBulkWrite() {
+	memset(&bulkWriteRefreshes, 0, sizeof(bulkWriteRefreshes));
+	bulkWriteActive = true;
+}
+
+void Synth::commitBulkWrite() {
+	if (!bulkWriteActive) {
+		return;
+	}
+	ProfilingTimer timer(profilingEnabled, renderStats.eventTime);
+	bulkWriteActive = false;
+	if (bulkWriteRefreshes.system != 0) {
+		report(ReportType_devReconfig, NULL);
+		refreshSystem(bulkWriteRefreshes.system);
+	}
+	for (unsigned int i = 0; i < 256; i++) {
+		if (bulkWriteRefreshes.timbres[i]) {
+			refreshTimbre(i);
+		}
+	}
+	for (unsigned int i = 0; i < 9; i++) {
+		if (bulkWriteRefreshes.parts[i]) {
+			refreshPart(i);
+		}
+	}
+}
+
+void Synth::refreshPart(unsigned int partNum) {
+	if (parts[partNum] == NULL) {
+		return;
+	}
+	if (bulkWriteActive) {
+		bulkWriteRefreshes.parts[partNum] = true;
+	} else {
+		parts[partNum]->refresh();
+	}
+}
+
+void Synth::refreshTimbre(unsigned int absTimbreNum) {
+	if (bulkWriteActive) {
+		bulkWriteRefreshes.timbres[absTimbreNum] = true;
+		return;
+	}
+	// FIXME:KG: Not sure if the stuff below should be done (for rhythm and/or parts)...
+	// Does the real MT-32 automatically do this?
+	for (unsigned int part = 0; part < 9; part++) {
+		if (parts[part] != NULL) {
+			parts[part]->refreshTimbre(absTimbreNum);
+		}
+	}
+}
+
 void Synth::readMemory(Bit32u addr, Bit32u len, Bit8u *data) {
 	const MemoryRegion *region = findMemoryRegion(addr);
 	if (region != NULL) {
@@ -917,11 +1275,111 @@ void Synth::readMemory(Bit32u addr, Bit32u len, Bit8u *data) {
 	}
 }
 
+bool Synth::initArena() {
+	size_t runFloatBufSize = Arena::alignSize(maxSamplesPerRun * sizeof(float));
+	size_t runBit16sBufSize = Arena::alignSize(maxSamplesPerRun * sizeof(Bit16s));
+	size_t prerenderBufSize = Arena::alignSize(maxPrerenderSamples * sizeof(Bit16s));
+	// Each partial comes with its TVA, TVP, TVF and sample buffer (which goes with the scratch buffers)
+	size_t partialSize = Arena::alignSize(sizeof(Partial)) + Arena::alignSize(sizeof(TVA)) + Arena::alignSize(sizeof(TVP)) + Arena::alignSize(sizeof(TVF)) + runFloatBufSize;
+
+	// Room for the reverb at any rate reconfigure() can switch to
+	Bit32u reverbBufferSize = getReverbBufferSize(maxSampleRate);
+
+	// Six float and six Bit16s buffers per run and six prerender buffers
+	arenaFootprint.sampleBuffers = 6 * runFloatBufSize + 6 * runBit16sBufSize + 6 * prerenderBufSize;
+	if (myProp.renderThreads > 1) {
+		arenaFootprint.sampleBuffers += 2 * MT32EMU_MAX_PARTIALS * runFloatBufSize;
+	}
+	if (myProp.pipelineReverb) {
+		// Four float buffers for each of the two runs in flight, plus the six delay lines
+		arenaFootprint.sampleBuffers += 8 * runFloatBufSize + 6 * runBit16sBufSize;
+	}
+	arenaFootprint.reverb = Arena::alignSize(reverbBufferSize * sizeof(float));
+	arenaFootprint.partials = Arena::alignSize(sizeof(PartialManager)) + MT32EMU_MAX_PARTIALS * partialSize;
+	arenaFootprint.parts = 8 * Arena::alignSize(sizeof(Part)) + Arena::alignSize(sizeof(RhythmPart)) + 9 * Arena::alignSize(MT32EMU_MAX_POLY * sizeof(Poly));
+	arenaFootprint.memoryRegions = Arena::alignSize(sizeof(MemParams::PaddedTimbre))
+		+ Arena::alignSize(sizeof(PatchTempMemoryRegion))
+		+ Arena::alignSize(sizeof(RhythmTempMemoryRegion))
+		+ Arena::alignSize(sizeof(TimbreTempMemoryRegion))
+		+ Arena::alignSize(sizeof(PatchesMemoryRegion))
+		+ Arena::alignSize(sizeof(TimbresMemoryRegion))
+		+ Arena::alignSize(sizeof(SystemMemoryRegion))
+		+ Arena::alignSize(sizeof(DisplayMemoryRegion))
+		+ Arena::alignSize(sizeof(ResetMemoryRegion))
+		+ Arena::alignSize(controlROMMap->pcmCount * sizeof(PCMWaveEntry))
+		+ Arena::alignSize(MAX_STREAM_SYSEX_SIZE);
+	size_t arenaSize = arenaFootprint.sampleBuffers + arenaFootprint.reverb + arenaFootprint.partials + arenaFootprint.parts + arenaFootprint.memoryRegions;
+	if (!arena.open(arenaSize)) {
+		printDebug("Init Error - Unable to allocate %lu bytes for the instance arena", (unsigned long)arenaSize);
+		memset(&arenaFootprint, 0, sizeof(arenaFootprint));
+		return false;
+	}
+
+	// The state that isn't part of any object comes first
+	prerenderNonReverbLeft = arena.allocateArray<Bit16s>(maxPrerenderSamples);
+	prerenderNonReverbRight = arena.allocateArray<Bit16s>(maxPrerenderSamples);
+	prerenderReverbDryLeft = arena.allocateArray<Bit16s>(maxPrerenderSamples);
+	prerenderReverbDryRight = arena.allocateArray<Bit16s>(maxPrerenderSamples);
+	prerenderReverbWetLeft = arena.allocateArray<Bit16s>(maxPrerenderSamples);
+	prerenderReverbWetRight = arena.allocateArray<Bit16s>(maxPrerenderSamples);
+
+	if (myProp.pipelineReverb) {
+		for (int i = 0; i < 6; i++) {
+			reverbStageOutput[i] = arena.allocateArray<Bit16s>(maxSamplesPerRun);
+		}
+	}
+
+	reverbBuffer = arena.allocateArray<float>(reverbBufferSize);
+
+	// The remainder is taken by the objects as they're constructed in open(), followed by the scratch buffers
+	return true;
+}
+
+void Synth::initScratchBuffers() {
+	arenaStateSize = arena.getUsed();
+
+	tmpBufPartialLeft = arena.allocateArray<float>(maxSamplesPerRun);
+	tmpBufPartialRight = arena.allocateArray<float>(maxSamplesPerRun);
+	tmpBufMixLeft = arena.allocateArray<float>(maxSamplesPerRun);
+	tmpBufMixRight = arena.allocateArray<float>(maxSamplesPerRun);
+	tmpBufReverbOutLeft = arena.allocateArray<float>(maxSamplesPerRun);
+	tmpBufReverbOutRight = arena.allocateArray<float>(maxSamplesPerRun);
+
+	tmpNonReverbLeft = arena.allocateArray<Bit16s>(maxSamplesPerRun);
+	tmpNonReverbRight = arena.allocateArray<Bit16s>(maxSamplesPerRun);
+	tmpReverbDryLeft = arena.allocateArray<Bit16s>(maxSamplesPerRun);
+	tmpReverbDryRight = arena.allocateArray<Bit16s>(maxSamplesPerRun);
+	tmpReverbWetLeft = arena.allocateArray<Bit16s>(maxSamplesPerRun);
+	tmpReverbWetRight = arena.allocateArray<Bit16s>(maxSamplesPerRun);
+
+	for (int i = 0; i < MT32EMU_MAX_PARTIALS; i++) {
+		partialManager->getPartial(i)->setBuffer(arena.allocateArray<float>(maxSamplesPerRun));
+	}
+
+	if (myProp.renderThreads > 1) {
+		for (int i = 0; i < MT32EMU_MAX_PARTIALS; i++) {
+			partialOutputLeft[i] = arena.allocateArray<float>(maxSamplesPerRun);
+			partialOutputRight[i] = arena.allocateArray<float>(maxSamplesPerRun);
+		}
+	}
+
+	if (myProp.pipelineReverb) {
+		for (int i = 0; i < 2; i++) {
+			reverbStageRuns[i].nonReverbLeft = arena.allocateArray<float>(maxSamplesPerRun);
+			reverbStageRuns[i].nonReverbRight = arena.allocateArray<float>(maxSamplesPerRun);
+			reverbStageRuns[i].reverbDryLeft = arena.allocateArray<float>(maxSamplesPerRun);
+			reverbStageRuns[i].reverbDryRight = arena.allocateArray<float>(maxSamplesPerRun);
+		}
+	}
+
+	streamSysex = arena.allocateArray<Bit8u>(MAX_STREAM_SYSEX_SIZE);
+}
+
 void Synth::initMemoryRegions() {
 	// Timbre max tables are slightly more complicated than the others, which are used directly from the ROM.
 	// The ROM (sensibly) just has maximums for TimbreParam.commonParam followed by just one TimbreParam.partialParam,
 	// so we produce a table with all partialParams filled out, as well as padding for PaddedTimbre, for quick lookup.
-	paddedTimbreMaxTable = new Bit8u[sizeof(MemParams::PaddedTimbre)];
+	paddedTimbreMaxTable = arena.allocateArray<Bit8u>(sizeof(MemParams::PaddedTimbre));
 	memcpy(&paddedTimbreMaxTable[0], &controlROMData[controlROMMap->timbreMaxTable], sizeof(TimbreParam::CommonParam) + sizeof(TimbreParam::PartialParam)); // commonParam and one partialParam
 	int pos = sizeof(TimbreParam::CommonParam) + sizeof(TimbreParam::PartialParam);
 	for (int i = 0; i < 3; i++) {
@@ -929,35 +1387,27 @@ void Synth::initMemoryRegions() {
 		pos += sizeof(TimbreParam::PartialParam);
 	}
 	memset(&paddedTimbreMaxTable[pos], 0, 10); // Padding
-	patchTempMemoryRegion = new PatchTempMemoryRegion(this, (Bit8u *)&mt32ram.patchTemp[0], &controlROMData[controlROMMap->patchMaxTable]);
-	rhythmTempMemoryRegion = new RhythmTempMemoryRegion(this, (Bit8u *)&mt32ram.rhythmTemp[0], &controlROMData[controlROMMap->rhythmMaxTable]);
-	timbreTempMemoryRegion = new TimbreTempMemoryRegion(this, (Bit8u *)&mt32ram.timbreTemp[0], paddedTimbreMaxTable);
-	patchesMemoryRegion = new PatchesMemoryRegion(this, (Bit8u *)&mt32ram.patches[0], &controlROMData[controlROMMap->patchMaxTable]);
-	timbresMemoryRegion = new TimbresMemoryRegion(this, (Bit8u *)&mt32ram.timbres[0], paddedTimbreMaxTable);
-	systemMemoryRegion = new SystemMemoryRegion(this, (Bit8u *)&mt32ram.system, &controlROMData[controlROMMap->systemMaxTable]);
-	displayMemoryRegion = new DisplayMemoryRegion(this);
-	resetMemoryRegion = new ResetMemoryRegion(this);
+	patchTempMemoryRegion = new (arena.allocate(sizeof(PatchTempMemoryRegion))) PatchTempMemoryRegion(this, (Bit8u *)&mt32ram.patchTemp[0], &controlROMData[controlROMMap->patchMaxTable]);
+	rhythmTempMemoryRegion = new (arena.allocate(sizeof(RhythmTempMemoryRegion))) RhythmTempMemoryRegion(this, (Bit8u *)&mt32ram.rhythmTemp[0], &controlROMData[controlROMMap->rhythmMaxTable]);
+	timbreTempMemoryRegion = new (arena.allocate(sizeof(TimbreTempMemoryRegion))) TimbreTempMemoryRegion(this, (Bit8u *)&mt32ram.timbreTemp[0], paddedTimbreMaxTable);
+	patchesMemoryRegion = new (arena.allocate(sizeof(PatchesMemoryRegion))) PatchesMemoryRegion(this, (Bit8u *)&mt32ram.patches[0], &controlROMData[controlROMMap->patchMaxTable]);
+	timbresMemoryRegion = new (arena.allocate(sizeof(TimbresMemoryRegion))) TimbresMemoryRegion(this, (Bit8u *)&mt32ram.timbres[0], paddedTimbreMaxTable);
+	systemMemoryRegion = new (arena.allocate(sizeof(SystemMemoryRegion))) SystemMemoryRegion(this, (Bit8u *)&mt32ram.system, &controlROMData[controlROMMap->systemMaxTable]);
+	displayMemoryRegion = new (arena.allocate(sizeof(DisplayMemoryRegion))) DisplayMemoryRegion(this);
+	resetMemoryRegion = new (arena.allocate(sizeof(ResetMemoryRegion))) ResetMemoryRegion(this);
 }
 
 void Synth::deleteMemoryRegions() {
-	delete patchTempMemoryRegion;
+	// The regions and the max table live in the arena, and the regions have trivial destructors
 	patchTempMemoryRegion = NULL;
-	delete rhythmTempMemoryRegion;
 	rhythmTempMemoryRegion = NULL;
-	delete timbreTempMemoryRegion;
 	timbreTempMemoryRegion = NULL;
-	delete patchesMemoryRegion;
 	patchesMemoryRegion = NULL;
-	delete timbresMemoryRegion;
 	timbresMemoryRegion = NULL;
-	delete systemMemoryRegion;
 	systemMemoryRegion = NULL;
-	delete displayMemoryRegion;
 	displayMemoryRegion = NULL;
-	delete resetMemoryRegion;
 	resetMemoryRegion = NULL;
 
-	delete[] paddedTimbreMaxTable;
 	paddedTimbreMaxTable = NULL;
 }
 
@@ -1006,6 +1456,7 @@ void Synth::writeMemoryRegion(const MemoryRegion *region, Bit32u addr, Bit32u le
 	unsigned int first = region->firstTouched(addr);
 	unsigned int last = region->lastTouched(addr, len);
 	unsigned int off = region->firstTouchedOffset(addr);
+	trace.record(TraceEvent_sysexWrite, renderedSampleCount, TRACE_NO_PART, len > 0xFFFF ? 0xFFFF : (Bit16u)len, MT32EMU_SYSEXMEMADDR(addr));
 	switch (region->type) {
 	case MR_PatchTemp:
 		region->write(first, off, data, len);
@@ -1028,10 +1479,10 @@ void Synth::writeMemoryRegion(const MemoryRegion *region, Bit32u addr, Bit32u le
 						printDebug(" (Not updating timbre, since those values weren't touched)");
 #endif
 					} else {
-						parts[i]->setTimbre(&mt32ram.timbres[parts[i]->getAbsTimbreNum()].timbre);
+						parts[i]->setTimbreFromPatch();
 					}
 				}
-				parts[i]->refresh();
+				refreshPart(i);
 			}
 		}
 		break;
@@ -1050,9 +1501,7 @@ void Synth::writeMemoryRegion(const MemoryRegion *region, Bit32u addr, Bit32u le
 			printDebug("WRITE-RHYTHM (%d-%d@%d..%d): %d; level=%02x, panpot=%02x, reverb=%02x, timbre=%d (%s)", first, last, off, off + len, i, mt32ram.rhythmTemp[i].outputLevel, mt32ram.rhythmTemp[i].panpot, mt32ram.rhythmTemp[i].reverbSwitch, mt32ram.rhythmTemp[i].timbre, timbreName);
 #endif
 		}
-		if (parts[8] != NULL) {
-			parts[8]->refresh();
-		}
+		refreshPart(8);
 		break;
 	case MR_TimbreTemp:
 		region->write(first, off, data, len);
@@ -1064,8 +1513,9 @@ void Synth::writeMemoryRegion(const MemoryRegion *region, Bit32u addr, Bit32u le
 			printDebug("WRITE-PARTTIMBRE (%d-%d@%d..%d): timbre=%d (%s)", first, last, off, off + len, i, instrumentName);
 #endif
 			if (parts[i] != NULL) {
-				parts[i]->refresh();
+				parts[i]->timbreTempWritten();
 			}
+			refreshPart(i);
 		}
 		break;
 	case MR_Patches:
@@ -1169,19 +1619,12 @@ void Synth::writeMemoryRegion(const MemoryRegion *region, Bit32u addr, Bit32u le
 #undef DT
 #endif
 #endif
-			// FIXME:KG: Not sure if the stuff below should be done (for rhythm and/or parts)...
-			// Does the real MT-32 automatically do this?
-			for (unsigned int part = 0; part < 9; part++) {
-				if (parts[part] != NULL) {
-					parts[part]->refreshTimbre(i);
-				}
-			}
+			refreshTimbre(i);
 		}
 		break;
-	case MR_System:
+	case MR_System: {
 		region->write(0, off, data, len);
 
-		report(ReportType_devReconfig, NULL);
 		// FIXME: We haven't properly confirmed any of this behaviour
 		// In particular, we tend to reset things such as reverb even if the write contained
 		// the same parameters as were already set, which may be wrong.
@@ -1190,22 +1633,34 @@ void Synth::writeMemoryRegion(const MemoryRegion *region, Bit32u addr, Bit32u le
 #if MT32EMU_MONITOR_SYSEX > 0
 		printDebug("WRITE-SYSTEM:");
 #endif
+		unsigned int systemRefreshes = 0;
 		if (off <= SYSTEM_MASTER_TUNE_OFF && off + len > SYSTEM_MASTER_TUNE_OFF) {
-			refreshSystemMasterTune();
+			systemRefreshes |= SystemRefresh_masterTune;
 		}
 		if (off <= SYSTEM_REVERB_LEVEL_OFF && off + len > SYSTEM_REVERB_MODE_OFF) {
-			refreshSystemReverbParameters();
+			systemRefreshes |= SystemRefresh_reverbParameters;
 		}
 		if (off <= SYSTEM_RESERVE_SETTINGS_END_OFF && off + len > SYSTEM_RESERVE_SETTINGS_START_OFF) {
-			refreshSystemReserveSettings();
+			systemRefreshes |= SystemRefresh_reserveSettings;
 		}
 		if (off <= SYSTEM_CHAN_ASSIGN_END_OFF && off + len > SYSTEM_CHAN_ASSIGN_START_OFF) {
-			refreshSystemChanAssign();
+			systemRefreshes |= SystemRefresh_chanAssign;
 		}
 		if (off <= SYSTEM_MASTER_VOL_OFF && off + len > SYSTEM_MASTER_VOL_OFF) {
-			refreshSystemMasterVol();
+			systemRefreshes |= SystemRefresh_masterVol;
+		}
+		if (bulkWriteActive) {
+			// Channel-specific sysex later in the bulk write is addressed according to the channel assignments
+			if (systemRefreshes & SystemRefresh_chanAssign) {
+				refreshSystemChanAssign();
+			}
+			bulkWriteRefreshes.system |= systemRefreshes;
+		} else {
+			report(ReportType_devReconfig, NULL);
+			refreshSystem(systemRefreshes);
 		}
 		break;
+	}
 	case MR_Display:
 		char buf[MAX_SYSEX_SIZE];
 		memcpy(&buf, &data[0], len);
@@ -1216,7 +1671,7 @@ void Synth::writeMemoryRegion(const MemoryRegion *region, Bit32u addr, Bit32u le
 		report(ReportType_lcdMessage, buf);
 		break;
 	case MR_Reset:
-		reset();
+		resetDevice();
 		break;
 	}
 }
@@ -1231,6 +1686,32 @@ void Synth::refreshSystemMasterTune() {
 #endif
 }
 
+Bit32u Synth::getReverbBufferSize(unsigned int sampleRate) const {
+	Bit32u reverbBufferSize = 0;
+	for (int i = 0; i < 4; i++) {
+		Bit32u modelBufferSize = reverbModels[i]->getBufferSize(sampleRate);
+#if MT32EMU_REDUCE_REVERB_MEMORY
+		if (reverbBufferSize < modelBufferSize) {
+			reverbBufferSize = modelBufferSize;
+		}
+#else
+		reverbBufferSize += modelBufferSize;
+#endif
+	}
+	return reverbBufferSize;
+}
+
+void Synth::openReverbModel(Bit8u mode) {
+	float *buffer = reverbBuffer;
+#if !MT32EMU_REDUCE_REVERB_MEMORY
+	for (Bit8u i = 0; i < mode; i++) {
+		buffer += reverbModels[i]->getBufferSize(myProp.sampleRate);
+	}
+#endif
+	// Just hands out memory from the pool allocated in initArena(), so this is safe to do while rendering
+	reverbModels[mode]->open(myProp.sampleRate, buffer);
+}
+
 void Synth::refreshSystemReverbParameters() {
 #if MT32EMU_MONITOR_SYSEX > 0
 	printDebug(" Reverb: mode=%d, time=%d, level=%d", mt32ram.system.reverbMode, mt32ram.system.reverbTime, mt32ram.system.reverbLevel);
@@ -1246,12 +1727,14 @@ void Synth::refreshSystemReverbParameters() {
 	report(ReportType_newReverbLevel, &mt32ram.system.reverbLevel);
 
 	ReverbModel *newReverbModel = reverbModels[mt32ram.system.reverbMode];
+	// The reverb stage may still be running the old settings on the previous run
+	waitForReverbStage();
 #if MT32EMU_REDUCE_REVERB_MEMORY
 	if (reverbModel != newReverbModel) {
 		if (reverbModel != NULL) {
 			reverbModel->close();
 		}
-		newReverbModel->open(myProp.sampleRate);
+		openReverbModel(mt32ram.system.reverbMode);
 	}
 #endif
 	reverbModel = newReverbModel;
@@ -1299,7 +1782,26 @@ void Synth::refreshSystem() {
 	refreshSystemMasterVol();
 }
 
-void Synth::reset() {
+void Synth::refreshSystem(unsigned int systemRefreshes) {
+	if (systemRefreshes & SystemRefresh_masterTune) {
+		refreshSystemMasterTune();
+	}
+	if (systemRefreshes & SystemRefresh_reverbParameters) {
+		refreshSystemReverbParameters();
+	}
+	if (systemRefreshes & SystemRefresh_reserveSettings) {
+		refreshSystemReserveSettings();
+	}
+	if (systemRefreshes & SystemRefresh_chanAssign) {
+		refreshSystemChanAssign();
+	}
+	if (systemRefreshes & SystemRefresh_masterVol) {
+		refreshSystemMasterVol();
+	}
+}
+
+// What the MT-32 does when it receives a reset sysex
+void Synth::resetDevice() {
 #if MT32EMU_MONITOR_SYSEX > 0
 	printDebug("RESET");
 #endif
@@ -1324,7 +1826,7 @@ void Synth::render(Bit16s *stream, Bit32u len) {
 		return;
 	}
 	while (len > 0) {
-		Bit32u thisLen = len > MAX_SAMPLES_PER_RUN ? MAX_SAMPLES_PER_RUN : len;
+		Bit32u thisLen = len > maxSamplesPerRun ? maxSamplesPerRun : len;
 		renderStreams(tmpNonReverbLeft, tmpNonReverbRight, tmpReverbDryLeft, tmpReverbDryRight, tmpReverbWetLeft, tmpReverbWetRight, thisLen);
 		for (Bit32u i = 0; i < thisLen; i++) {
 			stream[0] = clipBit16s((Bit32s)tmpNonReverbLeft[i] + (Bit32s)tmpReverbDryLeft[i] + (Bit32s)tmpReverbWetLeft[i]);
@@ -1335,8 +1837,25 @@ void Synth::render(Bit16s *stream, Bit32u len) {
 	}
 }
 
+void Synth::render(float *stream, Bit32u len) {
+	if (!isEnabled) {
+		memset(stream, 0, len * sizeof(float) * 2);
+		return;
+	}
+	while (len > 0) {
+		Bit32u thisLen = len > maxSamplesPerRun ? maxSamplesPerRun : len;
+		renderStreams(tmpNonReverbLeft, tmpNonReverbRight, tmpReverbDryLeft, tmpReverbDryRight, tmpReverbWetLeft, tmpReverbWetRight, thisLen);
+		for (Bit32u i = 0; i < thisLen; i++) {
+			stream[0] = ((Bit32s)tmpNonReverbLeft[i] + (Bit32s)tmpReverbDryLeft[i] + (Bit32s)tmpReverbWetLeft[i]) / 32768.0f;
+			stream[1] = ((Bit32s)tmpNonReverbRight[i] + (Bit32s)tmpReverbDryRight[i] + (Bit32s)tmpReverbWetRight[i]) / 32768.0f;
+			stream += 2;
+		}
+		len -= thisLen;
+	}
+}
+
 bool Synth::prerender() {
-	int newPrerenderWriteIx = (prerenderWriteIx + 1) % MAX_PRERENDER_SAMPLES;
+	int newPrerenderWriteIx = (prerenderWriteIx + 1) % maxPrerenderSamples;
 	if (newPrerenderWriteIx == prerenderReadIx) {
 		// The prerender buffer is full
 		return false;
@@ -1372,14 +1891,14 @@ void Synth::copyPrerender(Bit16s *nonReverbLeft, Bit16s *nonReverbRight, Bit16s
 void Synth::checkPrerender(Bit16s *nonReverbLeft, Bit16s *nonReverbRight, Bit16s *reverbDryLeft, Bit16s *reverbDryRight, Bit16s *reverbWetLeft, Bit16s *reverbWetRight, Bit32u &pos, Bit32u &len) {
 	if (prerenderReadIx > prerenderWriteIx) {
 		// There's data in the prerender buffer, and the write index has wrapped.
-		Bit32u prerenderCopyLen = MAX_PRERENDER_SAMPLES - prerenderReadIx;
+		Bit32u prerenderCopyLen = maxPrerenderSamples - prerenderReadIx;
 		if (prerenderCopyLen > len) {
 			prerenderCopyLen = len;
 		}
 		copyPrerender(nonReverbLeft, nonReverbRight, reverbDryLeft, reverbDryRight, reverbWetLeft, reverbWetRight, pos, prerenderCopyLen);
 		len -= prerenderCopyLen;
 		pos += prerenderCopyLen;
-		prerenderReadIx = (prerenderReadIx + prerenderCopyLen) % MAX_PRERENDER_SAMPLES;
+		prerenderReadIx = (prerenderReadIx + prerenderCopyLen) % maxPrerenderSamples;
 	}
 	if (prerenderReadIx < prerenderWriteIx) {
 		// There's data in the prerender buffer, and the write index is ahead of the read index.
@@ -1416,7 +1935,7 @@ void Synth::renderStreams(Bit16s *nonReverbLeft, Bit16s *nonReverbRight, Bit16s
 	checkPrerender(nonReverbLeft, nonReverbRight, reverbDryLeft, reverbDryRight, reverbWetLeft, reverbWetRight, pos, len);
 
 	while (len > 0) {
-		Bit32u thisLen = len > MAX_SAMPLES_PER_RUN ? MAX_SAMPLES_PER_RUN : len;
+		Bit32u thisLen = len > maxSamplesPerRun ? maxSamplesPerRun : len;
 		doRenderStreams(
 			streamOffset(nonReverbLeft, pos),
 			streamOffset(nonReverbRight, pos),
@@ -1430,69 +1949,437 @@ void Synth::renderStreams(Bit16s *nonReverbLeft, Bit16s *nonReverbRight, Bit16s
 	}
 }
 
-// FIXME: Using more temporary buffers than we need to
-void Synth::doRenderStreams(Bit16s *nonReverbLeft, Bit16s *nonReverbRight, Bit16s *reverbDryLeft, Bit16s *reverbDryRight, Bit16s *reverbWetLeft, Bit16s *reverbWetRight, Bit32u len) {
-	clearFloats(&tmpBufMixLeft[0], &tmpBufMixRight[0], len);
-	if (!reverbEnabled) {
+void Synth::renderPartialTask(void *context, unsigned int taskIx) {
+	Synth *synth = (Synth *)context;
+	unsigned int partialNum = synth->renderPartialNums[taskIx];
+	synth->partialOutputProduced[partialNum] = synth->partialManager->produceOutput(partialNum, synth->partialOutputLeft[partialNum], synth->partialOutputRight[partialNum], synth->renderPartialLen);
+}
+
+// Renders the selected partials and mixes them into mixLeft/Right
+void Synth::mixPartials(PartialSelection selection, float *mixLeft, float *mixRight, Bit32u len) {
+	if (workerPool.getWorkerCount() == 0) {
+		// The partials' trace records are staged here as well, so that they come out in the same order as with workers
+		// (a ring modulation slave makes its records while its master is rendered)
+		trace.setStagePartialRecords(true);
 		for (unsigned int i = 0; i < MT32EMU_MAX_PARTIALS; i++) {
+			if (selection != PartialSelection_all && partialManager->shouldReverb(i) != (selection == PartialSelection_reverb)) {
+				continue;
+			}
 			if (partialManager->produceOutput(i, &tmpBufPartialLeft[0], &tmpBufPartialRight[0], len)) {
-				mix(&tmpBufMixLeft[0], &tmpBufPartialLeft[0], len);
-				mix(&tmpBufMixRight[0], &tmpBufPartialRight[0], len);
+				mix(mixLeft, &tmpBufPartialLeft[0], len);
+				mix(mixRight, &tmpBufPartialRight[0], len);
 			}
 		}
-		if (nonReverbLeft != NULL) {
-			la32FloatToBit16sFunc(nonReverbLeft, &tmpBufMixLeft[0], len, outputGain);
+		trace.setStagePartialRecords(false);
+		trace.flushPartialRecords();
+		return;
+	}
+
+	// Decide up front which partials need rendering (ring modulation slaves are rendered by their masters),
+	// so that the tasks never look at partials being rendered by another thread
+	unsigned int renderPartialCount = 0;
+	for (unsigned int i = 0; i < MT32EMU_MAX_PARTIALS; i++) {
+		if (selection != PartialSelection_all && partialManager->shouldReverb(i) != (selection == PartialSelection_reverb)) {
+			continue;
 		}
-		if (nonReverbRight != NULL) {
-			la32FloatToBit16sFunc(nonReverbRight, &tmpBufMixRight[0], len, outputGain);
+		if (partialManager->canProduceOutput(i)) {
+			renderPartialNums[renderPartialCount++] = i;
 		}
-		clearIfNonNull(reverbDryLeft, len);
-		clearIfNonNull(reverbDryRight, len);
-		clearIfNonNull(reverbWetLeft, len);
-		clearIfNonNull(reverbWetRight, len);
-	} else {
-		for (unsigned int i = 0; i < MT32EMU_MAX_PARTIALS; i++) {
-			if (!partialManager->shouldReverb(i)) {
-				if (partialManager->produceOutput(i, &tmpBufPartialLeft[0], &tmpBufPartialRight[0], len)) {
-					mix(&tmpBufMixLeft[0], &tmpBufPartialLeft[0], len);
-					mix(&tmpBufMixRight[0], &tmpBufPartialRight[0], len);
-				}
-			}
+	}
+	renderPartialLen = len;
+	deferPartialDeactivation = true;
+	trace.setStagePartialRecords(true);
+	workerPool.run(renderPartialTask, this, renderPartialCount);
+	trace.setStagePartialRecords(false);
+	deferPartialDeactivation = false;
+	trace.flushPartialRecords();
+	partialManager->notifyDeactivations();
+
+	// Mixing in partial order keeps the result identical to the single-threaded path
+	for (unsigned int i = 0; i < renderPartialCount; i++) {
+		unsigned int partialNum = renderPartialNums[i];
+		if (partialOutputProduced[partialNum]) {
+			mix(mixLeft, partialOutputLeft[partialNum], len);
+			mix(mixRight, partialOutputRight[partialNum], len);
 		}
-		if (nonReverbLeft != NULL) {
-			la32FloatToBit16sFunc(nonReverbLeft, &tmpBufMixLeft[0], len, outputGain);
+	}
+}
+
+// Same as mixPartials(), but only advances the partials (see Partial::chase())
+void Synth::chasePartials(PartialSelection selection, Bit32u len) {
+	for (unsigned int i = 0; i < MT32EMU_MAX_PARTIALS; i++) {
+		if (selection != PartialSelection_all && partialManager->shouldReverb(i) != (selection == PartialSelection_reverb)) {
+			continue;
+		}
+		partialManager->chase(i, len);
+	}
+}
+
+void Synth::chase(Bit32u len) {
+	if (!isEnabled) {
+		return;
+	}
+	bool reverbMuted = chaseMutedReverbModel != NULL && chaseMutedReverbModel == reverbModel && chaseEndSampleCount == renderedSampleCount;
+
+	// Samples waiting in the prerender buffer have already been rendered, so they're simply dropped
+	Bit32u pos = 0;
+	checkPrerender(NULL, NULL, NULL, NULL, NULL, NULL, pos, len);
+
+	// Same runs and partial order as doRenderStreams(), so that partials end and get reused at the same points
+	while (len > 0) {
+		Bit32u thisLen = len > maxSamplesPerRun ? maxSamplesPerRun : len;
+		if (!reverbEnabled) {
+			chasePartials(PartialSelection_all, thisLen);
+		} else {
+			chasePartials(PartialSelection_nonReverb, thisLen);
+			chasePartials(PartialSelection_reverb, thisLen);
+		}
+		partialManager->clearAlreadyOutputed();
+		renderedSampleCount += thisLen;
+		len -= thisLen;
+	}
+
+	if (!reverbMuted) {
+		muteReverb();
+	}
+	chaseMutedReverbModel = reverbModel;
+	chaseEndSampleCount = renderedSampleCount;
+}
+
+// Plays the events due by the given frame (starting from playedCount), and returns the number of frames until the next one
+// is due, up to maxLen.
+Bit32u Synth::playDueEvents(Bit32u frame, Bit32u maxLen, const MidiEvent *events, Bit32u eventCount, Bit32u &playedCount) {
+	while (playedCount < eventCount) {
+		const MidiEvent &event = events[playedCount];
+		// Allows for the host's clock wrapping around
+		Bit32s framesUntilDue = (Bit32s)(event.frame - frame);
+		if (framesUntilDue > 0) {
+			return (Bit32u)framesUntilDue < maxLen ? (Bit32u)framesUntilDue : maxLen;
+		}
+		if (event.sysex != NULL) {
+			playSysex(event.sysex, event.sysexLen);
+		} else {
+			playMsg(event.msg);
+		}
+		playedCount++;
+	}
+	return maxLen;
+}
+
+Bit32u Synth::renderWithEvents(Bit16s *stream, Bit32u len, Bit32u startFrame, const MidiEvent *events, Bit32u eventCount) {
+	Bit32u playedCount = 0;
+	Bit32u pos = 0;
+	for (;;) {
+		Bit32u thisLen = playDueEvents(startFrame + pos, len - pos, events, eventCount, playedCount);
+		if (thisLen == 0) {
+			return playedCount;
+		}
+		render(stream + pos * 2, thisLen);
+		pos += thisLen;
+	}
+}
+
+Bit32u Synth::renderWithEvents(float *stream, Bit32u len, Bit32u startFrame, const MidiEvent *events, Bit32u eventCount) {
+	Bit32u playedCount = 0;
+	Bit32u pos = 0;
+	for (;;) {
+		Bit32u thisLen = playDueEvents(startFrame + pos, len - pos, events, eventCount, playedCount);
+		if (thisLen == 0) {
+			return playedCount;
+		}
+		render(stream + pos * 2, thisLen);
+		pos += thisLen;
+	}
+}
+
+Bit32u Synth::renderStreamsWithEvents(Bit16s *nonReverbLeft, Bit16s *nonReverbRight, Bit16s *reverbDryLeft, Bit16s *reverbDryRight, Bit16s *reverbWetLeft, Bit16s *reverbWetRight, Bit32u len, Bit32u startFrame, const MidiEvent *events, Bit32u eventCount) {
+	Bit32u playedCount = 0;
+	Bit32u pos = 0;
+	for (;;) {
+		Bit32u thisLen = playDueEvents(startFrame + pos, len - pos, events, eventCount, playedCount);
+		if (thisLen == 0) {
+			return playedCount;
+		}
+		renderStreams(
+			streamOffset(nonReverbLeft, pos),
+			streamOffset(nonReverbRight, pos),
+			streamOffset(reverbDryLeft, pos),
+			streamOffset(reverbDryRight, pos),
+			streamOffset(reverbWetLeft, pos),
+			streamOffset(reverbWetRight, pos),
+			thisLen);
+		pos += thisLen;
+	}
+}
+
+Bit32u Synth::chaseWithEvents(Bit32u len, Bit32u startFrame, const MidiEvent *events, Bit32u eventCount) {
+	Bit32u playedCount = 0;
+	Bit32u pos = 0;
+	for (;;) {
+		Bit32u thisLen = playDueEvents(startFrame + pos, len - pos, events, eventCount, playedCount);
+		if (thisLen == 0) {
+			return playedCount;
+		}
+		chase(thisLen);
+		pos += thisLen;
+	}
+}
+
+// Silences the reverb, along with any output delayed by the reverb stage
+void Synth::muteReverb() {
+	if (reverbStageEnabled) {
+		waitForReverbStage();
+		for (int i = 0; i < 6; i++) {
+			memset(reverbStageOutput[i], 0, maxSamplesPerRun * sizeof(Bit16s));
 		}
-		if (nonReverbRight != NULL) {
-			la32FloatToBit16sFunc(nonReverbRight, &tmpBufMixRight[0], len, outputGain);
+		reverbStageIdleFrames = maxSamplesPerRun;
+	}
+	// Opening a model again mutes it, keeping its parameters
+#if MT32EMU_REDUCE_REVERB_MEMORY
+	int reverbModelIx = getReverbModelIx();
+	if (reverbModelIx >= 0) {
+		openReverbModel(reverbModelIx);
+	}
+#else
+	for (Bit8u i = 0; i < 4; i++) {
+		openReverbModel(i);
+	}
+#endif
+}
+
+// FIXME: Using more temporary buffers than we need to
+void Synth::doRenderStreams(Bit16s *nonReverbLeft, Bit16s *nonReverbRight, Bit16s *reverbDryLeft, Bit16s *reverbDryRight, Bit16s *reverbWetLeft, Bit16s *reverbWetRight, Bit32u len) {
+	trace.record(TraceEvent_renderStart, renderedSampleCount, TRACE_NO_PART, 0, len);
+	ProfilingTimer timer(profilingEnabled, renderStats.renderTime);
+	if (profilingEnabled) {
+		renderStats.runCount++;
+		renderStats.sampleCount += len;
+	}
+	if (reverbStageEnabled) {
+		renderPipelined(nonReverbLeft, nonReverbRight, reverbDryLeft, reverbDryRight, reverbWetLeft, reverbWetRight, len);
+		return;
+	}
+	clearFloats(&tmpBufMixLeft[0], &tmpBufMixRight[0], len);
+	if (!reverbEnabled) {
+		mixPartials(PartialSelection_all, &tmpBufMixLeft[0], &tmpBufMixRight[0], len);
+		{
+			ProfilingTimer dacTimer(profilingEnabled, renderStats.dacTime);
+			if (nonReverbLeft != NULL) {
+				la32FloatToBit16sFunc(nonReverbLeft, &tmpBufMixLeft[0], len, outputGain);
+			}
+			if (nonReverbRight != NULL) {
+				la32FloatToBit16sFunc(nonReverbRight, &tmpBufMixRight[0], len, outputGain);
+			}
+		}
+		clearIfNonNull(reverbDryLeft, len);
+		clearIfNonNull(reverbDryRight, len);
+		clearIfNonNull(reverbWetLeft, len);
+		clearIfNonNull(reverbWetRight, len);
+	} else {
+		mixPartials(PartialSelection_nonReverb, &tmpBufMixLeft[0], &tmpBufMixRight[0], len);
+		{
+			ProfilingTimer dacTimer(profilingEnabled, renderStats.dacTime);
+			if (nonReverbLeft != NULL) {
+				la32FloatToBit16sFunc(nonReverbLeft, &tmpBufMixLeft[0], len, outputGain);
+			}
+			if (nonReverbRight != NULL) {
+				la32FloatToBit16sFunc(nonReverbRight, &tmpBufMixRight[0], len, outputGain);
+			}
 		}
 
 		clearFloats(&tmpBufMixLeft[0], &tmpBufMixRight[0], len);
-		for (unsigned int i = 0; i < MT32EMU_MAX_PARTIALS; i++) {
-			if (partialManager->shouldReverb(i)) {
-				if (partialManager->produceOutput(i, &tmpBufPartialLeft[0], &tmpBufPartialRight[0], len)) {
-					mix(&tmpBufMixLeft[0], &tmpBufPartialLeft[0], len);
-					mix(&tmpBufMixRight[0], &tmpBufPartialRight[0], len);
-				}
+		mixPartials(PartialSelection_reverb, &tmpBufMixLeft[0], &tmpBufMixRight[0], len);
+		{
+			ProfilingTimer dacTimer(profilingEnabled, renderStats.dacTime);
+			if (reverbDryLeft != NULL) {
+				la32FloatToBit16sFunc(reverbDryLeft, &tmpBufMixLeft[0], len, outputGain);
+			}
+			if (reverbDryRight != NULL) {
+				la32FloatToBit16sFunc(reverbDryRight, &tmpBufMixRight[0], len, outputGain);
 			}
 		}
-		if (reverbDryLeft != NULL) {
-			la32FloatToBit16sFunc(reverbDryLeft, &tmpBufMixLeft[0], len, outputGain);
+
+		{
+			ProfilingTimer reverbTimer(profilingEnabled, renderStats.reverbTime);
+			// FIXME: Note that on the real devices, reverb input and output are signed linear 16-bit (well, kinda, there's some fudging) PCM, not float.
+			reverbModel->process(&tmpBufMixLeft[0], &tmpBufMixRight[0], &tmpBufReverbOutLeft[0], &tmpBufReverbOutRight[0], len);
 		}
-		if (reverbDryRight != NULL) {
-			la32FloatToBit16sFunc(reverbDryRight, &tmpBufMixRight[0], len, outputGain);
+		{
+			ProfilingTimer dacTimer(profilingEnabled, renderStats.dacTime);
+			if (reverbWetLeft != NULL) {
+				reverbFloatToBit16sFunc(reverbWetLeft, &tmpBufReverbOutLeft[0], len, reverbOutputGain);
+			}
+			if (reverbWetRight != NULL) {
+				reverbFloatToBit16sFunc(reverbWetRight, &tmpBufReverbOutRight[0], len, reverbOutputGain);
+			}
 		}
+	}
+	partialManager->clearAlreadyOutputed();
+	renderedSampleCount += len;
+	trace.record(TraceEvent_renderEnd, renderedSampleCount, TRACE_NO_PART, 0, len);
+}
+
+static inline void takeFromDelayLine(Bit16s *target, const Bit16s *delayLine, Bit32u delayLen, Bit32u pos, Bit32u len) {
+	if (target == NULL) {
+		return;
+	}
+	Bit32u firstLen = delayLen - pos;
+	if (firstLen >= len) {
+		memcpy(target, delayLine + pos, len * sizeof(Bit16s));
+	} else {
+		memcpy(target, delayLine + pos, firstLen * sizeof(Bit16s));
+		memcpy(target + firstLen, delayLine, (len - firstLen) * sizeof(Bit16s));
+	}
+}
+
+static inline void convertIntoDelayLine(FloatToBit16sFunc convert, Bit16s *delayLine, Bit32u delayLen, Bit32u pos, const float *source, Bit32u len, float gain) {
+	Bit32u firstLen = delayLen - pos;
+	if (firstLen >= len) {
+		convert(delayLine + pos, source, len, gain);
+	} else {
+		convert(delayLine + pos, source, firstLen, gain);
+		convert(delayLine, source + firstLen, len - firstLen, gain);
+	}
+}
+
+static inline void clearDelayLine(Bit16s *delayLine, Bit32u delayLen, Bit32u pos, Bit32u len) {
+	Bit32u firstLen = delayLen - pos;
+	if (firstLen >= len) {
+		memset(delayLine + pos, 0, len * sizeof(Bit16s));
+	} else {
+		memset(delayLine + pos, 0, firstLen * sizeof(Bit16s));
+		memset(delayLine, 0, (len - firstLen) * sizeof(Bit16s));
+	}
+}
 
-		// FIXME: Note that on the real devices, reverb input and output are signed linear 16-bit (well, kinda, there's some fudging) PCM, not float.
-		reverbModel->process(&tmpBufMixLeft[0], &tmpBufMixRight[0], &tmpBufReverbOutLeft[0], &tmpBufReverbOutRight[0], len);
-		if (reverbWetLeft != NULL) {
-			reverbFloatToBit16sFunc(reverbWetLeft, &tmpBufReverbOutLeft[0], len, reverbOutputGain);
+static inline bool isDelayLineSilent(const Bit16s *delayLine, Bit32u delayLen, Bit32u pos, Bit32u len) {
+	for (Bit32u i = 0; i < len; i++) {
+		if (delayLine[pos] != 0) {
+			return false;
 		}
-		if (reverbWetRight != NULL) {
-			reverbFloatToBit16sFunc(reverbWetRight, &tmpBufReverbOutRight[0], len, reverbOutputGain);
+		if (++pos == delayLen) {
+			pos = 0;
 		}
 	}
+	return true;
+}
+
+// Same as the rest of doRenderStreams(), except that the reverb and output conversion are left to the reverb stage thread,
+// and the output returned is the one rendered maxSamplesPerRun frames earlier
+void Synth::renderPipelined(Bit16s *nonReverbLeft, Bit16s *nonReverbRight, Bit16s *reverbDryLeft, Bit16s *reverbDryRight, Bit16s *reverbWetLeft, Bit16s *reverbWetRight, Bit32u len) {
+	ReverbStageRun &run = reverbStageRuns[reverbStageRunIx];
+	// The stage may still be working on the other run, which is left alone
+	clearFloats(run.nonReverbLeft, run.nonReverbRight, len);
+	if (!reverbEnabled) {
+		mixPartials(PartialSelection_all, run.nonReverbLeft, run.nonReverbRight, len);
+		run.reverbModel = NULL;
+	} else {
+		mixPartials(PartialSelection_nonReverb, run.nonReverbLeft, run.nonReverbRight, len);
+		clearFloats(run.reverbDryLeft, run.reverbDryRight, len);
+		mixPartials(PartialSelection_reverb, run.reverbDryLeft, run.reverbDryRight, len);
+		run.reverbModel = reverbModel;
+	}
 	partialManager->clearAlreadyOutputed();
 	renderedSampleCount += len;
+
+	waitForReverbStage();
+	takeFromDelayLine(nonReverbLeft, reverbStageOutput[0], maxSamplesPerRun, reverbStageOutputPos, len);
+	takeFromDelayLine(nonReverbRight, reverbStageOutput[1], maxSamplesPerRun, reverbStageOutputPos, len);
+	takeFromDelayLine(reverbDryLeft, reverbStageOutput[2], maxSamplesPerRun, reverbStageOutputPos, len);
+	takeFromDelayLine(reverbDryRight, reverbStageOutput[3], maxSamplesPerRun, reverbStageOutputPos, len);
+	takeFromDelayLine(reverbWetLeft, reverbStageOutput[4], maxSamplesPerRun, reverbStageOutputPos, len);
+	takeFromDelayLine(reverbWetRight, reverbStageOutput[5], maxSamplesPerRun, reverbStageOutputPos, len);
+
+	run.pos = reverbStageOutputPos;
+	run.len = len;
+	run.la32FloatToBit16sFunc = la32FloatToBit16sFunc;
+	run.reverbFloatToBit16sFunc = reverbFloatToBit16sFunc;
+	run.outputGain = outputGain;
+	run.reverbOutputGain = reverbOutputGain;
+	run.profilingEnabled = profilingEnabled;
+	reverbStageOutputPos = (reverbStageOutputPos + len) % maxSamplesPerRun;
+	reverbStageCurrentRun = &run;
+	reverbStageBusy = true;
+	reverbStageStart.post();
+	reverbStageRunIx ^= 1;
+	trace.record(TraceEvent_renderEnd, renderedSampleCount, TRACE_NO_PART, 0, len);
+}
+
+void Synth::reverbStageMain(void *context) {
+	Synth *synth = (Synth *)context;
+	for (;;) {
+		synth->reverbStageStart.wait();
+		if (synth->reverbStageQuit) {
+			return;
+		}
+		synth->runReverbStage(*synth->reverbStageCurrentRun);
+		synth->reverbStageDone.post();
+	}
+}
+
+// Called on the reverb stage thread
+void Synth::runReverbStage(const ReverbStageRun &run) {
+	Bit16s **output = reverbStageOutput;
+	{
+		ProfilingTimer dacTimer(run.profilingEnabled, renderStats.dacTime);
+		convertIntoDelayLine(run.la32FloatToBit16sFunc, output[0], maxSamplesPerRun, run.pos, run.nonReverbLeft, run.len, run.outputGain);
+		convertIntoDelayLine(run.la32FloatToBit16sFunc, output[1], maxSamplesPerRun, run.pos, run.nonReverbRight, run.len, run.outputGain);
+	}
+	if (run.reverbModel == NULL) {
+		for (int i = 2; i < 6; i++) {
+			clearDelayLine(output[i], maxSamplesPerRun, run.pos, run.len);
+		}
+	} else {
+		{
+			ProfilingTimer dacTimer(run.profilingEnabled, renderStats.dacTime);
+			convertIntoDelayLine(run.la32FloatToBit16sFunc, output[2], maxSamplesPerRun, run.pos, run.reverbDryLeft, run.len, run.outputGain);
+			convertIntoDelayLine(run.la32FloatToBit16sFunc, output[3], maxSamplesPerRun, run.pos, run.reverbDryRight, run.len, run.outputGain);
+		}
+		{
+			ProfilingTimer reverbTimer(run.profilingEnabled, renderStats.reverbTime);
+			run.reverbModel->process(run.reverbDryLeft, run.reverbDryRight, &tmpBufReverbOutLeft[0], &tmpBufReverbOutRight[0], run.len);
+		}
+		ProfilingTimer dacTimer(run.profilingEnabled, renderStats.dacTime);
+		convertIntoDelayLine(run.reverbFloatToBit16sFunc, output[4], maxSamplesPerRun, run.pos, &tmpBufReverbOutLeft[0], run.len, run.reverbOutputGain);
+		convertIntoDelayLine(run.reverbFloatToBit16sFunc, output[5], maxSamplesPerRun, run.pos, &tmpBufReverbOutRight[0], run.len, run.reverbOutputGain);
+	}
+
+	bool audible = false;
+	for (int i = 0; i < 6 && !audible; i++) {
+		audible = !isDelayLineSilent(output[i], maxSamplesPerRun, run.pos, run.len);
+	}
+	reverbStageIdleFrames = audible ? 0 : reverbStageIdleFrames + run.len;
+}
+
+bool Synth::startReverbStage() {
+	for (int i = 0; i < 6; i++) {
+		memset(reverbStageOutput[i], 0, maxSamplesPerRun * sizeof(Bit16s));
+	}
+	reverbStageOutputPos = 0;
+	reverbStageIdleFrames = maxSamplesPerRun;
+	reverbStageRunIx = 0;
+	reverbStageBusy = false;
+	reverbStageQuit = false;
+	reverbStageEnabled = reverbStageThread.start(reverbStageMain, this);
+	return reverbStageEnabled;
+}
+
+void Synth::stopReverbStage() {
+	if (!reverbStageEnabled) {
+		return;
+	}
+	waitForReverbStage();
+	reverbStageQuit = true;
+	reverbStageStart.post();
+	reverbStageThread.join();
+	reverbStageEnabled = false;
+}
+
+void Synth::waitForReverbStage() const {
+	if (reverbStageBusy) {
+		reverbStageDone.wait();
+		reverbStageBusy = false;
+	}
 }
 
 void Synth::printPartialUsage(unsigned long sampleOffset) {
@@ -1523,6 +2410,13 @@ bool Synth::isActive() const {
 	if (hasActivePartials()) {
 		return true;
 	}
+	if (reverbStageEnabled) {
+		waitForReverbStage();
+		if (reverbStageIdleFrames < maxSamplesPerRun) {
+			// There's still something to be heard in the delay lines
+			return true;
+		}
+	}
 	if (reverbEnabled) {
 		return reverbModel->isActive();
 	}
@@ -1533,6 +2427,45 @@ const Partial *Synth::getPartial(unsigned int partialNum) const {
 	return partialManager->getPartial(partialNum);
 }
 
+bool Synth::startTrace(Bit32u capacity) {
+	return trace.open(capacity);
+}
+
+void Synth::stopTrace() {
+	trace.close();
+}
+
+Bit32u Synth::drainTrace(TraceRecord *records, Bit32u maxCount) {
+	return trace.drain(records, maxCount);
+}
+
+Bit32u Synth::getTraceDroppedCount() const {
+	return trace.getDroppedCount();
+}
+
+void Synth::setProfilingEnabled(bool enabled) {
+	profilingEnabled = enabled;
+}
+
+bool Synth::isProfilingEnabled() const {
+	return profilingEnabled;
+}
+
+RenderStats Synth::getRenderStats() const {
+	waitForReverbStage();
+	RenderStats stats = renderStats;
+	for (unsigned int i = 0; i < MT32EMU_MAX_PARTIALS; i++) {
+		stats.la32Time += partialLA32Times[i];
+	}
+	return stats;
+}
+
+void Synth::resetRenderStats() {
+	waitForReverbStage();
+	memset(&renderStats, 0, sizeof(renderStats));
+	memset(partialLA32Times, 0, sizeof(partialLA32Times));
+}
+
 const Part *Synth::getPart(unsigned int partNum) const {
 	if (partNum > 8) {
 		return NULL;
@@ -1540,6 +2473,568 @@ const Part *Synth::getPart(unsigned int partNum) const {
 	return parts[partNum];
 }
 
+ROMImage *Synth::getROMImage() const {
+	return romImage;
+}
+
+MemoryFootprint Synth::getMemoryFootprint() const {
+	MemoryFootprint footprint = arenaFootprint;
+	footprint.synth = sizeof(Synth);
+	footprint.pcmROM = isOpen ? pcmROMSize * sizeof(float) : 0;
+	footprint.total = footprint.synth + footprint.sampleBuffers + footprint.partials + footprint.parts + footprint.memoryRegions + footprint.pcmROM + footprint.reverb;
+	return footprint;
+}
+
+SynthCheckpoint::SynthCheckpoint() {
+	synth = NULL;
+	arenaCopy = NULL;
+	arenaCopySize = 0;
+	reverbStates = NULL;
+	memset(reverbStateOffsets, 0, sizeof(reverbStateOffsets));
+	reverbStatesSize = 0;
+	sampleRate = 0;
+	renderedSampleCount = 0;
+}
+
+SynthCheckpoint::~SynthCheckpoint() {
+	delete[] arenaCopy;
+	delete[] reverbStates;
+}
+
+bool SynthCheckpoint::isTakenFrom(const Synth *fromSynth) const {
+	return synth != NULL && synth == fromSynth;
+}
+
+Bit32u SynthCheckpoint::getRenderedSampleCount() const {
+	return renderedSampleCount;
+}
+
+size_t SynthCheckpoint::getSize() const {
+	return sizeof(SynthCheckpoint) + arenaCopySize + reverbStatesSize;
+}
+
+int Synth::getReverbModelIx() const {
+	for (int i = 0; i < 4; i++) {
+		if (reverbModel == reverbModels[i]) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+bool Synth::saveCheckpoint(SynthCheckpoint &checkpoint) {
+	if (!isOpen) {
+		return false;
+	}
+	// The reverb stage may still be working on the last run, whose output belongs to this state
+	waitForReverbStage();
+
+	// Only the emulation state is copied, not the scratch buffers that follow it
+	if (checkpoint.arenaCopySize != arenaStateSize) {
+		delete[] checkpoint.arenaCopy;
+		checkpoint.arenaCopySize = arenaStateSize;
+		checkpoint.arenaCopy = new Bit8u[checkpoint.arenaCopySize];
+	}
+	Bit32u reverbStatesSize = 0;
+	for (int i = 0; i < 4; i++) {
+		checkpoint.reverbStateOffsets[i] = reverbStatesSize;
+		// Keep each state aligned for whatever the model puts in it
+		reverbStatesSize += (reverbModels[i]->getStateSize() + 7) & ~7;
+	}
+	if (checkpoint.reverbStatesSize != reverbStatesSize) {
+		delete[] checkpoint.reverbStates;
+		checkpoint.reverbStatesSize = reverbStatesSize;
+		checkpoint.reverbStates = new Bit8u[reverbStatesSize];
+	}
+	arena.copyTo(checkpoint.arenaCopy, arenaStateSize);
+	for (int i = 0; i < 4; i++) {
+		reverbModels[i]->saveState(checkpoint.reverbStates + checkpoint.reverbStateOffsets[i]);
+	}
+	checkpoint.sampleRate = myProp.sampleRate;
+	checkpoint.mt32ram = mt32ram;
+	checkpoint.isEnabled = isEnabled;
+	memcpy(checkpoint.chantable, chantable, sizeof(chantable));
+	checkpoint.renderedSampleCount = renderedSampleCount;
+	checkpoint.reverbModelIx = getReverbModelIx();
+	checkpoint.masterTune = masterTune;
+	checkpoint.prerenderReadIx = prerenderReadIx;
+	checkpoint.prerenderWriteIx = prerenderWriteIx;
+	checkpoint.reverbStageOutputPos = reverbStageOutputPos;
+	checkpoint.reverbStageIdleFrames = reverbStageIdleFrames;
+	checkpoint.synth = this;
+	return true;
+}
+
+bool Synth::restoreCheckpoint(const SynthCheckpoint &checkpoint) {
+	if (!isOpen || !checkpoint.isTakenFrom(this) || checkpoint.arenaCopySize != arenaStateSize || checkpoint.sampleRate != myProp.sampleRate) {
+		return false;
+	}
+	waitForReverbStage();
+
+	ReverbModel *newReverbModel = checkpoint.reverbModelIx < 0 ? NULL : reverbModels[checkpoint.reverbModelIx];
+#if MT32EMU_REDUCE_REVERB_MEMORY
+	// Only the current model has the buffer, so it needs handing over before the buffer contents are restored
+	if (reverbModel != newReverbModel) {
+		if (reverbModel != NULL) {
+			reverbModel->close();
+		}
+		if (newReverbModel != NULL) {
+			openReverbModel(checkpoint.reverbModelIx);
+		}
+	}
+#endif
+	reverbModel = newReverbModel;
+
+	arena.copyFrom(checkpoint.arenaCopy, arenaStateSize);
+	for (int i = 0; i < 4; i++) {
+		reverbModels[i]->loadState(checkpoint.reverbStates + checkpoint.reverbStateOffsets[i]);
+	}
+	mt32ram = checkpoint.mt32ram;
+	isEnabled = checkpoint.isEnabled;
+	memcpy(chantable, checkpoint.chantable, sizeof(chantable));
+	renderedSampleCount = checkpoint.renderedSampleCount;
+	masterTune = checkpoint.masterTune;
+	prerenderReadIx = checkpoint.prerenderReadIx;
+	prerenderWriteIx = checkpoint.prerenderWriteIx;
+	reverbStageOutputPos = checkpoint.reverbStageOutputPos;
+	reverbStageIdleFrames = checkpoint.reverbStageIdleFrames;
+	chaseMutedReverbModel = NULL;
+	return true;
+}
+
+// Saved states start with this header, followed by the payload written by Synth::writeState()
+static const Bit8u STATE_MAGIC[4] = {'M', 'T', '3', '2'};
+// Increased whenever the layout of the payload changes
+static const Bit32u STATE_VERSION = 2;
+// Stored in native byte order, so that states from a machine with a different byte order are recognised
+static const Bit32u STATE_BYTE_ORDER_MARK = 0x01020304;
+static const Bit32u STATE_HEADER_SIZE = 4 + 4 * sizeof(Bit32u);
+
+// Room for the state of any of the reverb models, aligned for whatever they keep in it
+union ReverbModelState {
+	double alignment;
+	Bit8u bytes[512];
+};
+
+// FNV-1a, taken a word at a time to keep up with states of a few hundred kilobytes.
+// That's plenty to tell a damaged state from an intact one.
+static Bit32u calcStateChecksum(const Bit8u *data, Bit32u len) {
+	Bit32u checksum = 2166136261U;
+	Bit32u i = 0;
+	for (; i + 4 <= len; i += 4) {
+		Bit32u word;
+		memcpy(&word, data + i, 4);
+		checksum = (checksum ^ word) * 16777619U;
+	}
+	for (; i < len; i++) {
+		checksum = (checksum ^ data[i]) * 16777619U;
+	}
+	return checksum;
+}
+
+void Synth::savePartRef(StateWriter &writer, const Part *part) const {
+	Bit32s partNum = -1;
+	for (int i = 0; i < 9; i++) {
+		if (part != NULL && parts[i] == part) {
+			partNum = i;
+		}
+	}
+	writer.write(partNum);
+}
+
+Part *Synth::loadPartRef(StateReader &reader) const {
+	int partNum = reader.readIndex(9);
+	return partNum < 0 ? NULL : parts[partNum];
+}
+
+void Synth::savePolyRef(StateWriter &writer, const Poly *poly) const {
+	Bit32s partNum = -1;
+	Bit32s polyNum = -1;
+	for (int i = 0; i < 9 && poly != NULL; i++) {
+		polyNum = parts[i]->getPolyNum(poly);
+		if (polyNum >= 0) {
+			partNum = i;
+			break;
+		}
+	}
+	writer.write(partNum);
+	writer.write(polyNum);
+}
+
+Poly *Synth::loadPolyRef(StateReader &reader) const {
+	int partNum = reader.readIndex(9);
+	int polyNum = reader.readIndex(MT32EMU_MAX_POLY);
+	if (partNum < 0 || polyNum < 0) {
+		if (partNum != polyNum) {
+			reader.fail();
+		}
+		return NULL;
+	}
+	return parts[partNum]->getPolyByNum(polyNum);
+}
+
+void Synth::savePartialRef(StateWriter &writer, const Partial *partial) const {
+	// Partials are numbered by their position in the PartialManager
+	writer.write((Bit32s)(partial == NULL ? -1 : partial->debugGetPartialNum()));
+}
+
+Partial *Synth::loadPartialRef(StateReader &reader) const {
+	int partialNum = reader.readIndex(MT32EMU_MAX_PARTIALS);
+	return partialNum < 0 ? NULL : partialManager->getPartial(partialNum);
+}
+
+void Synth::savePatchCacheRef(StateWriter &writer, const PatchCache *cache) const {
+	Bit32s partNum = -1;
+	Bit32s cacheNum = -1;
+	for (int i = 0; i < 9 && cache != NULL; i++) {
+		cacheNum = parts[i]->getPatchCacheNum(cache);
+		if (cacheNum >= 0) {
+			partNum = i;
+			break;
+		}
+	}
+	writer.write(partNum);
+	writer.write(cacheNum);
+}
+
+const PatchCache *Synth::loadPatchCacheRef(StateReader &reader) const {
+	int partNum = reader.readIndex(9);
+	Bit32s cacheNum;
+	reader.read(cacheNum);
+	if (partNum < 0) {
+		if (cacheNum != -1) {
+			reader.fail();
+		}
+		return NULL;
+	}
+	const PatchCache *cache = parts[partNum]->getPatchCacheByNum(cacheNum);
+	if (cache == NULL) {
+		reader.fail();
+	}
+	return cache;
+}
+
+void Synth::saveMemoryRef(StateWriter &writer, const void *ref) const {
+	Bit32s offset = ref == NULL ? -1 : (Bit32s)((const Bit8u *)ref - (const Bit8u *)&mt32ram);
+	writer.write(offset);
+}
+
+const void *Synth::loadMemoryRef(StateReader &reader, size_t refSize) const {
+	Bit32s offset;
+	reader.read(offset);
+	if (offset == -1) {
+		return NULL;
+	}
+	if (offset < 0 || (size_t)offset + refSize > sizeof(MemParams)) {
+		reader.fail();
+		return NULL;
+	}
+	return (const Bit8u *)&mt32ram + offset;
+}
+
+void Synth::savePatchCache(StateWriter &writer, const PatchCache &cache) const {
+	writer.write(cache.playPartial);
+	writer.write(cache.PCMPartial);
+	writer.write(cache.pcm);
+	writer.write(cache.waveform);
+	writer.write(cache.structureMix);
+	writer.write(cache.structurePosition);
+	writer.write(cache.structurePair);
+	writer.write(cache.dirty);
+	writer.write(cache.partialCount);
+	writer.write(cache.sustain);
+	writer.write(cache.reverb);
+	writer.writeBytes(&cache.srcPartial, sizeof(cache.srcPartial));
+}
+
+void Synth::loadPatchCache(StateReader &reader, PatchCache &cache) const {
+	reader.read(cache.playPartial);
+	reader.read(cache.PCMPartial);
+	reader.read(cache.pcm);
+	reader.read(cache.waveform);
+	reader.read(cache.structureMix);
+	reader.read(cache.structurePosition);
+	reader.read(cache.structurePair);
+	reader.read(cache.dirty);
+	reader.read(cache.partialCount);
+	reader.read(cache.sustain);
+	reader.read(cache.reverb);
+	reader.readBytes(&cache.srcPartial, sizeof(cache.srcPartial));
+}
+
+static void writeRingSamples(StateWriter &writer, const Bit16s *ring, Bit32u ringLen, Bit32u pos, Bit32u len) {
+	Bit32u firstLen = ringLen - pos < len ? ringLen - pos : len;
+	writer.writeBytes(ring + pos, firstLen * sizeof(Bit16s));
+	writer.writeBytes(ring, (len - firstLen) * sizeof(Bit16s));
+}
+
+static void readRingSamples(StateReader &reader, Bit16s *ring, Bit32u ringLen, Bit32u pos, Bit32u len) {
+	Bit32u firstLen = ringLen - pos < len ? ringLen - pos : len;
+	reader.readBytes(ring + pos, firstLen * sizeof(Bit16s));
+	reader.readBytes(ring, (len - firstLen) * sizeof(Bit16s));
+}
+
+void Synth::writeState(StateWriter &writer) const {
+	// Things the synth restoring the state must agree with come first, so that they're checked before anything changes
+	writer.write((Bit32u)myProp.sampleRate);
+	writer.write((Bit32u)pcmROMSize);
+	writer.write(controlROMMap->idLen);
+	writer.writeBytes(controlROMMap->idBytes, controlROMMap->idLen);
+	writer.write(getReverbBufferSize(myProp.sampleRate));
+	writer.write((Bit32u)(reverbStageEnabled ? maxSamplesPerRun : 0));
+	Bit32u prerenderLen = (prerenderWriteIx + maxPrerenderSamples - prerenderReadIx) % maxPrerenderSamples;
+	writer.write(prerenderLen);
+
+	writer.writeBytes(&mt32ram, sizeof(mt32ram));
+	writer.write(isEnabled);
+	writer.writeBytes(chantable, sizeof(chantable));
+	writer.write(renderedSampleCount);
+	writer.write(masterTune);
+
+	partialManager->saveState(writer);
+	for (int i = 0; i < 9; i++) {
+		parts[i]->saveState(writer);
+	}
+
+	int reverbModelIx = getReverbModelIx();
+	writer.write((Bit32s)reverbModelIx);
+	for (int i = 0; i < 4; i++) {
+		ReverbModelState reverbState;
+		Bit32u reverbStateSize = reverbModels[i]->getStateSize();
+		reverbModels[i]->saveState(reverbState.bytes);
+		writer.write(reverbStateSize);
+		writer.writeBytes(reverbState.bytes, reverbStateSize);
+	}
+#if MT32EMU_REDUCE_REVERB_MEMORY
+	// Only the buffer of the open model holds anything worth keeping
+	Bit32u reverbBufferLen = reverbModel == NULL ? 0 : reverbModel->getBufferSize(myProp.sampleRate);
+#else
+	Bit32u reverbBufferLen = getReverbBufferSize(myProp.sampleRate);
+#endif
+	writer.write(reverbBufferLen);
+	writer.writeBytes(reverbBuffer, reverbBufferLen * sizeof(float));
+
+	writeRingSamples(writer, prerenderNonReverbLeft, maxPrerenderSamples, prerenderReadIx, prerenderLen);
+	writeRingSamples(writer, prerenderNonReverbRight, maxPrerenderSamples, prerenderReadIx, prerenderLen);
+	writeRingSamples(writer, prerenderReverbDryLeft, maxPrerenderSamples, prerenderReadIx, prerenderLen);
+	writeRingSamples(writer, prerenderReverbDryRight, maxPrerenderSamples, prerenderReadIx, prerenderLen);
+	writeRingSamples(writer, prerenderReverbWetLeft, maxPrerenderSamples, prerenderReadIx, prerenderLen);
+	writeRingSamples(writer, prerenderReverbWetRight, maxPrerenderSamples, prerenderReadIx, prerenderLen);
+
+	if (reverbStageEnabled) {
+		writer.write(reverbStageIdleFrames);
+		for (int i = 0; i < 6; i++) {
+			writeRingSamples(writer, reverbStageOutput[i], maxSamplesPerRun, reverbStageOutputPos, maxSamplesPerRun);
+		}
+	}
+}
+
+bool Synth::readState(StateReader &reader) {
+	Bit32u sampleRate, romSize, reverbBufferSize, reverbStageDelay, prerenderLen;
+	Bit16u romIdLen;
+	char romId[256];
+	reader.read(sampleRate);
+	reader.read(romSize);
+	reader.read(romIdLen);
+	if (romIdLen > sizeof(romId)) {
+		return false;
+	}
+	reader.readBytes(romId, romIdLen);
+	reader.read(reverbBufferSize);
+	reader.read(reverbStageDelay);
+	reader.read(prerenderLen);
+	if (reader.isFailed() || sampleRate != myProp.sampleRate || romSize != (Bit32u)pcmROMSize
+		|| romIdLen != controlROMMap->idLen || memcmp(romId, controlROMMap->idBytes, romIdLen) != 0) {
+		printDebug("Can't restore state: it was saved by a synth with different ROMs or sample rate");
+		return false;
+	}
+	if (reverbBufferSize != getReverbBufferSize(myProp.sampleRate) || reverbStageDelay != (reverbStageEnabled ? maxSamplesPerRun : 0) || prerenderLen >= maxPrerenderSamples) {
+		printDebug("Can't restore state: it was saved by a synth with different reverb or buffer settings");
+		return false;
+	}
+
+	// From here on, the state is put straight into place. Should anything below fail, the synth is left partly restored,
+	// which restoreState() undoes.
+	reader.readBytes(&mt32ram, sizeof(mt32ram));
+	reader.read(isEnabled);
+	reader.readBytes(chantable, sizeof(chantable));
+	reader.read(renderedSampleCount);
+	reader.read(masterTune);
+
+	partialManager->loadState(reader);
+	for (int i = 0; i < 9; i++) {
+		parts[i]->loadState(reader);
+	}
+
+	int reverbModelIx = reader.readIndex(4);
+	ReverbModel *newReverbModel = reverbModelIx < 0 ? NULL : reverbModels[reverbModelIx];
+#if MT32EMU_REDUCE_REVERB_MEMORY
+	// Only the current model has the buffer, so it needs handing over before the buffer contents are restored
+	if (reverbModel != newReverbModel) {
+		if (reverbModel != NULL) {
+			reverbModel->close();
+		}
+		if (newReverbModel != NULL) {
+			openReverbModel(reverbModelIx);
+		}
+	}
+#endif
+	reverbModel = newReverbModel;
+	for (int i = 0; i < 4; i++) {
+		ReverbModelState reverbState;
+		Bit32u reverbStateSize;
+		reader.read(reverbStateSize);
+		if (reverbStateSize != reverbModels[i]->getStateSize()) {
+			reader.fail();
+			break;
+		}
+		reader.readBytes(reverbState.bytes, reverbStateSize);
+		reverbModels[i]->loadState(reverbState.bytes);
+	}
+	Bit32u reverbBufferLen;
+	reader.read(reverbBufferLen);
+	if (reverbBufferLen > reverbBufferSize) {
+		reader.fail();
+		reverbBufferLen = 0;
+	}
+	reader.readBytes(reverbBuffer, reverbBufferLen * sizeof(float));
+
+	prerenderReadIx = 0;
+	prerenderWriteIx = prerenderLen;
+	chaseMutedReverbModel = NULL;
+	readRingSamples(reader, prerenderNonReverbLeft, maxPrerenderSamples, 0, prerenderLen);
+	readRingSamples(reader, prerenderNonReverbRight, maxPrerenderSamples, 0, prerenderLen);
+	readRingSamples(reader, prerenderReverbDryLeft, maxPrerenderSamples, 0, prerenderLen);
+	readRingSamples(reader, prerenderReverbDryRight, maxPrerenderSamples, 0, prerenderLen);
+	readRingSamples(reader, prerenderReverbWetLeft, maxPrerenderSamples, 0, prerenderLen);
+	readRingSamples(reader, prerenderReverbWetRight, maxPrerenderSamples, 0, prerenderLen);
+
+	if (reverbStageEnabled) {
+		reader.read(reverbStageIdleFrames);
+		reverbStageOutputPos = 0;
+		for (int i = 0; i < 6; i++) {
+			readRingSamples(reader, reverbStageOutput[i], maxSamplesPerRun, 0, maxSamplesPerRun);
+		}
+	}
+	if (!reader.isComplete()) {
+		printDebug("Can't restore state: it's malformed");
+		return false;
+	}
+	return true;
+}
+
+Bit32u Synth::getStateSize() const {
+	if (!isOpen) {
+		return 0;
+	}
+	waitForReverbStage();
+	StateWriter writer(NULL, 0);
+	writeState(writer);
+	return STATE_HEADER_SIZE + writer.getPosition();
+}
+
+Bit32u Synth::saveState(void *buffer, Bit32u bufferSize) const {
+	if (!isOpen || bufferSize < STATE_HEADER_SIZE) {
+		return 0;
+	}
+	// The reverb stage may still be working on the last run, whose output belongs to this state
+	waitForReverbStage();
+
+	Bit8u *payload = (Bit8u *)buffer + STATE_HEADER_SIZE;
+	StateWriter writer(payload, bufferSize - STATE_HEADER_SIZE);
+	writeState(writer);
+	if (writer.isOverflowed()) {
+		return 0;
+	}
+	Bit32u payloadSize = writer.getPosition();
+	StateWriter headerWriter(buffer, STATE_HEADER_SIZE);
+	headerWriter.writeBytes(STATE_MAGIC, sizeof(STATE_MAGIC));
+	headerWriter.write(STATE_BYTE_ORDER_MARK);
+	headerWriter.write(STATE_VERSION);
+	headerWriter.write(payloadSize);
+	headerWriter.write(calcStateChecksum(payload, payloadSize));
+	return STATE_HEADER_SIZE + payloadSize;
+}
+
+bool Synth::restoreState(const void *state, Bit32u stateSize) {
+	if (!isOpen) {
+		return false;
+	}
+	StateReader headerReader(state, stateSize < STATE_HEADER_SIZE ? stateSize : STATE_HEADER_SIZE);
+	Bit8u magic[4];
+	Bit32u byteOrderMark, version, payloadSize, checksum;
+	headerReader.readBytes(magic, sizeof(magic));
+	headerReader.read(byteOrderMark);
+	headerReader.read(version);
+	headerReader.read(payloadSize);
+	headerReader.read(checksum);
+	if (headerReader.isFailed() || memcmp(magic, STATE_MAGIC, sizeof(magic)) != 0) {
+		printDebug("Can't restore state: not a saved state");
+		return false;
+	}
+	if (byteOrderMark != STATE_BYTE_ORDER_MARK || version != STATE_VERSION) {
+		printDebug("Can't restore state: it was saved by a different version, or on a machine with a different byte order");
+		return false;
+	}
+	const Bit8u *payload = (const Bit8u *)state + STATE_HEADER_SIZE;
+	if (payloadSize != stateSize - STATE_HEADER_SIZE || calcStateChecksum(payload, payloadSize) != checksum) {
+		printDebug("Can't restore state: it's damaged");
+		return false;
+	}
+
+	waitForReverbStage();
+	// Even an intact state can turn out not to fit part way through, e.g. if it was made up or comes from a build with
+	// other limits. readState() has changed the synth by then, so it's put back the way it was.
+	SynthCheckpoint checkpoint;
+	if (!saveCheckpoint(checkpoint)) {
+		return false;
+	}
+	StateReader reader(payload, payloadSize);
+	if (!readState(reader)) {
+		restoreCheckpoint(checkpoint);
+		return false;
+	}
+	return true;
+}
+
+Synth *Synth::clone() const {
+	if (!isOpen) {
+		return NULL;
+	}
+	SynthProperties cloneProp = myProp;
+	// Skips loading the ROMs, which is most of the work of opening a synth
+	cloneProp.romImage = romImage;
+	Synth *synthClone = new Synth();
+	if (!synthClone->open(cloneProp)) {
+		delete synthClone;
+		return NULL;
+	}
+	synthClone->reverbEnabled = reverbEnabled;
+	synthClone->reverbOverridden = reverbOverridden;
+	synthClone->la32FloatToBit16sFunc = la32FloatToBit16sFunc;
+	synthClone->reverbFloatToBit16sFunc = reverbFloatToBit16sFunc;
+	synthClone->outputGain = outputGain;
+	synthClone->reverbOutputGain = reverbOutputGain;
+
+	// The clone is known to match, so the state is passed over without the header and checksum saveState() adds
+	waitForReverbStage();
+	StateWriter sizeWriter(NULL, 0);
+	writeState(sizeWriter);
+	Bit32u stateSize = sizeWriter.getPosition();
+	Bit8u *state = new Bit8u[stateSize];
+	StateWriter writer(state, stateSize);
+	writeState(writer);
+	StateReader reader(state, stateSize);
+	bool restored = synthClone->readState(reader);
+	delete[] state;
+	if (!restored) {
+		synthClone->close();
+		delete synthClone;
+		return NULL;
+	}
+	return synthClone;
+}
+
 void MemoryRegion::read(unsigned int entry, unsigned int off, Bit8u *dst, unsigned int len) const {
 	off += entry * entrySize;
 	// This method should never be called with out-of-bounds parameters,
@@ -27,6 +27,7 @@ class TableInitialiser;
 class Partial;
 class PartialManager;
 class Part;
+class ROMImage;
 
 /**
  * Methods for emulating the connection between the LA32 and the DAC, which involves
@@ -117,6 +118,26 @@ struct SynthProperties {
 	File *(*openFile)(void *userData, const char *filename, File::OpenMode mode);
 	// Callback for closing a File. May be NULL, in which case the File will automatically be close()d/deleted.
 	void (*closeFile)(void *userData, File *file);
+	// The maximum number of frames rendered internally in one pass. Renders longer than this are simply split up.
+	// Hosts rendering in small blocks can set this to their block size to reduce memory use.
+	// If 0, MAX_SAMPLES_PER_RUN is used.
+	unsigned int maxSamplesPerRun;
+	// The size of the ring buffers used to simulate delays while aborting partials.
+	// If 0, MAX_PRERENDER_SAMPLES is used.
+	unsigned int maxPrerenderSamples;
+	// The number of threads used to render partials, including the thread calling render().
+	// Output is identical whatever the number of threads. 0 or 1 renders everything on the calling thread.
+	unsigned int renderThreads;
+	// If true, the reverb and the conversion to 16-bit samples run on a thread of their own, one run behind the partials.
+	// The output is identical, but delayed by maxSamplesPerRun frames - live hosts should set that to their block size.
+	// Offline hosts need to render an extra maxSamplesPerRun frames at the end to get the tail out.
+	bool pipelineReverb;
+	// If not NULL, the ROMs are taken from this image (see Synth::getROMImage()) instead of being loaded from files.
+	// The image is reference counted, so it stays around for as long as any synth uses it.
+	ROMImage *romImage;
+	// The highest sample rate Synth::reconfigure() can switch to. The reverb buffers are sized for it when opening.
+	// If 0 (or lower than sampleRate), sampleRate is used.
+	unsigned int maxSampleRate;
 };
 
 // This is the specification of the Callback routine used when calling the RecalcWaveforms
@@ -141,6 +162,8 @@ const Bit8u SYSEX_CMD_ERR = 0x4E; // Communications error
 const Bit8u SYSEX_CMD_RJC = 0x4F; // Rejection
 
 const int MAX_SYSEX_SIZE = 512;
+// The longest sysex message Synth::parseStream() can put together: a DT1 writing all 64 user timbres at once
+const Bit32u MAX_STREAM_SYSEX_SIZE = 10 + 64 * 256;
 
 const unsigned int CONTROL_ROM_SIZE = 64 * 1024;
 
@@ -176,6 +199,87 @@ struct ControlROMMap {
 	Bit16u timbreMaxTable; // 72 bytes
 };
 
+// The timbres in the two ROM banks (A and B, absolute timbre numbers 0-127) can't be written by sysex. Their patch caches
+// are worked out once, with the reverb switch off and on, and kept in the ROM image.
+const unsigned int ROM_TIMBRE_COUNT = 128;
+const unsigned int ROM_TIMBRE_CACHE_COUNT = ROM_TIMBRE_COUNT * 2 * 4;
+
+// Control and PCM ROM contents. Loaded by Synth::open(), and shared read-only by any other synths opened with
+// SynthProperties::romImage pointing at it.
+class ROMImage {
+friend class Synth;
+private:
+	Mutex refCountMutex;
+	unsigned int refCount;
+
+	const ControlROMMap *controlROMMap;
+	Bit8u controlROMData[CONTROL_ROM_SIZE];
+	float *pcmROMData;
+	int pcmROMSize; // This is in 16-bit samples, therefore half the number of bytes in the ROM
+	// ROM_TIMBRE_CACHE_COUNT entries, see Synth::getROMTimbreCaches()
+	PatchCache *romTimbreCaches;
+
+	ROMImage();
+	~ROMImage();
+	ROMImage(const ROMImage &);
+	ROMImage &operator=(const ROMImage &);
+
+	void addRef();
+	// Deletes the image once the last user has released it
+	void release();
+};
+
+// A copy of a synth's emulation state, taken by Synth::saveCheckpoint() and put back by Synth::restoreCheckpoint().
+// Since all the per-instance objects live in the synth's arena, a checkpoint is little more than a copy of the part of it
+// that holds the emulation state (the scratch buffers used while rendering are left out). That makes checkpoints cheap
+// enough to take many times a second - but they can only be restored into the synth they were taken from, while it stays
+// open.
+// Host settings (output gains, DAC input mode, reverb enabled/overridden) aren't part of the emulation state, so aren't saved.
+class SynthCheckpoint {
+friend class Synth;
+private:
+	const Synth *synth;
+	Bit8u *arenaCopy;
+	size_t arenaCopySize;
+	// The state of each reverb model, at reverbStateOffsets[i]
+	Bit8u *reverbStates;
+	Bit32u reverbStateOffsets[4];
+	Bit32u reverbStatesSize;
+
+	// The TVPs and the reverb models in the copy only suit this rate, see Synth::reconfigure()
+	unsigned int sampleRate;
+	MemParams mt32ram;
+	bool isEnabled;
+	Bit8s chantable[32];
+	Bit32u renderedSampleCount;
+	int reverbModelIx; // -1 if none
+	float masterTune;
+	int prerenderReadIx;
+	int prerenderWriteIx;
+	Bit32u reverbStageOutputPos;
+	Bit32u reverbStageIdleFrames;
+
+	SynthCheckpoint(const SynthCheckpoint &);
+	SynthCheckpoint &operator=(const SynthCheckpoint &);
+
+public:
+	SynthCheckpoint();
+	~SynthCheckpoint();
+
+	// Returns true if the checkpoint holds a state of the given synth
+	bool isTakenFrom(const Synth *synth) const;
+	// Returns the number of samples the synth had rendered when the checkpoint was taken
+	Bit32u getRenderedSampleCount() const;
+	// Returns the number of bytes copied into the checkpoint each time it's saved
+	size_t getSize() const;
+};
+
+enum PartialSelection {
+	PartialSelection_all,
+	PartialSelection_nonReverb,
+	PartialSelection_reverb
+};
+
 enum MemoryRegionType {
 	MR_PatchTemp, MR_RhythmTemp, MR_TimbreTemp, MR_Patches, MR_Timbres, MR_System, MR_Display, MR_Reset
 };
@@ -184,12 +288,12 @@ class MemoryRegion {
 private:
 	Synth *synth;
 	Bit8u *realMemory;
-	Bit8u *maxTable;
+	const Bit8u *maxTable;
 public:
 	MemoryRegionType type;
 	Bit32u startAddr, entrySize, entries;
 
-	MemoryRegion(Synth *useSynth, Bit8u *useRealMemory, Bit8u *useMaxTable, MemoryRegionType useType, Bit32u useStartAddr, Bit32u useEntrySize, Bit32u useEntries) {
+	MemoryRegion(Synth *useSynth, Bit8u *useRealMemory, const Bit8u *useMaxTable, MemoryRegionType useType, Bit32u useStartAddr, Bit32u useEntrySize, Bit32u useEntries) {
 		synth = useSynth;
 		realMemory = useRealMemory;
 		maxTable = useMaxTable;
@@ -244,27 +348,27 @@ public:
 
 class PatchTempMemoryRegion : public MemoryRegion {
 public:
-	PatchTempMemoryRegion(Synth *useSynth, Bit8u *useRealMemory, Bit8u *useMaxTable) : MemoryRegion(useSynth, useRealMemory, useMaxTable, MR_PatchTemp, MT32EMU_MEMADDR(0x030000), sizeof(MemParams::PatchTemp), 9) {}
+	PatchTempMemoryRegion(Synth *useSynth, Bit8u *useRealMemory, const Bit8u *useMaxTable) : MemoryRegion(useSynth, useRealMemory, useMaxTable, MR_PatchTemp, MT32EMU_MEMADDR(0x030000), sizeof(MemParams::PatchTemp), 9) {}
 };
 class RhythmTempMemoryRegion : public MemoryRegion {
 public:
-	RhythmTempMemoryRegion(Synth *useSynth, Bit8u *useRealMemory, Bit8u *useMaxTable) : MemoryRegion(useSynth, useRealMemory, useMaxTable, MR_RhythmTemp, MT32EMU_MEMADDR(0x030110), sizeof(MemParams::RhythmTemp), 85) {}
+	RhythmTempMemoryRegion(Synth *useSynth, Bit8u *useRealMemory, const Bit8u *useMaxTable) : MemoryRegion(useSynth, useRealMemory, useMaxTable, MR_RhythmTemp, MT32EMU_MEMADDR(0x030110), sizeof(MemParams::RhythmTemp), 85) {}
 };
 class TimbreTempMemoryRegion : public MemoryRegion {
 public:
-	TimbreTempMemoryRegion(Synth *useSynth, Bit8u *useRealMemory, Bit8u *useMaxTable) : MemoryRegion(useSynth, useRealMemory, useMaxTable, MR_TimbreTemp, MT32EMU_MEMADDR(0x040000), sizeof(TimbreParam), 8) {}
+	TimbreTempMemoryRegion(Synth *useSynth, Bit8u *useRealMemory, const Bit8u *useMaxTable) : MemoryRegion(useSynth, useRealMemory, useMaxTable, MR_TimbreTemp, MT32EMU_MEMADDR(0x040000), sizeof(TimbreParam), 8) {}
 };
 class PatchesMemoryRegion : public MemoryRegion {
 public:
-	PatchesMemoryRegion(Synth *useSynth, Bit8u *useRealMemory, Bit8u *useMaxTable) : MemoryRegion(useSynth, useRealMemory, useMaxTable, MR_Patches, MT32EMU_MEMADDR(0x050000), sizeof(PatchParam), 128) {}
+	PatchesMemoryRegion(Synth *useSynth, Bit8u *useRealMemory, const Bit8u *useMaxTable) : MemoryRegion(useSynth, useRealMemory, useMaxTable, MR_Patches, MT32EMU_MEMADDR(0x050000), sizeof(PatchParam), 128) {}
 };
 class TimbresMemoryRegion : public MemoryRegion {
 public:
-	TimbresMemoryRegion(Synth *useSynth, Bit8u *useRealMemory, Bit8u *useMaxTable) : MemoryRegion(useSynth, useRealMemory, useMaxTable, MR_Timbres, MT32EMU_MEMADDR(0x080000), sizeof(MemParams::PaddedTimbre), 64 + 64 + 64 + 64) {}
+	TimbresMemoryRegion(Synth *useSynth, Bit8u *useRealMemory, const Bit8u *useMaxTable) : MemoryRegion(useSynth, useRealMemory, useMaxTable, MR_Timbres, MT32EMU_MEMADDR(0x080000), sizeof(MemParams::PaddedTimbre), 64 + 64 + 64 + 64) {}
 };
 class SystemMemoryRegion : public MemoryRegion {
 public:
-	SystemMemoryRegion(Synth *useSynth, Bit8u *useRealMemory, Bit8u *useMaxTable) : MemoryRegion(useSynth, useRealMemory, useMaxTable, MR_System, MT32EMU_MEMADDR(0x100000), sizeof(MemParams::System), 1) {}
+	SystemMemoryRegion(Synth *useSynth, Bit8u *useRealMemory, const Bit8u *useMaxTable) : MemoryRegion(useSynth, useRealMemory, useMaxTable, MR_System, MT32EMU_MEMADDR(0x100000), sizeof(MemParams::System), 1) {}
 };
 class DisplayMemoryRegion : public MemoryRegion {
 public:
@@ -278,13 +382,75 @@ public:
 class ReverbModel {
 public:
 	virtual ~ReverbModel() {}
+	// Returns the number of samples of delay line memory that open() needs at the given sample rate.
+	virtual Bit32u getBufferSize(unsigned int sampleRate) const = 0;
 	// After construction or a close(), open() will be called at least once before any other call (with the exception of close()).
-	virtual void open(unsigned int sampleRate) = 0;
+	// The buffer has room for getBufferSize(sampleRate) samples. It is owned by the caller and stays valid until close(),
+	// so models never allocate memory themselves when switching reverb modes.
+	virtual void open(unsigned int sampleRate, float *buffer) = 0;
 	// May be called multiple times without an open() in between.
 	virtual void close() = 0;
 	virtual void setParameters(Bit8u time, Bit8u level) = 0;
 	virtual void process(const float *inLeft, const float *inRight, float *outLeft, float *outRight, unsigned long numSamples) = 0;
 	virtual bool isActive() const = 0;
+	// Returns the size of the model's own state as written by saveState(), which doesn't include the contents of the buffer
+	// passed to open() (that belongs to the caller). loadState() puts such a state back into an open model of the same kind.
+	virtual Bit32u getStateSize() const = 0;
+	virtual void saveState(void *state) const = 0;
+	virtual void loadState(const void *state) = 0;
+};
+
+// Breakdown of the memory used by a Synth instance, in bytes. See Synth::getMemoryFootprint().
+struct MemoryFootprint {
+	// The Synth object itself, which includes the emulated sysex memory.
+	// The Control ROM image is kept in the (possibly shared) ROMImage along with the PCM ROM, and isn't counted.
+	size_t synth;
+	// Temporary and prerender sample buffers used while rendering, including per-partial output buffers for multi-threaded rendering
+	size_t sampleBuffers;
+	// The PartialManager and all partials, including their TVA, TVP, TVF and sample buffers
+	size_t partials;
+	// All parts and their polys
+	size_t parts;
+	// Memory region descriptors, the padded timbre max table, the PCM wave list and the buffer for sysex messages parsed from a stream
+	size_t memoryRegions;
+	// PCM ROM samples (possibly shared with other synths)
+	size_t pcmROM;
+	// Reverb buffer pool
+	size_t reverb;
+	// Sum of all the above
+	size_t total;
+};
+
+// Where the time goes while rendering and handling events. See Synth::getRenderStats().
+// Times are wall clock time in seconds, accumulated since profiling was enabled or the stats were last reset.
+struct RenderStats {
+	// Runs rendered (of up to maxSamplesPerRun samples each) and the samples in them.
+	// The counts are doubles like the times, so that they don't wrap when a synth is monitored for days
+	// (a Bit32u sample count does after about 27 hours at 44.1 kHz). They stay exact up to 2^53.
+	double runCount;
+	double sampleCount;
+	// All of the rendering of the runs, including the stages below (but not event handling).
+	// The stages run on other threads when rendering on several threads or pipelining the reverb, so they may add up to more.
+	double renderTime;
+	// LA32 synthesis: generating the samples of the partials (in Partial::generateSamples()) and mixing them
+	double la32Time;
+	// ReverbModel::process()
+	double reverbTime;
+	// Conversion of the mixed output to the samples that the emulated DAC receives
+	double dacTime;
+	// Short messages and sysex handled, and the time taken, including any refreshes caused by memory writes
+	double eventCount;
+	double eventTime;
+};
+
+// A MIDI message stamped with the frame it's to be played at. See Synth::renderWithEvents().
+struct MidiEvent {
+	Bit32u frame;
+	// A short message as for Synth::playMsg(), unless sysex isn't NULL
+	Bit32u msg;
+	// A complete sysex message as for Synth::playSysex()
+	const Bit8u *sysex;
+	Bit32u sysexLen;
 };
 
 class Synth {
@@ -292,6 +458,7 @@ friend class Part;
 friend class RhythmPart;
 friend class Poly;
 friend class Partial;
+friend class PartialManager;
 friend class Tables;
 friend class MemoryRegion;
 friend class TVA;
@@ -313,21 +480,28 @@ private:
 
 	PCMWaveEntry *pcmWaves; // Array
 
+	// The ROMs, possibly shared with other synths. The pointers below point into it, for convenience.
+	ROMImage *romImage;
 	const ControlROMMap *controlROMMap;
-	Bit8u controlROMData[CONTROL_ROM_SIZE];
-	float *pcmROMData;
+	const Bit8u *controlROMData;
+	const float *pcmROMData;
 	int pcmROMSize; // This is in 16-bit samples, therefore half the number of bytes in the ROM
 
 	Bit8s chantable[32];
 
 	Bit32u renderedSampleCount;
 
-	Tables tables;
+	// Shared by all instances, see Tables::getInstance()
+	const Tables &tables;
 
 	MemParams mt32ram, mt32default;
 
 	ReverbModel *reverbModels[4];
 	ReverbModel *reverbModel;
+	// Delay line memory handed to the reverb models as they're opened, see openReverbModel().
+	// With MT32EMU_REDUCE_REVERB_MEMORY, only one model is open at a time and they all share a block sized for the largest one.
+	// Otherwise each model has its own part of the pool.
+	float *reverbBuffer;
 	bool reverbEnabled;
 	bool reverbOverridden;
 
@@ -339,44 +513,169 @@ private:
 	float masterTune;
 
 	bool isOpen;
+	// Set while open() is in progress, so that close() also cleans up after an open() that failed half way
+	bool isPartiallyOpen;
 
 	PartialManager *partialManager;
 	Part *parts[9];
 
+	unsigned int maxSamplesPerRun;
+	unsigned int maxPrerenderSamples;
+	unsigned int maxSampleRate;
+
+	// Holds all the buffers below, the reverb buffer pool, the partials (with their TVA, TVP, TVF and sample buffers),
+	// the PartialManager, the parts and their polys, the memory regions and the PCM wave list.
+	// The hottest state comes first, so that the render loop touches as few cache lines and pages as possible.
+	Arena arena;
+	// Sizes of the arena's subsystems, as computed by initArena()
+	MemoryFootprint arenaFootprint;
+	// The emulation state takes up the first arenaStateSize bytes of the arena. The scratch buffers that only hold
+	// anything during a run (the tmpBuf and tmp buffers, the partials' sample buffers and their per-thread outputs, the
+	// runs handed to the reverb stage) and streamSysex follow, so that checkpoints can leave them out.
+	size_t arenaStateSize;
+
 	// FIXME: We can reorganise things so that we don't need all these separate tmpBuf, tmp and prerender buffers.
 	// This should be rationalised when things have stabilised a bit (if prerender buffers don't die in the mean time).
 
-	float tmpBufPartialLeft[MAX_SAMPLES_PER_RUN];
-	float tmpBufPartialRight[MAX_SAMPLES_PER_RUN];
-	float tmpBufMixLeft[MAX_SAMPLES_PER_RUN];
-	float tmpBufMixRight[MAX_SAMPLES_PER_RUN];
-	float tmpBufReverbOutLeft[MAX_SAMPLES_PER_RUN];
-	float tmpBufReverbOutRight[MAX_SAMPLES_PER_RUN];
-
-	Bit16s tmpNonReverbLeft[MAX_SAMPLES_PER_RUN];
-	Bit16s tmpNonReverbRight[MAX_SAMPLES_PER_RUN];
-	Bit16s tmpReverbDryLeft[MAX_SAMPLES_PER_RUN];
-	Bit16s tmpReverbDryRight[MAX_SAMPLES_PER_RUN];
-	Bit16s tmpReverbWetLeft[MAX_SAMPLES_PER_RUN];
-	Bit16s tmpReverbWetRight[MAX_SAMPLES_PER_RUN];
+	// Each of these has room for maxSamplesPerRun samples
+	float *tmpBufPartialLeft;
+	float *tmpBufPartialRight;
+	float *tmpBufMixLeft;
+	float *tmpBufMixRight;
+	float *tmpBufReverbOutLeft;
+	float *tmpBufReverbOutRight;
+
+	Bit16s *tmpNonReverbLeft;
+	Bit16s *tmpNonReverbRight;
+	Bit16s *tmpReverbDryLeft;
+	Bit16s *tmpReverbDryRight;
+	Bit16s *tmpReverbWetLeft;
+	Bit16s *tmpReverbWetRight;
 
 	// These ring buffers are only used to simulate delays present on the real device.
 	// In particular, when a partial needs to be aborted to free it up for use by a new Poly,
 	// the controller will busy-loop waiting for the sound to finish.
-	Bit16s prerenderNonReverbLeft[MAX_PRERENDER_SAMPLES];
-	Bit16s prerenderNonReverbRight[MAX_PRERENDER_SAMPLES];
-	Bit16s prerenderReverbDryLeft[MAX_PRERENDER_SAMPLES];
-	Bit16s prerenderReverbDryRight[MAX_PRERENDER_SAMPLES];
-	Bit16s prerenderReverbWetLeft[MAX_PRERENDER_SAMPLES];
-	Bit16s prerenderReverbWetRight[MAX_PRERENDER_SAMPLES];
+	// Each of these has room for maxPrerenderSamples samples.
+	Bit16s *prerenderNonReverbLeft;
+	Bit16s *prerenderNonReverbRight;
+	Bit16s *prerenderReverbDryLeft;
+	Bit16s *prerenderReverbDryRight;
+	Bit16s *prerenderReverbWetLeft;
+	Bit16s *prerenderReverbWetRight;
 	int prerenderReadIx;
 	int prerenderWriteIx;
 
+	// Helper threads for rendering partials, if SynthProperties::renderThreads > 1
+	WorkerPool workerPool;
+	// When rendering on several threads, each partial renders into its own pair of buffers (with room for maxSamplesPerRun
+	// samples each, allocated from the arena), which are then mixed in partial order to give the same result as the
+	// single-threaded path.
+	float *partialOutputLeft[MT32EMU_MAX_PARTIALS];
+	float *partialOutputRight[MT32EMU_MAX_PARTIALS];
+	bool partialOutputProduced[MT32EMU_MAX_PARTIALS];
+	unsigned int renderPartialNums[MT32EMU_MAX_PARTIALS];
+	Bit32u renderPartialLen;
+	// See Partial::deactivate()
+	bool deferPartialDeactivation;
+
+	// One run's worth of partial output waiting for the pipelined reverb stage, along with the settings it was rendered with
+	struct ReverbStageRun {
+		// Each of these has room for maxSamplesPerRun samples
+		float *nonReverbLeft;
+		float *nonReverbRight;
+		float *reverbDryLeft;
+		float *reverbDryRight;
+		// Where the converted output goes in reverbStageOutput
+		Bit32u pos;
+		Bit32u len;
+		// NULL if reverb was disabled for the run
+		ReverbModel *reverbModel;
+		FloatToBit16sFunc la32FloatToBit16sFunc;
+		FloatToBit16sFunc reverbFloatToBit16sFunc;
+		float outputGain;
+		float reverbOutputGain;
+		// Whether to count the stage's time in renderStats
+		bool profilingEnabled;
+	};
+
+	// Pipelined reverb stage, if SynthProperties::pipelineReverb is set and the thread could be started.
+	// doRenderStreams() renders the partials of each run into one of the two reverbStageRuns and hands it to reverbStageThread,
+	// which runs the reverb on it while the partials of the next run are rendered into the other one.
+	// reverbStageOutput holds six delay lines of maxSamplesPerRun frames: each run takes its output from there,
+	// and the stage then writes the run's own output in its place, to be taken maxSamplesPerRun frames later.
+	// Anything touching the reverb model outside the stage must call waitForReverbStage() first.
+	bool reverbStageEnabled;
+	Thread reverbStageThread;
+	Semaphore reverbStageStart;
+	mutable Semaphore reverbStageDone;
+	mutable bool reverbStageBusy;
+	bool reverbStageQuit;
+	ReverbStageRun reverbStageRuns[2];
+	unsigned int reverbStageRunIx;
+	const ReverbStageRun *reverbStageCurrentRun;
+	Bit16s *reverbStageOutput[6];
+	Bit32u reverbStageOutputPos;
+	// Frames since the stage last produced anything audible, so that isActive() holds until the delay lines have played out
+	Bit32u reverbStageIdleFrames;
+
+	// chase() leaves the reverb muted. Until anything else happens (which shows in renderedSampleCount or reverbModel),
+	// there's no need to mute it again, which saves a lot of time when chasing in short steps.
+	const ReverbModel *chaseMutedReverbModel;
+	Bit32u chaseEndSampleCount;
+
+	// State of parseStream() between calls.
+	// Status of the message being received: a channel message (which remains as running status once complete), a system
+	// common message, 0xF0 while receiving a sysex message, or 0 if there's none (any data bytes are then ignored).
+	Bit8u streamStatus;
+	Bit8u streamData[2];
+	unsigned int streamDataCount;
+	// Counts all the bytes received, even those that didn't fit in streamSysex
+	Bit32u streamSysexLen;
+	// MAX_STREAM_SYSEX_SIZE bytes, allocated from the arena
+	Bit8u *streamSysex;
+
+	// Parts of the system area that a write may call for refreshing, see refreshSystem(unsigned int)
+	enum SystemRefresh {
+		SystemRefresh_masterTune = 1,
+		SystemRefresh_reverbParameters = 2,
+		SystemRefresh_reserveSettings = 4,
+		SystemRefresh_chanAssign = 8,
+		SystemRefresh_masterVol = 16
+	};
+
+	// While a bulk write is in progress (see beginBulkWrite()), writeMemoryRegion() records the refreshes it would do here,
+	// so that commitBulkWrite() does each of them once.
+	bool bulkWriteActive;
+	struct BulkWriteRefreshes {
+		bool parts[9];
+		bool timbres[256];
+		// SystemRefresh flags
+		unsigned int system;
+	} bulkWriteRefreshes;
+
+	// See startTrace()
+	EventTrace trace;
+
+	// See setProfilingEnabled(). The pipelined reverb stage adds its times to renderStats from its own thread, so those are
+	// only read after waitForReverbStage(). Partials keep their LA32 times apart, since they may be rendered on any thread.
+	bool profilingEnabled;
+	RenderStats renderStats;
+	double partialLA32Times[MT32EMU_MAX_PARTIALS];
+
 	SynthProperties myProp;
 
 	bool prerender();
 	void copyPrerender(Bit16s *nonReverbLeft, Bit16s *nonReverbRight, Bit16s *reverbDryLeft, Bit16s *reverbDryRight, Bit16s *reverbWetLeft, Bit16s *reverbWetRight, Bit32u pos, Bit32u len);
 	void checkPrerender(Bit16s *nonReverbLeft, Bit16s *nonReverbRight, Bit16s *reverbDryLeft, Bit16s *reverbDryRight, Bit16s *reverbWetLeft, Bit16s *reverbWetRight, Bit32u &pos, Bit32u &len);
+	static void renderPartialTask(void *context, unsigned int taskIx);
+	void mixPartials(PartialSelection selection, float *mixLeft, float *mixRight, Bit32u len);
+	void chasePartials(PartialSelection selection, Bit32u len);
+	void renderPipelined(Bit16s *nonReverbLeft, Bit16s *nonReverbRight, Bit16s *reverbDryLeft, Bit16s *reverbDryRight, Bit16s *reverbWetLeft, Bit16s *reverbWetRight, Bit32u len);
+	static void reverbStageMain(void *context);
+	void runReverbStage(const ReverbStageRun &run);
+	bool startReverbStage();
+	void stopReverbStage();
+	void waitForReverbStage() const;
 	void doRenderStreams(Bit16s *nonReverbLeft, Bit16s *nonReverbRight, Bit16s *reverbDryLeft, Bit16s *reverbDryRight, Bit16s *reverbWetLeft, Bit16s *reverbWetRight, Bit32u len);
 
 	void playAddressedSysex(unsigned char channel, const Bit8u *sysex, Bit32u len);
@@ -387,23 +686,57 @@ private:
 	void writeMemoryRegion(const MemoryRegion *region, Bit32u addr, Bit32u len, const Bit8u *data);
 	void readMemoryRegion(const MemoryRegion *region, Bit32u addr, Bit32u len, Bit8u *data);
 
+	bool loadROMs();
 	LoadResult loadControlROM(const char *filename);
 	LoadResult loadPCMROM(const char *filename);
 
 	bool initPCMList(Bit16u mapAddress, Bit16u count);
 	bool initTimbres(Bit16u mapAddress, Bit16u offset, int timbreCount, int startTimbre, bool compressed);
 	bool initCompressedTimbre(int drumNum, const Bit8u *mem, unsigned int memLen);
+	void initROMTimbreCaches();
+	// Returns the shared caches (with the reverb switch off, followed by on) of a timbre in the ROM banks,
+	// or NULL for the other timbres
+	const PatchCache *getROMTimbreCaches(unsigned int absTimbreNum) const;
 
 	void refreshSystemMasterTune();
+	void openReverbModel(Bit8u mode);
 	void refreshSystemReverbParameters();
 	void refreshSystemReserveSettings();
 	void refreshSystemChanAssign();
 	void refreshSystemMasterVol();
 	void refreshSystem();
-	void reset();
+	void refreshSystem(unsigned int systemRefreshes);
+	void refreshPart(unsigned int partNum);
+	void refreshTimbre(unsigned int absTimbreNum);
+	void resetDevice();
+	Bit32u playDueEvents(Bit32u frame, Bit32u maxLen, const MidiEvent *events, Bit32u eventCount, Bit32u &playedCount);
+	void muteReverb();
 
 	unsigned int getSampleRate() const;
 
+	bool initArena();
+	void initScratchBuffers();
+	Bit32u getReverbBufferSize(unsigned int sampleRate) const;
+	int getReverbModelIx() const;
+
+	// Used by saveState() and restoreState(), and the classes they call on, to refer to objects by number
+	// rather than by address, so that the state can be restored into another synth.
+	void savePartRef(StateWriter &writer, const Part *part) const;
+	Part *loadPartRef(StateReader &reader) const;
+	void savePolyRef(StateWriter &writer, const Poly *poly) const;
+	Poly *loadPolyRef(StateReader &reader) const;
+	void savePartialRef(StateWriter &writer, const Partial *partial) const;
+	Partial *loadPartialRef(StateReader &reader) const;
+	void savePatchCacheRef(StateWriter &writer, const PatchCache *cache) const;
+	const PatchCache *loadPatchCacheRef(StateReader &reader) const;
+	// For pointers into the sysex-addressable memory (mt32ram)
+	void saveMemoryRef(StateWriter &writer, const void *ref) const;
+	const void *loadMemoryRef(StateReader &reader, size_t refSize) const;
+	void savePatchCache(StateWriter &writer, const PatchCache &cache) const;
+	void loadPatchCache(StateReader &reader, PatchCache &cache) const;
+	void writeState(StateWriter &writer) const;
+	bool readState(StateReader &reader);
+
 	void printPartialUsage(unsigned long sampleOffset = 0);
 protected:
 	int report(ReportType type, const void *reportData);
@@ -424,6 +757,18 @@ public:
 	// Closes the MT-32 and deallocates any memory used by the synthesizer
 	void close(void);
 
+	// Puts the synth back into the state it was in right after open(): all sound stops at once (including the reverb),
+	// and the memory and the parts return to their defaults. The ROMs, the arena and any threads are kept, so this takes
+	// next to no time compared with closing and opening again. Host settings such as the output gains are kept as well.
+	void reset();
+
+	// Changes the sample rate of an open synth in place, up to the SynthProperties::maxSampleRate it was opened with.
+	// Nothing is allocated: the TVPs' timing is recalculated and the reverb models are opened again on their buffers.
+	// Any sound stops and the controllers are reset, but the MT-32's memory (patches, timbres, system settings and the
+	// temporary areas) is kept along with the host settings. Checkpoints taken before can't be restored afterwards.
+	// Returns false, leaving the synth as it was, if it isn't open or the rate is 0 or above maxSampleRate.
+	bool reconfigure(unsigned int newSampleRate);
+
 	// Sends a 4-byte MIDI message to the MT-32 for immediate playback
 	void playMsg(Bit32u msg);
 	void playMsgOnPart(unsigned char part, unsigned char code, unsigned char note, unsigned char velocity);
@@ -435,6 +780,14 @@ public:
 	void playSysexWithoutHeader(unsigned char device, unsigned char command, const Bit8u *sysex, Bit32u len);
 	void writeSysex(unsigned char channel, const Bit8u *sysex, Bit32u len);
 
+	// Plays a raw MIDI byte stream, as received from a MIDI port or read from a .syx file, for immediate playback.
+	// The stream may be split anywhere between calls: a message cut short is completed by the bytes that follow.
+	// Running status is supported, and real-time messages (which the MT-32 doesn't respond to) may appear anywhere,
+	// even in the middle of another message. A sysex message is put together in a buffer in the synth, so nothing is
+	// allocated; one longer than MAX_STREAM_SYSEX_SIZE bytes, or interrupted by a status byte other than End Of Exclusive,
+	// is ignored. Data bytes without a status to go with them (as when the stream was picked up halfway) are ignored too.
+	void parseStream(const Bit8u *stream, Bit32u len);
+
 	void setReverbEnabled(bool reverbEnabled);
 	bool isReverbEnabled() const;
 	void setReverbOverridden(bool reverbOverridden);
@@ -452,9 +805,31 @@ public:
 	// one frame is 4 bytes).
 	void render(Bit16s *stream, Bit32u len);
 
+	// Same as above, except that the samples are floats, with 1.0 corresponding to 32768 in 16-bit samples.
+	// Each of the streams renderStreams() gives is still 16-bit, as on the real thing, but their mix isn't clipped,
+	// so this doesn't distort where the 16-bit mix would.
+	void render(float *stream, Bit32u len);
+
 	// Renders samples to the specified output streams (any or all of which may be NULL).
 	void renderStreams(Bit16s *nonReverbLeft, Bit16s *nonReverbRight, Bit16s *reverbDryLeft, Bit16s *reverbDryRight, Bit16s *reverbWetLeft, Bit16s *reverbWetRight, Bit32u len);
 
+	// Moves the emulation len frames forward without producing any output, for seeking much faster than by rendering.
+	// MIDI sent between calls is handled as usual, and the partials end up exactly as if the frames had been rendered:
+	// only their waveforms are skipped, along with the reverb and the conversion to 16-bit samples.
+	// Since the reverb has no input meanwhile, it's muted afterwards, as is any output delayed by the prerender buffer
+	// or the reverb stage. Rendering then resumes from the new position, with the reverb starting afresh.
+	void chase(Bit32u len);
+
+	// Same as render(), renderStreams() and chase(), except that events are played during the call, each at exactly the frame
+	// it's stamped with, so that a host playing MIDI from a sequence doesn't have to split up its renders around every event.
+	// Frames are counted on the host's clock, on which startFrame is the first frame the call renders. The events must be in
+	// frame order. Those stamped for frames up to and including startFrame + len are played, ones already due straight away.
+	// Returns the number of events played, so that the next call can carry on from the event after them.
+	Bit32u renderWithEvents(Bit16s *stream, Bit32u len, Bit32u startFrame, const MidiEvent *events, Bit32u eventCount);
+	Bit32u renderWithEvents(float *stream, Bit32u len, Bit32u startFrame, const MidiEvent *events, Bit32u eventCount);
+	Bit32u renderStreamsWithEvents(Bit16s *nonReverbLeft, Bit16s *nonReverbRight, Bit16s *reverbDryLeft, Bit16s *reverbDryRight, Bit16s *reverbWetLeft, Bit16s *reverbWetRight, Bit32u len, Bit32u startFrame, const MidiEvent *events, Bit32u eventCount);
+	Bit32u chaseWithEvents(Bit32u len, Bit32u startFrame, const MidiEvent *events, Bit32u eventCount);
+
 	// Returns true when there is at least one active partial, otherwise false.
 	bool hasActivePartials() const;
 
@@ -465,8 +840,80 @@ public:
 
 	void readMemory(Bit32u addr, Bit32u len, Bit8u *data);
 
+	// Writes to the MT-32's memory directly, as a DT1 sysex message to the same address would, but without the framing
+	// and checksum. The address is in the same (MT32EMU_MEMADDR) form as for readMemory().
+	void writeMemory(Bit32u addr, const Bit8u *data, Bit32u len);
+
+	// Starts a bulk write, such as loading a bank of patches and timbres or a game's setup at boot. Until commitBulkWrite()
+	// is called, writes to the memory (by writeMemory() or sysex) only store the data, and the parts, timbres and system
+	// settings they affect are refreshed once at the commit rather than after every write. Nothing should be played or
+	// rendered in between, since the parts may not reflect the memory yet. Channel assignments are applied at once though,
+	// so any channel-specific sysex that follows is addressed as usual.
+	void beginBulkWrite();
+	// Ends a bulk write, refreshing everything it changed. Does nothing if no bulk write is in progress.
+	void commitBulkWrite();
+
+	// Starts recording an event trace (see EventTrace) with room for at least capacity records, replacing any trace
+	// already being recorded. Must not be called while the synth is rendering on another thread.
+	// Returns false if the ring couldn't be allocated.
+	bool startTrace(Bit32u capacity);
+	// Stops recording, discarding any records that haven't been drained. Same restrictions as for startTrace().
+	void stopTrace();
+	// Moves up to maxCount of the oldest trace records into the given array, and returns the number moved.
+	// This can be done on another thread while the synth is in use, as long as only one thread drains at a time.
+	Bit32u drainTrace(TraceRecord *records, Bit32u maxCount);
+	// Returns the number of trace records dropped because the ring was full when they were made
+	Bit32u getTraceDroppedCount() const;
+
+	// Enables the counters returned by getRenderStats(). These read the clock a few times per run and partial, and once
+	// per event. When disabled, they cost no more than a check. Must not be called while the synth is rendering on another
+	// thread.
+	void setProfilingEnabled(bool enabled);
+	bool isProfilingEnabled() const;
+	// Returns the counters accumulated while profiling was enabled. Same restrictions as for setProfilingEnabled().
+	RenderStats getRenderStats() const;
+	// Sets all the counters back to zero
+	void resetRenderStats();
+
 	// partNum should be 0..7 for Part 1..8, or 8 for Rhythm
 	const Part *getPart(unsigned int partNum) const;
+
+	// Returns the ROMs used by this synth, for sharing with other synths through SynthProperties::romImage.
+	// Only valid while the synth is open.
+	ROMImage *getROMImage() const;
+
+	// Returns the memory used by this instance, broken down by subsystem. All zeros (except synth) when not open.
+	MemoryFootprint getMemoryFootprint() const;
+
+	// Saves the emulation state into the checkpoint (see SynthCheckpoint). The checkpoint's memory is allocated the first
+	// time it's used with this synth, so reusing checkpoints avoids allocating while rendering.
+	// Returns false if the synth isn't open.
+	bool saveCheckpoint(SynthCheckpoint &checkpoint);
+	// Puts the emulation state back as it was when the checkpoint was saved from this synth.
+	// Returns false if the checkpoint wasn't taken from this synth.
+	bool restoreCheckpoint(const SynthCheckpoint &checkpoint);
+
+	// Returns the number of bytes saveState() currently needs, or 0 if the synth isn't open.
+	// This depends on what the synth is doing (e.g. the reverb mode), so it should be checked right before saving.
+	Bit32u getStateSize() const;
+	// Saves the emulation state into a compact, versioned binary blob: the sysex-addressable memory, the parts, polys and
+	// partials along with their envelope generators, the reverb and any samples waiting in the prerender buffer.
+	// Unlike a SynthCheckpoint, the blob refers to objects by number rather than by address, so it can be kept around and
+	// restored into another synth. Host settings aren't saved, same as for checkpoints.
+	// Returns the number of bytes written, or 0 if the synth isn't open or the buffer is too small.
+	Bit32u saveState(void *buffer, Bit32u bufferSize) const;
+	// Puts back a state saved by saveState(), possibly by another synth. That needs to have been open with the same ROMs
+	// and sample rate, on a machine with the same byte order, and if it pipelined the reverb, with the same maxSamplesPerRun.
+	// Returns false, leaving the synth as it was, if the state can't be used here, is damaged (there's a checksum) or turns
+	// out to be malformed part way through. To be able to undo that, it saves a checkpoint first, which allocates memory.
+	bool restoreState(const void *state, Bit32u stateSize);
+
+	// Returns a new synth, opened with the same properties and sharing the ROMs (see getROMImage()), that carries on from
+	// exactly where this one is: the emulation state is copied over with saveState() and restoreState(), along with the
+	// host settings (output gains, DAC input mode, reverb enabled/overridden), which can then be changed independently.
+	// Must not be called while this synth is rendering on another thread. Returns NULL if the synth isn't open or the
+	// clone couldn't be opened. The caller owns the clone, which needs closing and deleting as usual.
+	Synth *clone() const;
 };
 
 }
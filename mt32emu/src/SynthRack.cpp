@@ -0,0 +1,216 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <cstring>
+
+#include "mt32emu.h"
+#include "mmath.h"
+
+using namespace MT32Emu;
+
+// Frames rendered per pass by renderBuses()
+static const Bit32u RACK_BUFFER_FRAMES = MAX_SAMPLES_PER_RUN;
+
+SynthRack::SynthRack() {
+	synths = NULL;
+	synthCount = 0;
+	busNums = NULL;
+	synthBuffers = NULL;
+	busMixBuffer = NULL;
+	bufferFrames = 0;
+	cpuTimes = NULL;
+	renderTargets = NULL;
+	renderLen = 0;
+}
+
+SynthRack::~SynthRack() {
+	close();
+}
+
+bool SynthRack::open(SynthProperties &useProp, unsigned int useSynthCount, unsigned int threadCount) {
+	close();
+	if (useSynthCount == 0) {
+		return false;
+	}
+	SynthProperties rackProp = useProp;
+	// Synths are spread across the rack's threads instead
+	rackProp.renderThreads = 1;
+
+	synths = new Synth*[useSynthCount];
+	for (unsigned int i = 0; i < useSynthCount; i++) {
+		synths[i] = NULL;
+	}
+	synthCount = useSynthCount;
+	for (unsigned int i = 0; i < synthCount; i++) {
+		synths[i] = new Synth();
+		if (i > 0 && rackProp.romImage == NULL) {
+			// The first synth loaded the ROMs, the rest share them
+			rackProp.romImage = synths[0]->getROMImage();
+		}
+		if (!synths[i]->open(rackProp)) {
+			close();
+			return false;
+		}
+	}
+
+	busNums = new unsigned int[synthCount];
+	synthBuffers = new Bit16s*[synthCount];
+	cpuTimes = new double[synthCount];
+	bufferFrames = RACK_BUFFER_FRAMES;
+	for (unsigned int i = 0; i < synthCount; i++) {
+		busNums[i] = 0;
+		synthBuffers[i] = new Bit16s[bufferFrames * 2];
+		cpuTimes[i] = 0.0;
+	}
+	busMixBuffer = new Bit32s[bufferFrames * 2];
+
+	if (threadCount == 0) {
+		threadCount = Thread::getProcessorCount();
+	}
+	if (threadCount > synthCount) {
+		threadCount = synthCount;
+	}
+	// If the workers can't be started, the pool simply runs everything on the calling thread
+	if (threadCount > 1) {
+		workerPool.open(threadCount - 1);
+	}
+	return true;
+}
+
+void SynthRack::close() {
+	workerPool.close();
+	if (synths != NULL) {
+		for (unsigned int i = 0; i < synthCount; i++) {
+			if (synths[i] != NULL) {
+				synths[i]->close();
+				delete synths[i];
+			}
+		}
+		delete[] synths;
+		synths = NULL;
+	}
+	if (synthBuffers != NULL) {
+		for (unsigned int i = 0; i < synthCount; i++) {
+			delete[] synthBuffers[i];
+		}
+		delete[] synthBuffers;
+		synthBuffers = NULL;
+	}
+	delete[] busMixBuffer;
+	busMixBuffer = NULL;
+	delete[] busNums;
+	busNums = NULL;
+	delete[] cpuTimes;
+	cpuTimes = NULL;
+	bufferFrames = 0;
+	synthCount = 0;
+}
+
+unsigned int SynthRack::getSynthCount() const {
+	return synthCount;
+}
+
+Synth *SynthRack::getSynth(unsigned int synthIx) const {
+	return synthIx < synthCount ? synths[synthIx] : NULL;
+}
+
+void SynthRack::renderTask(void *context, unsigned int synthIx) {
+	SynthRack *rack = (SynthRack *)context;
+	// Each task runs start to finish on one thread, so the difference in that thread's CPU time is all spent on this synth
+	double startTime = Thread::getCPUTime();
+	Synth *synth = rack->synths[synthIx];
+	Bit16s *stream = rack->renderTargets[synthIx];
+	if (stream != NULL) {
+		synth->render(stream, rack->renderLen);
+	} else {
+		Bit32u len = rack->renderLen;
+		while (len > 0) {
+			Bit32u thisLen = len > rack->bufferFrames ? rack->bufferFrames : len;
+			synth->render(rack->synthBuffers[synthIx], thisLen);
+			len -= thisLen;
+		}
+	}
+	rack->cpuTimes[synthIx] += Thread::getCPUTime() - startTime;
+}
+
+void SynthRack::renderAll(Bit16s * const *targets, Bit32u len) {
+	renderTargets = targets;
+	renderLen = len;
+	workerPool.run(renderTask, this, synthCount);
+	renderTargets = NULL;
+}
+
+void SynthRack::render(Bit16s * const *streams, Bit32u len) {
+	if (synthCount == 0) {
+		return;
+	}
+	renderAll(streams, len);
+}
+
+void SynthRack::setBus(unsigned int synthIx, unsigned int busNum) {
+	if (synthIx < synthCount) {
+		busNums[synthIx] = busNum;
+	}
+}
+
+void SynthRack::renderBuses(Bit16s * const *busStreams, unsigned int busCount, Bit32u len) {
+	for (unsigned int busIx = 0; busIx < busCount; busIx++) {
+		if (busStreams[busIx] != NULL) {
+			memset(busStreams[busIx], 0, len * sizeof(Bit16s) * 2);
+		}
+	}
+	if (synthCount == 0) {
+		return;
+	}
+	Bit32u pos = 0;
+	while (pos < len) {
+		Bit32u thisLen = len - pos > bufferFrames ? bufferFrames : len - pos;
+		renderAll(synthBuffers, thisLen);
+		// Each bus is summed at full precision and clipped once, so the result doesn't depend on the order of the synths
+		for (unsigned int busIx = 0; busIx < busCount; busIx++) {
+			if (busStreams[busIx] == NULL) {
+				continue;
+			}
+			memset(busMixBuffer, 0, thisLen * sizeof(Bit32s) * 2);
+			for (unsigned int synthIx = 0; synthIx < synthCount; synthIx++) {
+				if (busNums[synthIx] != busIx) {
+					continue;
+				}
+				const Bit16s *source = synthBuffers[synthIx];
+				for (Bit32u i = 0; i < thisLen * 2; i++) {
+					busMixBuffer[i] += source[i];
+				}
+			}
+			Bit16s *target = busStreams[busIx] + pos * 2;
+			for (Bit32u i = 0; i < thisLen * 2; i++) {
+				target[i] = clipBit16s(busMixBuffer[i]);
+			}
+		}
+		pos += thisLen;
+	}
+}
+
+double SynthRack::getCPUTime(unsigned int synthIx) const {
+	return synthIx < synthCount ? cpuTimes[synthIx] : 0.0;
+}
+
+void SynthRack::resetCPUTimes() {
+	for (unsigned int i = 0; i < synthCount; i++) {
+		cpuTimes[i] = 0.0;
+	}
+}
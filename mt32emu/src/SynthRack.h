@@ -0,0 +1,87 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_SYNTH_RACK_H
+#define MT32EMU_SYNTH_RACK_H
+
+namespace MT32Emu {
+
+// A set of independent synths, rendered in parallel on a shared pool of threads.
+// All the synths share a single copy of the ROMs (as well as the Tables shared by all synths anyway).
+// Each synth can either be rendered into a stream of its own with render(), or mixed with others into
+// output buses with renderBuses().
+// As with a single Synth, all calls must be made from one thread at a time (other than from within callbacks).
+class SynthRack {
+private:
+	Synth **synths;
+	unsigned int synthCount;
+	WorkerPool workerPool;
+
+	// Bus of each synth, for renderBuses()
+	unsigned int *busNums;
+	// Interleaved stereo buffer for each synth with room for bufferFrames frames, used by renderBuses()
+	Bit16s **synthBuffers;
+	// Interleaved stereo buffer with room for bufferFrames frames, where renderBuses() sums the synths on a bus
+	Bit32s *busMixBuffer;
+	Bit32u bufferFrames;
+
+	// CPU time spent rendering each synth since open() or resetCPUTimes(), in seconds
+	double *cpuTimes;
+
+	// The current render job
+	Bit16s * const *renderTargets;
+	Bit32u renderLen;
+
+	SynthRack(const SynthRack &);
+	SynthRack &operator=(const SynthRack &);
+
+	static void renderTask(void *context, unsigned int synthIx);
+	void renderAll(Bit16s * const *targets, Bit32u len);
+
+public:
+	SynthRack();
+	~SynthRack();
+
+	// Opens useSynthCount synths with the given properties, loading the ROMs only once.
+	// threadCount is the number of threads to render with, including the one calling render() (0 means one per processor).
+	// SynthProperties::renderThreads is ignored - synths in a rack are rendered in parallel with each other instead.
+	bool open(SynthProperties &useProp, unsigned int useSynthCount, unsigned int threadCount);
+	void close();
+
+	unsigned int getSynthCount() const;
+	// Returns the synth for sending MIDI to (or NULL if synthIx is out of range)
+	Synth *getSynth(unsigned int synthIx) const;
+
+	// Renders len frames of interleaved stereo output for each synth into streams[synthIx].
+	// If a stream is NULL, the synth is rendered anyway (to keep it in time) but its output discarded.
+	void render(Bit16s * const *streams, Bit32u len);
+
+	// Sets the output bus the synth is mixed into by renderBuses(). All synths start on bus 0.
+	void setBus(unsigned int synthIx, unsigned int busNum);
+	// Renders len frames of all synths, and mixes them into interleaved stereo buses (clipping only the sum for each bus).
+	// Synths assigned to bus numbers >= busCount, or to buses whose stream is NULL, are rendered but not heard.
+	void renderBuses(Bit16s * const *busStreams, unsigned int busCount, Bit32u len);
+
+	// Returns the CPU time spent rendering the synth since open() or resetCPUTimes(), in seconds.
+	// Useful for deciding how to distribute synths between racks or processes.
+	double getCPUTime(unsigned int synthIx) const;
+	void resetCPUTimes();
+};
+
+}
+
+#endif
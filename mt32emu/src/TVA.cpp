@@ -33,7 +33,19 @@ TVA::TVA(const Partial *usePartial, LA32Ramp *useAmpRamp) :
 	partial(usePartial), ampRamp(useAmpRamp), system(&usePartial->getSynth()->mt32ram.system) {
 }
 
+// Records a phase change in the synth's trace (see EventTrace). The trip through TVA_PHASE_SUSTAIN - 1 that recalcSustain()
+// makes every so often while sustaining isn't a change as far as the trace is concerned.
+void TVA::tracePhase(int newPhase) {
+	if ((phase == TVA_PHASE_SUSTAIN && newPhase == TVA_PHASE_SUSTAIN - 1) || newPhase == tracedPhase) {
+		return;
+	}
+	tracedPhase = newPhase;
+	Synth *synth = partial->getSynth();
+	synth->trace.recordPartial(partial->debugGetPartialNum(), TraceEvent_tvaPhase, synth->renderedSampleCount + (Bit32u)partial->debugGetSampleNum(), (Bit8u)partial->getOwnerPart(), newPhase);
+}
+
 void TVA::startRamp(Bit8u newTarget, Bit8u newIncrement, int newPhase) {
+	tracePhase(newPhase);
 	target = newTarget;
 	phase = newPhase;
 	ampRamp->startRamp(newTarget, newIncrement);
@@ -43,6 +55,7 @@ void TVA::startRamp(Bit8u newTarget, Bit8u newIncrement, int newPhase) {
 }
 
 void TVA::end(int newPhase) {
+	tracePhase(newPhase);
 	phase = newPhase;
 	playing = false;
 #if MT32EMU_MONITOR_TVA >= 1
@@ -154,7 +167,7 @@ void TVA::reset(const Part *newPart, const TimbreParam::PartialParam *newPartial
 
 	playing = true;
 
-	Tables *tables = &partial->getSynth()->tables;
+	const Tables *tables = &partial->getSynth()->tables;
 
 	int key = partial->getPoly()->getKey();
 	int velocity = partial->getPoly()->getVelocity();
@@ -177,6 +190,7 @@ void TVA::reset(const Part *newPart, const TimbreParam::PartialParam *newPartial
 	}
 
 	ampRamp->reset();//currentAmp = 0;
+	tracedPhase = -1;
 
 	// "Go downward as quickly as possible".
 	// Since the current value is 0, the LA32Ramp will notice that we're already at or below the target and trying to go downward,
@@ -215,7 +229,7 @@ void TVA::recalcSustain() {
 		return;
 	}
 	// We're sustaining. Recalculate all the values
-	Tables *tables = &partial->getSynth()->tables;
+	const Tables *tables = &partial->getSynth()->tables;
 	int newTarget = calcBasicAmp(tables, partial, system, partialParam, patchTemp, rhythmTemp, biasAmpSubtraction, veloAmpSubtraction, part->getExpression());
 	newTarget += partialParam->tva.envLevel[3];
 	// Since we're in TVA_PHASE_SUSTAIN at this point, we know that target has been reached and an interrupt fired, so we can rely on it being the current amp.
@@ -241,7 +255,7 @@ int TVA::getPhase() const {
 }
 
 void TVA::nextPhase() {
-	Tables *tables = &partial->getSynth()->tables;
+	const Tables *tables = &partial->getSynth()->tables;
 
 	if (phase >= TVA_PHASE_DEAD || !playing) {
 		partial->getSynth()->printDebug("TVA::nextPhase(): Shouldn't have got here with phase %d, playing=%s", phase, playing ? "true" : "false");
@@ -362,4 +376,36 @@ void TVA::nextPhase() {
 	startRamp((Bit8u)newTarget, (Bit8u)newIncrement, newPhase);
 }
 
+
+void TVA::saveState(StateWriter &writer) const {
+	const Synth *synth = partial->getSynth();
+	synth->savePartRef(writer, part);
+	synth->saveMemoryRef(writer, partialParam);
+	synth->saveMemoryRef(writer, rhythmTemp);
+	writer.write(playing);
+	writer.write(biasAmpSubtraction);
+	writer.write(veloAmpSubtraction);
+	writer.write(keyTimeSubtraction);
+	writer.write(target);
+	writer.write(phase);
+}
+
+void TVA::loadState(StateReader &reader) {
+	const Synth *synth = partial->getSynth();
+	part = synth->loadPartRef(reader);
+	patchTemp = part == NULL ? NULL : part->getPatchTemp();
+	partialParam = (const TimbreParam::PartialParam *)synth->loadMemoryRef(reader, sizeof(TimbreParam::PartialParam));
+	rhythmTemp = (const MemParams::RhythmTemp *)synth->loadMemoryRef(reader, sizeof(MemParams::RhythmTemp));
+	reader.read(playing);
+	reader.read(biasAmpSubtraction);
+	reader.read(veloAmpSubtraction);
+	reader.read(keyTimeSubtraction);
+	reader.read(target);
+	reader.read(phase);
+	if (phase < TVA_PHASE_BASIC || phase > TVA_PHASE_DEAD) {
+		reader.fail();
+	}
+	tracedPhase = phase;
+}
+
 }
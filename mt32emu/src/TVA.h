@@ -72,9 +72,12 @@ private:
 
 	Bit8u target;
 	int phase;
+	// The last phase recorded in the trace, see tracePhase()
+	int tracedPhase;
 
 	void startRamp(Bit8u newTarget, Bit8u newIncrement, int newPhase);
 	void end(int newPhase);
+	void tracePhase(int newPhase);
 	void nextPhase();
 
 public:
@@ -87,6 +90,10 @@ public:
 
 	bool isPlaying() const;
 	int getPhase() const;
+
+	// See Synth::saveState()
+	void saveState(StateWriter &writer) const;
+	void loadState(StateReader &reader);
 };
 
 }
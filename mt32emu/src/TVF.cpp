@@ -117,7 +117,7 @@ void TVF::reset(const TimbreParam::PartialParam *newPartialParam, unsigned int b
 	unsigned int key = partial->getPoly()->getKey();
 	unsigned int velocity = partial->getPoly()->getVelocity();
 
-	Tables *tables = &partial->getSynth()->tables;
+	const Tables *tables = &partial->getSynth()->tables;
 
 	baseCutoff = calcBaseCutoff(newPartialParam, basePitch, key);
 #if MT32EMU_MONITOR_TVF >= 1
@@ -179,7 +179,7 @@ void TVF::startDecay() {
 }
 
 void TVF::nextPhase() {
-	Tables *tables = &partial->getSynth()->tables;
+	const Tables *tables = &partial->getSynth()->tables;
 	int newPhase = phase + 1;
 
 	switch (newPhase) {
@@ -227,4 +227,23 @@ void TVF::nextPhase() {
 	startRamp(newTarget, newIncrement, newPhase);
 }
 
+
+void TVF::saveState(StateWriter &writer) const {
+	partial->getSynth()->saveMemoryRef(writer, partialParam);
+	writer.write(baseCutoff);
+	writer.write(keyTimeSubtraction);
+	writer.write(levelMult);
+	writer.write(target);
+	writer.write(phase);
+}
+
+void TVF::loadState(StateReader &reader) {
+	partialParam = (const TimbreParam::PartialParam *)partial->getSynth()->loadMemoryRef(reader, sizeof(TimbreParam::PartialParam));
+	reader.read(baseCutoff);
+	reader.read(keyTimeSubtraction);
+	reader.read(levelMult);
+	reader.read(target);
+	reader.read(phase);
+}
+
 }
@@ -47,6 +47,10 @@ public:
 	Bit8u getBaseCutoff() const;
 	void handleInterrupt();
 	void startDecay();
+
+	// See Synth::saveState()
+	void saveState(StateWriter &writer) const;
+	void loadState(StateReader &reader);
 };
 
 }
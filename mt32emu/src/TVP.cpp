@@ -47,7 +47,11 @@ static Bit16u keyToPitchTable[] = {
 
 TVP::TVP(const Partial *usePartial) :
 	partial(usePartial), system(&usePartial->getSynth()->mt32ram.system) {
-	unsigned int sampleRate = usePartial->getSynth()->myProp.sampleRate;
+	refreshSampleRate();
+}
+
+void TVP::refreshSampleRate() {
+	unsigned int sampleRate = partial->getSynth()->myProp.sampleRate;
 	// We want to do processing 4000 times per second. FIXME: This is pretty arbitrary.
 	maxCounter = sampleRate / 4000;
 	// The timer runs at 500kHz. We only need to bother updating it every maxCounter samples, before we do processing.
@@ -325,4 +329,43 @@ void TVP::process() {
 	updatePitch();
 }
 
+
+void TVP::saveState(StateWriter &writer) const {
+	const Synth *synth = partial->getSynth();
+	synth->savePartRef(writer, part);
+	synth->saveMemoryRef(writer, partialParam);
+	writer.write(counter);
+	writer.write(timeElapsed);
+	writer.write(phase);
+	writer.write(basePitch);
+	writer.write(targetPitchOffsetWithoutLFO);
+	writer.write(currentPitchOffset);
+	writer.write(lfoPitchOffset);
+	writer.write(timeKeyfollowSubtraction);
+	writer.write(pitchOffsetChangePerBigTick);
+	writer.write(targetPitchOffsetReachedBigTick);
+	writer.write(shifts);
+	writer.write(pitch);
+}
+
+void TVP::loadState(StateReader &reader) {
+	// maxCounter and processTimerIncrement only depend on the sample rate, which the synth checks before restoring a state
+	const Synth *synth = partial->getSynth();
+	part = synth->loadPartRef(reader);
+	patchTemp = part == NULL ? NULL : part->getPatchTemp();
+	partialParam = (const TimbreParam::PartialParam *)synth->loadMemoryRef(reader, sizeof(TimbreParam::PartialParam));
+	reader.read(counter);
+	reader.read(timeElapsed);
+	reader.read(phase);
+	reader.read(basePitch);
+	reader.read(targetPitchOffsetWithoutLFO);
+	reader.read(currentPitchOffset);
+	reader.read(lfoPitchOffset);
+	reader.read(timeKeyfollowSubtraction);
+	reader.read(pitchOffsetChangePerBigTick);
+	reader.read(targetPitchOffsetReachedBigTick);
+	reader.read(shifts);
+	reader.read(pitch);
+}
+
 }
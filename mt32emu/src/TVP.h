@@ -56,10 +56,16 @@ private:
 	void process();
 public:
 	TVP(const Partial *partial);
+	// Picks up a new sample rate of the synth, see Synth::reconfigure(). The partial must not be playing.
+	void refreshSampleRate();
 	void reset(const Part *part, const TimbreParam::PartialParam *partialParam);
 	Bit32u getBasePitch() const;
 	Bit16u nextPitch();
 	void startDecay();
+
+	// See Synth::saveState()
+	void saveState(StateWriter &writer) const;
+	void loadState(StateReader &reader);
 };
 
 }
@@ -24,16 +24,16 @@
 
 using namespace MT32Emu;
 
-Tables::Tables() {
-	initialised = false;
-}
+// Built during static initialisation rather than on first use: a function-local static isn't guaranteed to be
+// initialised safely in C++98, and synths may be opened from several threads at once.
+// The Synth constructor only takes a reference to it, so a Synth may still be constructed before it is.
+const Tables Tables::instance;
 
-void Tables::init() {
-	if (initialised) {
-		return;
-	}
-	initialised = true;
+const Tables &Tables::getInstance() {
+	return instance;
+}
 
+Tables::Tables() {
 	int lf;
 	for (lf = 0; lf <= 100; lf++) {
 		// CONFIRMED:KG: This matches a ROM table found by Mok
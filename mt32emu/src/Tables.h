@@ -25,9 +25,18 @@ const int MIDDLEC = 60;
 class Synth;
 
 class Tables {
-	bool initialised;
+private:
+	static const Tables instance;
+
+	Tables();
+	Tables(const Tables &);
+	Tables &operator=(const Tables &);
 
 public:
+	// Returns the process-wide instance, which is built when the library is loaded and never modified afterwards.
+	// All Synth instances share it, so it costs no per-instance memory or open() time.
+	static const Tables &getInstance();
+
 	// Constant LUTs
 
 	// CONFIRMED: This is used to convert several parameters to amp-modifying values in the TVA envelope:
@@ -54,9 +63,6 @@ public:
 	float resAmpMax[32];
 	float resAmpFadeFactor[8];
 	float sinf10[5120];
-
-	Tables();
-	void init();
 };
 
 }
@@ -0,0 +1,276 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef _WIN32
+#include <windows.h>
+#include <climits>
+#else
+#include <pthread.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "mt32emu.h"
+
+using namespace MT32Emu;
+
+#ifdef _WIN32
+
+Mutex::Mutex() {
+	CRITICAL_SECTION *criticalSection = new CRITICAL_SECTION;
+	InitializeCriticalSection(criticalSection);
+	handle = criticalSection;
+}
+
+Mutex::~Mutex() {
+	CRITICAL_SECTION *criticalSection = (CRITICAL_SECTION *)handle;
+	DeleteCriticalSection(criticalSection);
+	delete criticalSection;
+}
+
+void Mutex::lock() {
+	EnterCriticalSection((CRITICAL_SECTION *)handle);
+}
+
+void Mutex::unlock() {
+	LeaveCriticalSection((CRITICAL_SECTION *)handle);
+}
+
+Semaphore::Semaphore() {
+	handle = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+}
+
+Semaphore::~Semaphore() {
+	CloseHandle((HANDLE)handle);
+}
+
+void Semaphore::post() {
+	ReleaseSemaphore((HANDLE)handle, 1, NULL);
+}
+
+void Semaphore::wait() {
+	WaitForSingleObject((HANDLE)handle, INFINITE);
+}
+
+unsigned long __stdcall Thread::threadMain(void *thread) {
+	Thread *self = (Thread *)thread;
+	self->func(self->context);
+	return 0;
+}
+
+bool Thread::start(ThreadFunc useFunc, void *useContext) {
+	if (handle != NULL) {
+		return false;
+	}
+	func = useFunc;
+	context = useContext;
+	handle = CreateThread(NULL, 0, threadMain, this, 0, NULL);
+	return handle != NULL;
+}
+
+void Thread::join() {
+	if (handle == NULL) {
+		return;
+	}
+	WaitForSingleObject((HANDLE)handle, INFINITE);
+	CloseHandle((HANDLE)handle);
+	handle = NULL;
+}
+
+unsigned int Thread::getProcessorCount() {
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	return systemInfo.dwNumberOfProcessors > 0 ? (unsigned int)systemInfo.dwNumberOfProcessors : 1;
+}
+
+double Thread::getCPUTime() {
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	if (!GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime)) {
+		return 0.0;
+	}
+	// FILETIMEs are in units of 100ns
+	double kernel = kernelTime.dwHighDateTime * 4294967296.0 + kernelTime.dwLowDateTime;
+	double user = userTime.dwHighDateTime * 4294967296.0 + userTime.dwLowDateTime;
+	return (kernel + user) / 10000000.0;
+}
+
+double Thread::getTime() {
+	LARGE_INTEGER counter, frequency;
+	if (QueryPerformanceCounter(&counter) && QueryPerformanceFrequency(&frequency)) {
+		return (double)counter.QuadPart / (double)frequency.QuadPart;
+	}
+	return GetTickCount() / 1000.0;
+}
+
+void Thread::memoryBarrier() {
+	MemoryBarrier();
+}
+
+#else
+
+struct SemaphoreState {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	unsigned int count;
+};
+
+Mutex::Mutex() {
+	pthread_mutex_t *mutex = new pthread_mutex_t;
+	pthread_mutex_init(mutex, NULL);
+	handle = mutex;
+}
+
+Mutex::~Mutex() {
+	pthread_mutex_t *mutex = (pthread_mutex_t *)handle;
+	pthread_mutex_destroy(mutex);
+	delete mutex;
+}
+
+void Mutex::lock() {
+	pthread_mutex_lock((pthread_mutex_t *)handle);
+}
+
+void Mutex::unlock() {
+	pthread_mutex_unlock((pthread_mutex_t *)handle);
+}
+
+// Unnamed POSIX semaphores aren't available everywhere (notably on Mac OS X), so this uses a condition variable
+Semaphore::Semaphore() {
+	SemaphoreState *state = new SemaphoreState;
+	pthread_mutex_init(&state->mutex, NULL);
+	pthread_cond_init(&state->cond, NULL);
+	state->count = 0;
+	handle = state;
+}
+
+Semaphore::~Semaphore() {
+	SemaphoreState *state = (SemaphoreState *)handle;
+	pthread_cond_destroy(&state->cond);
+	pthread_mutex_destroy(&state->mutex);
+	delete state;
+}
+
+void Semaphore::post() {
+	SemaphoreState *state = (SemaphoreState *)handle;
+	pthread_mutex_lock(&state->mutex);
+	state->count++;
+	pthread_cond_signal(&state->cond);
+	pthread_mutex_unlock(&state->mutex);
+}
+
+void Semaphore::wait() {
+	SemaphoreState *state = (SemaphoreState *)handle;
+	pthread_mutex_lock(&state->mutex);
+	while (state->count == 0) {
+		pthread_cond_wait(&state->cond, &state->mutex);
+	}
+	state->count--;
+	pthread_mutex_unlock(&state->mutex);
+}
+
+void *Thread::threadMain(void *thread) {
+	Thread *self = (Thread *)thread;
+	self->func(self->context);
+	return NULL;
+}
+
+bool Thread::start(ThreadFunc useFunc, void *useContext) {
+	if (handle != NULL) {
+		return false;
+	}
+	func = useFunc;
+	context = useContext;
+	pthread_t *thread = new pthread_t;
+	if (pthread_create(thread, NULL, threadMain, this) != 0) {
+		delete thread;
+		return false;
+	}
+	handle = thread;
+	return true;
+}
+
+void Thread::join() {
+	if (handle == NULL) {
+		return;
+	}
+	pthread_t *thread = (pthread_t *)handle;
+	pthread_join(*thread, NULL);
+	delete thread;
+	handle = NULL;
+}
+
+unsigned int Thread::getProcessorCount() {
+#ifdef _SC_NPROCESSORS_ONLN
+	long processorCount = sysconf(_SC_NPROCESSORS_ONLN);
+	if (processorCount > 0) {
+		return (unsigned int)processorCount;
+	}
+#endif
+	return 1;
+}
+
+double Thread::getCPUTime() {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+	struct timespec cpuTime;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuTime) == 0) {
+		return cpuTime.tv_sec + cpuTime.tv_nsec / 1000000000.0;
+	}
+#endif
+	struct timeval wallTime;
+	gettimeofday(&wallTime, NULL);
+	return wallTime.tv_sec + wallTime.tv_usec / 1000000.0;
+}
+
+double Thread::getTime() {
+#ifdef CLOCK_MONOTONIC
+	struct timespec time;
+	if (clock_gettime(CLOCK_MONOTONIC, &time) == 0) {
+		return time.tv_sec + time.tv_nsec / 1000000000.0;
+	}
+#endif
+	struct timeval wallTime;
+	gettimeofday(&wallTime, NULL);
+	return wallTime.tv_sec + wallTime.tv_usec / 1000000.0;
+}
+
+void Thread::memoryBarrier() {
+#ifdef __GNUC__
+	__sync_synchronize();
+#else
+	// POSIX guarantees that locking and unlocking a mutex synchronises memory
+	static pthread_mutex_t barrierMutex = PTHREAD_MUTEX_INITIALIZER;
+	pthread_mutex_lock(&barrierMutex);
+	pthread_mutex_unlock(&barrierMutex);
+#endif
+}
+
+#endif
+
+Thread::Thread() {
+	handle = NULL;
+	func = NULL;
+	context = NULL;
+}
+
+Thread::~Thread() {
+	join();
+}
+
+bool Thread::isStarted() const {
+	return handle != NULL;
+}
@@ -0,0 +1,103 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_THREAD_H
+#define MT32EMU_THREAD_H
+
+namespace MT32Emu {
+
+// Minimal portable threading primitives, implemented with POSIX threads or the Win32 API.
+// None of them allocate memory after construction, so they can be used in the render path.
+
+class Mutex {
+private:
+	void *handle;
+
+	Mutex(const Mutex &);
+	Mutex &operator=(const Mutex &);
+
+public:
+	Mutex();
+	~Mutex();
+	void lock();
+	void unlock();
+};
+
+// A counting semaphore, initially zero.
+class Semaphore {
+private:
+	void *handle;
+
+	Semaphore(const Semaphore &);
+	Semaphore &operator=(const Semaphore &);
+
+public:
+	Semaphore();
+	~Semaphore();
+	// Increments the count, waking up one waiting thread if there is one
+	void post();
+	// Waits until the count is non-zero, then decrements it
+	void wait();
+};
+
+class Thread {
+public:
+	typedef void (*ThreadFunc)(void *context);
+
+private:
+	void *handle;
+	ThreadFunc func;
+	void *context;
+
+	Thread(const Thread &);
+	Thread &operator=(const Thread &);
+
+#ifdef _WIN32
+	static unsigned long __stdcall threadMain(void *thread);
+#else
+	static void *threadMain(void *thread);
+#endif
+
+public:
+	Thread();
+	// Waits for the thread to finish if it's still running
+	~Thread();
+	// Runs func(context) on a new thread. Returns false if the thread couldn't be created.
+	bool start(ThreadFunc useFunc, void *useContext);
+	// Waits for the thread to finish. Does nothing if it wasn't started.
+	void join();
+	bool isStarted() const;
+
+	// Returns the number of processors available, or 1 if that can't be determined
+	static unsigned int getProcessorCount();
+
+	// Returns the CPU time used so far by the calling thread, in seconds.
+	// Where per-thread CPU time isn't available, wall clock time is used instead.
+	static double getCPUTime();
+
+	// Returns the time in seconds from an arbitrary starting point, for measuring short intervals.
+	// Where a monotonic high resolution clock isn't available, the time of day is used instead.
+	static double getTime();
+
+	// Full memory fence: memory accesses before the call are seen by other threads before any made after it.
+	// This is what lock-free structures shared between threads (such as EventTrace) rely on.
+	static void memoryBarrier();
+};
+
+}
+
+#endif
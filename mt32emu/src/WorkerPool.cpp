@@ -0,0 +1,127 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mt32emu.h"
+
+using namespace MT32Emu;
+
+WorkerPool::WorkerPool() {
+	workers = NULL;
+	workerCount = 0;
+	busy = false;
+	quit = false;
+	taskFunc = NULL;
+	taskContext = NULL;
+	taskCount = 0;
+	nextTaskIx = 0;
+}
+
+WorkerPool::~WorkerPool() {
+	close();
+}
+
+bool WorkerPool::open(unsigned int useWorkerCount) {
+	close();
+	if (useWorkerCount == 0) {
+		return true;
+	}
+	workers = new Thread[useWorkerCount];
+	quit = false;
+	for (workerCount = 0; workerCount < useWorkerCount; workerCount++) {
+		if (!workers[workerCount].start(workerMain, this)) {
+			close();
+			return false;
+		}
+	}
+	return true;
+}
+
+void WorkerPool::close() {
+	if (workers == NULL) {
+		return;
+	}
+	quit = true;
+	for (unsigned int i = 0; i < workerCount; i++) {
+		startSemaphore.post();
+	}
+	for (unsigned int i = 0; i < workerCount; i++) {
+		workers[i].join();
+	}
+	delete[] workers;
+	workers = NULL;
+	workerCount = 0;
+}
+
+unsigned int WorkerPool::getWorkerCount() const {
+	return workerCount;
+}
+
+void WorkerPool::workerMain(void *pool) {
+	WorkerPool *self = (WorkerPool *)pool;
+	for (;;) {
+		self->startSemaphore.wait();
+		if (self->quit) {
+			break;
+		}
+		self->runTasks();
+		self->doneSemaphore.post();
+	}
+}
+
+void WorkerPool::runTasks() {
+	for (;;) {
+		mutex.lock();
+		if (nextTaskIx >= taskCount) {
+			mutex.unlock();
+			return;
+		}
+		unsigned int taskIx = nextTaskIx++;
+		mutex.unlock();
+		taskFunc(taskContext, taskIx);
+	}
+}
+
+void WorkerPool::run(TaskFunc func, void *context, unsigned int count) {
+	mutex.lock();
+	if (busy || workerCount == 0 || count < 2) {
+		mutex.unlock();
+		for (unsigned int i = 0; i < count; i++) {
+			func(context, i);
+		}
+		return;
+	}
+	busy = true;
+	taskFunc = func;
+	taskContext = context;
+	taskCount = count;
+	nextTaskIx = 0;
+	mutex.unlock();
+
+	// Workers beyond the number of tasks would find nothing to do
+	unsigned int helperCount = count - 1 < workerCount ? count - 1 : workerCount;
+	for (unsigned int i = 0; i < helperCount; i++) {
+		startSemaphore.post();
+	}
+	runTasks();
+	for (unsigned int i = 0; i < helperCount; i++) {
+		doneSemaphore.wait();
+	}
+
+	mutex.lock();
+	busy = false;
+	mutex.unlock();
+}
@@ -0,0 +1,70 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_WORKER_POOL_H
+#define MT32EMU_WORKER_POOL_H
+
+namespace MT32Emu {
+
+// A fixed set of worker threads that run batches of independent tasks together with the calling thread.
+// Tasks are handed out one at a time, so threads that finish early pick up the remaining ones.
+// If the pool is already busy with another batch (e.g. when it's shared between several synths, or run() is called
+// from one of its own tasks), or it has no workers, the batch is simply run on the calling thread.
+class WorkerPool {
+public:
+	typedef void (*TaskFunc)(void *context, unsigned int taskIx);
+
+private:
+	Thread *workers;
+	unsigned int workerCount;
+
+	Mutex mutex;
+	Semaphore startSemaphore;
+	Semaphore doneSemaphore;
+	bool busy;
+	bool quit;
+
+	// The current batch, guarded by mutex
+	TaskFunc taskFunc;
+	void *taskContext;
+	unsigned int taskCount;
+	unsigned int nextTaskIx;
+
+	WorkerPool(const WorkerPool &);
+	WorkerPool &operator=(const WorkerPool &);
+
+	static void workerMain(void *pool);
+	void runTasks();
+
+public:
+	WorkerPool();
+	~WorkerPool();
+
+	// Starts the given number of worker threads, in addition to the threads that will be calling run().
+	// Returns false if they couldn't all be started, in which case the pool is left closed.
+	bool open(unsigned int useWorkerCount);
+	void close();
+	unsigned int getWorkerCount() const;
+
+	// Calls func(context, taskIx) for each taskIx in 0..count-1, and returns when all of them have finished.
+	// The order in which tasks start is unspecified.
+	void run(TaskFunc func, void *context, unsigned int count);
+};
+
+}
+
+#endif
@@ -15,6 +15,7 @@ void allpass::setbuffer(float *buf, int size)
 {
 	buffer = buf;
 	bufsize = size;
+	bufidx = 0;
 }
 
 void allpass::mute()
@@ -33,6 +34,16 @@ float allpass::getfeedback()
 	return feedback;
 }
 
+int allpass::getindex()
+{
+	return bufidx;
+}
+
+void allpass::setindex(int idx)
+{
+	bufidx = idx;
+}
+
 void allpass::deletebuffer()
 {
 	delete[] buffer;
@@ -18,6 +18,8 @@ public:
 	        void    mute();
 	        void    setfeedback(float val);
 	        float   getfeedback();
+	        int     getindex();
+	        void    setindex(int idx);
 // private:
 	float   feedback;
 	float   *buffer;
@@ -17,6 +17,8 @@ void comb::setbuffer(float *buf, int size)
 	buffer = buf;
 	bufferptr = buf;
 	bufsize = size;
+	bufidx = 0;
+	filterstore = 0;
 }
 
 void comb::mute()
@@ -49,6 +51,19 @@ float comb::getfeedback()
 	return feedback;
 }
 
+void comb::getstate(float &store, int &idx)
+{
+	store = filterstore;
+	idx = bufidx;
+}
+
+void comb::setstate(float store, int idx)
+{
+	filterstore = store;
+	bufidx = idx;
+	bufferptr = buffer + idx;
+}
+
 void comb::deletebuffer()
 {
 	delete[] buffer;
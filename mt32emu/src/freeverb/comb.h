@@ -21,6 +21,8 @@ public:
 	        float   getdamp();
 	        void    setfeedback(float val);
 	        float   getfeedback();
+	        void    getstate(float &store, int &idx);
+	        void    setstate(float store, int idx);
 private:
 	float   feedback;
 	float   filterstore;
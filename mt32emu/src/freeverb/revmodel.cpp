@@ -10,23 +10,20 @@
 revmodel::revmodel(float scaletuning)
 {
 	int i;
-	int bufsize;
 
-	// Allocate buffers for the components
+	// The delay lines are provided by the caller through setbuffer(), as a single block of this many samples
+	buffersize = 0;
 	for (i = 0; i < numcombs; i++) {
-		bufsize = int(scaletuning * combtuning[i]);
-		combL[i].setbuffer(new float[bufsize], bufsize);
-		bufsize += int(scaletuning * stereospread);
-		combR[i].setbuffer(new float[bufsize], bufsize);
+		combsize[i] = int(scaletuning * combtuning[i]);
+		buffersize += 2 * combsize[i] + int(scaletuning * stereospread);
 	}
 	for (i = 0; i < numallpasses; i++) {
-		bufsize = int(scaletuning * allpasstuning[i]);
-		allpassL[i].setbuffer(new float[bufsize], bufsize);
+		allpasssize[i] = int(scaletuning * allpasstuning[i]);
+		buffersize += 2 * allpasssize[i] + int(scaletuning * stereospread);
 		allpassL[i].setfeedback(0.5f);
-		bufsize += int(scaletuning * stereospread);
-		allpassR[i].setbuffer(new float[bufsize], bufsize);
 		allpassR[i].setfeedback(0.5f);
 	}
+	stereospreadsize = int(scaletuning * stereospread);
 
 	// Set default values
 	dry = initialdry;
@@ -36,25 +33,87 @@ revmodel::revmodel(float scaletuning)
 	width = initialwidth;
 	mode = initialmode;
 	update();
+}
+
+revmodel::~revmodel()
+{
+}
+
+int revmodel::getbuffersize()
+{
+	return buffersize;
+}
+
+void revmodel::setbuffer(float *buf)
+{
+	int i;
+
+	// Carve the buffers for the components out of the block
+	for (i = 0; i < numcombs; i++) {
+		combL[i].setbuffer(buf, combsize[i]);
+		buf += combsize[i];
+		combR[i].setbuffer(buf, combsize[i] + stereospreadsize);
+		buf += combsize[i] + stereospreadsize;
+	}
+	for (i = 0; i < numallpasses; i++) {
+		allpassL[i].setbuffer(buf, allpasssize[i]);
+		buf += allpasssize[i];
+		allpassR[i].setbuffer(buf, allpasssize[i] + stereospreadsize);
+		buf += allpasssize[i] + stereospreadsize;
+	}
 
 	// Buffer will be full of rubbish - so we MUST mute them
 	mute();
 }
 
-revmodel::~revmodel()
+void revmodel::getstate(revmodelstate &state)
 {
 	int i;
 
+	state.roomsize = roomsize;
+	state.damp = damp;
+	state.wet = wet;
+	state.dry = dry;
+	state.width = width;
+	state.mode = mode;
+	state.filtval = filtval;
+	state.filtprev1 = filtprev1;
+	state.filtprev2 = filtprev2;
 	for (i = 0; i < numcombs; i++) {
-		combL[i].deletebuffer();
-		combR[i].deletebuffer();
+		combL[i].getstate(state.combstoreL[i], state.combidxL[i]);
+		combR[i].getstate(state.combstoreR[i], state.combidxR[i]);
 	}
 	for (i = 0; i < numallpasses; i++) {
-		allpassL[i].deletebuffer();
-		allpassR[i].deletebuffer();
+		state.allpassidxL[i] = allpassL[i].getindex();
+		state.allpassidxR[i] = allpassR[i].getindex();
 	}
 }
 
+void revmodel::setstate(const revmodelstate &state)
+{
+	int i;
+
+	roomsize = state.roomsize;
+	damp = state.damp;
+	wet = state.wet;
+	dry = state.dry;
+	width = state.width;
+	mode = state.mode;
+	filtval = state.filtval;
+	filtprev1 = state.filtprev1;
+	filtprev2 = state.filtprev2;
+	for (i = 0; i < numcombs; i++) {
+		combL[i].setstate(state.combstoreL[i], state.combidxL[i]);
+		combR[i].setstate(state.combstoreR[i], state.combidxR[i]);
+	}
+	for (i = 0; i < numallpasses; i++) {
+		allpassL[i].setindex(state.allpassidxL[i]);
+		allpassR[i].setindex(state.allpassidxR[i]);
+	}
+	// Recalculates everything derived from the parameters above
+	update();
+}
+
 void revmodel::mute()
 {
 	int i;
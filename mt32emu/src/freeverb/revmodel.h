@@ -12,6 +12,16 @@
 #include "allpass.h"
 #include "tuning.h"
 
+// Everything needed to put a revmodel back as it was, apart from the contents of its buffer
+struct revmodelstate
+{
+	float  roomsize, damp, wet, dry, width, mode;
+	float  filtval, filtprev1, filtprev2;
+	float  combstoreL[numcombs], combstoreR[numcombs];
+	int    combidxL[numcombs], combidxR[numcombs];
+	int    allpassidxL[numallpasses], allpassidxR[numallpasses];
+};
+
 class revmodel
 {
 public:
@@ -32,6 +42,10 @@ public:
 			void   setmode(float value);
 			float  getmode();
 			void   setfiltval(float value);
+			int    getbuffersize();
+			void   setbuffer(float *buf);
+			void   getstate(revmodelstate &state);
+			void   setstate(const revmodelstate &state);
 private:
 			void   update();
 private:
@@ -48,6 +62,12 @@ private:
 	float filtprev1;
 	float filtprev2;
 
+	// Size of the single block holding the buffers of all the filters below
+	int    buffersize;
+	int    combsize[numcombs];
+	int    allpasssize[numallpasses];
+	int    stereospreadsize;
+
 	// Comb filters
 	comb   combL[numcombs];
 	comb   combR[numcombs];
@@ -68,6 +68,14 @@ static inline float LOG10F(float x) {
 	return log10(x);
 }
 
+static inline Bit16s clipBit16s(Bit32s a) {
+	// Clamp values above 32767 to 32767, and values below -32768 to -32768
+	if ((a + 32768) & ~65535) {
+		return (a >> 31) ^ 32767;
+	}
+	return a;
+}
+
 }
 
 #endif
@@ -73,8 +73,9 @@
 // No point making it more than MT32EMU_MAX_PARTIALS, since each note needs at least one partial.
 #define MT32EMU_MAX_POLY 32
 
-// If non-zero, deletes reverb buffers that are not in use to save memory.
-// If zero, keeps reverb buffers for all modes around all the time to avoid allocating/freeing in the critical path.
+// If non-zero, all reverb modes share a single buffer sized for the largest one, and a mode's state is discarded when switching away from it.
+// If zero, each reverb mode has a buffer of its own, so all modes are kept open all the time.
+// Either way, the buffers are allocated when the synth is opened, so switching modes never allocates memory.
 #define MT32EMU_REDUCE_REVERB_MEMORY 1
 
 // 0: Use standard Freeverb
@@ -83,6 +84,7 @@
 
 namespace MT32Emu
 {
+// The default for SynthProperties::maxSamplesPerRun, used when that is 0.
 // The higher this number, the more memory will be used, but the more samples can be processed in one run -
 // various parts of sample generation can be processed more efficiently in a single run.
 // A run's maximum length is that given to Synth::render(), so giving a value here higher than render() is ever
@@ -92,6 +94,7 @@ namespace MT32Emu
 // This value must be >= 1.
 const unsigned int MAX_SAMPLES_PER_RUN = 4096;
 
+// The default for SynthProperties::maxPrerenderSamples, used when that is 0.
 // This determines the amount of memory available for simulating delays.
 // If set too low, partials aborted to allow other partials to play will not end gracefully, but will terminate
 // abruptly and potentially cause a pop/crackle in the audio output.
@@ -101,6 +104,11 @@ const unsigned int MAX_PRERENDER_SAMPLES = 1024;
 
 #include "Structures.h"
 #include "File.h"
+#include "Arena.h"
+#include "StateStream.h"
+#include "Thread.h"
+#include "WorkerPool.h"
+#include "EventTrace.h"
 #include "Tables.h"
 #include "Poly.h"
 #include "LA32Ramp.h"
@@ -110,5 +118,7 @@ const unsigned int MAX_PRERENDER_SAMPLES = 1024;
 #include "Partial.h"
 #include "Part.h"
 #include "Synth.h"
+#include "SynthRack.h"
+#include "RenderAhead.h"
 
 #endif
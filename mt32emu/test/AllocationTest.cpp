@@ -0,0 +1,216 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks that playing notes and rendering don't allocate memory once the synth is open (see Synth::open() and PolyList),
+// and that neither does queueing events for a RenderAhead, which is meant to be done from a real-time MIDI thread
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "TestSupport.h"
+#include "Tests.h"
+
+using namespace MT32Emu;
+
+static bool countingAllocations = false;
+static unsigned long allocationCount = 0;
+
+static void *countedAllocate(size_t size) {
+	if (countingAllocations) {
+		allocationCount++;
+	}
+	void *block = malloc(size > 0 ? size : 1);
+	if (block == NULL) {
+		throw std::bad_alloc();
+	}
+	return block;
+}
+
+#if __cplusplus >= 201103L
+void *operator new(size_t size) {
+	return countedAllocate(size);
+}
+
+void *operator new[](size_t size) {
+	return countedAllocate(size);
+}
+
+void operator delete(void *block) noexcept {
+	free(block);
+}
+
+void operator delete[](void *block) noexcept {
+	free(block);
+}
+#else
+void *operator new(size_t size) throw(std::bad_alloc) {
+	return countedAllocate(size);
+}
+
+void *operator new[](size_t size) throw(std::bad_alloc) {
+	return countedAllocate(size);
+}
+
+void operator delete(void *block) throw() {
+	free(block);
+}
+
+void operator delete[](void *block) throw() {
+	free(block);
+}
+#endif
+
+static bool testSynth(const TestConfig &config) {
+	const unsigned int blockCount = getTestBlockCount(config, 128000);
+
+	SynthProperties prop;
+	initTestProperties(prop, config);
+	Synth *synth = openTestSynth(prop);
+	if (synth == NULL) {
+		return false;
+	}
+	Bit16s *stream = new Bit16s[config.blockLen * 2];
+
+	// Enough notes at once to keep all the partials busy, so that polys are stolen as well as freed
+	TestWorkload workload(1, 12, false);
+	unsigned long playAllocations = 0;
+	unsigned long renderAllocations = 0;
+	Bit32u nonZeroSamples = 0;
+	bool reconfigured = false;
+	for (unsigned int blockNum = 0; blockNum < blockCount; blockNum++) {
+		allocationCount = 0;
+		countingAllocations = true;
+		// Reconfiguring is done in place as well
+		if (blockNum == blockCount / 2) {
+			reconfigured = synth->reconfigure(prop.sampleRate);
+		}
+		workload.playBlock(synth, blockNum);
+		countingAllocations = false;
+		playAllocations += allocationCount;
+
+		allocationCount = 0;
+		countingAllocations = true;
+		synth->render(stream, config.blockLen);
+		countingAllocations = false;
+		renderAllocations += allocationCount;
+		nonZeroSamples += countNonZeroSamples(stream, config.blockLen);
+	}
+
+	delete[] stream;
+	closeTestSynth(synth);
+
+	if (playAllocations != 0 || renderAllocations != 0) {
+		printf("%s: allocations while playing: %lu, while rendering: %lu\n", config.name, playAllocations, renderAllocations);
+		return false;
+	}
+	if (nonZeroSamples == 0) {
+		printf("%s: the synth produced no sound\n", config.name);
+		return false;
+	}
+	if (!reconfigured) {
+		printf("%s: unable to reconfigure the synth\n", config.name);
+		return false;
+	}
+	return true;
+}
+
+// Queues a sysex message writing 256 bytes of patch memory, followed by a note, for every block. That's more sysex in all
+// than the RenderAhead has room for, so it also checks that the room taken by played messages is reused.
+static bool testRenderAhead() {
+	const unsigned int blockCount = 400;
+	const Bit32u blockLen = 256;
+	const Bit32u maxEvents = 32;
+	// How long to wait for the render-ahead thread to catch up when the queue is full, in seconds
+	const double maxWaitTime = 10.0;
+
+	SynthProperties prop;
+	initTestProperties(prop);
+	prop.maxSamplesPerRun = blockLen;
+	Synth *synth = openTestSynth(prop);
+	if (synth == NULL) {
+		return false;
+	}
+	RenderAhead renderAhead;
+	if (!renderAhead.open(synth, blockLen * 16, blockLen * 2, maxEvents)) {
+		printf("Unable to open the RenderAhead\n");
+		closeTestSynth(synth);
+		return false;
+	}
+	Bit8u sysex[10 + 256];
+	sysex[0] = 0xF0;
+	sysex[1] = 0x41;
+	sysex[2] = 0x10;
+	sysex[3] = 0x16;
+	sysex[4] = 0x12;
+	sysex[5] = 0x05;
+	sysex[6] = 0x00;
+	sysex[7] = 0x00;
+	sysex[sizeof(sysex) - 1] = 0xF7;
+	Bit16s *stream = new Bit16s[blockLen * 2];
+	Bit32u sysexBytesQueued = 0;
+	unsigned long queueAllocations = 0;
+	double waitTime = 0.0;
+	bool passed = true;
+	for (unsigned int blockNum = 0; blockNum < blockCount && passed; blockNum++) {
+		for (unsigned int i = 8; i < sizeof(sysex) - 2; i++) {
+			sysex[i] = (Bit8u)((blockNum + i) % 2);
+		}
+		sysex[sizeof(sysex) - 2] = Synth::calcSysexChecksum(&sysex[5], sizeof(sysex) - 7, 0);
+		Bit32u timestamp = renderAhead.getPlayPosition() + blockLen * 4;
+		for (;;) {
+			allocationCount = 0;
+			countingAllocations = true;
+			bool queued = renderAhead.playSysex(sysex, sizeof(sysex), timestamp);
+			if (queued) {
+				queued = renderAhead.playMsg(0x641091 | ((blockNum % 2) << 8), timestamp);
+			}
+			countingAllocations = false;
+			queueAllocations += allocationCount;
+			if (queued) {
+				break;
+			}
+			if (waitTime > maxWaitTime) {
+				printf("The RenderAhead's queue stayed full after %u sysex bytes had been queued\n", sysexBytesQueued);
+				passed = false;
+				break;
+			}
+			// Plays on, at no more than realtime speed, so that retired events make room
+			renderAhead.render(stream, blockLen);
+			double waitStart = Thread::getTime();
+			while (Thread::getTime() - waitStart < 0.005) {
+			}
+			waitTime += Thread::getTime() - waitStart;
+		}
+		sysexBytesQueued += sizeof(sysex);
+		renderAhead.render(stream, blockLen);
+	}
+	renderAhead.close();
+	delete[] stream;
+	closeTestSynth(synth);
+
+	if (queueAllocations != 0) {
+		printf("Allocations while queueing RenderAhead events: %lu\n", queueAllocations);
+		passed = false;
+	}
+	return passed;
+}
+
+bool MT32Emu::runAllocationTest() {
+	bool passed = runInTestConfigs(testSynth);
+	return testRenderAhead() && passed;
+}
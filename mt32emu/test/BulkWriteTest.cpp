@@ -0,0 +1,210 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks that loading a set of sysex messages between beginBulkWrite() and commitBulkWrite() leaves the synth just as
+// loading them one by one does, in its memory and in what it renders afterwards. The set reassigns the channels part way
+// through, and the channel-specific messages after that have to reach the newly assigned parts.
+
+#include <cstddef>
+#include <cstring>
+
+#include "TestSupport.h"
+#include "Tests.h"
+
+using namespace MT32Emu;
+
+static const Bit32u MAX_SET_LEN = 16384;
+static const unsigned int BLOCK_COUNT = 200;
+static const Bit32u BLOCK_LEN = 256;
+
+// A set of sysex messages, one after another as in a .syx file
+class SysexSet {
+private:
+	Bit8u bytes[MAX_SET_LEN];
+	Bit32u len;
+
+public:
+	SysexSet() : len(0) {
+	}
+
+	void clear() {
+		len = 0;
+	}
+
+	void add(Bit32u addr, const Bit8u *data, Bit32u dataLen) {
+		len += makeTestSysex(bytes + len, addr, data, dataLen);
+	}
+
+	// Adds a message to the part the channel is assigned to at the time, with an address relative to its patch temp area
+	void addForChannel(Bit8u chan, Bit32u addr, const Bit8u *data, Bit32u dataLen) {
+		Bit8u *sysex = bytes + len;
+		add(addr, data, dataLen);
+		// The device ID isn't covered by the checksum
+		sysex[2] = chan;
+	}
+
+	void load(Synth *synth, bool bulk) const {
+		if (bulk) {
+			synth->beginBulkWrite();
+		}
+		synth->parseStream(bytes, len);
+		if (bulk) {
+			synth->commitBulkWrite();
+		}
+	}
+};
+
+// Adds a write of a memory timbre, copied from a ROM timbre with the partials muted and the pitch changed as given
+static void addMemoryTimbre(Synth *synth, SysexSet &set, unsigned int timbreNum, Bit8u partialMute, Bit8u pitchCoarse) {
+	TimbreParam timbre;
+	synth->readMemory(MT32EMU_MEMADDR(0x080000) + (4 + timbreNum) * 256, sizeof(timbre), (Bit8u *)&timbre);
+	timbre.common.partialMute = partialMute;
+	for (unsigned int partialNum = 0; partialNum < 4; partialNum++) {
+		timbre.partial[partialNum].wg.pitchCoarse = pitchCoarse;
+	}
+	set.add(MT32EMU_MEMADDR(0x080000) + timbreNum * 256, (const Bit8u *)&timbre, sizeof(timbre));
+}
+
+// Loaded into both synths as usual before they play anything
+static void buildSetup(Synth *synth, SysexSet &set) {
+	addMemoryTimbre(synth, set, 1, 15, 36);
+	addMemoryTimbre(synth, set, 2, 3, 36);
+	// Parts 1 and 2 set to the first memory timbre
+	MemParams::PatchTemp patchTemps[2];
+	synth->readMemory(MT32EMU_MEMADDR(0x030000), sizeof(patchTemps), (Bit8u *)patchTemps);
+	for (unsigned int i = 0; i < 2; i++) {
+		patchTemps[i].patch.timbreGroup = 2;
+		patchTemps[i].patch.timbreNum = 1;
+	}
+	set.add(MT32EMU_MEMADDR(0x030000), (const Bit8u *)patchTemps, sizeof(patchTemps));
+	// Part 3 made to play its timbre temp area rather than the ROM timbre of its patch, by a write with three partials
+	Bit8u partialMute = 7;
+	set.add(MT32EMU_MEMADDR(0x040000) + 2 * sizeof(TimbreParam) + offsetof(TimbreParam::CommonParam, partialMute), &partialMute, 1);
+	// Rhythm keys 36-47 set to the first memory timbre
+	Bit8u rhythmKeys[12 * sizeof(MemParams::RhythmTemp)];
+	for (unsigned int i = 0; i < 12; i++) {
+		Bit8u *rhythmKey = rhythmKeys + i * sizeof(MemParams::RhythmTemp);
+		rhythmKey[0] = 1;
+		rhythmKey[1] = 80;
+		rhythmKey[2] = (Bit8u)i;
+		rhythmKey[3] = 1;
+	}
+	set.add(MT32EMU_MEMADDR(0x030110) + (36 - 24) * sizeof(MemParams::RhythmTemp), rhythmKeys, sizeof(rhythmKeys));
+}
+
+// Loaded into one synth as a bulk write and into the other one by one, after playing for a while so that the parts have
+// cached their timbres
+static void buildSet(Synth *synth, SysexSet &set) {
+	// Patch temp area for part 1 (by channel), set to a memory timbre which is only written further on
+	MemParams::PatchTemp patchTemp;
+	memset(&patchTemp, 0, sizeof(patchTemp));
+	patchTemp.patch.timbreGroup = 2;
+	patchTemp.patch.timbreNum = 1;
+	patchTemp.patch.fineTune = 50;
+	patchTemp.patch.benderRange = 12;
+	patchTemp.patch.reverbSwitch = 1;
+	patchTemp.outputLevel = 100;
+	patchTemp.panpot = 3;
+	set.addForChannel(1, 0, (const Bit8u *)&patchTemp, sizeof(patchTemp));
+	// Swap the channels of parts 1 and 2, along with new reverb, partial reserve and master volume settings
+	Bit8u system[SYSTEM_MASTER_VOL_OFF + 1];
+	synth->readMemory(MT32EMU_MEMADDR(0x100000), sizeof(system), system);
+	system[SYSTEM_REVERB_MODE_OFF] = 2;
+	system[SYSTEM_REVERB_TIME_OFF] = 5;
+	system[SYSTEM_REVERB_LEVEL_OFF] = 6;
+	static const Bit8u reserveSettings[] = {6, 6, 4, 2, 2, 2, 2, 2, 6};
+	memcpy(system + SYSTEM_RESERVE_SETTINGS_START_OFF, reserveSettings, sizeof(reserveSettings));
+	system[SYSTEM_CHAN_ASSIGN_START_OFF] = 2;
+	system[SYSTEM_CHAN_ASSIGN_START_OFF + 1] = 1;
+	system[SYSTEM_MASTER_VOL_OFF] = 90;
+	set.add(MT32EMU_MEMADDR(0x100000), system, sizeof(system));
+	// Channel 2 now addresses part 2, so this goes to part 2 rather than part 1 as above, switching it to the second memory
+	// timbre
+	patchTemp.patch.timbreNum = 2;
+	patchTemp.patch.keyShift = 31;
+	patchTemp.panpot = 11;
+	set.addForChannel(1, 0, (const Bit8u *)&patchTemp, sizeof(patchTemp));
+	// Part 3 down to the first two partials, which only a refresh of the part itself picks up
+	Bit8u partialMute = 3;
+	set.add(MT32EMU_MEMADDR(0x040000) + 2 * sizeof(TimbreParam) + offsetof(TimbreParam::CommonParam, partialMute), &partialMute, 1);
+	// The memory timbres which parts 1 and 2 play. The rhythm part is already playing the first one, which now loses all
+	// but its first partial, so the rhythm part has to rebuild its cache.
+	addMemoryTimbre(synth, set, 1, 1, 30);
+	addMemoryTimbre(synth, set, 2, 15, 40);
+	// Patches 1-8 for the program changes of the workload, alternating between the two memory timbres
+	for (unsigned int i = 0; i < 8; i++) {
+		PatchParam patch;
+		memset(&patch, 0, sizeof(patch));
+		patch.timbreGroup = 2;
+		patch.timbreNum = (Bit8u)(1 + i % 2);
+		patch.keyShift = (Bit8u)(20 + i);
+		patch.fineTune = 50;
+		patch.benderRange = 2;
+		patch.reverbSwitch = 1;
+		set.add(MT32EMU_MEMADDR(0x050000) + i * sizeof(PatchParam), (const Bit8u *)&patch, sizeof(patch));
+	}
+}
+
+// Plays a note on each of MIDI channels 2-10, which has each part (re)build the cache of the timbre it plays. The rhythm
+// part plays key 36.
+static void playNotes(Synth *synth) {
+	for (Bit32u chan = 1; chan <= 9; chan++) {
+		synth->playMsg(0x90 | chan | ((chan == 9 ? 36 : 40 + chan * 3) << 8) | (100 << 16));
+	}
+}
+
+static void stopNotes(Synth *synth) {
+	for (Bit32u chan = 1; chan <= 9; chan++) {
+		synth->playMsg(0xB0 | chan | (0x7B << 8));
+	}
+}
+
+bool MT32Emu::runBulkWriteTest() {
+	SynthProperties prop;
+	initTestProperties(prop);
+	Synth *oneByOne = openTestSynth(prop);
+	Synth *bulk = openTestSynth(prop);
+	bool passed = false;
+	if (oneByOne != NULL && bulk != NULL) {
+		// No events of its own, just rendering
+		TestWorkload silentWorkload(460, 0);
+		SysexSet *set = new SysexSet;
+		buildSetup(oneByOne, *set);
+		set->load(oneByOne, false);
+		set->load(bulk, false);
+		playNotes(oneByOne);
+		playNotes(bulk);
+		passed = compareTestRenders("Before bulk write", silentWorkload, oneByOne, bulk, BLOCK_COUNT, BLOCK_LEN);
+		stopNotes(oneByOne);
+		stopNotes(bulk);
+		set->clear();
+		buildSet(oneByOne, *set);
+		set->load(oneByOne, false);
+		set->load(bulk, true);
+		delete set;
+		passed = compareTestMemory("Bulk write", oneByOne, bulk) && passed;
+		playNotes(oneByOne);
+		playNotes(bulk);
+		passed = compareTestRenders("Bulk write", silentWorkload, oneByOne, bulk, BLOCK_COUNT, BLOCK_LEN) && passed;
+		// Then the program changes of the workload, which select the patches written
+		TestWorkload workload(460);
+		passed = compareTestRenders("After bulk write", workload, oneByOne, bulk, BLOCK_COUNT, BLOCK_LEN) && passed;
+	}
+	closeTestSynth(oneByOne);
+	closeTestSynth(bulk);
+	return passed;
+}
@@ -0,0 +1,95 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks that after Synth::chase(), a synth renders the same dry streams as one that rendered all along.
+// The reverb has no input while chasing, so the wet streams are expected to differ until the reverb catches up.
+
+#include <cstdio>
+
+#include "TestSupport.h"
+#include "Tests.h"
+
+using namespace MT32Emu;
+
+// nonReverbLeft, nonReverbRight, reverbDryLeft and reverbDryRight, as passed to renderStreams()
+static const unsigned int DRY_STREAM_COUNT = 4;
+
+static bool testChase(const TestConfig &config) {
+	// Chases through two seconds, then renders one
+	const unsigned int chaseBlocks = getTestBlockCount(config, 64000);
+	const unsigned int renderBlocks = getTestBlockCount(config, 32000);
+	const Bit32u blockLen = config.blockLen;
+	// With pipelined reverb, the output held back by the reverb stage is muted after chasing (see Synth::chase()), and so are
+	// any frames still waiting in the prerender buffer, since they came out of the stage
+	const Bit32u mutedFrames = config.pipelineReverb ? config.maxSamplesPerRun + MAX_PRERENDER_SAMPLES : 0;
+
+	Synth *rendered = openTestSynth(config);
+	Synth *chased = openTestSynth(config);
+	if (rendered == NULL || chased == NULL) {
+		closeTestSynth(rendered);
+		closeTestSynth(chased);
+		return false;
+	}
+	TestWorkload workload(39, 8);
+	Bit16s *expected[6];
+	Bit16s *actual[6];
+	for (unsigned int i = 0; i < 6; i++) {
+		expected[i] = new Bit16s[blockLen];
+		actual[i] = new Bit16s[blockLen];
+	}
+	bool passed = true;
+	Bit32u nonZeroSamples = 0;
+	for (unsigned int blockNum = 0; blockNum < chaseBlocks + renderBlocks && passed; blockNum++) {
+		workload.playBlock(rendered, blockNum);
+		workload.playBlock(chased, blockNum);
+		rendered->renderStreams(expected[0], expected[1], expected[2], expected[3], expected[4], expected[5], blockLen);
+		if (blockNum < chaseBlocks) {
+			chased->chase(blockLen);
+			continue;
+		}
+		chased->renderStreams(actual[0], actual[1], actual[2], actual[3], actual[4], actual[5], blockLen);
+		Bit32u renderedFrames = (blockNum - chaseBlocks) * blockLen;
+		for (unsigned int i = 0; i < DRY_STREAM_COUNT; i++) {
+			for (Bit32u j = renderedFrames < mutedFrames ? mutedFrames - renderedFrames : 0; j < blockLen; j++) {
+				if (expected[i][j] != actual[i][j]) {
+					printf("%s: dry stream %u differs at frame %u of block %u (expected %d, got %d)\n",
+						config.name, i, j, blockNum, expected[i][j], actual[i][j]);
+					passed = false;
+					break;
+				}
+				if (expected[i][j] != 0) {
+					nonZeroSamples++;
+				}
+			}
+		}
+	}
+	if (passed && nonZeroSamples == 0) {
+		printf("%s: the dry streams were silent after chasing\n", config.name);
+		passed = false;
+	}
+	for (unsigned int i = 0; i < 6; i++) {
+		delete[] expected[i];
+		delete[] actual[i];
+	}
+	closeTestSynth(rendered);
+	closeTestSynth(chased);
+	return passed;
+}
+
+bool MT32Emu::runChaseTest() {
+	return runInTestConfigs(testChase);
+}
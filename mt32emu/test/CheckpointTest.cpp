@@ -0,0 +1,121 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks that after restoring a SynthCheckpoint, a synth renders the same as it did after the checkpoint was taken,
+// whatever it did in between (as when RenderAhead rolls back to play an event that came in late)
+
+#include <cstdio>
+
+#include "TestSupport.h"
+#include "Tests.h"
+
+using namespace MT32Emu;
+
+static bool testCheckpoints(const TestConfig &config) {
+	const unsigned int roundCount = 5;
+	const unsigned int blocksBetweenRounds = getTestBlockCount(config, 12800);
+	const unsigned int blocksAfterCheckpoint = getTestBlockCount(config, 10240);
+	const Bit32u blockLen = config.blockLen;
+	const Bit32u framesAfterCheckpoint = blocksAfterCheckpoint * blockLen;
+
+	Synth *synth = openTestSynth(config);
+	if (synth == NULL) {
+		return false;
+	}
+	TestWorkload workload(34, 8);
+	TestWorkload otherWorkload(340, 8);
+	SynthCheckpoint checkpoint;
+	Bit16s *expected = new Bit16s[framesAfterCheckpoint * 2];
+	Bit16s *actual = new Bit16s[framesAfterCheckpoint * 2];
+	bool passed = true;
+	unsigned int blockNum = 0;
+	for (unsigned int round = 0; round < roundCount && passed; round++) {
+		workload.render(synth, NULL, blocksBetweenRounds, blockLen, blockNum);
+		blockNum += blocksBetweenRounds;
+		// The checkpoint is reused, as RenderAhead does, so this also covers saving over an older state
+		if (!synth->saveCheckpoint(checkpoint)) {
+			printf("%s: unable to save a checkpoint\n", config.name);
+			passed = false;
+			break;
+		}
+		workload.render(synth, expected, blocksAfterCheckpoint, blockLen, blockNum);
+
+		if (!synth->restoreCheckpoint(checkpoint)) {
+			printf("%s: unable to restore the checkpoint\n", config.name);
+			passed = false;
+			break;
+		}
+		otherWorkload.render(synth, NULL, blocksAfterCheckpoint, blockLen, blockNum);
+
+		synth->restoreCheckpoint(checkpoint);
+		workload.render(synth, actual, blocksAfterCheckpoint, blockLen, blockNum);
+		blockNum += blocksAfterCheckpoint;
+
+		char description[96];
+		sprintf(description, "%s, round %u", config.name, round);
+		passed = compareStreams(description, expected, actual, framesAfterCheckpoint);
+	}
+	delete[] expected;
+	delete[] actual;
+
+	// A checkpoint only belongs to the synth it was taken from
+	Synth *otherSynth = openTestSynth(config);
+	if (otherSynth == NULL) {
+		passed = false;
+	} else if (!checkpoint.isTakenFrom(synth) || checkpoint.isTakenFrom(otherSynth) || otherSynth->restoreCheckpoint(checkpoint)) {
+		printf("%s: a checkpoint was accepted by a synth it wasn't taken from\n", config.name);
+		passed = false;
+	}
+	closeTestSynth(otherSynth);
+	closeTestSynth(synth);
+	return passed;
+}
+
+// Returns the size of a checkpoint of a synth opened with the given settings, or 0 if that fails
+static size_t getCheckpointSize(unsigned int renderThreads, unsigned int maxSamplesPerRun) {
+	SynthProperties prop;
+	initTestProperties(prop);
+	prop.renderThreads = renderThreads;
+	prop.maxSamplesPerRun = maxSamplesPerRun;
+	Synth *synth = openTestSynth(prop);
+	if (synth == NULL) {
+		return 0;
+	}
+	SynthCheckpoint checkpoint;
+	size_t size = synth->saveCheckpoint(checkpoint) ? checkpoint.getSize() : 0;
+	closeTestSynth(synth);
+	return size;
+}
+
+// Checks that checkpoints leave out the scratch buffers, whose size depends on the run length and the number of threads
+static bool testCheckpointSize() {
+	size_t size = getCheckpointSize(1, 256);
+	if (size == 0) {
+		printf("Unable to save a checkpoint\n");
+		return false;
+	}
+	if (getCheckpointSize(3, 256) != size || getCheckpointSize(1, 4096) != size) {
+		printf("The size of a checkpoint (%u bytes with one thread and runs of 256 samples) depends on the scratch buffers\n", (unsigned int)size);
+		return false;
+	}
+	return true;
+}
+
+bool MT32Emu::runCheckpointTest() {
+	bool passed = runInTestConfigs(testCheckpoints);
+	return testCheckpointSize() && passed;
+}
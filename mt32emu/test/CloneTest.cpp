@@ -0,0 +1,67 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks that a synth made by Synth::clone() carries on exactly as the original does, host settings included
+
+#include <cstdio>
+
+#include "TestSupport.h"
+#include "Tests.h"
+
+using namespace MT32Emu;
+
+static bool testClone(const TestConfig &config) {
+	const unsigned int roundCount = 5;
+	const unsigned int blocksPerRound = getTestBlockCount(config, 10240);
+
+	Synth *synth = openTestSynth(config);
+	if (synth == NULL) {
+		return false;
+	}
+	// Host settings that differ from the defaults, which the clone is expected to take over
+	synth->setOutputGain(0.7f);
+	synth->setReverbOutputGain(1.2f);
+	synth->setDACInputMode(DACInputMode_GENERATION2);
+
+	TestWorkload workload(36, 8);
+	bool passed = true;
+	for (unsigned int round = 0; round < roundCount && passed; round++) {
+		unsigned int blockNum = round * blocksPerRound * 2;
+		workload.render(synth, NULL, blocksPerRound, config.blockLen, blockNum);
+		blockNum += blocksPerRound;
+		Synth *synthClone = synth->clone();
+		if (synthClone == NULL) {
+			printf("%s: unable to clone the synth\n", config.name);
+			passed = false;
+			break;
+		}
+		if (synthClone->getROMImage() != synth->getROMImage()) {
+			printf("%s: the clone doesn't share the ROMs\n", config.name);
+			passed = false;
+		}
+		char description[96];
+		sprintf(description, "%s, round %u", config.name, round);
+		passed = compareTestRenders(description, workload, synth, synthClone, blocksPerRound, config.blockLen, blockNum) && passed;
+		closeTestSynth(synthClone);
+	}
+	closeTestSynth(synth);
+	return passed;
+}
+
+bool MT32Emu::runCloneTest() {
+	return runInTestConfigs(testClone);
+}
@@ -0,0 +1,289 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks the event trace: the records made for a note and a sysex write, the same records whatever the number of render
+// threads, dropping new records when the ring is full, draining from another thread while rendering, and the export to
+// the Chrome trace format
+
+#include <cstdio>
+#include <cstring>
+
+#include "TestSupport.h"
+#include "Tests.h"
+
+using namespace MT32Emu;
+
+static const Bit32u BLOCK_LEN = 256;
+static const Bit32u MAX_RECORDS = 65536;
+static const unsigned int MAX_WORKLOAD_BLOCKS = 500;
+
+// Returns the index of the first record of the type for the part from the given one on, or count if there isn't any
+static Bit32u findRecord(const TraceRecord *records, Bit32u count, Bit32u from, TraceEventType type, Bit8u part) {
+	for (Bit32u i = from; i < count; i++) {
+		if (records[i].type == type && records[i].part == part) {
+			return i;
+		}
+	}
+	return count;
+}
+
+static bool isSameRecord(const TraceRecord &a, const TraceRecord &b) {
+	return a.sampleStamp == b.sampleStamp && a.type == b.type && a.part == b.part && a.param == b.param && a.value == b.value;
+}
+
+static bool compareRecords(const char *description, const TraceRecord *expected, Bit32u expectedCount, const TraceRecord *actual, Bit32u actualCount) {
+	for (Bit32u i = 0; i < expectedCount && i < actualCount; i++) {
+		if (!isSameRecord(expected[i], actual[i])) {
+			printf("%s: trace record %u differs (expected type %u at %u, got type %u at %u)\n", description, i, expected[i].type, expected[i].sampleStamp, actual[i].type, actual[i].sampleStamp);
+			return false;
+		}
+	}
+	if (expectedCount != actualCount) {
+		printf("%s: %u trace records instead of %u\n", description, actualCount, expectedCount);
+		return false;
+	}
+	return true;
+}
+
+// Records a note on part 1 and a sysex write while it plays, then exports the trace
+static bool testRecords() {
+	SynthProperties prop;
+	initTestProperties(prop);
+	Synth *synth = openTestSynth(prop);
+	if (synth == NULL) {
+		return false;
+	}
+	bool passed = true;
+	Bit16s *stream = new Bit16s[BLOCK_LEN * 2];
+	TraceRecord *records = new TraceRecord[MAX_RECORDS];
+	if (!synth->startTrace(MAX_RECORDS)) {
+		printf("Event trace: unable to start tracing\n");
+		passed = false;
+	}
+	synth->playMsg(0x643C91);
+	synth->render(stream, BLOCK_LEN);
+	playTimbreTempSysex(synth, 0, 14, 1);
+	synth->playMsg(0x3C81);
+	synth->render(stream, BLOCK_LEN);
+	Bit32u count = synth->drainTrace(records, MAX_RECORDS);
+
+	Bit32u noteOnIx = findRecord(records, count, 0, TraceEvent_noteOn, 0);
+	Bit32u allocIx = findRecord(records, count, noteOnIx, TraceEvent_partialAlloc, 0);
+	Bit32u renderStartIx = findRecord(records, count, allocIx, TraceEvent_renderStart, TRACE_NO_PART);
+	Bit32u tvaPhaseIx = findRecord(records, count, renderStartIx, TraceEvent_tvaPhase, 0);
+	Bit32u renderEndIx = findRecord(records, count, renderStartIx, TraceEvent_renderEnd, TRACE_NO_PART);
+	Bit32u sysexIx = findRecord(records, count, renderEndIx, TraceEvent_sysexWrite, TRACE_NO_PART);
+	Bit32u noteOffIx = findRecord(records, count, sysexIx, TraceEvent_noteOff, 0);
+	if (noteOffIx == count) {
+		printf("Event trace: the records of the note, the render and the sysex write aren't all there in order\n");
+		passed = false;
+	} else {
+		const TraceRecord &noteOn = records[noteOnIx];
+		if (noteOn.sampleStamp != 0 || noteOn.param != 0x3C || noteOn.value != 0x64) {
+			printf("Event trace: wrong note on record\n");
+			passed = false;
+		}
+		if (records[allocIx].sampleStamp != 0 || records[tvaPhaseIx].param != records[allocIx].param) {
+			printf("Event trace: the TVA phase record isn't for the partial allocated\n");
+			passed = false;
+		}
+		if (records[renderStartIx].value != BLOCK_LEN || records[renderEndIx].sampleStamp != BLOCK_LEN) {
+			printf("Event trace: wrong render records\n");
+			passed = false;
+		}
+		const TraceRecord &sysexWrite = records[sysexIx];
+		if (sysexWrite.sampleStamp != BLOCK_LEN || sysexWrite.param != 1 || sysexWrite.value != 0x04000E) {
+			printf("Event trace: wrong sysex write record\n");
+			passed = false;
+		}
+		if (records[noteOffIx].sampleStamp != BLOCK_LEN || records[noteOffIx].param != 0x3C) {
+			printf("Event trace: wrong note off record\n");
+			passed = false;
+		}
+	}
+	if (synth->getTraceDroppedCount() != 0) {
+		printf("Event trace: %u records dropped\n", synth->getTraceDroppedCount());
+		passed = false;
+	}
+
+	// The size asked for first is the size needed, and a buffer too small still gets the start of the text, terminated
+	Bit32u textLen = EventTrace::exportChromeTrace(records, count, 32000, NULL, 0);
+	char *text = new char[textLen + 1];
+	char truncatedText[100];
+	if (EventTrace::exportChromeTrace(records, count, 32000, text, textLen + 1) != textLen || strlen(text) != textLen) {
+		printf("Event trace: the exported trace isn't the size given beforehand\n");
+		passed = false;
+	} else if (strncmp(text, "{\"traceEvents\":[\n", 17) != 0 || strcmp(text + textLen - 3, "]}\n") != 0 || strstr(text, "\"name\":\"noteOn\"") == NULL) {
+		printf("Event trace: the exported trace doesn't look right\n");
+		passed = false;
+	} else if (EventTrace::exportChromeTrace(records, count, 32000, truncatedText, sizeof(truncatedText)) != textLen
+		|| strlen(truncatedText) != sizeof(truncatedText) - 1 || strncmp(text, truncatedText, sizeof(truncatedText) - 1) != 0) {
+		printf("Event trace: wrong truncated export\n");
+		passed = false;
+	}
+	delete[] text;
+
+	delete[] records;
+	delete[] stream;
+	closeTestSynth(synth);
+	return passed;
+}
+
+// The workload plays a few events in every block, so the number of blocks is limited to keep the records within the ring
+static unsigned int getTraceBlockCount(const TestConfig &config) {
+	unsigned int blockCount = getTestBlockCount(config, 32000);
+	return blockCount < MAX_WORKLOAD_BLOCKS ? blockCount : MAX_WORKLOAD_BLOCKS;
+}
+
+// Traces a workload and drains all the records at the end. Returns the number of records, or MAX_RECORDS + 1 on failure.
+static Bit32u traceWorkload(const TestConfig &config, TraceRecord *records) {
+	Synth *synth = openTestSynth(config);
+	if (synth == NULL) {
+		return MAX_RECORDS + 1;
+	}
+	Bit32u count = MAX_RECORDS + 1;
+	if (synth->startTrace(MAX_RECORDS)) {
+		TestWorkload workload(49, 8);
+		workload.render(synth, NULL, getTraceBlockCount(config), config.blockLen);
+		if (synth->getTraceDroppedCount() == 0) {
+			count = synth->drainTrace(records, MAX_RECORDS);
+		}
+	}
+	closeTestSynth(synth);
+	if (count > MAX_RECORDS) {
+		printf("%s: unable to trace the workload\n", config.name);
+	}
+	return count;
+}
+
+// The records of the partials rendered on worker threads end up in the same order as on one thread
+static bool testRenderThreads(const TestConfig &config) {
+	if (config.renderThreads == 1) {
+		return true;
+	}
+	TestConfig serialConfig = config;
+	serialConfig.renderThreads = 1;
+	TraceRecord *expected = new TraceRecord[MAX_RECORDS];
+	TraceRecord *actual = new TraceRecord[MAX_RECORDS];
+	Bit32u expectedCount = traceWorkload(serialConfig, expected);
+	Bit32u actualCount = traceWorkload(config, actual);
+	bool passed = expectedCount <= MAX_RECORDS && actualCount <= MAX_RECORDS
+		&& compareRecords(config.name, expected, expectedCount, actual, actualCount);
+	delete[] expected;
+	delete[] actual;
+	return passed;
+}
+
+// Once the ring is full, the oldest records are kept and the new ones counted as dropped, until there's room again
+static bool testRingFull() {
+	SynthProperties prop;
+	initTestProperties(prop);
+	Synth *synth = openTestSynth(prop);
+	if (synth == NULL) {
+		return false;
+	}
+	bool passed = true;
+	TraceRecord records[16];
+	// Rounded up to 16
+	synth->startTrace(9);
+	for (Bit32u key = 40; key < 50; key++) {
+		synth->playMsg(0x91 | (key << 8) | (0x64 << 16));
+		synth->playMsg(0x81 | (key << 8));
+	}
+	Bit32u count = synth->drainTrace(records, 16);
+	if (count != 16 || synth->getTraceDroppedCount() == 0) {
+		printf("Event trace: %u records kept and %u dropped in a full ring\n", count, synth->getTraceDroppedCount());
+		passed = false;
+	} else if (records[0].type != TraceEvent_noteOn || records[0].param != 40) {
+		printf("Event trace: the first record kept in a full ring isn't the oldest\n");
+		passed = false;
+	}
+	Bit32u droppedCount = synth->getTraceDroppedCount();
+	synth->playMsg(0x643C91);
+	count = synth->drainTrace(records, 16);
+	if (count == 0 || records[0].type != TraceEvent_noteOn || records[0].param != 0x3C || synth->getTraceDroppedCount() != droppedCount) {
+		printf("Event trace: not recording again after the ring was drained\n");
+		passed = false;
+	}
+	closeTestSynth(synth);
+	return passed;
+}
+
+struct Drainer {
+	Synth *synth;
+	TraceRecord *records;
+	Bit32u count;
+	volatile bool stop;
+};
+
+static void drainTrace(void *context) {
+	Drainer *drainer = (Drainer *)context;
+	for (;;) {
+		// Reads the flag before draining, so that nothing recorded before it was set is missed
+		bool stop = drainer->stop;
+		Thread::memoryBarrier();
+		drainer->count += drainer->synth->drainTrace(drainer->records + drainer->count, MAX_RECORDS - drainer->count);
+		if (stop) {
+			break;
+		}
+	}
+}
+
+// Draining a small ring on another thread while rendering gets all the records made, in order
+static bool testConcurrentDrain() {
+	TestConfig config = TEST_CONFIGS[0];
+	TraceRecord *expected = new TraceRecord[MAX_RECORDS];
+	Bit32u expectedCount = traceWorkload(config, expected);
+	Synth *synth = openTestSynth(config);
+	bool passed = expectedCount <= MAX_RECORDS && synth != NULL;
+	if (passed) {
+		Drainer drainer;
+		drainer.synth = synth;
+		drainer.records = new TraceRecord[MAX_RECORDS];
+		drainer.count = 0;
+		drainer.stop = false;
+		synth->startTrace(4096);
+		Thread thread;
+		if (!thread.start(drainTrace, &drainer)) {
+			printf("Event trace: unable to start the draining thread\n");
+			passed = false;
+		} else {
+			TestWorkload workload(49, 8);
+			workload.render(synth, NULL, getTraceBlockCount(config), config.blockLen);
+			Thread::memoryBarrier();
+			drainer.stop = true;
+			thread.join();
+			if (synth->getTraceDroppedCount() != 0) {
+				printf("Event trace: %u records dropped while draining on another thread\n", synth->getTraceDroppedCount());
+				passed = false;
+			}
+			passed = compareRecords("Event trace drained on another thread", expected, expectedCount, drainer.records, drainer.count) && passed;
+		}
+		delete[] drainer.records;
+	}
+	delete[] expected;
+	closeTestSynth(synth);
+	return passed;
+}
+
+bool MT32Emu::runEventTraceTest() {
+	bool passed = testRecords();
+	passed = runInTestConfigs(testRenderThreads) && passed;
+	passed = testRingFull() && passed;
+	passed = testConcurrentDrain() && passed;
+	return passed;
+}
@@ -0,0 +1,119 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks that a Synth::open() which fails part way through (here on a damaged timbre map, after the worker threads and
+// the arena are set up) leaves nothing behind, and that the same synth can then be opened and renders like a fresh one
+
+#include <cstdio>
+#include <cstring>
+
+#include "TestSupport.h"
+#include "Tests.h"
+
+using namespace MT32Emu;
+
+// Where the generated Control ROM keeps the map of timbre bank B
+static const unsigned int TIMBRE_B_MAP = 0xC000;
+
+static Bit8u *damagedControlROM = NULL;
+
+static File *openDamagedROMFile(void * /*userData*/, const char *filename, File::OpenMode /*mode*/) {
+	size_t size;
+	const Bit8u *data = getTestROM(filename, size);
+	if (data == NULL) {
+		return NULL;
+	}
+	if (strcmp(filename, "MT32_CONTROL.ROM") == 0) {
+		if (damagedControlROM == NULL) {
+			damagedControlROM = new Bit8u[size];
+			memcpy(damagedControlROM, data, size);
+			// Points the first timbre of bank B past the end of the ROM
+			damagedControlROM[TIMBRE_B_MAP] = 0xFF;
+			damagedControlROM[TIMBRE_B_MAP + 1] = 0xFF;
+		}
+		data = damagedControlROM;
+	}
+	return openTestMemoryFile(data, size);
+}
+
+// Returns the number of threads in this process, or 0 where that isn't known
+static unsigned int getThreadCount() {
+	unsigned int threadCount = 0;
+#ifdef __linux__
+	FILE *status = fopen("/proc/self/status", "r");
+	if (status != NULL) {
+		char line[256];
+		while (fgets(line, sizeof(line), status) != NULL) {
+			if (sscanf(line, "Threads: %u", &threadCount) == 1) {
+				break;
+			}
+		}
+		fclose(status);
+	}
+#endif
+	return threadCount;
+}
+
+static bool testOpenFailure(const TestConfig &config) {
+	const unsigned int blockCount = getTestBlockCount(config, 51200);
+
+	bool passed = true;
+	unsigned int threadCount = getThreadCount();
+
+	SynthProperties prop;
+	initTestProperties(prop, config);
+	prop.openFile = openDamagedROMFile;
+	Synth *synth = new Synth();
+	if (synth->open(prop)) {
+		printf("%s: the synth opened on a damaged Control ROM\n", config.name);
+		closeTestSynth(synth);
+		return false;
+	}
+	MemoryFootprint footprint = synth->getMemoryFootprint();
+	if (footprint.total != footprint.synth) {
+		printf("%s: %u bytes are still in use after the failed open\n", config.name, (unsigned int)(footprint.total - footprint.synth));
+		passed = false;
+	}
+	if (getThreadCount() != threadCount) {
+		printf("%s: %u threads were left running after the failed open\n", config.name, getThreadCount() - threadCount);
+		passed = false;
+	}
+
+	initTestProperties(prop, config);
+	if (!synth->open(prop)) {
+		printf("%s: unable to open the synth after a failed open\n", config.name);
+		delete synth;
+		return false;
+	}
+	Synth *freshSynth = openTestSynth(config);
+	if (freshSynth == NULL) {
+		closeTestSynth(synth);
+		return false;
+	}
+	TestWorkload workload(40, 8);
+	passed = compareTestRenders(config.name, workload, freshSynth, synth, blockCount, config.blockLen) && passed;
+	closeTestSynth(freshSynth);
+	closeTestSynth(synth);
+	return passed;
+}
+
+bool MT32Emu::runOpenFailureTest() {
+	bool passed = runInTestConfigs(testOpenFailure);
+	delete[] damagedControlROM;
+	damagedControlROM = NULL;
+	return passed;
+}
@@ -0,0 +1,226 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks that Synth::parseStream() plays a byte stream, split up in any way, just like the same messages played one by
+// one: running status, real-time bytes in the middle of a message, long and overlong sysex messages, a sysex interrupted
+// by a status byte, and system common messages, which cancel running status
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+#include "TestSupport.h"
+#include "Tests.h"
+
+using namespace MT32Emu;
+
+static const Bit32u MAX_STREAM_LEN = 2 * MAX_STREAM_SYSEX_SIZE + 256;
+static const unsigned int MAX_EXPECTED_CALLS = 64;
+// Frames rendered after each piece of the stream
+static const Bit32u BLOCK_LEN = 4;
+
+// A stream, along with the messages it's expected to play. Each of those is played (into another synth) once the stream
+// has been parsed up to where the message ends.
+class TestStream {
+private:
+	struct ExpectedCall {
+		Bit32u streamEnd;
+		Bit32u msg;
+		Bit32u sysexPos;
+		Bit32u sysexLen;
+	};
+
+	Bit8u bytes[MAX_STREAM_LEN];
+	Bit32u len;
+	Bit8u sysexBytes[MAX_STREAM_LEN];
+	Bit32u sysexBytesLen;
+	ExpectedCall calls[MAX_EXPECTED_CALLS];
+	unsigned int callCount;
+
+public:
+	TestStream() : len(0), sysexBytesLen(0), callCount(0) {
+	}
+
+	void add(const Bit8u *data, Bit32u dataLen) {
+		memcpy(bytes + len, data, dataLen);
+		len += dataLen;
+	}
+
+	void add(Bit8u b) {
+		bytes[len++] = b;
+	}
+
+	// Adds a message that the stream is expected to play as it is
+	void addMsg(Bit8u status, Bit8u data1, Bit8u data2) {
+		add(status);
+		add(data1);
+		add(data2);
+		expectMsg(status | (data1 << 8) | (data2 << 16));
+	}
+
+	void expectMsg(Bit32u msg) {
+		ExpectedCall &call = calls[callCount++];
+		call.streamEnd = len;
+		call.msg = msg;
+		call.sysexLen = 0;
+	}
+
+	void expectSysex(const Bit8u *sysex, Bit32u sysexLen) {
+		ExpectedCall &call = calls[callCount++];
+		call.streamEnd = len;
+		call.sysexPos = sysexBytesLen;
+		call.sysexLen = sysexLen;
+		memcpy(sysexBytes + sysexBytesLen, sysex, sysexLen);
+		sysexBytesLen += sysexLen;
+	}
+
+	Bit32u getLength() const {
+		return len;
+	}
+
+	// Parses the stream into one synth in pieces of pieceLen bytes, plays the expected messages into the other as it goes,
+	// and compares what the two render after each piece
+	bool play(Synth *parsing, Synth *playing, Bit32u pieceLen) const {
+		Bit16s expected[BLOCK_LEN * 2];
+		Bit16s actual[BLOCK_LEN * 2];
+		char description[64];
+		unsigned int callIx = 0;
+		Bit32u nonZeroSamples = 0;
+		for (Bit32u pos = 0; pos < len; pos += pieceLen) {
+			Bit32u thisLen = len - pos < pieceLen ? len - pos : pieceLen;
+			parsing->parseStream(bytes + pos, thisLen);
+			for (; callIx < callCount && calls[callIx].streamEnd <= pos + thisLen; callIx++) {
+				const ExpectedCall &call = calls[callIx];
+				if (call.sysexLen > 0) {
+					playing->playSysex(sysexBytes + call.sysexPos, call.sysexLen);
+				} else {
+					playing->playMsg(call.msg);
+				}
+			}
+			playing->render(expected, BLOCK_LEN);
+			parsing->render(actual, BLOCK_LEN);
+			sprintf(description, "Pieces of %u bytes, after byte %u", pieceLen, pos + thisLen);
+			if (!compareStreams(description, expected, actual, BLOCK_LEN)) {
+				return false;
+			}
+			nonZeroSamples += countNonZeroSamples(expected, BLOCK_LEN);
+		}
+		sprintf(description, "Pieces of %u bytes", pieceLen);
+		if (nonZeroSamples == 0) {
+			printf("%s: the synth produced no sound\n", description);
+			return false;
+		}
+		return compareTestMemory(description, playing, parsing);
+	}
+};
+
+static void buildStream(TestStream &stream) {
+	// Data bytes without a status, as when the stream is picked up halfway
+	stream.add(0x40);
+	stream.add(0x64);
+
+	// Running status, down to a note off by velocity 0
+	stream.addMsg(0x91, 0x3C, 0x64);
+	static const Bit8u runningNotes[] = {0x40, 0x64, 0x43, 0x50, 0x3C, 0x00};
+	for (unsigned int i = 0; i < sizeof(runningNotes); i += 2) {
+		stream.add(runningNotes[i]);
+		stream.add(runningNotes[i + 1]);
+		stream.expectMsg(0x91 | (runningNotes[i] << 8) | (runningNotes[i + 1] << 16));
+	}
+	// Running status with a single data byte
+	static const Bit8u programs[] = {0xC2, 0x10, 0x11};
+	stream.add(programs, sizeof(programs));
+	stream.expectMsg(0x10C2);
+	stream.expectMsg(0x11C2);
+
+	// Real-time bytes inside a message, and between messages with running status
+	static const Bit8u realTimeNote[] = {0x92, 0xF8, 0x48, 0xFE, 0x70};
+	stream.add(realTimeNote, sizeof(realTimeNote));
+	stream.expectMsg(0x704892);
+	static const Bit8u realTimeRunningNote[] = {0xF8, 0x4C, 0xFA, 0x70};
+	stream.add(realTimeRunningNote, sizeof(realTimeRunningNote));
+	stream.expectMsg(0x704C92);
+
+	// A sysex with a real-time byte in the middle, making part 3 play its first partial only
+	Bit8u partialMute = 1;
+	Bit8u sysex[MAX_STREAM_SYSEX_SIZE + 1];
+	Bit32u sysexLen = makeTestSysex(sysex, MT32EMU_MEMADDR(0x040000) + 2 * sizeof(TimbreParam) + offsetof(TimbreParam::CommonParam, partialMute), &partialMute, 1);
+	stream.add(sysex, 6);
+	stream.add(0xF8);
+	stream.add(sysex + 6, sysexLen - 6);
+	stream.expectSysex(sysex, sysexLen);
+	stream.addMsg(0x93, 0x45, 0x64);
+
+	// The longest sysex there's room for, writing all the memory timbres, which is much longer than MAX_SYSEX_SIZE
+	Bit32u timbresLen = MAX_STREAM_SYSEX_SIZE - 10;
+	Bit8u *timbres = new Bit8u[timbresLen];
+	for (Bit32u i = 0; i < timbresLen; i++) {
+		timbres[i] = (Bit8u)(i % 50);
+	}
+	sysexLen = makeTestSysex(sysex, MT32EMU_MEMADDR(0x080000), timbres, timbresLen);
+	stream.add(sysex, sysexLen);
+	stream.expectSysex(sysex, sysexLen);
+
+	// One byte longer, and starting with a master volume of 0, which would silence everything if it were played
+	memset(timbres, 0, timbresLen);
+	sysexLen = makeTestSysex(sysex, MT32EMU_MEMADDR(0x100016), timbres, timbresLen + 1);
+	stream.add(sysex, sysexLen);
+	delete[] timbres;
+	stream.addMsg(0x94, 0x48, 0x64);
+
+	// A sysex interrupted by a status byte, which starts a message of its own
+	sysexLen = makeTestSysex(sysex, MT32EMU_MEMADDR(0x100016), &partialMute, 1);
+	stream.add(sysex, sysexLen - 2);
+	stream.addMsg(0x95, 0x4A, 0x64);
+
+	// System common messages with 0, 1 and 2 data bytes, each cancelling running status so that the data bytes after them
+	// are ignored, and a stray End Of Exclusive
+	static const Bit8u systemCommon[][3] = {{0xF6, 0, 0}, {0xF1, 0x10, 0}, {0xF2, 0x01, 0x02}, {0xF7, 0, 0}};
+	static const unsigned int systemCommonLen[] = {1, 2, 3, 1};
+	for (unsigned int i = 0; i < 4; i++) {
+		stream.addMsg(0x96, 0x3C + i * 3, 0x64);
+		stream.add(systemCommon[i], systemCommonLen[i]);
+		stream.add(0x50);
+		stream.add(0x64);
+	}
+	stream.addMsg(0x97, 0x3C, 0x64);
+}
+
+bool MT32Emu::runParseStreamTest() {
+	static const Bit32u pieceLens[] = {1, 2, 3, 7, 100, 5000, MAX_STREAM_LEN};
+
+	TestStream *stream = new TestStream;
+	buildStream(*stream);
+	bool passed = true;
+	for (unsigned int i = 0; i < sizeof(pieceLens) / sizeof(pieceLens[0]); i++) {
+		SynthProperties prop;
+		initTestProperties(prop);
+		Synth *parsing = openTestSynth(prop);
+		Synth *playing = openTestSynth(prop);
+		if (parsing == NULL || playing == NULL) {
+			closeTestSynth(parsing);
+			closeTestSynth(playing);
+			passed = false;
+			break;
+		}
+		passed = stream->play(parsing, playing, pieceLens[i]) && passed;
+		closeTestSynth(parsing);
+		closeTestSynth(playing);
+	}
+	delete stream;
+	return passed;
+}
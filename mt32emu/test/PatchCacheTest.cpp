@@ -0,0 +1,185 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks the lazy rebuilding of the patch caches. A timbre write only takes effect on the next note played. The notes
+// already playing keep the cache they started with, and are only given a copy of it when it actually changes, not
+// after a write that repeats the same values. Such writes leave the output as it would be without them.
+
+#include <cstddef>
+#include <cstdio>
+
+#include "TestSupport.h"
+#include "Tests.h"
+
+using namespace MT32Emu;
+
+// Part 3, on MIDI channel 4
+static const unsigned int PART_NUM = 2;
+static const Bit32u PART_CHANNEL = 3;
+static const Bit32u BLOCK_LEN = 256;
+static const unsigned int BLOCK_COUNT = 200;
+static const unsigned int PARTIAL_MUTE_OFF = offsetof(TimbreParam::CommonParam, partialMute);
+
+// A partial playing a note, along with the cache entry it was playing with when it was found
+struct PlayingPartial {
+	const Partial *partial;
+	const PatchCache *cachePtr;
+	PatchCache cache;
+};
+
+// Finds the partials of the part playing the key. Returns how many there are (up to 4).
+static unsigned int findPartials(Synth *synth, int key, PlayingPartial *playing) {
+	unsigned int count = 0;
+	for (unsigned int partialNum = 0; partialNum < MT32EMU_MAX_PARTIALS && count < 4; partialNum++) {
+		const Partial *partial = synth->getPartial(partialNum);
+		if (partial->isActive() && partial->getOwnerPart() == (int)PART_NUM && partial->getKey() == key) {
+			playing[count].partial = partial;
+			playing[count].cachePtr = partial->patchCache;
+			playing[count].cache = *partial->patchCache;
+			count++;
+		}
+	}
+	return count;
+}
+
+static bool isSameCache(const PatchCache &a, const PatchCache &b) {
+	return a.playPartial == b.playPartial && a.PCMPartial == b.PCMPartial && a.pcm == b.pcm && a.waveform == b.waveform
+		&& a.structureMix == b.structureMix && a.structurePosition == b.structurePosition && a.structurePair == b.structurePair
+		&& a.partialCount == b.partialCount && a.sustain == b.sustain && a.reverb == b.reverb;
+}
+
+// Checks that the partials found earlier are still playing with the same cache, and, unless it may have been copied since,
+// with the very same entry
+static bool checkPartials(const char *description, const PlayingPartial *playing, unsigned int count, bool sameEntry) {
+	for (unsigned int i = 0; i < count; i++) {
+		const Partial *partial = playing[i].partial;
+		if (!partial->isActive()) {
+			printf("Patch cache: a partial ended before it was checked %s\n", description);
+			return false;
+		}
+		if (!isSameCache(playing[i].cache, *partial->patchCache)) {
+			printf("Patch cache: the cache of a playing partial changed %s\n", description);
+			return false;
+		}
+		if (sameEntry && partial->patchCache != playing[i].cachePtr) {
+			printf("Patch cache: a playing partial was given a copy of its cache %s\n", description);
+			return false;
+		}
+	}
+	return true;
+}
+
+static void noteOn(Synth *synth, Bit32u key) {
+	synth->playMsg(0x90 | PART_CHANNEL | (key << 8) | (100 << 16));
+}
+
+static bool testHeldNotes() {
+	SynthProperties prop;
+	initTestProperties(prop);
+	Synth *synth = openTestSynth(prop);
+	if (synth == NULL) {
+		return false;
+	}
+	Bit16s *stream = new Bit16s[BLOCK_LEN * 2];
+	// The part plays its timbre temp area from now on (rather than the shared cache of the ROM timbre), with all partials
+	playTimbreTempSysex(synth, PART_NUM, PARTIAL_MUTE_OFF, 15);
+	noteOn(synth, 60);
+	synth->render(stream, BLOCK_LEN);
+	PlayingPartial playing[4];
+	unsigned int playingCount = findPartials(synth, 60, playing);
+	bool passed = true;
+	if (playingCount != 4) {
+		printf("Patch cache: the first note is playing %u partials instead of 4\n", playingCount);
+		passed = false;
+	}
+
+	// Nothing to rebuild after a write of the same value
+	playTimbreTempSysex(synth, PART_NUM, PARTIAL_MUTE_OFF, 15);
+	noteOn(synth, 64);
+	synth->render(stream, BLOCK_LEN);
+	passed = checkPartials("after a write of the same value", playing, playingCount, true) && passed;
+
+	// A write that changes the cache is only picked up by the next note, while the notes already playing carry on as before
+	playTimbreTempSysex(synth, PART_NUM, PARTIAL_MUTE_OFF, 3);
+	synth->render(stream, BLOCK_LEN);
+	passed = checkPartials("before the next note", playing, playingCount, true) && passed;
+	noteOn(synth, 67);
+	synth->render(stream, BLOCK_LEN);
+	passed = checkPartials("after the next note", playing, playingCount, false) && passed;
+	PlayingPartial newPlaying[4];
+	unsigned int newPlayingCount = findPartials(synth, 67, newPlaying);
+	if (newPlayingCount != 2) {
+		printf("Patch cache: the note after the write is playing %u partials instead of 2\n", newPlayingCount);
+		passed = false;
+	}
+
+	delete[] stream;
+	closeTestSynth(synth);
+	return passed;
+}
+
+// Writes the patch temp and timbre temp areas of each part with the values they already have. The patch temp areas are
+// written from the fine tune on, since a write to any of the bytes before reloads the timbre temp area from the timbre
+// memory.
+static void rewriteParts(Synth *synth) {
+	for (unsigned int partNum = 0; partNum < 8; partNum++) {
+		Bit8u sysex[sizeof(TimbreParam) + 10];
+		Bit32u patchTempAddr = MT32EMU_MEMADDR(0x030000) + partNum * sizeof(MemParams::PatchTemp) + offsetof(PatchParam, fineTune);
+		Bit8u patchTemp[sizeof(MemParams::PatchTemp) - offsetof(PatchParam, fineTune)];
+		synth->readMemory(patchTempAddr, sizeof(patchTemp), patchTemp);
+		synth->playSysex(sysex, makeTestSysex(sysex, patchTempAddr, patchTemp, sizeof(patchTemp)));
+		Bit32u timbreTempAddr = MT32EMU_MEMADDR(0x040000) + partNum * sizeof(TimbreParam);
+		Bit8u timbreTemp[sizeof(TimbreParam)];
+		synth->readMemory(timbreTempAddr, sizeof(timbreTemp), timbreTemp);
+		synth->playSysex(sysex, makeTestSysex(sysex, timbreTempAddr, timbreTemp, sizeof(timbreTemp)));
+	}
+}
+
+static bool testRewrites() {
+	SynthProperties prop;
+	initTestProperties(prop);
+	Synth *plain = openTestSynth(prop);
+	Synth *rewritten = openTestSynth(prop);
+	bool passed = false;
+	if (plain != NULL && rewritten != NULL) {
+		TestWorkload workload(47);
+		Bit16s *expected = new Bit16s[BLOCK_COUNT * BLOCK_LEN * 2];
+		Bit16s *actual = new Bit16s[BLOCK_COUNT * BLOCK_LEN * 2];
+		workload.render(plain, expected, BLOCK_COUNT, BLOCK_LEN);
+		for (unsigned int blockNum = 0; blockNum < BLOCK_COUNT; blockNum++) {
+			workload.playBlock(rewritten, blockNum);
+			rewriteParts(rewritten);
+			rewritten->render(actual + blockNum * BLOCK_LEN * 2, BLOCK_LEN);
+		}
+		passed = compareStreams("Patch cache rewrites", expected, actual, BLOCK_COUNT * BLOCK_LEN);
+		if (countNonZeroSamples(expected, BLOCK_COUNT * BLOCK_LEN) == 0) {
+			printf("Patch cache rewrites: the synth produced no sound\n");
+			passed = false;
+		}
+		delete[] expected;
+		delete[] actual;
+	}
+	closeTestSynth(plain);
+	closeTestSynth(rewritten);
+	return passed;
+}
+
+bool MT32Emu::runPatchCacheTest() {
+	bool passed = testHeldNotes();
+	passed = testRewrites() && passed;
+	return passed;
+}
@@ -0,0 +1,72 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks that with SynthProperties::pipelineReverb, the output is the same as without, delayed by maxSamplesPerRun frames
+
+#include <cstdio>
+
+#include "TestSupport.h"
+#include "Tests.h"
+
+using namespace MT32Emu;
+
+// Renders blockCount blocks of the workload, followed by extraFrames frames without any further events
+static bool renderWorkload(const TestConfig &config, unsigned int blockCount, Bit32u extraFrames, Bit16s *stream) {
+	Synth *synth = openTestSynth(config);
+	if (synth == NULL) {
+		return false;
+	}
+	TestWorkload workload(33, 8);
+	workload.render(synth, stream, blockCount, config.blockLen);
+	synth->render(stream + blockCount * config.blockLen * 2, extraFrames);
+	closeTestSynth(synth);
+	return true;
+}
+
+// Compares each configuration with pipelined reverb to the same without
+static bool testPipelinedReverb(const TestConfig &config) {
+	if (!config.pipelineReverb) {
+		return true;
+	}
+	TestConfig serialConfig = config;
+	serialConfig.pipelineReverb = false;
+	const unsigned int blockCount = getTestBlockCount(config, 64000);
+	const Bit32u frames = blockCount * config.blockLen;
+	const Bit32u delay = config.maxSamplesPerRun;
+
+	Bit16s *serial = new Bit16s[frames * 2];
+	Bit16s *pipelined = new Bit16s[(frames + delay) * 2];
+	bool passed = renderWorkload(serialConfig, blockCount, 0, serial) && renderWorkload(config, blockCount, delay, pipelined);
+	if (passed) {
+		if (countNonZeroSamples(pipelined, delay) != 0) {
+			printf("%s: the pipelined synth produced sound before the delay was over\n", config.name);
+			passed = false;
+		}
+		if (countNonZeroSamples(serial, frames) == 0) {
+			printf("%s: the synth produced no sound\n", config.name);
+			passed = false;
+		}
+		passed = compareStreams(config.name, serial, pipelined + delay * 2, frames) && passed;
+	}
+	delete[] serial;
+	delete[] pipelined;
+	return passed;
+}
+
+bool MT32Emu::runPipelinedReverbTest() {
+	return runInTestConfigs(testPipelinedReverb);
+}
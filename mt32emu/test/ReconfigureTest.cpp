@@ -0,0 +1,183 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks that Synth::reconfigure() changes the sample rate in place: the parts play the timbres edited by sysex before, and
+// sound (delay reverb included) just like a synth opened at the new rate. A rate it wasn't opened for is refused, leaving
+// the synth as it was, and so are checkpoints taken at another rate.
+
+#include <cstddef>
+#include <cstdio>
+
+#include "TestSupport.h"
+#include "Tests.h"
+
+using namespace MT32Emu;
+
+static const Bit32u FRAME_COUNT = 32000;
+
+// Edits the timbre temp areas of parts 1-8, leaving only the first partial playing.
+// Unlike most timbre parameters, which partials play is taken from the patch cache rather than the timbre itself.
+static void editTimbres(Synth *synth) {
+	for (unsigned int partNum = 0; partNum < 8; partNum++) {
+		playTimbreTempSysex(synth, partNum, offsetof(TimbreParam::CommonParam, partialMute), 1);
+	}
+}
+
+// Switches to the delay reverb, the only reverb model whose buffer depends on the sample rate
+static void selectDelayReverb(Synth *synth) {
+	Bit8u sysex[] = {0xF0, 0x41, 0x10, 0x16, 0x12, 0x10, 0x00, 0x01, 0x03, 0x00, 0xF7};
+	sysex[9] = Synth::calcSysexChecksum(&sysex[5], 4, 0);
+	synth->playSysex(sysex, sizeof(sysex));
+}
+
+static void prepare(Synth *synth, bool edit) {
+	selectDelayReverb(synth);
+	if (edit) {
+		editTimbres(synth);
+	}
+}
+
+// Plays a note on each of parts 1-8 and renders a second (or so) in blocks of blockLen frames
+static void playNotes(Synth *synth, Bit32u blockLen, Bit16s *stream) {
+	for (Bit32u chan = 1; chan <= 8; chan++) {
+		synth->playMsg(0x90 | chan | ((48 + chan * 3) << 8) | (100 << 16));
+	}
+	for (Bit32u pos = 0; pos < FRAME_COUNT; pos += blockLen) {
+		synth->render(stream + pos * 2, FRAME_COUNT - pos < blockLen ? FRAME_COUNT - pos : blockLen);
+	}
+}
+
+static bool isSame(const Bit16s *expected, const Bit16s *actual) {
+	for (Bit32u i = 0; i < FRAME_COUNT * 2; i++) {
+		if (expected[i] != actual[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool testReconfigure(const TestConfig &config, unsigned int sampleRate) {
+	SynthProperties prop;
+	initTestProperties(prop, config);
+	prop.maxSampleRate = 44100;
+	Synth *reconfigured = openTestSynth(prop);
+	Synth *edited = openTestSynth(prop);
+	Synth *unedited = openTestSynth(prop);
+	SynthProperties freshProp = prop;
+	freshProp.sampleRate = sampleRate;
+	Synth *fresh = openTestSynth(freshProp);
+	if (reconfigured == NULL || edited == NULL || unedited == NULL || fresh == NULL) {
+		closeTestSynth(reconfigured);
+		closeTestSynth(edited);
+		closeTestSynth(unedited);
+		closeTestSynth(fresh);
+		return false;
+	}
+	prepare(reconfigured, true);
+	prepare(edited, true);
+	prepare(unedited, false);
+	prepare(fresh, true);
+	size_t footprint = reconfigured->getMemoryFootprint().total;
+	SynthCheckpoint checkpoint;
+	reconfigured->saveCheckpoint(checkpoint);
+	Bit16s *expected = new Bit16s[FRAME_COUNT * 2];
+	Bit16s *actual = new Bit16s[FRAME_COUNT * 2];
+	char description[96];
+	bool passed = true;
+
+	sprintf(description, "%s, reconfigured to %u Hz", config.name, sampleRate);
+	if (!reconfigured->reconfigure(sampleRate)) {
+		printf("%s: unable to reconfigure the synth\n", description);
+		passed = false;
+	} else {
+		playNotes(fresh, config.blockLen, expected);
+		playNotes(reconfigured, config.blockLen, actual);
+		passed = compareStreams(description, expected, actual, FRAME_COUNT) && passed;
+		if (reconfigured->restoreCheckpoint(checkpoint)) {
+			printf("%s: restored a checkpoint taken at %u Hz\n", description, prop.sampleRate);
+			passed = false;
+		}
+	}
+
+	sprintf(description, "%s, reconfigured through %u Hz", config.name, sampleRate);
+	if (!reconfigured->reconfigure(prop.sampleRate)) {
+		printf("%s: unable to reconfigure the synth\n", description);
+		passed = false;
+	} else {
+		playNotes(edited, config.blockLen, expected);
+		playNotes(reconfigured, config.blockLen, actual);
+		passed = compareStreams(description, expected, actual, FRAME_COUNT) && passed;
+		// Makes sure the edits are heard at all, so the comparison above means something
+		playNotes(unedited, config.blockLen, actual);
+		if (isSame(expected, actual)) {
+			printf("%s: the edited timbres sound the same as the unedited ones\n", description);
+			passed = false;
+		}
+	}
+
+	if (reconfigured->getMemoryFootprint().total != footprint) {
+		printf("%s: the memory footprint changed from %lu to %lu bytes\n", description, (unsigned long)footprint, (unsigned long)reconfigured->getMemoryFootprint().total);
+		passed = false;
+	}
+	delete[] expected;
+	delete[] actual;
+	closeTestSynth(reconfigured);
+	closeTestSynth(edited);
+	closeTestSynth(unedited);
+	closeTestSynth(fresh);
+	return passed;
+}
+
+static bool testReconfigureRates(const TestConfig &config) {
+	bool passed = testReconfigure(config, 44100);
+	return testReconfigure(config, 22050) && passed;
+}
+
+// Rates above the one the synth was opened for (and 0) are refused, and the synth plays on as if nothing happened
+static bool testRefused() {
+	SynthProperties prop;
+	initTestProperties(prop);
+	Synth *refusing = openTestSynth(prop);
+	Synth *untouched = openTestSynth(prop);
+	if (refusing == NULL || untouched == NULL) {
+		closeTestSynth(refusing);
+		closeTestSynth(untouched);
+		return false;
+	}
+	prepare(refusing, true);
+	prepare(untouched, true);
+	bool passed = true;
+	if (refusing->reconfigure(prop.sampleRate + 1) || refusing->reconfigure(0)) {
+		printf("Reconfigured to a rate above maxSampleRate or to 0\n");
+		passed = false;
+	}
+	Bit16s *expected = new Bit16s[FRAME_COUNT * 2];
+	Bit16s *actual = new Bit16s[FRAME_COUNT * 2];
+	playNotes(untouched, FRAME_COUNT, expected);
+	playNotes(refusing, FRAME_COUNT, actual);
+	passed = compareStreams("Refused to reconfigure", expected, actual, FRAME_COUNT) && passed;
+	delete[] expected;
+	delete[] actual;
+	closeTestSynth(refusing);
+	closeTestSynth(untouched);
+	return passed;
+}
+
+bool MT32Emu::runReconfigureTest() {
+	bool passed = runInTestConfigs(testReconfigureRates);
+	return testRefused() && passed;
+}
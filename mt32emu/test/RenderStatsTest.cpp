@@ -0,0 +1,113 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks the render stats: nothing is counted until profiling is enabled, the samples and runs rendered and the events
+// are counted while it is, every stage gets some of the time, profiling leaves the output as it is, and the counters stop
+// when it's disabled and start again from zero when reset
+
+#include <cstdio>
+
+#include "TestSupport.h"
+#include "Tests.h"
+
+using namespace MT32Emu;
+
+static const Bit32u FRAMES = 16000;
+
+static bool isZero(const RenderStats &stats) {
+	return stats.runCount == 0 && stats.sampleCount == 0 && stats.renderTime == 0 && stats.la32Time == 0
+		&& stats.reverbTime == 0 && stats.dacTime == 0 && stats.eventCount == 0 && stats.eventTime == 0;
+}
+
+static bool isSame(const RenderStats &a, const RenderStats &b) {
+	return a.runCount == b.runCount && a.sampleCount == b.sampleCount && a.renderTime == b.renderTime && a.la32Time == b.la32Time
+		&& a.reverbTime == b.reverbTime && a.dacTime == b.dacTime && a.eventCount == b.eventCount && a.eventTime == b.eventTime;
+}
+
+// Plays three notes on part 1 and a sysex write to its timbre temp area, four events in all
+static void playEvents(Synth *synth) {
+	synth->playMsg(0x643C91);
+	synth->playMsg(0x644091);
+	synth->playMsg(0x3C81);
+	playTimbreTempSysex(synth, 0, 14, 7);
+}
+
+static bool testRenderStats(const TestConfig &config) {
+	Synth *plain = openTestSynth(config);
+	Synth *profiled = openTestSynth(config);
+	if (plain == NULL || profiled == NULL) {
+		closeTestSynth(plain);
+		closeTestSynth(profiled);
+		return false;
+	}
+	bool passed = true;
+	unsigned int blockCount = getTestBlockCount(config, FRAMES);
+	TestWorkload workload(50);
+
+	// Off by default
+	workload.render(plain, NULL, 1, config.blockLen);
+	workload.render(profiled, NULL, 1, config.blockLen);
+	if (profiled->isProfilingEnabled() || !isZero(profiled->getRenderStats())) {
+		printf("%s: render stats counted without profiling enabled\n", config.name);
+		passed = false;
+	}
+
+	profiled->setProfilingEnabled(true);
+	passed = compareTestRenders(config.name, workload, plain, profiled, blockCount, config.blockLen, 1) && passed;
+	RenderStats stats = profiled->getRenderStats();
+	double frames = (double)blockCount * config.blockLen;
+	// Polys aborted to free partials for a new note are rendered ahead one sample at a time, so there may be more runs and
+	// samples than rendered here (see Synth::prerender())
+	if (stats.sampleCount < frames || stats.runCount < blockCount || stats.runCount * config.maxSamplesPerRun < stats.sampleCount) {
+		printf("%s: %.0f samples in %.0f runs counted, after rendering %.0f samples in %u blocks\n", config.name, stats.sampleCount, stats.runCount, frames, blockCount);
+		passed = false;
+	}
+	if (stats.eventCount == 0 || stats.renderTime <= 0 || stats.la32Time <= 0 || stats.reverbTime <= 0 || stats.dacTime <= 0 || stats.eventTime <= 0) {
+		printf("%s: a stage with no time counted\n", config.name);
+		passed = false;
+	}
+
+	profiled->resetRenderStats();
+	playEvents(profiled);
+	stats = profiled->getRenderStats();
+	if (stats.eventCount != 4) {
+		printf("%s: %.0f events counted instead of 4\n", config.name, stats.eventCount);
+		passed = false;
+	}
+
+	// Nothing more is counted once profiling is disabled, but the counters are kept until reset
+	profiled->setProfilingEnabled(false);
+	playEvents(profiled);
+	workload.render(profiled, NULL, blockCount, config.blockLen);
+	if (!isSame(stats, profiled->getRenderStats())) {
+		printf("%s: render stats counted after profiling was disabled\n", config.name);
+		passed = false;
+	}
+	profiled->resetRenderStats();
+	if (!isZero(profiled->getRenderStats())) {
+		printf("%s: render stats not reset\n", config.name);
+		passed = false;
+	}
+
+	closeTestSynth(plain);
+	closeTestSynth(profiled);
+	return passed;
+}
+
+bool MT32Emu::runRenderStatsTest() {
+	return runInTestConfigs(testRenderStats);
+}
@@ -0,0 +1,102 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Measures how rendering scales with SynthProperties::renderThreads.
+// Usage: mt32emu-benchmark-render-threads [max threads [ROM directory]]
+// Renders the same workload, which keeps nearly all the partials busy, with 1 to max threads (by default, one per processor).
+// The generated test ROMs are used unless a directory with the real ones is given (with a trailing slash).
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "TestSupport.h"
+
+using namespace MT32Emu;
+
+static const unsigned int SAMPLE_RATE = 32000;
+static const Bit32u BLOCK_LEN = 256;
+static const unsigned int SECONDS = 20;
+// Every part plays a four-note chord this often, which asks for far more partials than there are
+static const Bit32u CHORD_FRAMES = SAMPLE_RATE / 8;
+
+static void playChords(Synth *synth, unsigned int chordNum) {
+	for (Bit32u chan = 1; chan <= 8; chan++) {
+		Bit32u root = 36 + (chordNum * 5 + chan * 7) % 36;
+		for (Bit32u note = 0; note < 4; note++) {
+			if (chordNum > 0) {
+				Bit32u oldRoot = 36 + ((chordNum - 1) * 5 + chan * 7) % 36;
+				synth->playMsg(0x80 | chan | ((oldRoot + note * 4) << 8));
+			}
+			synth->playMsg(0x90 | chan | ((root + note * 4) << 8) | (100 << 16));
+		}
+	}
+}
+
+static unsigned int countActivePartials(const Synth *synth) {
+	unsigned int count = 0;
+	for (unsigned int i = 0; i < MT32EMU_MAX_PARTIALS; i++) {
+		if (synth->getPartial(i)->isActive()) {
+			count++;
+		}
+	}
+	return count;
+}
+
+int main(int argc, char *argv[]) {
+	unsigned int maxThreads = argc > 1 ? atoi(argv[1]) : Thread::getProcessorCount();
+	if (maxThreads == 0) {
+		maxThreads = 1;
+	}
+	SynthProperties prop;
+	initTestProperties(prop);
+	if (argc > 2) {
+		prop.openFile = NULL;
+		prop.baseDir = argv[2];
+	}
+	prop.sampleRate = SAMPLE_RATE;
+
+	const Bit32u totalFrames = SAMPLE_RATE * SECONDS;
+	Bit16s stream[BLOCK_LEN * 2];
+	double singleThreadTime = 0.0;
+	printf("threads  seconds  x realtime  speedup  active partials\n");
+	for (unsigned int threads = 1; threads <= maxThreads; threads++) {
+		prop.renderThreads = threads;
+		Synth *synth = openTestSynth(prop);
+		if (synth == NULL) {
+			return 1;
+		}
+		unsigned long activePartialSum = 0;
+		unsigned int blockCount = 0;
+		double startTime = Thread::getTime();
+		for (Bit32u pos = 0; pos < totalFrames; pos += BLOCK_LEN) {
+			if (pos % CHORD_FRAMES < BLOCK_LEN) {
+				playChords(synth, pos / CHORD_FRAMES);
+			}
+			synth->render(stream, BLOCK_LEN);
+			activePartialSum += countActivePartials(synth);
+			blockCount++;
+		}
+		double time = Thread::getTime() - startTime;
+		synth->close();
+		delete synth;
+		if (threads == 1) {
+			singleThreadTime = time;
+		}
+		printf("%7u  %7.3f  %10.1f  %7.2f  %15.1f\n", threads, time, SECONDS / time, singleThreadTime / time, (double)activePartialSum / blockCount);
+	}
+	return 0;
+}
@@ -0,0 +1,65 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks that rendering partials on several threads (SynthProperties::renderThreads) gives the same output as on one
+
+#include <cstdio>
+
+#include "TestSupport.h"
+#include "Tests.h"
+
+using namespace MT32Emu;
+
+static bool renderWorkload(const TestConfig &config, unsigned int blockCount, Bit16s *stream) {
+	Synth *synth = openTestSynth(config);
+	if (synth == NULL) {
+		return false;
+	}
+	TestWorkload workload(31, 8);
+	workload.render(synth, stream, blockCount, config.blockLen);
+	closeTestSynth(synth);
+	return true;
+}
+
+// Compares each configuration with several threads to the same on one
+static bool testRenderThreads(const TestConfig &config) {
+	if (config.renderThreads == 1) {
+		return true;
+	}
+	TestConfig serialConfig = config;
+	serialConfig.renderThreads = 1;
+	const unsigned int blockCount = getTestBlockCount(config, 64000);
+	const Bit32u frames = blockCount * config.blockLen;
+
+	Bit16s *expected = new Bit16s[frames * 2];
+	Bit16s *actual = new Bit16s[frames * 2];
+	bool passed = renderWorkload(serialConfig, blockCount, expected) && renderWorkload(config, blockCount, actual);
+	if (passed) {
+		if (countNonZeroSamples(expected, frames) == 0) {
+			printf("%s: the synth produced no sound\n", config.name);
+			passed = false;
+		}
+		passed = compareStreams(config.name, expected, actual, frames) && passed;
+	}
+	delete[] expected;
+	delete[] actual;
+	return passed;
+}
+
+bool MT32Emu::runRenderThreadsTest() {
+	return runInTestConfigs(testRenderThreads);
+}
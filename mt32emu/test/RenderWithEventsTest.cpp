@@ -0,0 +1,197 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks that renderWithEvents() and chaseWithEvents(), called block by block with the events left over from the previous
+// call, play each event at the frame it's stamped with: the output is the same as when the renders are split up around
+// the events by hand. The host's clock wraps around part way through, and the first events are already overdue.
+
+#include <cstddef>
+#include <cstdio>
+
+#include "TestSupport.h"
+#include "Tests.h"
+
+using namespace MT32Emu;
+
+static const Bit32u EVENT_COUNT = 300;
+static const Bit32u TOTAL_FRAMES = 32000;
+static const Bit32u OVERDUE_EVENT_COUNT = 3;
+// Frames rendered after the events, all with nothing left to play
+static const Bit32u TAIL_FRAMES = 4000;
+// The host's clock at the first frame, so that it wraps around a little way in
+static const Bit32u FIRST_FRAME = 0xFFFFFFFF - 3000;
+
+struct TestEvents {
+	MidiEvent events[EVENT_COUNT];
+	Bit8u sysex[EVENT_COUNT][11];
+};
+
+// Events all through TOTAL_FRAMES, several of them often on the same frame
+static void makeEvents(TestEvents &testEvents) {
+	Bit32u state = 44;
+	Bit32u frame = FIRST_FRAME - OVERDUE_EVENT_COUNT;
+	for (Bit32u i = 0; i < EVENT_COUNT; i++) {
+		MidiEvent &event = testEvents.events[i];
+		if (i >= OVERDUE_EVENT_COUNT) {
+			frame += nextTestRandom(state) % (2 * TOTAL_FRAMES / EVENT_COUNT);
+			if (frame - FIRST_FRAME > TOTAL_FRAMES) {
+				frame = FIRST_FRAME + TOTAL_FRAMES;
+			}
+		} else {
+			frame++;
+		}
+		event.frame = frame;
+		event.sysex = NULL;
+		event.sysexLen = 0;
+		unsigned int kind = nextTestRandom(state) % 100;
+		Bit32u chan = 1 + nextTestRandom(state) % 9;
+		if (kind < 50) {
+			event.msg = 0x90 | chan | ((36 + nextTestRandom(state) % 60) << 8) | ((1 + nextTestRandom(state) % 126) << 16);
+		} else if (kind < 85) {
+			event.msg = 0x80 | chan | ((36 + nextTestRandom(state) % 60) << 8);
+		} else if (kind < 90) {
+			event.msg = 0xC0 | chan | ((nextTestRandom(state) % 128) << 8);
+		} else if (kind < 95) {
+			event.msg = 0xE0 | chan | ((nextTestRandom(state) & 0x3FFF) << 8);
+		} else {
+			// Mutes a partial or two of a part's timbre temp area
+			Bit8u partialMute = (Bit8u)(1 + nextTestRandom(state) % 15);
+			Bit32u addr = MT32EMU_MEMADDR(0x040000) + (chan - 1) % 8 * sizeof(TimbreParam) + offsetof(TimbreParam::CommonParam, partialMute);
+			event.msg = 0;
+			event.sysex = testEvents.sysex[i];
+			event.sysexLen = makeTestSysex(testEvents.sysex[i], addr, &partialMute, 1);
+		}
+	}
+}
+
+static void playEvent(Synth *synth, const MidiEvent &event) {
+	if (event.sysex != NULL) {
+		synth->playSysex(event.sysex, event.sysexLen);
+	} else {
+		synth->playMsg(event.msg);
+	}
+}
+
+// The frames from FIRST_FRAME to the frame of the given event
+static Bit32u getEventPos(const MidiEvent &event) {
+	Bit32s pos = (Bit32s)(event.frame - FIRST_FRAME);
+	return pos < 0 ? 0 : (Bit32u)pos;
+}
+
+// Renders the events the long way round, into the 16-bit or float stream (one of which is NULL), or by chasing if both are
+template <class Sample>
+static void renderSplit(Synth *synth, const TestEvents &testEvents, Sample *stream) {
+	Bit32u pos = 0;
+	for (Bit32u i = 0; i <= EVENT_COUNT; i++) {
+		Bit32u nextPos = i < EVENT_COUNT ? getEventPos(testEvents.events[i]) : TOTAL_FRAMES + TAIL_FRAMES;
+		if (nextPos > pos) {
+			if (stream != NULL) {
+				synth->render(stream + pos * 2, nextPos - pos);
+			} else {
+				synth->chase(nextPos - pos);
+			}
+			pos = nextPos;
+		}
+		if (i < EVENT_COUNT) {
+			playEvent(synth, testEvents.events[i]);
+		}
+	}
+}
+
+// Same as renderSplit(), in blocks of the configuration with the events passed along. Returns false if any are left over.
+template <class Sample>
+static bool renderBlocks(const TestConfig &config, Synth *synth, const TestEvents &testEvents, Sample *stream) {
+	Bit32u playedCount = 0;
+	for (Bit32u pos = 0; pos < TOTAL_FRAMES + TAIL_FRAMES;) {
+		Bit32u len = TOTAL_FRAMES + TAIL_FRAMES - pos;
+		if (len > config.blockLen) {
+			len = config.blockLen;
+		}
+		const MidiEvent *events = testEvents.events + playedCount;
+		Bit32u eventCount = EVENT_COUNT - playedCount;
+		if (stream != NULL) {
+			playedCount += synth->renderWithEvents(stream + pos * 2, len, FIRST_FRAME + pos, events, eventCount);
+		} else {
+			playedCount += synth->chaseWithEvents(len, FIRST_FRAME + pos, events, eventCount);
+		}
+		pos += len;
+	}
+	if (playedCount != EVENT_COUNT) {
+		printf("%s: played %u of %u events\n", config.name, playedCount, EVENT_COUNT);
+		return false;
+	}
+	return true;
+}
+
+static bool compareFloatStreams(const char *description, const float *expected, const float *actual, Bit32u frames) {
+	for (Bit32u i = 0; i < frames * 2; i++) {
+		if (expected[i] != actual[i]) {
+			printf("%s: float output differs at frame %u (expected %f, got %f)\n", description, i / 2, expected[i], actual[i]);
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool testRenderWithEvents(const TestConfig &config) {
+	const Bit32u frames = TOTAL_FRAMES + TAIL_FRAMES;
+	Synth *expectedSynth = openTestSynth(config);
+	Synth *actualSynth = openTestSynth(config);
+	if (expectedSynth == NULL || actualSynth == NULL) {
+		closeTestSynth(expectedSynth);
+		closeTestSynth(actualSynth);
+		return false;
+	}
+	TestEvents *testEvents = new TestEvents;
+	makeEvents(*testEvents);
+	Bit16s *expected = new Bit16s[frames * 2];
+	Bit16s *actual = new Bit16s[frames * 2];
+	float *expectedFloat = new float[frames * 2];
+	float *actualFloat = new float[frames * 2];
+
+	renderSplit<Bit16s>(expectedSynth, *testEvents, expected);
+	bool passed = renderBlocks<Bit16s>(config, actualSynth, *testEvents, actual);
+	passed = compareStreams(config.name, expected, actual, frames) && passed;
+	if (countNonZeroSamples(expected, frames) == 0) {
+		printf("%s: the synth produced no sound\n", config.name);
+		passed = false;
+	}
+
+	renderSplit<float>(expectedSynth, *testEvents, expectedFloat);
+	passed = renderBlocks<float>(config, actualSynth, *testEvents, actualFloat) && passed;
+	passed = compareFloatStreams(config.name, expectedFloat, actualFloat, frames) && passed;
+
+	// Both synths chase through the events again, then carry on rendering without any
+	renderSplit<Bit16s>(expectedSynth, *testEvents, NULL);
+	passed = renderBlocks<Bit16s>(config, actualSynth, *testEvents, NULL) && passed;
+	expectedSynth->render(expected, frames);
+	actualSynth->render(actual, frames);
+	passed = compareStreams(config.name, expected, actual, frames) && passed;
+
+	delete[] expected;
+	delete[] actual;
+	delete[] expectedFloat;
+	delete[] actualFloat;
+	delete testEvents;
+	closeTestSynth(expectedSynth);
+	closeTestSynth(actualSynth);
+	return passed;
+}
+
+bool MT32Emu::runRenderWithEventsTest() {
+	return runInTestConfigs(testRenderWithEvents);
+}
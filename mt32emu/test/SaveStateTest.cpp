@@ -0,0 +1,166 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks that a state saved by Synth::saveState() and restored into another synth makes that synth render the same as
+// the one it came from, and that damaged states are refused
+
+#include <cstdio>
+#include <cstring>
+
+#include "TestSupport.h"
+#include "Tests.h"
+
+using namespace MT32Emu;
+
+static bool testSaveState(const TestConfig &config) {
+	const unsigned int roundCount = 5;
+	// About a quarter of a second between saves
+	const unsigned int blocksPerRound = getTestBlockCount(config, 8000);
+	const Bit32u blockLen = config.blockLen;
+
+	Synth *source = openTestSynth(config);
+	// The other synth loads the ROMs itself, so nothing is shared between the two
+	Synth *target = openTestSynth(config);
+	if (source == NULL || target == NULL) {
+		closeTestSynth(source);
+		closeTestSynth(target);
+		return false;
+	}
+	TestWorkload workload(35, 8);
+	// The target plays something else before each restore, so that everything it ends up with has to come from the state
+	TestWorkload otherWorkload(350, 8);
+	Bit8u *state = NULL;
+	Bit32u stateSize = 0;
+	char description[96];
+	bool passed = true;
+	for (unsigned int round = 0; round < roundCount && passed; round++) {
+		unsigned int blockNum = round * blocksPerRound * 2;
+		workload.render(source, NULL, blocksPerRound, blockLen, blockNum);
+		otherWorkload.render(target, NULL, blocksPerRound, blockLen, blockNum);
+		blockNum += blocksPerRound;
+
+		delete[] state;
+		stateSize = source->getStateSize();
+		state = new Bit8u[stateSize];
+		if (source->saveState(state, stateSize) != stateSize) {
+			printf("%s: unable to save a state of %u bytes\n", config.name, stateSize);
+			passed = false;
+			break;
+		}
+		if (!target->restoreState(state, stateSize)) {
+			printf("%s: unable to restore a state of %u bytes\n", config.name, stateSize);
+			passed = false;
+			break;
+		}
+		if (target->getStateSize() != stateSize) {
+			printf("%s: the state of the restored synth takes %u bytes instead of %u\n", config.name, target->getStateSize(), stateSize);
+			passed = false;
+		}
+		sprintf(description, "%s, round %u", config.name, round);
+		passed = compareTestRenders(description, workload, source, target, blocksPerRound, blockLen, blockNum) && passed;
+	}
+
+	if (state != NULL && passed) {
+		if (target->restoreState(state, 10)) {
+			printf("%s: a truncated state was restored\n", config.name);
+			passed = false;
+		}
+		state[stateSize / 2] ^= 1;
+		if (target->restoreState(state, stateSize)) {
+			printf("%s: a damaged state was restored\n", config.name);
+			passed = false;
+		}
+	}
+	delete[] state;
+	closeTestSynth(source);
+	closeTestSynth(target);
+	return passed;
+}
+
+// The header saveState() puts before the payload: magic, byte order mark, version, payload size and checksum
+static const Bit32u STATE_HEADER_SIZE = 20;
+static const Bit32u STATE_PAYLOAD_SIZE_POS = 12;
+static const Bit32u STATE_CHECKSUM_POS = 16;
+
+// The checksum saveState() stores in the header, so that a malformed state can be made to look intact
+static Bit32u calcStateChecksum(const Bit8u *data, Bit32u len) {
+	Bit32u checksum = 2166136261U;
+	Bit32u i = 0;
+	for (; i + 4 <= len; i += 4) {
+		Bit32u word;
+		memcpy(&word, data + i, 4);
+		checksum = (checksum ^ word) * 16777619U;
+	}
+	for (; i < len; i++) {
+		checksum = (checksum ^ data[i]) * 16777619U;
+	}
+	return checksum;
+}
+
+// Checks that a state that passes the checks up front but turns out to be malformed at the very end (here, by having
+// a byte too many) is refused without changing the synth
+static bool testMalformedState() {
+	const unsigned int blockCount = 100;
+	const Bit32u blockLen = 256;
+
+	SynthProperties prop;
+	initTestProperties(prop);
+	Synth *source = openTestSynth(prop);
+	Synth *target = openTestSynth(prop);
+	Synth *untouched = openTestSynth(prop);
+	if (source == NULL || target == NULL || untouched == NULL) {
+		closeTestSynth(source);
+		closeTestSynth(target);
+		closeTestSynth(untouched);
+		return false;
+	}
+	TestWorkload workload(35, 8);
+	TestWorkload otherWorkload(350, 8);
+	workload.render(source, NULL, blockCount, blockLen);
+	otherWorkload.render(target, NULL, blockCount, blockLen);
+	otherWorkload.render(untouched, NULL, blockCount, blockLen);
+
+	Bit32u stateSize = source->getStateSize();
+	Bit8u *state = new Bit8u[stateSize + 1];
+	bool passed = true;
+	if (source->saveState(state, stateSize) != stateSize) {
+		printf("Unable to save a state of %u bytes\n", stateSize);
+		passed = false;
+	} else {
+		state[stateSize] = 0;
+		Bit32u payloadSize = stateSize + 1 - STATE_HEADER_SIZE;
+		memcpy(state + STATE_PAYLOAD_SIZE_POS, &payloadSize, 4);
+		Bit32u checksum = calcStateChecksum(state + STATE_HEADER_SIZE, payloadSize);
+		memcpy(state + STATE_CHECKSUM_POS, &checksum, 4);
+		if (target->restoreState(state, stateSize + 1)) {
+			printf("A state with a byte too many was restored\n");
+			passed = false;
+		}
+	}
+	delete[] state;
+
+	passed = compareTestRenders("After refusing a malformed state", otherWorkload, untouched, target, blockCount, blockLen, blockCount) && passed;
+	closeTestSynth(source);
+	closeTestSynth(target);
+	closeTestSynth(untouched);
+	return passed;
+}
+
+bool MT32Emu::runSaveStateTest() {
+	bool passed = runInTestConfigs(testSaveState);
+	return testMalformedState() && passed;
+}
@@ -0,0 +1,104 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+// Checks that with the reverb disabled, a song can be rendered in segments on several synths, as mt32emu-smf2wav --jobs
+// does: one synth chases through the song, saving its state at the start of each segment, and the others render the
+// segments from those states. Joined up, the segments are the same as a serial render, and the synth that chased carries
+// on just like the one that rendered all along.
+
+#include <cstdio>
+
+#include "TestSupport.h"
+#include "Tests.h"
+
+using namespace MT32Emu;
+
+static bool testSegmentedRender(const TestConfig &config) {
+	// chase() drops the output the reverb stage holds back, so a segment would start with a run of silence
+	if (config.pipelineReverb) {
+		return true;
+	}
+	const unsigned int segmentCount = 6;
+	const unsigned int blocksPerSegment = getTestBlockCount(config, 12800);
+	const unsigned int tailBlocks = blocksPerSegment;
+	const unsigned int songBlocks = segmentCount * blocksPerSegment;
+	const Bit32u blockLen = config.blockLen;
+
+	Synth *serial = openTestSynth(config);
+	Synth *chased = openTestSynth(config);
+	Synth *segmentSynth = openTestSynth(config);
+	if (serial == NULL || chased == NULL || segmentSynth == NULL) {
+		closeTestSynth(serial);
+		closeTestSynth(chased);
+		closeTestSynth(segmentSynth);
+		return false;
+	}
+	serial->setReverbEnabled(false);
+	chased->setReverbEnabled(false);
+	segmentSynth->setReverbEnabled(false);
+
+	TestWorkload workload(41, 8);
+	Bit16s *expected = new Bit16s[(songBlocks + tailBlocks) * blockLen * 2];
+	Bit16s *actual = new Bit16s[(songBlocks + tailBlocks) * blockLen * 2];
+	workload.render(serial, expected, songBlocks + tailBlocks, blockLen);
+
+	// The synth rendering the segments plays them in reverse order, so that each really starts from the state it's given
+	Bit8u *states[segmentCount];
+	Bit32u stateSizes[segmentCount];
+	bool passed = true;
+	for (unsigned int segmentIx = 0; segmentIx < segmentCount; segmentIx++) {
+		stateSizes[segmentIx] = chased->getStateSize();
+		states[segmentIx] = new Bit8u[stateSizes[segmentIx]];
+		if (chased->saveState(states[segmentIx], stateSizes[segmentIx]) == 0) {
+			printf("%s: unable to save the state at the start of segment %u\n", config.name, segmentIx);
+			passed = false;
+		}
+		for (unsigned int blockNum = segmentIx * blocksPerSegment; blockNum < (segmentIx + 1) * blocksPerSegment; blockNum++) {
+			workload.playBlock(chased, blockNum);
+			chased->chase(blockLen);
+		}
+	}
+	for (unsigned int segmentIx = segmentCount; passed && segmentIx-- > 0;) {
+		if (!segmentSynth->restoreState(states[segmentIx], stateSizes[segmentIx])) {
+			printf("%s: unable to restore the state at the start of segment %u\n", config.name, segmentIx);
+			passed = false;
+			break;
+		}
+		unsigned int firstBlock = segmentIx * blocksPerSegment;
+		workload.render(segmentSynth, actual + firstBlock * blockLen * 2, blocksPerSegment, blockLen, firstBlock);
+	}
+	workload.render(chased, actual + songBlocks * blockLen * 2, tailBlocks, blockLen, songBlocks);
+
+	passed = passed && compareStreams(config.name, expected, actual, (songBlocks + tailBlocks) * blockLen);
+	if (countNonZeroSamples(expected, songBlocks * blockLen) == 0) {
+		printf("%s: the synth produced no sound\n", config.name);
+		passed = false;
+	}
+
+	for (unsigned int segmentIx = 0; segmentIx < segmentCount; segmentIx++) {
+		delete[] states[segmentIx];
+	}
+	delete[] expected;
+	delete[] actual;
+	closeTestSynth(serial);
+	closeTestSynth(chased);
+	closeTestSynth(segmentSynth);
+	return passed;
+}
+
+bool MT32Emu::runSegmentedRenderTest() {
+	return runInTestConfigs(testSegmentedRender);
+}
@@ -0,0 +1,143 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks that synths in a SynthRack sound the same as synths of their own, and that renderBuses() mixes them with
+// a single clip of the sum for each bus
+
+#include <cstdio>
+
+#include "TestSupport.h"
+#include "Tests.h"
+
+using namespace MT32Emu;
+
+static const unsigned int SYNTH_COUNT = 4;
+// The synths before this one share bus 0, and it has bus 1 to itself
+static const unsigned int BUS_1_SYNTH = 3;
+static const unsigned int BUS_COUNT = 2;
+// Loud enough for the sum of the synths on bus 0 to go out of range now and then, also part way through
+static const float OUTPUT_GAIN = 16.0f;
+
+// Samples where the sum went out of range before all the synths were added, but not in the end, in any configuration
+static Bit32u recoveredSamples = 0;
+
+static bool testSynthRack(const TestConfig &config) {
+	const unsigned int blockCount = getTestBlockCount(config, 48000);
+	const Bit32u blockLen = config.blockLen;
+
+	SynthProperties prop;
+	initTestProperties(prop, config);
+	SynthRack rack;
+	if (!rack.open(prop, SYNTH_COUNT, SYNTH_COUNT)) {
+		printf("%s: unable to open the rack\n", config.name);
+		return false;
+	}
+	Synth *synths[SYNTH_COUNT];
+	TestWorkload *workloads[SYNTH_COUNT];
+	bool passed = true;
+	for (unsigned int i = 0; i < SYNTH_COUNT; i++) {
+		synths[i] = openTestSynth(prop);
+		if (synths[i] == NULL) {
+			passed = false;
+		} else {
+			synths[i]->setOutputGain(OUTPUT_GAIN);
+		}
+		rack.getSynth(i)->setOutputGain(OUTPUT_GAIN);
+		// The first two synths play the same, so that their sum goes out of range whenever they're above half scale
+		workloads[i] = new TestWorkload(i == 1 ? 320 : 320 + i, 8);
+	}
+	if (rack.getSynth(1)->getROMImage() != rack.getSynth(0)->getROMImage()) {
+		printf("%s: the synths in the rack don't share their ROMs\n", config.name);
+		passed = false;
+	}
+	rack.setBus(BUS_1_SYNTH, 1);
+
+	Bit16s *expected[SYNTH_COUNT];
+	Bit16s *actual[SYNTH_COUNT];
+	Bit16s *buses[BUS_COUNT];
+	for (unsigned int i = 0; i < SYNTH_COUNT; i++) {
+		expected[i] = new Bit16s[blockLen * 2];
+		actual[i] = new Bit16s[blockLen * 2];
+	}
+	for (unsigned int i = 0; i < BUS_COUNT; i++) {
+		buses[i] = new Bit16s[blockLen * 2];
+	}
+	Bit16s *expectedBus = new Bit16s[blockLen * 2];
+
+	for (unsigned int blockNum = 0; blockNum < blockCount && passed; blockNum++) {
+		for (unsigned int i = 0; i < SYNTH_COUNT; i++) {
+			workloads[i]->playBlock(synths[i], blockNum);
+			workloads[i]->playBlock(rack.getSynth(i), blockNum);
+			synths[i]->render(expected[i], blockLen);
+		}
+		char description[96];
+		// Alternates between rendering each synth separately and mixing them into buses
+		if (blockNum % 2 == 0) {
+			rack.render(actual, blockLen);
+			for (unsigned int i = 0; i < SYNTH_COUNT; i++) {
+				sprintf(description, "%s, block %u, synth %u", config.name, blockNum, i);
+				passed = compareStreams(description, expected[i], actual[i], blockLen) && passed;
+			}
+			continue;
+		}
+		rack.renderBuses(buses, BUS_COUNT, blockLen);
+		for (Bit32u j = 0; j < blockLen * 2; j++) {
+			Bit32s sum = 0;
+			bool outOfRange = false;
+			for (unsigned int i = 0; i < BUS_1_SYNTH; i++) {
+				sum += expected[i][j];
+				outOfRange = outOfRange || sum > 32767 || sum < -32768;
+			}
+			if (sum > 32767) {
+				expectedBus[j] = 32767;
+			} else if (sum < -32768) {
+				expectedBus[j] = -32768;
+			} else {
+				expectedBus[j] = (Bit16s)sum;
+				if (outOfRange) {
+					recoveredSamples++;
+				}
+			}
+		}
+		sprintf(description, "%s, block %u, bus 0", config.name, blockNum);
+		passed = compareStreams(description, expectedBus, buses[0], blockLen) && passed;
+		sprintf(description, "%s, block %u, bus 1", config.name, blockNum);
+		passed = compareStreams(description, expected[BUS_1_SYNTH], buses[1], blockLen) && passed;
+	}
+	for (unsigned int i = 0; i < SYNTH_COUNT; i++) {
+		delete[] expected[i];
+		delete[] actual[i];
+		closeTestSynth(synths[i]);
+		delete workloads[i];
+	}
+	for (unsigned int i = 0; i < BUS_COUNT; i++) {
+		delete[] buses[i];
+	}
+	delete[] expectedBus;
+	rack.close();
+	return passed;
+}
+
+bool MT32Emu::runSynthRackTest() {
+	recoveredSamples = 0;
+	bool passed = runInTestConfigs(testSynthRack);
+	if (passed && recoveredSamples == 0) {
+		printf("The sum of the synths on bus 0 never went out of range part way through, so the mixing wasn't fully checked\n");
+		passed = false;
+	}
+	return passed;
+}
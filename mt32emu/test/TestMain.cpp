@@ -0,0 +1,82 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Usage: mt32emu-tests [test name...]
+// Runs the named tests, or all of them if none are named. CTest runs each on its own (see CMakeLists.txt).
+
+#include <cstdio>
+#include <cstring>
+
+#include "Tests.h"
+
+using namespace MT32Emu;
+
+struct TestEntry {
+	const char *name;
+	bool (*run)();
+};
+
+static const TestEntry TESTS[] = {
+	{"allocation", runAllocationTest},
+	{"render-threads", runRenderThreadsTest},
+	{"synth-rack", runSynthRackTest},
+	{"pipelined-reverb", runPipelinedReverbTest},
+	{"checkpoint", runCheckpointTest},
+	{"save-state", runSaveStateTest},
+	{"clone", runCloneTest},
+	{"chase", runChaseTest},
+	{"open-failure", runOpenFailureTest},
+	{"reconfigure", runReconfigureTest},
+	{"segmented-render", runSegmentedRenderTest},
+	{"parse-stream", runParseStreamTest},
+	{"bulk-write", runBulkWriteTest},
+	{"render-with-events", runRenderWithEventsTest},
+	{"patch-cache", runPatchCacheTest},
+	{"event-trace", runEventTraceTest},
+	{"render-stats", runRenderStatsTest}
+};
+
+static const unsigned int TEST_COUNT = sizeof(TESTS) / sizeof(TESTS[0]);
+
+static bool runTest(const TestEntry &test) {
+	bool passed = test.run();
+	printf("%s: %s\n", test.name, passed ? "passed" : "FAILED");
+	return passed;
+}
+
+int main(int argc, char *argv[]) {
+	bool passed = true;
+	if (argc < 2) {
+		for (unsigned int i = 0; i < TEST_COUNT; i++) {
+			passed = runTest(TESTS[i]) && passed;
+		}
+		return passed ? 0 : 1;
+	}
+	for (int argIx = 1; argIx < argc; argIx++) {
+		unsigned int i = 0;
+		while (i < TEST_COUNT && strcmp(TESTS[i].name, argv[argIx]) != 0) {
+			i++;
+		}
+		if (i == TEST_COUNT) {
+			printf("No test named %s\n", argv[argIx]);
+			passed = false;
+			continue;
+		}
+		passed = runTest(TESTS[i]) && passed;
+	}
+	return passed ? 0 : 1;
+}
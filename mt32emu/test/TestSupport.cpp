@@ -0,0 +1,423 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstring>
+
+#include "TestSupport.h"
+
+using namespace MT32Emu;
+
+static const unsigned int TEST_CONTROL_ROM_SIZE = 64 * 1024;
+static const unsigned int TEST_PCM_ROM_SIZE = 512 * 1024;
+
+// Locations used by the ver1.07 entry of ControlROMMaps (see Synth.cpp)
+static const unsigned int TEST_ROM_ID_POS = 0x4010;
+static const unsigned int TEST_ROM_PCM_TABLE = 0x3000;
+static const unsigned int TEST_ROM_TIMBRE_A_MAP = 0x8000;
+static const unsigned int TEST_ROM_TIMBRE_B_MAP = 0xC000;
+static const unsigned int TEST_ROM_TIMBRE_B_OFFSET = 0x4000;
+static const unsigned int TEST_ROM_TIMBRE_R_MAP = 0x3200;
+static const unsigned int TEST_ROM_TIMBRE_R_COUNT = 30;
+static const unsigned int TEST_ROM_RHYTHM_SETTINGS = 0x73FE;
+static const unsigned int TEST_ROM_RESERVE_SETTINGS = 0x57B1;
+static const unsigned int TEST_ROM_PAN_SETTINGS = 0x57CC;
+static const unsigned int TEST_ROM_PROGRAM_SETTINGS = 0x57BA;
+static const unsigned int TEST_ROM_RHYTHM_MAX_TABLE = 0x523C;
+static const unsigned int TEST_ROM_PATCH_MAX_TABLE = 0x5248;
+static const unsigned int TEST_ROM_SYSTEM_MAX_TABLE = 0x5258;
+static const unsigned int TEST_ROM_TIMBRE_MAX_TABLE = 0x51F4;
+
+static const Bit8u TEST_ROM_ID[] = "\000 ver1.07 10 Oct, 87 ";
+
+// Maximum values of the timbre parameters, in TimbreParam order. These are also used to generate the timbres.
+static const Bit8u TIMBRE_COMMON_MAX[] = {
+	127, 127, 127, 127, 127, 127, 127, 127, 127, 127, // name
+	12, 12, 15, 1 // partialStructure12, partialStructure34, partialMute, noSustain
+};
+static const Bit8u TIMBRE_PARTIAL_MAX[] = {
+	96, 100, 16, 1, 1, 127, 100, 14, // wg
+	10, 3, 4, 100, 100, 100, 100, 100, 100, 100, 100, 100, // pitchEnv
+	100, 100, 100, // pitchLFO
+	100, 30, 14, 127, 14, 100, 100, 4, 4, 100, 100, 100, 100, 100, 100, 100, 100, 100, // tvf
+	100, 100, 127, 12, 127, 12, 4, 4, 100, 100, 100, 100, 100, 100, 100, 100, 100 // tva
+};
+static const Bit8u RHYTHM_MAX[] = {127, 100, 14, 1};
+static const Bit8u PATCH_MAX[] = {3, 63, 48, 100, 24, 3, 1, 0, 100, 14, 0, 0, 0, 0, 0, 0};
+static const Bit8u SYSTEM_MAX[] = {
+	127, 3, 7, 7,
+	32, 32, 32, 32, 32, 32, 32, 32, 32, // reserveSettings
+	16, 16, 16, 16, 16, 16, 16, 16, 16, // chanAssign
+	100 // masterVol
+};
+static const Bit8u RESERVE_SETTINGS[] = {3, 10, 6, 4, 3, 0, 0, 0, 6};
+static const Bit8u PROGRAM_SETTINGS[] = {0, 68, 48, 95, 78, 41, 3, 110};
+
+static Bit8u *testControlROM = NULL;
+static Bit8u *testPCMROM = NULL;
+
+// Reads a block of memory, such as one of the generated ROM images
+class TestROMFile : public File {
+private:
+	const Bit8u *data;
+	size_t size;
+	size_t pos;
+
+public:
+	TestROMFile(const Bit8u *useData, size_t useSize) : data(useData), size(useSize), pos(0) {
+	}
+
+	void close() {
+	}
+
+	size_t read(void *in, size_t readSize) {
+		if (readSize > size - pos) {
+			readSize = size - pos;
+		}
+		memcpy(in, data + pos, readSize);
+		pos += readSize;
+		return readSize;
+	}
+
+	bool readBit8u(Bit8u *in) {
+		if (pos == size) {
+			return false;
+		}
+		*in = data[pos++];
+		return true;
+	}
+
+	bool isEOF() {
+		return pos == size;
+	}
+};
+
+Bit32u MT32Emu::nextTestRandom(Bit32u &state) {
+	state = state * 1103515245 + 12345;
+	return (state >> 16) & 0x7FFF;
+}
+
+static Bit8u randomUpTo(Bit32u &state, unsigned int max) {
+	return (Bit8u)(nextTestRandom(state) % (max + 1));
+}
+
+static void generateTimbre(Bit8u *dst, Bit32u &state, bool allPartials) {
+	for (unsigned int i = 0; i < 10; i++) {
+		*dst++ = 'A' + randomUpTo(state, 25);
+	}
+	*dst++ = randomUpTo(state, TIMBRE_COMMON_MAX[10]);
+	*dst++ = randomUpTo(state, TIMBRE_COMMON_MAX[11]);
+	*dst++ = allPartials ? 15 : 1 + randomUpTo(state, 14);
+	*dst++ = randomUpTo(state, TIMBRE_COMMON_MAX[13]);
+	for (unsigned int partialNum = 0; partialNum < 4; partialNum++) {
+		for (unsigned int i = 0; i < sizeof(TIMBRE_PARTIAL_MAX); i++) {
+			*dst++ = randomUpTo(state, TIMBRE_PARTIAL_MAX[i]);
+		}
+	}
+}
+
+static void generateTimbreBank(Bit8u *rom, Bit32u &state, unsigned int mapPos, unsigned int dataPos, unsigned int offset, unsigned int count, bool allPartials) {
+	for (unsigned int i = 0; i < count; i++) {
+		unsigned int address = dataPos + i * sizeof(TimbreParam) - offset;
+		rom[mapPos + i * 2] = (Bit8u)(address & 0xFF);
+		rom[mapPos + i * 2 + 1] = (Bit8u)(address >> 8);
+		generateTimbre(&rom[dataPos + i * sizeof(TimbreParam)], state, allPartials);
+	}
+}
+
+static void generateTestROMs() {
+	if (testControlROM != NULL) {
+		return;
+	}
+	Bit32u state = 1234;
+	Bit8u *rom = new Bit8u[TEST_CONTROL_ROM_SIZE];
+	memset(rom, 0, TEST_CONTROL_ROM_SIZE);
+	memcpy(&rom[TEST_ROM_ID_POS], TEST_ROM_ID, sizeof(TEST_ROM_ID) - 1);
+
+	memcpy(&rom[TEST_ROM_TIMBRE_MAX_TABLE], TIMBRE_COMMON_MAX, sizeof(TIMBRE_COMMON_MAX));
+	memcpy(&rom[TEST_ROM_TIMBRE_MAX_TABLE + sizeof(TIMBRE_COMMON_MAX)], TIMBRE_PARTIAL_MAX, sizeof(TIMBRE_PARTIAL_MAX));
+	memcpy(&rom[TEST_ROM_RHYTHM_MAX_TABLE], RHYTHM_MAX, sizeof(RHYTHM_MAX));
+	memcpy(&rom[TEST_ROM_PATCH_MAX_TABLE], PATCH_MAX, sizeof(PATCH_MAX));
+	memcpy(&rom[TEST_ROM_SYSTEM_MAX_TABLE], SYSTEM_MAX, sizeof(SYSTEM_MAX));
+	memcpy(&rom[TEST_ROM_RESERVE_SETTINGS], RESERVE_SETTINGS, sizeof(RESERVE_SETTINGS));
+	memset(&rom[TEST_ROM_PAN_SETTINGS], 7, 9);
+	memcpy(&rom[TEST_ROM_PROGRAM_SETTINGS], PROGRAM_SETTINGS, sizeof(PROGRAM_SETTINGS));
+
+	// Timbre numbers in the rhythm settings count from absolute timbre 128, so bank R starts at 64 (see RhythmPart::noteOn())
+	for (unsigned int i = 0; i < 85; i++) {
+		Bit8u *setting = &rom[TEST_ROM_RHYTHM_SETTINGS + i * 4];
+		setting[0] = 64 + randomUpTo(state, TEST_ROM_TIMBRE_R_COUNT - 1);
+		setting[1] = 60 + randomUpTo(state, 40);
+		setting[2] = randomUpTo(state, 14);
+		setting[3] = randomUpTo(state, 1);
+	}
+
+	// Wave positions are kept low enough for the longest of the lengths used to fit in the PCM ROM
+	static const Bit8u waveLengths[] = {0x00, 0x80, 0x10, 0x90};
+	for (unsigned int i = 0; i < 128; i++) {
+		Bit8u *wave = &rom[TEST_ROM_PCM_TABLE + i * 4];
+		wave[0] = (Bit8u)(i % 100);
+		wave[1] = waveLengths[randomUpTo(state, 3)] | 1;
+		wave[2] = randomUpTo(state, 255);
+		wave[3] = randomUpTo(state, 0x7F);
+	}
+
+	generateTimbreBank(rom, state, TEST_ROM_TIMBRE_A_MAP, TEST_ROM_TIMBRE_A_MAP + 0x100, 0, 64, false);
+	generateTimbreBank(rom, state, TEST_ROM_TIMBRE_B_MAP, TEST_ROM_TIMBRE_B_MAP + 0x100, TEST_ROM_TIMBRE_B_OFFSET, 64, false);
+	// The rhythm bank is stored "compressed", which with all partials present just means the timbres are packed together
+	generateTimbreBank(rom, state, TEST_ROM_TIMBRE_R_MAP, 0x1000, 0, TEST_ROM_TIMBRE_R_COUNT, true);
+	testControlROM = rom;
+
+	testPCMROM = new Bit8u[TEST_PCM_ROM_SIZE];
+	for (unsigned int i = 0; i < TEST_PCM_ROM_SIZE; i++) {
+		testPCMROM[i] = randomUpTo(state, 255);
+	}
+}
+
+const Bit8u *MT32Emu::getTestROM(const char *filename, size_t &size) {
+	generateTestROMs();
+	if (strcmp(filename, "MT32_CONTROL.ROM") == 0) {
+		size = TEST_CONTROL_ROM_SIZE;
+		return testControlROM;
+	}
+	if (strcmp(filename, "MT32_PCM.ROM") == 0) {
+		size = TEST_PCM_ROM_SIZE;
+		return testPCMROM;
+	}
+	size = 0;
+	return NULL;
+}
+
+File *MT32Emu::openTestMemoryFile(const Bit8u *data, size_t size) {
+	return new TestROMFile(data, size);
+}
+
+static File *openTestROMFile(void * /*userData*/, const char *filename, File::OpenMode /*mode*/) {
+	size_t size;
+	const Bit8u *data = getTestROM(filename, size);
+	return data == NULL ? NULL : new TestROMFile(data, size);
+}
+
+static void discardDebug(void * /*userData*/, const char * /*fmt*/, va_list /*list*/) {
+}
+
+void MT32Emu::initTestProperties(SynthProperties &prop) {
+	generateTestROMs();
+	memset(&prop, 0, sizeof(prop));
+	prop.sampleRate = 32000;
+	prop.printDebug = discardDebug;
+	prop.openFile = openTestROMFile;
+}
+
+Synth *MT32Emu::openTestSynth(SynthProperties &prop) {
+	Synth *synth = new Synth();
+	if (!synth->open(prop)) {
+		printf("Unable to open a synth on the test ROMs\n");
+		delete synth;
+		return NULL;
+	}
+	return synth;
+}
+
+void MT32Emu::closeTestSynth(Synth *synth) {
+	if (synth != NULL) {
+		synth->close();
+		delete synth;
+	}
+}
+
+const TestConfig MT32Emu::TEST_CONFIGS[] = {
+	{"1 thread, blocks of 256", 1, false, 512, 256},
+	{"1 thread, blocks of 7", 1, false, 512, 7},
+	{"1 thread, blocks of 1000", 1, false, 512, 1000},
+	{"3 threads, blocks of 256", 3, false, 512, 256},
+	{"8 threads, blocks of 1000", 8, false, 512, 1000},
+	{"Pipelined reverb, 1 thread, blocks of 256", 1, true, 512, 256},
+	{"Pipelined reverb, 3 threads, blocks of 7", 3, true, 512, 7}
+};
+
+const unsigned int MT32Emu::TEST_CONFIG_COUNT = sizeof(TEST_CONFIGS) / sizeof(TEST_CONFIGS[0]);
+
+void MT32Emu::initTestProperties(SynthProperties &prop, const TestConfig &config) {
+	initTestProperties(prop);
+	prop.renderThreads = config.renderThreads;
+	prop.pipelineReverb = config.pipelineReverb;
+	prop.maxSamplesPerRun = config.maxSamplesPerRun;
+}
+
+Synth *MT32Emu::openTestSynth(const TestConfig &config) {
+	SynthProperties prop;
+	initTestProperties(prop, config);
+	return openTestSynth(prop);
+}
+
+unsigned int MT32Emu::getTestBlockCount(const TestConfig &config, Bit32u frames) {
+	return (frames + config.blockLen - 1) / config.blockLen;
+}
+
+bool MT32Emu::runInTestConfigs(bool (*test)(const TestConfig &config)) {
+	bool passed = true;
+	for (unsigned int i = 0; i < TEST_CONFIG_COUNT; i++) {
+		if (!test(TEST_CONFIGS[i])) {
+			printf("Failed with: %s\n", TEST_CONFIGS[i].name);
+			passed = false;
+		}
+	}
+	return passed;
+}
+
+TestWorkload::TestWorkload(Bit32u useSeed, unsigned int useMaxEventsPerBlock, bool useSysexEnabled) :
+	seed(useSeed), maxEventsPerBlock(useMaxEventsPerBlock), sysexEnabled(useSysexEnabled) {
+}
+
+Bit32u MT32Emu::makeTestSysex(Bit8u *sysex, Bit32u addr, const Bit8u *data, Bit32u len) {
+	static const Bit8u header[] = {0xF0, 0x41, 0x10, 0x16, 0x12};
+	memcpy(sysex, header, sizeof(header));
+	sysex[5] = (Bit8u)((addr >> 14) & 0x7F);
+	sysex[6] = (Bit8u)((addr >> 7) & 0x7F);
+	sysex[7] = (Bit8u)(addr & 0x7F);
+	memcpy(sysex + 8, data, len);
+	sysex[8 + len] = Synth::calcSysexChecksum(&sysex[5], len + 3, 0);
+	sysex[9 + len] = 0xF7;
+	return len + 10;
+}
+
+static void playReverbSysex(Synth *synth, Bit8u mode, Bit8u time, Bit8u level) {
+	Bit8u data[] = {mode, time, level};
+	Bit8u sysex[sizeof(data) + 10];
+	synth->playSysex(sysex, makeTestSysex(sysex, MT32EMU_MEMADDR(0x100001), data, sizeof(data)));
+}
+
+void MT32Emu::playTimbreTempSysex(Synth *synth, unsigned int partNum, unsigned int offset, Bit8u value) {
+	Bit8u sysex[11];
+	synth->playSysex(sysex, makeTestSysex(sysex, MT32EMU_MEMADDR(0x040000) + partNum * sizeof(TimbreParam) + offset, &value, 1));
+}
+
+void TestWorkload::playBlock(Synth *synth, unsigned int blockNum) const {
+	Bit32u state = seed ^ (blockNum * 2654435761U);
+	nextTestRandom(state);
+	unsigned int eventCount = nextTestRandom(state) % (maxEventsPerBlock + 1);
+	for (unsigned int i = 0; i < eventCount; i++) {
+		unsigned int kind = nextTestRandom(state) % 100;
+		// MIDI channels 2-10, which are assigned to parts 1-8 and the rhythm part
+		Bit32u chan = 1 + nextTestRandom(state) % 9;
+		if (kind < 50) {
+			synth->playMsg(0x90 | chan | ((36 + nextTestRandom(state) % 60) << 8) | ((1 + nextTestRandom(state) % 126) << 16));
+		} else if (kind < 85) {
+			synth->playMsg(0x80 | chan | ((36 + nextTestRandom(state) % 60) << 8));
+		} else if (kind < 90) {
+			synth->playMsg(0xC0 | (1 + nextTestRandom(state) % 8) | ((nextTestRandom(state) % 128) << 8));
+		} else if (kind < 93) {
+			synth->playMsg(0xB0 | chan | (0x40 << 8) | ((nextTestRandom(state) % 2) * 127 << 16));
+		} else if (kind < 98) {
+			if (!sysexEnabled) {
+				continue;
+			}
+			if (kind < 95) {
+				playReverbSysex(synth, nextTestRandom(state) % 4, nextTestRandom(state) % 8, nextTestRandom(state) % 8);
+			} else {
+				playTimbreTempSysex(synth, nextTestRandom(state) % 8, 14 + nextTestRandom(state) % 50, nextTestRandom(state) % 50);
+			}
+		} else {
+			synth->playMsg(0xE0 | chan | ((nextTestRandom(state) % 128) << 8) | ((nextTestRandom(state) % 128) << 16));
+		}
+	}
+}
+
+void TestWorkload::render(Synth *synth, Bit16s *stream, unsigned int blockCount, Bit32u blockLen, unsigned int firstBlock) const {
+	Bit16s *discardBuffer = stream == NULL ? new Bit16s[blockLen * 2] : NULL;
+	for (unsigned int i = 0; i < blockCount; i++) {
+		playBlock(synth, firstBlock + i);
+		synth->render(stream == NULL ? discardBuffer : stream + i * blockLen * 2, blockLen);
+	}
+	delete[] discardBuffer;
+}
+
+bool MT32Emu::compareStreams(const char *description, const Bit16s *expected, const Bit16s *actual, Bit32u frames) {
+	Bit32u differences = 0;
+	Bit32u firstDifference = 0;
+	for (Bit32u i = 0; i < frames * 2; i++) {
+		if (expected[i] != actual[i]) {
+			if (differences == 0) {
+				firstDifference = i;
+			}
+			differences++;
+		}
+	}
+	if (differences == 0) {
+		return true;
+	}
+	printf("%s: %u of %u samples differ, the first at frame %u (expected %d, got %d)\n", description,
+		differences, frames * 2, firstDifference / 2, expected[firstDifference], actual[firstDifference]);
+	return false;
+}
+
+Bit32u MT32Emu::countNonZeroSamples(const Bit16s *stream, Bit32u frames) {
+	Bit32u count = 0;
+	for (Bit32u i = 0; i < frames * 2; i++) {
+		if (stream[i] != 0) {
+			count++;
+		}
+	}
+	return count;
+}
+
+bool MT32Emu::compareTestRenders(const char *description, const TestWorkload &workload, Synth *expectedSynth, Synth *actualSynth, unsigned int blockCount, Bit32u blockLen, unsigned int firstBlock) {
+	Bit32u frames = blockCount * blockLen;
+	Bit16s *expected = new Bit16s[frames * 2];
+	Bit16s *actual = new Bit16s[frames * 2];
+	workload.render(expectedSynth, expected, blockCount, blockLen, firstBlock);
+	workload.render(actualSynth, actual, blockCount, blockLen, firstBlock);
+	bool passed = compareStreams(description, expected, actual, frames);
+	if (countNonZeroSamples(expected, frames) == 0) {
+		printf("%s: the synth produced no sound\n", description);
+		passed = false;
+	}
+	delete[] expected;
+	delete[] actual;
+	return passed;
+}
+
+bool MT32Emu::compareTestMemory(const char *description, Synth *expectedSynth, Synth *actualSynth) {
+	// The regions of mt32ram, by address and size
+	static const Bit32u regions[][2] = {
+		{MT32EMU_MEMADDR(0x030000), 9 * sizeof(MemParams::PatchTemp)},
+		{MT32EMU_MEMADDR(0x030110), 85 * sizeof(MemParams::RhythmTemp)},
+		{MT32EMU_MEMADDR(0x040000), 8 * sizeof(TimbreParam)},
+		{MT32EMU_MEMADDR(0x050000), 128 * sizeof(PatchParam)},
+		{MT32EMU_MEMADDR(0x080000), 256 * sizeof(MemParams::PaddedTimbre)},
+		{MT32EMU_MEMADDR(0x100000), sizeof(MemParams::System)}
+	};
+	bool passed = true;
+	for (unsigned int i = 0; i < sizeof(regions) / sizeof(regions[0]) && passed; i++) {
+		Bit32u len = regions[i][1];
+		Bit8u *expected = new Bit8u[len];
+		Bit8u *actual = new Bit8u[len];
+		expectedSynth->readMemory(regions[i][0], len, expected);
+		actualSynth->readMemory(regions[i][0], len, actual);
+		for (Bit32u j = 0; j < len; j++) {
+			if (expected[j] != actual[j]) {
+				printf("%s: memory differs at address %06X (expected %u, got %u)\n", description, MT32EMU_SYSEXMEMADDR(regions[i][0] + j), expected[j], actual[j]);
+				passed = false;
+				break;
+			}
+		}
+		delete[] expected;
+		delete[] actual;
+	}
+	return passed;
+}
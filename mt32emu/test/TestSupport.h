@@ -0,0 +1,116 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_TEST_SUPPORT_H
+#define MT32EMU_TEST_SUPPORT_H
+
+#include <mt32emu/mt32emu.h>
+
+namespace MT32Emu {
+
+// The tests don't need the real ROMs, which can't be distributed. Instead, a Control ROM that identifies itself as
+// an MT-32 ver1.07 is generated with random (but valid) timbres, patches and rhythm settings, along with a PCM ROM
+// full of noise. That's no good for listening to, but fine for checking that two ways of rendering the same MIDI
+// produce the same output.
+
+// Clears the properties and sets them up to open a synth on the generated ROMs, with debug output discarded
+void initTestProperties(SynthProperties &prop);
+
+// Opens a synth on the generated ROMs. Returns NULL (after saying so) if that fails.
+Synth *openTestSynth(SynthProperties &prop);
+
+// Closes and deletes a synth opened by openTestSynth(), if it isn't NULL
+void closeTestSynth(Synth *synth);
+
+// One of the ways of rendering the tests go through. The output is the same in all of them, except that with pipelineReverb
+// it's delayed by maxSamplesPerRun frames.
+struct TestConfig {
+	const char *name;
+	unsigned int renderThreads;
+	bool pipelineReverb;
+	unsigned int maxSamplesPerRun;
+	// The number of frames rendered at a time, which is also how often the test workloads play events
+	Bit32u blockLen;
+};
+
+// Block sizes well below, around and across the run size, on one and several threads, with and without pipelined reverb
+extern const TestConfig TEST_CONFIGS[];
+extern const unsigned int TEST_CONFIG_COUNT;
+
+// Same as initTestProperties(prop), with the threads, pipelining and run size of the configuration
+void initTestProperties(SynthProperties &prop, const TestConfig &config);
+Synth *openTestSynth(const TestConfig &config);
+
+// Returns the number of blocks of the configuration it takes to render at least the given number of frames
+unsigned int getTestBlockCount(const TestConfig &config, Bit32u frames);
+
+// Runs a test in each of TEST_CONFIGS. Returns true if it passed in all of them, otherwise names the ones it failed in.
+bool runInTestConfigs(bool (*test)(const TestConfig &config));
+
+// For tests that need to serve altered ROMs from an openFile callback of their own.
+// getTestROM() returns the generated ROM for the file name Synth asks for (or NULL), and openTestMemoryFile() returns a File
+// reading the given data, which must stay around until the file is closed.
+const Bit8u *getTestROM(const char *filename, size_t &size);
+File *openTestMemoryFile(const Bit8u *data, size_t size);
+
+// A reproducible stream of notes, program changes, pedal, pitch bend and sysex for all parts, including rhythm.
+// The events for each block only depend on the seed and the block number, so the same workload can be played
+// into several synths, or into one synth starting part way through.
+class TestWorkload {
+private:
+	Bit32u seed;
+	unsigned int maxEventsPerBlock;
+	bool sysexEnabled;
+
+public:
+	TestWorkload(Bit32u useSeed, unsigned int useMaxEventsPerBlock = 5, bool useSysexEnabled = true);
+
+	// Plays the events of the given block into the synth
+	void playBlock(Synth *synth, unsigned int blockNum) const;
+	// Plays the events of blocks [0, blockCount) with blockLen frames rendered after each.
+	// The output goes to stream (interleaved stereo, blockCount * blockLen frames), which may be NULL.
+	void render(Synth *synth, Bit16s *stream, unsigned int blockCount, Bit32u blockLen, unsigned int firstBlock = 0) const;
+};
+
+// Writes a DT1 sysex message that sets len bytes of memory from addr (in MT32EMU_MEMADDR form) into sysex, which needs
+// room for len + 10 bytes. Returns the length of the message.
+Bit32u makeTestSysex(Bit8u *sysex, Bit32u addr, const Bit8u *data, Bit32u len);
+
+// Plays a sysex that sets one byte (at offset within TimbreParam) of the timbre temp area of the given part
+void playTimbreTempSysex(Synth *synth, unsigned int partNum, unsigned int offset, Bit8u value);
+
+// Simple deterministic random numbers, so that test runs don't depend on the C library
+Bit32u nextTestRandom(Bit32u &state);
+
+// Compares two interleaved stereo streams, printing the first difference (and the number of differing samples)
+// along with the description if they differ
+bool compareStreams(const char *description, const Bit16s *expected, const Bit16s *actual, Bit32u frames);
+
+// Returns the number of non-zero samples in an interleaved stereo stream, to make sure a test actually produced sound
+Bit32u countNonZeroSamples(const Bit16s *stream, Bit32u frames);
+
+// Compares the sysex-addressable memory of two synths, as read by Synth::readMemory(), printing the first difference
+// along with the description if they differ
+bool compareTestMemory(const char *description, Synth *expectedSynth, Synth *actualSynth);
+
+// Renders the same blocks of the workload on two synths and compares their output, which is expected to be the same.
+// Silent output fails as well (said so along with the description), since it would make the comparison meaningless.
+bool compareTestRenders(const char *description, const TestWorkload &workload, Synth *expectedSynth, Synth *actualSynth, unsigned int blockCount, Bit32u blockLen, unsigned int firstBlock = 0);
+
+}
+
+#endif
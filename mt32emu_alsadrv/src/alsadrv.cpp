@@ -871,14 +871,16 @@ void reload_mt32_core(int rv)
 	MT32Emu::SynthProperties synthp;
 	memset(&synthp, 0, sizeof(synthp));
 
-	/* delete core if there is already an instance of it */
+	/* reset the core if there is already an instance of it,
+	 * keeping the loaded ROMs and allocated memory */
 	if (mt32 != NULL)
 	{
-		delete mt32;
+		mt32->reset();
 		printf("Restarting MT-32 core\n");
 		report(DRV_M32RESET);
-	} else 
-		printf("Starting MT-32 core\n");
+		return;
+	}
+	printf("Starting MT-32 core\n");
 	
 	/* create MT32Synth object */
 	mt32 = new MT32Emu::Synth();
@@ -24,6 +24,11 @@
 
 #include <glib.h>
 
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
 #include <mt32emu/mt32emu.h>
 
 #include "config.h"
@@ -35,10 +40,22 @@ static const int DEFAULT_SAMPLE_RATE = 32000;
 // Maximum number of frames to render in each pass while waiting for reverb to become inactive.
 static const unsigned int MAX_REVERB_END_FRAMES = 8192;
 
-static const int HEADEROFFS_RIFFLEN = 4;
-static const int HEADEROFFS_SAMPLERATE = 24;
-static const int HEADEROFFS_BYTERATE = 28;
-static const int HEADEROFFS_DATALEN = 40;
+// The output is collected in blocks of this size, each of which is then written with a single call.
+// Both the size and the alignment of the blocks suit unbuffered (and direct) I/O.
+static const unsigned int OUTPUT_BLOCK_SIZE = 1024 * 1024;
+static const unsigned int OUTPUT_BLOCK_ALIGNMENT = 4096;
+// Number of blocks in the ring between rendering and the writer thread.
+// Rendering only waits for the writer once all of them are waiting to be written.
+static const unsigned int OUTPUT_BLOCK_COUNT = 4;
+
+// The length of the segments rendered at once with --jobs, in seconds. Each worker holds the frames of one segment.
+static const unsigned int SEGMENT_SECONDS = 10;
+
+// Room for the largest header makeHeader() writes
+static const unsigned int MAX_HEADER_SIZE = 128;
+// A data size that isn't known yet, as when writing to a pipe. It's written as all ones, which readers take to mean
+// "up to the end of the stream".
+static const guint64 UNKNOWN_DATA_SIZE = G_MAXUINT64;
 
 static const MT32Emu::DACInputMode DAC_INPUT_MODES[] = {
 	MT32Emu::DACInputMode_NICE,
@@ -47,6 +64,15 @@ static const MT32Emu::DACInputMode DAC_INPUT_MODES[] = {
 	MT32Emu::DACInputMode_GENERATION2
 };
 
+enum OutputFormat {
+	OutputFormat_WAVE,
+	OutputFormat_RF64,
+	OutputFormat_W64,
+	OutputFormat_RAW
+};
+
+static const char *OUTPUT_FORMAT_NAMES[] = {"wav", "rf64", "w64", "raw"};
+
 struct Options {
 	gchar **inputFilenames;
 	gchar *outputFilename;
@@ -56,11 +82,17 @@ struct Options {
 	gchar *romDir;
 	unsigned int bufferFrameCount;
 	gint sampleRate;
+	unsigned int renderThreads;
+	unsigned int jobCount;
+	gboolean reverb;
 
 	MT32Emu::DACInputMode dacInputMode;
 	int rawChannelMap[8];
 	int rawChannelCount;
+	OutputFormat outputFormat;
+	gboolean floatSamples;
 
+	unsigned int startFrames;
 	unsigned int renderMinFrames;
 	unsigned int renderMaxFrames;
 	gint recordMaxStartSilentFrames;
@@ -69,20 +101,99 @@ struct Options {
 	gboolean waitForLA32;
 	gboolean waitForReverb;
 	gboolean sendAllNotesOff;
+
+	gchar *batchFilename;
+	gchar *batchLogFilename;
+	unsigned int batchWorkerCount;
+};
+
+// Rendering fills the blocks of a ring in turn, while a thread of the writer's own writes them out in the same order.
+// Each block is only ever touched by one side at a time, as handed over by the semaphores, so the ring needs no locking.
+struct OutputWriter {
+	FILE *file;
+	unsigned char *allocatedBuffer;
+	// OUTPUT_BLOCK_SIZE bytes each within allocatedBuffer, aligned to OUTPUT_BLOCK_ALIGNMENT
+	unsigned char *blocks[OUTPUT_BLOCK_COUNT];
+	// The number of bytes to write from each block. 0 tells the writer thread to finish.
+	unsigned int blockLengths[OUTPUT_BLOCK_COUNT];
+	// Set by the writer thread for a block it didn't manage to write
+	bool blockWriteFailed[OUTPUT_BLOCK_COUNT];
+	MT32Emu::Semaphore freeBlockCount;
+	MT32Emu::Semaphore filledBlockCount;
+	MT32Emu::Thread thread;
+	// False if the writer thread couldn't be started (or has finished), in which case blocks are written straight away
+	bool threaded;
+
+	// Only touched by rendering
+	unsigned int fillBlockIx;
+	unsigned char *block;
+	unsigned int blockUsed;
+	// Set once rendering learns that a write has failed
+	bool failed;
+	// Time spent waiting for the writer thread to free a block
+	GTimer *waitTimer;
+
+	// Only touched by the writer thread while it runs
+	unsigned int writeBlockIx;
+	// Set once a write fails, after which nothing more is written
+	bool writeFailed;
+	// Time spent writing
+	GTimer *writeTimer;
+};
+
+// Renders segments of an SMF file on a synth of its own (a clone of the one converting), starting each from the state saved
+// by the fast pass at the start of the segment. See renderSegmented().
+struct SegmentWorker {
+	MT32Emu::Synth *synth;
+	MT32Emu::Thread thread;
+	// Posted to hand over a segment (or to finish, once quit is set), and by the worker when it's done with it
+	MT32Emu::Semaphore startSignal;
+	MT32Emu::Semaphore doneSignal;
+	bool quit;
+
+	// The segment handed over
+	MT32Emu::Bit8u *synthState;
+	MT32Emu::Bit32u synthStateSize;
+	MT32Emu::Bit32u synthStateBufferSize;
+	unsigned long startFrame;
+	unsigned int frameCount;
+	const MT32Emu::MidiEvent *events;
+	unsigned int eventCount;
+	// Set by the worker if the state couldn't be restored, in which case nothing was rendered
+	bool failed;
+
+	// The frames rendered, in the same layout as the buffers of State but with room for a whole segment
+	MT32Emu::Bit16s *stereoSampleBuffer;
+	float *floatStereoSampleBuffer;
+	MT32Emu::Bit16s *rawSampleBuffer[6];
 };
 
 struct State {
 	MT32Emu::Bit16s *stereoSampleBuffer;
+	float *floatStereoSampleBuffer;
 	MT32Emu::Bit16s *rawSampleBuffer[6];
 	MT32Emu::Synth *synth;
-	FILE *outputFile;
+	OutputWriter *output;
+	// Time spent in the synth rendering
+	GTimer *synthTimer;
+	// Events still to be played while rendering, stamped with frames counted like renderedFrames
+	const MT32Emu::MidiEvent *events;
+	unsigned int eventCount;
 	bool lastInputFile;
 	bool firstNoiseEncountered;
 	unsigned long unwrittenSilentFrames;
 	unsigned long renderedFrames;
 	unsigned long writtenFrames;
+	// Workers rendering segments at once with --jobs, or NULL to render serially
+	SegmentWorker *segmentWorkers;
+	unsigned int segmentWorkerCount;
+	unsigned int segmentFrames;
 };
 
+static long secondsToSamples(double seconds, int sampleRate) {
+	return seconds * sampleRate;
+}
+
 static void freeOptions(Options *options) {
 	g_strfreev(options->inputFilenames);
 	options->inputFilenames = NULL;
@@ -90,14 +201,24 @@ static void freeOptions(Options *options) {
 	options->outputFilename = NULL;
 	g_free(options->romDir);
 	options->romDir = NULL;
+	g_free(options->batchFilename);
+	options->batchFilename = NULL;
+	g_free(options->batchLogFilename);
+	options->batchLogFilename = NULL;
 }
 
-static bool parseOptions(int argc, char *argv[], Options *options) {
+// batchJob is true when parsing the arguments of a job in a batch manifest, which doesn't print help on failure.
+static bool parseOptions(int argc, char *argv[], Options *options, bool batchJob) {
 	gint dacInputModeIx = 0;
 	gint bufferFrameCount = DEFAULT_BUFFER_SIZE;
+	gint renderThreadCount = 1;
+	gint jobCount = 1;
+	gint batchWorkerCount = MT32Emu::Thread::getProcessorCount();
 	gint renderMinFrames = 0;
 	gint renderMaxFrames = -1;
+	gdouble startSeconds = 0;
 	gchar **rawStreams = NULL;
+	gchar *outputFormatName = NULL;
 	gchar *deprecatedSysexFile = NULL;
 	options->inputFilenames = NULL;
 	options->outputFilename = NULL;
@@ -106,9 +227,11 @@ static bool parseOptions(int argc, char *argv[], Options *options) {
 
 	options->romDir = NULL;
 	options->sampleRate = DEFAULT_SAMPLE_RATE;
+	options->reverb = true;
 
 	options->dacInputMode = DAC_INPUT_MODES[0];
 	options->rawChannelCount = 0;
+	options->floatSamples = false;
 
 	options->recordMaxStartSilentFrames = 0;
 	options->recordMaxEndSilentFrames = 0;
@@ -116,9 +239,12 @@ static bool parseOptions(int argc, char *argv[], Options *options) {
 	options->waitForLA32 = true;
 	options->waitForReverb = true;
 	options->sendAllNotesOff = true;
+
+	options->batchFilename = NULL;
+	options->batchLogFilename = NULL;
 	// FIXME: Perhaps there's a nicer way to represent long argument descriptions...
 	GOptionEntry entries[] = {
-		{"output", 'o', 0, G_OPTION_ARG_FILENAME, &options->outputFilename, "Output file (default: last source file name with \".wav\" appended)", "<filename>"},
+		{"output", 'o', 0, G_OPTION_ARG_FILENAME, &options->outputFilename, "Output file, or - for standard output (default: last source file name with \".wav\", \".w64\" or \".raw\" appended)", "<filename>"},
 		{"force", 'f', 0, G_OPTION_ARG_NONE, &options->force, "Overwrite the output file if it already exists", NULL},
 		{"quiet", 'q', 0, G_OPTION_ARG_NONE, &options->quiet, "Be quiet", NULL},
 
@@ -127,6 +253,15 @@ static bool parseOptions(int argc, char *argv[], Options *options) {
 		// This can have a big impact on performance (Generally more at a time=better).
 		{"buffer-size", 'b', 0, G_OPTION_ARG_INT, &bufferFrameCount, "Buffer size in frames (minimum: 1)", "<frame_count>"},  // FIXME: Show default
 		{"sample-rate", 'r', 0, G_OPTION_ARG_INT, &options->sampleRate, "Sample rate in Hz (minimum: 1, default: 32000)", "<sample_rate>"},
+		// Passed on as SynthProperties::renderThreads. The song is still rendered from start to end in one go, but the
+		// partials of each run are split between this many threads. The output doesn't depend on it.
+		{"render-threads", 0, 0, G_OPTION_ARG_INT, &renderThreadCount, "Number of threads rendering the partials of the synth (minimum: 1, default: 1)\n"
+		 "                The output is the same whatever the number. To convert several files at once, see --batch", "<thread_count>"},
+		// See renderSegmented()
+		{"jobs", 'j', 0, G_OPTION_ARG_INT, &jobCount, "Number of segments of each SMF file to render at once (minimum: 1, default: 1)\n"
+		 "                Segments are rendered on synths of their own, each starting from the state saved by a fast pass that plays the MIDI without rendering any audio. The output is the same as when rendering serially.\n"
+		 "                Only used with --no-reverb: the reverb can't be picked up part way through, so otherwise each file is rendered serially.", "<job_count>"},
+		{"no-reverb", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &options->reverb, "Disable the reverb. Reverb settings sent by MIDI are still kept, but not heard.", NULL},
 
 		{"dac-input-mode", 'd', 0, G_OPTION_ARG_INT, &dacInputModeIx, "LA-32 to DAC input mode (default: 0)\n"
 		 "                Ignored if -w is used (in which case 1/PURE is always used)\n"
@@ -134,7 +269,7 @@ static bool parseOptions(int argc, char *argv[], Options *options) {
 		 "                 1: PURE\n"
 		 "                 2: GENERATION1\n"
 		 "                 3: GENERATION2", "<dac_input_mode>"},
-		{"raw-stream", 'w', 0, G_OPTION_ARG_STRING_ARRAY, &rawStreams, "Write a raw file with signed 16-bit big-endian samples instead of a WAVE file, and include the specified channel.\n"
+		{"raw-stream", 'w', 0, G_OPTION_ARG_STRING_ARRAY, &rawStreams, "Write the specified stream instead of the stereo mix, by default to a raw file (see --format).\n"
 		 "                This option can be specified multiple times (up to eight), in which case streams will be written to the file multiplexed sample-by-sample in the order given.\n"
 		 "                Available stream IDs:\n"
 		 "                -1: Dummy stream filled with 0\n"
@@ -144,7 +279,16 @@ static bool parseOptions(int argc, char *argv[], Options *options) {
 		 "                 3: [LA32] Right reverb dry\n"
 		 "                 4: [Reverb] Left reverb wet\n"
 		 "                 5: [Reverb] Right reverb wet", "<stream_id>"},
+		{"format", 'F', 0, G_OPTION_ARG_STRING, &outputFormatName, "Output file format (default: wav, or raw if -w is used)\n"
+		 "                wav: WAVE, up to 4 GB\n"
+		 "                rf64: RF64, the WAVE format extended to 64-bit sizes\n"
+		 "                w64: Sony Wave64\n"
+		 "                raw: Samples only, big-endian\n"
+		 "                When writing to a pipe, the sizes in the header are left unknown.", "<format>"},
+		{"float", 0, 0, G_OPTION_ARG_NONE, &options->floatSamples, "Write 32-bit floating point samples instead of signed 16-bit ones. The mix isn't clipped.", NULL},
 
+		{"start-at", 0, 0, G_OPTION_ARG_DOUBLE, &startSeconds, "Skip this many seconds at the start (default: 0)\n"
+		 "                The MIDI is played up to there without rendering any audio, which is much faster. The reverb starts afresh from that point.", "<seconds>"},
 		{"render-min", 0, 0, G_OPTION_ARG_INT, &renderMinFrames, "Render at least this many frames (default: 0) (NYI)", "<frame_count>"},
 		{"render-max", 'e', 0, G_OPTION_ARG_INT, &renderMaxFrames, "Render at most this many frames (default: -1)", "<frame_count>|-1 (unlimited)"},
 		{"record-max-start-silence", 0, 0, G_OPTION_ARG_INT, &options->recordMaxStartSilentFrames, "Record at most this many silent frames at the start of each SMF file (default: 0)", "<frame_count>|-1 (unlimited)"},
@@ -155,6 +299,12 @@ static bool parseOptions(int argc, char *argv[], Options *options) {
 		{"no-send-all-notes-off", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &options->sendAllNotesOff, "Don't release the hold pedal and perform all-notes-off on all parts in the emulator at the end of each SMF file.\n"
 		 "                WARNING: Sound can theoretically continue forever if not limited by other options.", NULL},
 
+		{"batch", 0, 0, G_OPTION_ARG_FILENAME, &options->batchFilename, "Convert the jobs listed in this manifest file, one per line, instead of the input files.\n"
+		 "                Each line holds the arguments of a job as they would be given on the command line (its input files, -o with its output file and any other options), which are added to those given on the command line.\n"
+		 "                Input files given on the command line are played before those of each job. Empty lines and lines starting with # are ignored.", "<manifest_file>"},
+		{"batch-workers", 0, 0, G_OPTION_ARG_INT, &batchWorkerCount, "Number of jobs to convert at once in batch mode (minimum: 1, default: number of processors)", "<worker_count>"},
+		{"batch-log", 0, 0, G_OPTION_ARG_FILENAME, &options->batchLogFilename, "Log the progress and timing of each job in batch mode to this file, as one JSON object per line (default: standard output)", "<filename>"},
+
 		{"s", 's', 0, G_OPTION_ARG_FILENAME, &deprecatedSysexFile, "[DEPRECATED] Play this SMF or sysex file before any other. DEPRECATED: Instead just specify the file first in the file list.", "<midi_file>"},
 		{G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &options->inputFilenames, NULL, "<midi_file> [midi_file...]"},
 		{NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}
@@ -176,6 +326,30 @@ static bool parseOptions(int argc, char *argv[], Options *options) {
 	} else {
 		options->bufferFrameCount = bufferFrameCount;
 	}
+	if (renderThreadCount < 1) {
+		fprintf(stderr, "render-threads must be greater than 0\n");
+		parseSuccess = false;
+	} else {
+		options->renderThreads = renderThreadCount;
+	}
+	if (jobCount < 1) {
+		fprintf(stderr, "jobs must be greater than 0\n");
+		parseSuccess = false;
+	} else {
+		options->jobCount = jobCount;
+	}
+	if (batchWorkerCount < 1) {
+		fprintf(stderr, "batch-workers must be greater than 0\n");
+		parseSuccess = false;
+	} else {
+		options->batchWorkerCount = batchWorkerCount;
+	}
+	if (startSeconds < 0) {
+		fprintf(stderr, "start-at must not be negative\n");
+		parseSuccess = false;
+	} else {
+		options->startFrames = MIN(secondsToSamples(startSeconds, options->sampleRate), INT_MAX);
+	}
 	options->renderMaxFrames = renderMaxFrames < 0 ? INT_MAX : renderMaxFrames;
 	options->renderMinFrames = renderMinFrames < 0 ? 0 : renderMinFrames;
 	if (options->renderMinFrames > options->renderMaxFrames) {
@@ -219,87 +393,329 @@ static bool parseOptions(int argc, char *argv[], Options *options) {
 		g_free(options->inputFilenames);
 		options->inputFilenames = newInputFilenames;
 	}
-	if (options->inputFilenames == NULL || g_strv_length(options->inputFilenames) == 0) {
+	if ((options->inputFilenames == NULL || g_strv_length(options->inputFilenames) == 0) && (batchJob || options->batchFilename == NULL)) {
 		fprintf(stderr, "No input files specified\n");
 		parseSuccess = false;
 	}
 	g_strfreev(rawStreams);
+	options->outputFormat = options->rawChannelCount > 0 ? OutputFormat_RAW : OutputFormat_WAVE;
+	if (outputFormatName != NULL) {
+		unsigned int formatIx = 0;
+		while (formatIx < sizeof(OUTPUT_FORMAT_NAMES) / sizeof(OUTPUT_FORMAT_NAMES[0]) && strcmp(outputFormatName, OUTPUT_FORMAT_NAMES[formatIx]) != 0) {
+			formatIx++;
+		}
+		if (formatIx < sizeof(OUTPUT_FORMAT_NAMES) / sizeof(OUTPUT_FORMAT_NAMES[0])) {
+			options->outputFormat = (OutputFormat)formatIx;
+		} else {
+			fprintf(stderr, "Unknown format %s - must be one of wav, rf64, w64 or raw\n", outputFormatName);
+			parseSuccess = false;
+		}
+		g_free(outputFormatName);
+	}
 	if (options->rawChannelCount > 0) {
 		options->dacInputMode = MT32Emu::DACInputMode_PURE;
 	} else {
 		options->dacInputMode = DAC_INPUT_MODES[dacInputModeIx];
 	}
 	if (!parseSuccess) {
-		gchar *help = g_option_context_get_help(context, TRUE, NULL);
-		fputs(help, stderr);
+		if (!batchJob) {
+			gchar *help = g_option_context_get_help(context, TRUE, NULL);
+			fputs(help, stderr);
+		}
 		freeOptions(options);
 	}
 	g_option_context_free(context);
 	return parseSuccess;
 }
 
-static long secondsToSamples(double seconds, int sampleRate) {
-	return seconds * sampleRate;
+static GTimer *newStoppedTimer() {
+	GTimer *timer = g_timer_new();
+	g_timer_stop(timer);
+	return timer;
 }
 
-static bool writeWAVEHeader(FILE *outputFile, int sampleRate) {
-	int byteRate = sampleRate * 4;
-	// All values are little-endian
-	unsigned char waveHeader[] = {
-		'R','I','F','F',
-		0,0,0,0, // Length to be filled in later
-		'W','A','V','E',
-
-		// "fmt " chunk
-		'f','m','t',' ',
-		0x10, 0x00, 0x00, 0x00, // 0x00000010 - 16 byte chunk
-		0x01, 0x00, // 0x0001 - PCM/Uncompressed
-		0x02, 0x00, // 0x0002 - 2 channels
-		0x00, 0x7D, 0x00, 0x00, // 0x00007D00 - 32kHz, overwritten by real sample rate below
-		0x00, 0xF4, 0x01, 0x00, // 0x0001F400 - 128000 bytes/sec, overwritten with real value below
-		0x04, 0x00, // 0x0004 - 4 byte alignment
-		0x10, 0x00, // 0x0010 - 16 bits/sample
-
-		// "data" chunk
-		'd','a','t','a',
-		0x00, 0x00, 0x00, 0x00 // Chunk length, to be filled in later
-	};
-	waveHeader[HEADEROFFS_SAMPLERATE] = sampleRate & 0xFF;
-	waveHeader[HEADEROFFS_SAMPLERATE + 1] = (sampleRate >> 8) & 0xFF;
-	waveHeader[HEADEROFFS_SAMPLERATE + 2] = (sampleRate >> 16) & 0xFF;
-	waveHeader[HEADEROFFS_SAMPLERATE + 3] = (sampleRate >> 24) & 0xFF;
-	waveHeader[HEADEROFFS_BYTERATE] = byteRate & 0xFF;
-	waveHeader[HEADEROFFS_BYTERATE + 1] = (byteRate >> 8) & 0xFF;
-	waveHeader[HEADEROFFS_BYTERATE + 2] = (byteRate >> 16) & 0xFF;
-	waveHeader[HEADEROFFS_BYTERATE + 3] = (byteRate >> 24) & 0xFF;
-	return fwrite(waveHeader, 1, sizeof(waveHeader), outputFile) == sizeof(waveHeader);
-}
-
-static bool fillWAVESizes(FILE *outputFile, int numFrames) {
-	// FIXME: Check return codes, etc.
-	int dataSize = numFrames * 4;
-	int riffSize = dataSize + 28;
-	if (fseek(outputFile, HEADEROFFS_RIFFLEN, SEEK_SET))
-		return false;
-	if (fputc(riffSize & 0xFF, outputFile) == EOF)
-		return false;
-	if (fputc((riffSize >> 8) & 0xFF, outputFile) == EOF)
-		return false;
-	if (fputc((riffSize >> 16) & 0xFF, outputFile) == EOF)
-		return false;
-	if (fputc((riffSize >> 24) & 0xFF, outputFile) == EOF)
-		return false;
-	if (fseek(outputFile, HEADEROFFS_DATALEN, SEEK_SET))
-		return false;
-	if (fputc(dataSize & 0xFF, outputFile) == EOF)
-		return false;
-	if (fputc((dataSize >> 8) & 0xFF, outputFile) == EOF)
-		return false;
-	if (fputc((dataSize >> 16) & 0xFF, outputFile) == EOF)
-		return false;
-	if (fputc((dataSize >> 24) & 0xFF, outputFile) == EOF)
+static void writeBlock(OutputWriter &writer, unsigned int blockIx) {
+	if (!writer.writeFailed) {
+		unsigned int length = writer.blockLengths[blockIx];
+		g_timer_continue(writer.writeTimer);
+		if (fwrite(writer.blocks[blockIx], 1, length, writer.file) != length) {
+			writer.writeFailed = true;
+		}
+		g_timer_stop(writer.writeTimer);
+	}
+	writer.blockWriteFailed[blockIx] = writer.writeFailed;
+}
+
+static void runOutputWriter(void *context) {
+	OutputWriter &writer = *(OutputWriter *)context;
+	for (;;) {
+		writer.filledBlockCount.wait();
+		if (writer.blockLengths[writer.writeBlockIx] == 0) {
+			break;
+		}
+		writeBlock(writer, writer.writeBlockIx);
+		writer.writeBlockIx = (writer.writeBlockIx + 1) % OUTPUT_BLOCK_COUNT;
+		writer.freeBlockCount.post();
+	}
+}
+
+static void openOutputWriter(OutputWriter &writer, FILE *file) {
+	writer.file = file;
+	// Whole blocks are written at a time, so the stdio buffer would only add a copy
+	setvbuf(file, NULL, _IONBF, 0);
+	writer.allocatedBuffer = new unsigned char[OUTPUT_BLOCK_COUNT * OUTPUT_BLOCK_SIZE + OUTPUT_BLOCK_ALIGNMENT - 1];
+	unsigned char *alignedBuffer = (unsigned char *)(((guintptr)writer.allocatedBuffer + OUTPUT_BLOCK_ALIGNMENT - 1) & ~(guintptr)(OUTPUT_BLOCK_ALIGNMENT - 1));
+	for (unsigned int blockIx = 0; blockIx < OUTPUT_BLOCK_COUNT; blockIx++) {
+		writer.blocks[blockIx] = alignedBuffer + blockIx * OUTPUT_BLOCK_SIZE;
+		writer.blockLengths[blockIx] = 0;
+		writer.blockWriteFailed[blockIx] = false;
+		// Rendering gets to fill every block before it has to wait for one to be written
+		writer.freeBlockCount.post();
+	}
+	writer.fillBlockIx = 0;
+	writer.block = writer.blocks[0];
+	writer.blockUsed = 0;
+	writer.failed = false;
+	writer.waitTimer = newStoppedTimer();
+	writer.writeBlockIx = 0;
+	writer.writeFailed = false;
+	writer.writeTimer = newStoppedTimer();
+	// The first block is taken straight away
+	writer.freeBlockCount.wait();
+	writer.threaded = writer.thread.start(runOutputWriter, &writer);
+}
+
+// Hands the block filled so far over to be written, and takes the next one to fill.
+static void submitOutput(OutputWriter &writer) {
+	if (writer.blockUsed == 0) {
+		return;
+	}
+	writer.blockLengths[writer.fillBlockIx] = writer.blockUsed;
+	if (writer.threaded) {
+		writer.filledBlockCount.post();
+	} else {
+		writeBlock(writer, writer.fillBlockIx);
+		writer.failed = writer.writeFailed;
+		writer.freeBlockCount.post();
+	}
+	writer.fillBlockIx = (writer.fillBlockIx + 1) % OUTPUT_BLOCK_COUNT;
+	g_timer_continue(writer.waitTimer);
+	writer.freeBlockCount.wait();
+	g_timer_stop(writer.waitTimer);
+	// The writer thread is done with this block, including noting whether it was written
+	if (writer.blockWriteFailed[writer.fillBlockIx]) {
+		writer.failed = true;
+	}
+	writer.block = writer.blocks[writer.fillBlockIx];
+	writer.blockUsed = 0;
+}
+
+// Writes out everything filled so far and stops the writer thread, after which the file may be used directly.
+// Returns false if any write has failed.
+static bool finishOutput(OutputWriter &writer) {
+	submitOutput(writer);
+	if (writer.threaded) {
+		writer.blockLengths[writer.fillBlockIx] = 0;
+		writer.filledBlockCount.post();
+		writer.thread.join();
+		writer.threaded = false;
+	}
+	if (writer.writeFailed) {
+		writer.failed = true;
+	}
+	return !writer.failed;
+}
+
+static void closeOutputWriter(OutputWriter &writer) {
+	delete[] writer.allocatedBuffer;
+	writer.allocatedBuffer = NULL;
+	writer.block = NULL;
+	g_timer_destroy(writer.waitTimer);
+	g_timer_destroy(writer.writeTimer);
+}
+
+// Returns room for frameCount frames of frameSize bytes each at the end of the block, which the caller must fill in.
+// If the block has no room left, it's written out first. If there's room for fewer frames than requested,
+// frameCount is reduced accordingly. frameSize must not exceed OUTPUT_BLOCK_SIZE.
+static unsigned char *reserveOutput(OutputWriter &writer, unsigned int frameSize, unsigned int &frameCount) {
+	unsigned int roomFrameCount = (OUTPUT_BLOCK_SIZE - writer.blockUsed) / frameSize;
+	if (roomFrameCount == 0) {
+		submitOutput(writer);
+		roomFrameCount = OUTPUT_BLOCK_SIZE / frameSize;
+	}
+	if (frameCount > roomFrameCount) {
+		frameCount = roomFrameCount;
+	}
+	unsigned char *frames = writer.block + writer.blockUsed;
+	writer.blockUsed += frameCount * frameSize;
+	return frames;
+}
+
+static void writeOutput(OutputWriter &writer, const unsigned char *data, unsigned int length) {
+	while (length > 0) {
+		unsigned int writtenLength = length;
+		memcpy(reserveOutput(writer, 1, writtenLength), data, writtenLength);
+		data += writtenLength;
+		length -= writtenLength;
+	}
+}
+
+static void writeOutputZeros(OutputWriter &writer, unsigned long length) {
+	while (length > 0) {
+		unsigned int writtenLength = MIN(length, OUTPUT_BLOCK_SIZE);
+		memset(reserveOutput(writer, 1, writtenLength), 0, writtenLength);
+		length -= writtenLength;
+	}
+}
+
+static unsigned int getChannelCount(const Options &options) {
+	return options.rawChannelCount > 0 ? options.rawChannelCount : 2;
+}
+
+static unsigned int getSampleSize(const Options &options) {
+	return options.floatSamples ? sizeof(float) : sizeof(MT32Emu::Bit16s);
+}
+
+static unsigned int getFrameSize(const Options &options) {
+	return getChannelCount(options) * getSampleSize(options);
+}
+
+static bool writesToStandardOutput(const Options &options) {
+	return options.outputFilename != NULL && strcmp(options.outputFilename, "-") == 0;
+}
+
+// Progress messages go to standard error when the output itself goes to standard output
+static FILE *getMessageFile(const Options &options) {
+	return writesToStandardOutput(options) ? stderr : stdout;
+}
+
+static void putBytes(unsigned char *&out, const char *bytes, unsigned int length) {
+	memcpy(out, bytes, length);
+	out += length;
+}
+
+static void putLE16(unsigned char *&out, unsigned int value) {
+	*out++ = value & 0xFF;
+	*out++ = (value >> 8) & 0xFF;
+}
+
+static void putLE32(unsigned char *&out, guint32 value) {
+	putLE16(out, value & 0xFFFF);
+	putLE16(out, (value >> 16) & 0xFFFF);
+}
+
+static void putLE64(unsigned char *&out, guint64 value) {
+	putLE32(out, (guint32)(value & G_MAXUINT32));
+	putLE32(out, (guint32)(value >> 32));
+}
+
+// Sizes beyond 32 bits (and unknown sizes) are written as all ones
+static void putLE32Size(unsigned char *&out, guint64 value) {
+	putLE32(out, value > G_MAXUINT32 ? G_MAXUINT32 : (guint32)value);
+}
+
+// Sony Wave64 identifies chunks by GUIDs, each starting with the corresponding RIFF chunk ID
+static const char W64_GUID_RIFF[] = "riff\x2E\x91\xCF\x11\xA5\xD6\x28\xDB\x04\xC1\x00\x00";
+static const char W64_GUID_WAVE[] = "wave\xF3\xAC\xD3\x11\x8C\xD1\x00\xC0\x4F\x8E\xDB\x8A";
+static const char W64_GUID_FMT[] = "fmt \xF3\xAC\xD3\x11\x8C\xD1\x00\xC0\x4F\x8E\xDB\x8A";
+static const char W64_GUID_DATA[] = "data\xF3\xAC\xD3\x11\x8C\xD1\x00\xC0\x4F\x8E\xDB\x8A";
+static const unsigned int W64_GUID_SIZE = 16;
+static const unsigned int W64_CHUNK_HEADER_SIZE = W64_GUID_SIZE + 8;
+
+// Fills in the contents of the "fmt " chunk (the same for all formats), returning its length.
+static unsigned int makeFormatChunk(unsigned char *fmt, const Options &options) {
+	unsigned int channelCount = getChannelCount(options);
+	unsigned int bitsPerSample = getSampleSize(options) * 8;
+	// More than two channels need WAVE_FORMAT_EXTENSIBLE, which says what kind of samples they are with a GUID instead
+	bool extensible = channelCount > 2;
+	unsigned int formatTag = options.floatSamples ? 0x0003 : 0x0001; // IEEE float, or PCM
+	unsigned char *out = fmt;
+	putLE16(out, extensible ? 0xFFFE : formatTag);
+	putLE16(out, channelCount);
+	putLE32(out, options.sampleRate);
+	putLE32(out, options.sampleRate * getFrameSize(options));
+	putLE16(out, getFrameSize(options));
+	putLE16(out, bitsPerSample);
+	if (extensible) {
+		putLE16(out, 22); // Size of the extension
+		putLE16(out, bitsPerSample); // Valid bits per sample
+		putLE32(out, 0); // Channel mask: the channels aren't meant for any speakers in particular
+		putLE16(out, formatTag);
+		putBytes(out, "\x00\x00\x00\x00\x10\x00\x80\x00\x00\xAA\x00\x38\x9B\x71", 14);
+	} else if (options.floatSamples) {
+		putLE16(out, 0); // Formats other than PCM have an extension, empty in this case
+	}
+	return out - fmt;
+}
+
+// Fills in the header of the output file for dataSize bytes of samples (or UNKNOWN_DATA_SIZE), returning its length.
+// The length doesn't depend on dataSize, so that the header can be rewritten in place once the size is known.
+static unsigned int makeHeader(unsigned char *header, const Options &options, guint64 dataSize) {
+	unsigned char fmt[40];
+	unsigned int fmtLength = makeFormatChunk(fmt, options);
+	guint64 frameCount = dataSize == UNKNOWN_DATA_SIZE ? UNKNOWN_DATA_SIZE : dataSize / getFrameSize(options);
+	unsigned char *out = header;
+	switch (options.outputFormat) {
+	case OutputFormat_WAVE:
+	case OutputFormat_RF64: {
+		bool rf64 = options.outputFormat == OutputFormat_RF64;
+		// Formats other than PCM are supposed to have a "fact" chunk with the number of frames
+		bool fact = options.floatSamples;
+		guint64 headerSize = 12 + (rf64 ? 36 : 0) + 8 + fmtLength + (fact ? 12 : 0) + 8;
+		guint64 riffSize = dataSize == UNKNOWN_DATA_SIZE ? UNKNOWN_DATA_SIZE : headerSize - 8 + dataSize;
+		putBytes(out, rf64 ? "RF64" : "RIFF", 4);
+		// In RF64, sizes in the 32-bit fields are all ones, while the real ones are in the "ds64" chunk
+		putLE32Size(out, rf64 ? UNKNOWN_DATA_SIZE : riffSize);
+		putBytes(out, "WAVE", 4);
+		if (rf64) {
+			putBytes(out, "ds64", 4);
+			putLE32(out, 28);
+			putLE64(out, riffSize);
+			putLE64(out, dataSize);
+			putLE64(out, frameCount);
+			putLE32(out, 0); // No other chunks need 64-bit sizes
+		}
+		putBytes(out, "fmt ", 4);
+		putLE32(out, fmtLength);
+		putBytes(out, (const char *)fmt, fmtLength);
+		if (fact) {
+			putBytes(out, "fact", 4);
+			putLE32(out, 4);
+			putLE32Size(out, rf64 ? UNKNOWN_DATA_SIZE : frameCount);
+		}
+		putBytes(out, "data", 4);
+		putLE32Size(out, rf64 ? UNKNOWN_DATA_SIZE : dataSize);
+		break;
+	}
+	case OutputFormat_W64: {
+		// Chunks are aligned to 8 bytes, and their sizes include their own headers
+		unsigned int fmtPadding = (8 - fmtLength % 8) % 8;
+		guint64 headerSize = W64_CHUNK_HEADER_SIZE + W64_GUID_SIZE + W64_CHUNK_HEADER_SIZE + fmtLength + fmtPadding + W64_CHUNK_HEADER_SIZE;
+		putBytes(out, W64_GUID_RIFF, W64_GUID_SIZE);
+		putLE64(out, dataSize == UNKNOWN_DATA_SIZE ? UNKNOWN_DATA_SIZE : headerSize + dataSize);
+		putBytes(out, W64_GUID_WAVE, W64_GUID_SIZE);
+		putBytes(out, W64_GUID_FMT, W64_GUID_SIZE);
+		putLE64(out, W64_CHUNK_HEADER_SIZE + fmtLength);
+		putBytes(out, (const char *)fmt, fmtLength);
+		memset(out, 0, fmtPadding);
+		out += fmtPadding;
+		putBytes(out, W64_GUID_DATA, W64_GUID_SIZE);
+		putLE64(out, dataSize == UNKNOWN_DATA_SIZE ? UNKNOWN_DATA_SIZE : W64_CHUNK_HEADER_SIZE + dataSize);
+		break;
+	}
+	case OutputFormat_RAW:
+		break;
+	}
+	return out - header;
+}
+
+// Rewrites the header with the final data size. Must only be called once the output has been finished.
+static bool fillHeaderSizes(FILE *outputFile, const Options &options, guint64 dataSize) {
+	unsigned char header[MAX_HEADER_SIZE];
+	unsigned int headerLength = makeHeader(header, options, dataSize);
+	if (fseek(outputFile, 0, SEEK_SET))
 		return false;
-	return true;
+	return fwrite(header, 1, headerLength, outputFile) == headerLength;
 }
 
 static bool loadFile(MT32Emu::Bit8u *&fileBuffer, gsize &fileBufferLength, const gchar *filename, const gchar *displayFilename) {
@@ -313,27 +729,6 @@ static bool loadFile(MT32Emu::Bit8u *&fileBuffer, gsize &fileBufferLength, const
 	return true;
 }
 
-static bool playSysexFileBuffer(MT32Emu::Synth *synth, const gchar *displayFilename, MT32Emu::Bit8u *fileBuffer, gsize fileBufferLength) {
-	long start = -1;
-	for (gsize i = 0; i < fileBufferLength; i++) {
-		if (fileBuffer[i] == 0xF0) {
-			if (start != -1) {
-				fprintf(stderr, "Started a new sysex message before the last finished - sysex file '%s' may be in an unsupported format.\n", displayFilename);
-			}
-			start = i;
-		}
-		else if (fileBuffer[i] == 0xF7) {
-			if (start == -1) {
-				fprintf(stderr, "Ended a sysex message without a start byte - sysex file '%s' may be in an unsupported format.\n", displayFilename);
-			} else {
-				synth->playSysex((MT32Emu::Bit8u*)(fileBuffer + start), i - start + 1);
-			}
-			start = -1;
-		}
-	}
-	return true;
-}
-
 enum Occasion {
 	NOISE_DETECTED,
 	MIDI_ENDED,
@@ -341,7 +736,6 @@ enum Occasion {
 };
 
 static void flushSilence(Occasion occasion, const Options &options, State &state) {
-	unsigned int channelCount = options.rawChannelCount > 0 ? options.rawChannelCount : 2;
 	int writtenFrames = state.unwrittenSilentFrames;
 	switch(occasion) {
 	case NOISE_DETECTED:
@@ -360,73 +754,159 @@ static void flushSilence(Occasion occasion, const Options &options, State &state
 		state.unwrittenSilentFrames -= writtenFrames;
 		break;
 	}
-	for (unsigned long i = 0; i < writtenFrames * sizeof(MT32Emu::Bit16s) * channelCount; i++) {
-		fputc(0, state.outputFile);
-	}
+	writeOutputZeros(*state.output, (unsigned long)writtenFrames * getFrameSize(options));
 	state.writtenFrames += writtenFrames;
 }
 
-static void renderStereo(unsigned int frameCount, const Options &options, State &state) {
-	state.renderedFrames += frameCount;
-	while (frameCount > 0) {
-		unsigned int renderedFramesThisPass = MIN(frameCount, options.bufferFrameCount);
-		state.synth->render(state.stereoSampleBuffer, renderedFramesThisPass);
-		for (unsigned int i = 0; i < renderedFramesThisPass; i++) {
-			unsigned int leftIx = i * 2;
-			unsigned int rightIx = leftIx + 1;
-			bool silent = state.stereoSampleBuffer[leftIx] == 0 && state.stereoSampleBuffer[rightIx] == 0;
-			if (silent) {
-				state.unwrittenSilentFrames++;
-				continue;
-			}
-			flushSilence(NOISE_DETECTED, options, state);
-			fputc(state.stereoSampleBuffer[leftIx] & 0xFF, state.outputFile);
-			fputc((state.stereoSampleBuffer[leftIx] >> 8) & 0xFF, state.outputFile);
-			fputc(state.stereoSampleBuffer[rightIx] & 0xFF, state.outputFile);
-			fputc((state.stereoSampleBuffer[rightIx] >> 8) & 0xFF, state.outputFile);
-			state.writtenFrames++;
+static bool isSilentFrame(unsigned int frameIx, const Options &options, const State &state) {
+	if (options.rawChannelCount == 0) {
+		if (options.floatSamples) {
+			return state.floatStereoSampleBuffer[frameIx * 2] == 0.0f && state.floatStereoSampleBuffer[frameIx * 2 + 1] == 0.0f;
 		}
-		frameCount -= renderedFramesThisPass;
+		return state.stereoSampleBuffer[frameIx * 2] == 0 && state.stereoSampleBuffer[frameIx * 2 + 1] == 0;
 	}
+	for (int chanMapIx = 0; chanMapIx < options.rawChannelCount; chanMapIx++) {
+		if (options.rawChannelMap[chanMapIx] >= 0 && state.rawSampleBuffer[options.rawChannelMap[chanMapIx]][frameIx] != 0) {
+			return false;
+		}
+	}
+	return true;
 }
 
-static void renderRaw(unsigned int frameCount, const Options &options, State &state) {
-	state.renderedFrames += frameCount;
+static inline void putSample(unsigned char *&out, MT32Emu::Bit16s sample, bool bigEndian) {
+	if (bigEndian) {
+		*out++ = (sample >> 8) & 0xFF;
+		*out++ = sample & 0xFF;
+	} else {
+		*out++ = sample & 0xFF;
+		*out++ = (sample >> 8) & 0xFF;
+	}
+}
+
+static inline void putSample(unsigned char *&out, float sample, bool bigEndian) {
+	// Floats are assumed to be IEEE single precision, in the same byte order as integers
+	guint32 bits;
+	memcpy(&bits, &sample, sizeof(bits));
+	if (bigEndian) {
+		*out++ = (bits >> 24) & 0xFF;
+		*out++ = (bits >> 16) & 0xFF;
+		*out++ = (bits >> 8) & 0xFF;
+		*out++ = bits & 0xFF;
+	} else {
+		*out++ = bits & 0xFF;
+		*out++ = (bits >> 8) & 0xFF;
+		*out++ = (bits >> 16) & 0xFF;
+		*out++ = (bits >> 24) & 0xFF;
+	}
+}
+
+// Converts the frames to the output format straight into the output block: interleaved samples of the stereo mix or of the
+// mapped streams, big-endian for raw output and little-endian otherwise.
+static void writeFrames(unsigned int frameIx, unsigned int frameCount, const Options &options, State &state) {
+	unsigned int frameSize = getFrameSize(options);
+	bool bigEndian = options.outputFormat == OutputFormat_RAW;
 	while (frameCount > 0) {
-		unsigned int renderedFramesThisPass = MIN(frameCount, options.bufferFrameCount);
-		state.synth->renderStreams(state.rawSampleBuffer[0], state.rawSampleBuffer[1], state.rawSampleBuffer[2], state.rawSampleBuffer[3], state.rawSampleBuffer[4], state.rawSampleBuffer[5], renderedFramesThisPass);
-		for (unsigned int i = 0; i < renderedFramesThisPass; i++) {
-			bool allSilent = false;
-			for (int chanMapIx = 0; chanMapIx < options.rawChannelCount; chanMapIx++) {
-				if (options.rawChannelMap[chanMapIx] >= 0 && state.rawSampleBuffer[options.rawChannelMap[chanMapIx]][i] != 0) {
-					break;
+		unsigned int blockFrameCount = frameCount;
+		unsigned char *out = reserveOutput(*state.output, frameSize, blockFrameCount);
+		if (options.rawChannelCount == 0) {
+			if (options.floatSamples) {
+				const float *in = state.floatStereoSampleBuffer + frameIx * 2;
+				for (unsigned int i = 0; i < blockFrameCount * 2; i++) {
+					putSample(out, in[i], bigEndian);
 				}
-				if (chanMapIx == options.rawChannelCount - 1) {
-					allSilent = true;
+			} else {
+				const MT32Emu::Bit16s *in = state.stereoSampleBuffer + frameIx * 2;
+				for (unsigned int i = 0; i < blockFrameCount * 2; i++) {
+					putSample(out, in[i], bigEndian);
 				}
 			}
-			if (allSilent) {
-				state.unwrittenSilentFrames++;
-				continue;
-			}
-			flushSilence(NOISE_DETECTED, options, state);
-			for (int chanMapIx = 0; chanMapIx < options.rawChannelCount; chanMapIx++) {
-				if (options.rawChannelMap[chanMapIx] < 0) {
-					fputc(0, state.outputFile);
-					fputc(0, state.outputFile);
-				} else {
-					MT32Emu::Bit16s sample = state.rawSampleBuffer[options.rawChannelMap[chanMapIx]][i];
-					fputc((sample >> 8) & 0xFF, state.outputFile);
-					fputc(sample & 0xFF, state.outputFile);
+		} else {
+			for (unsigned int i = frameIx; i < frameIx + blockFrameCount; i++) {
+				for (int chanMapIx = 0; chanMapIx < options.rawChannelCount; chanMapIx++) {
+					MT32Emu::Bit16s sample = options.rawChannelMap[chanMapIx] < 0 ? 0 : state.rawSampleBuffer[options.rawChannelMap[chanMapIx]][i];
+					if (options.floatSamples) {
+						putSample(out, sample / 32768.0f, bigEndian);
+					} else {
+						putSample(out, sample, bigEndian);
+					}
 				}
 			}
-			state.writtenFrames++;
 		}
+		frameIx += blockFrameCount;
+		frameCount -= blockFrameCount;
+		state.writtenFrames += blockFrameCount;
+	}
+}
+
+// Writes out the frames just rendered. Silent frames are only counted here: flushSilence() decides how many of them get written.
+static void writeRenderedFrames(unsigned int frameCount, const Options &options, State &state) {
+	unsigned int frameIx = 0;
+	while (frameIx < frameCount) {
+		unsigned int noiseStartIx = frameIx;
+		while (noiseStartIx < frameCount && isSilentFrame(noiseStartIx, options, state)) {
+			noiseStartIx++;
+		}
+		state.unwrittenSilentFrames += noiseStartIx - frameIx;
+		if (noiseStartIx == frameCount) {
+			break;
+		}
+		unsigned int noiseEndIx = noiseStartIx + 1;
+		while (noiseEndIx < frameCount && !isSilentFrame(noiseEndIx, options, state)) {
+			noiseEndIx++;
+		}
+		flushSilence(NOISE_DETECTED, options, state);
+		writeFrames(noiseStartIx, noiseEndIx - noiseStartIx, options, state);
+		frameIx = noiseEndIx;
+	}
+}
+
+static void eventsPlayed(unsigned int playedEventCount, State &state) {
+	state.events += playedEventCount;
+	state.eventCount -= playedEventCount;
+}
+
+static void renderStereo(unsigned int frameCount, const Options &options, State &state) {
+	while (frameCount > 0) {
+		unsigned int renderedFramesThisPass = MIN(frameCount, options.bufferFrameCount);
+		unsigned int playedEventCount;
+		g_timer_continue(state.synthTimer);
+		if (options.floatSamples) {
+			playedEventCount = state.synth->renderWithEvents(state.floatStereoSampleBuffer, renderedFramesThisPass, state.renderedFrames, state.events, state.eventCount);
+		} else {
+			playedEventCount = state.synth->renderWithEvents(state.stereoSampleBuffer, renderedFramesThisPass, state.renderedFrames, state.events, state.eventCount);
+		}
+		g_timer_stop(state.synthTimer);
+		eventsPlayed(playedEventCount, state);
+		state.renderedFrames += renderedFramesThisPass;
+		writeRenderedFrames(renderedFramesThisPass, options, state);
+		frameCount -= renderedFramesThisPass;
+	}
+}
+
+static void renderRaw(unsigned int frameCount, const Options &options, State &state) {
+	while (frameCount > 0) {
+		unsigned int renderedFramesThisPass = MIN(frameCount, options.bufferFrameCount);
+		g_timer_continue(state.synthTimer);
+		unsigned int playedEventCount = state.synth->renderStreamsWithEvents(state.rawSampleBuffer[0], state.rawSampleBuffer[1], state.rawSampleBuffer[2], state.rawSampleBuffer[3], state.rawSampleBuffer[4], state.rawSampleBuffer[5], renderedFramesThisPass, state.renderedFrames, state.events, state.eventCount);
+		g_timer_stop(state.synthTimer);
+		eventsPlayed(playedEventCount, state);
+		state.renderedFrames += renderedFramesThisPass;
+		writeRenderedFrames(renderedFramesThisPass, options, state);
 		frameCount -= renderedFramesThisPass;
 	}
 }
 
+// Renders the frames, playing any events due meanwhile (including those due at the frame after the last one rendered).
 static void render(unsigned int frameCount, const Options &options, State &state) {
+	if (state.renderedFrames < options.startFrames) {
+		// Still before the start, so only the state of the synth needs to be kept up to date
+		unsigned int chasedFrames = MIN(frameCount, options.startFrames - state.renderedFrames);
+		g_timer_continue(state.synthTimer);
+		eventsPlayed(state.synth->chaseWithEvents(chasedFrames, state.renderedFrames, state.events, state.eventCount), state);
+		g_timer_stop(state.synthTimer);
+		state.renderedFrames += chasedFrames;
+		frameCount -= chasedFrames;
+	}
 	if (options.rawChannelCount > 0) {
 		renderRaw(frameCount, options, state);
 	} else {
@@ -434,83 +914,253 @@ static void render(unsigned int frameCount, const Options &options, State &state
 	}
 }
 
-static void playSMF(smf_t *smf, const Options &options, State &state) {
-	int unterminatedSysexLen = 0;
-	unsigned char *unterminatedSysex = NULL;
-	unsigned long renderedFrames = 0;
+static void runSegmentWorker(void *context) {
+	SegmentWorker &worker = *(SegmentWorker *)context;
 	for (;;) {
-		smf_event_t *event = smf_get_next_event(smf);
-		unsigned long eventFrameIx;
-
-		if (event == NULL) {
+		worker.startSignal.wait();
+		if (worker.quit) {
 			break;
 		}
+		worker.failed = !worker.synth->restoreState(worker.synthState, worker.synthStateSize);
+		if (!worker.failed) {
+			if (worker.rawSampleBuffer[0] != NULL) {
+				worker.synth->renderStreamsWithEvents(worker.rawSampleBuffer[0], worker.rawSampleBuffer[1], worker.rawSampleBuffer[2], worker.rawSampleBuffer[3], worker.rawSampleBuffer[4], worker.rawSampleBuffer[5], worker.frameCount, worker.startFrame, worker.events, worker.eventCount);
+			} else if (worker.floatStereoSampleBuffer != NULL) {
+				worker.synth->renderWithEvents(worker.floatStereoSampleBuffer, worker.frameCount, worker.startFrame, worker.events, worker.eventCount);
+			} else {
+				worker.synth->renderWithEvents(worker.stereoSampleBuffer, worker.frameCount, worker.startFrame, worker.events, worker.eventCount);
+			}
+		}
+		worker.doneSignal.post();
+	}
+}
 
-		assert(event->track->track_number >= 0);
+static void closeSegmentWorkers(State &state) {
+	for (unsigned int workerIx = 0; workerIx < state.segmentWorkerCount; workerIx++) {
+		SegmentWorker &worker = state.segmentWorkers[workerIx];
+		if (worker.thread.isStarted()) {
+			worker.quit = true;
+			worker.startSignal.post();
+			worker.thread.join();
+		}
+		if (worker.synth != NULL) {
+			worker.synth->close();
+			delete worker.synth;
+		}
+		delete[] worker.synthState;
+		delete[] worker.stereoSampleBuffer;
+		delete[] worker.floatStereoSampleBuffer;
+		for (unsigned int i = 0; i < 6; i++) {
+			delete[] worker.rawSampleBuffer[i];
+		}
+	}
+	delete[] state.segmentWorkers;
+	state.segmentWorkers = NULL;
+	state.segmentWorkerCount = 0;
+}
 
-		eventFrameIx = secondsToSamples(event->time_seconds, options.sampleRate);
-		if (eventFrameIx < renderedFrames) {
-			fprintf(stderr, "Event went back in time!\n");
+// Starts the workers for --jobs, each with a clone of the synth. Returns false (with none left running) if any of them
+// couldn't be started.
+static bool openSegmentWorkers(const Options &options, State &state) {
+	state.segmentFrames = options.sampleRate * SEGMENT_SECONDS;
+	state.segmentWorkerCount = options.jobCount;
+	state.segmentWorkers = new SegmentWorker[state.segmentWorkerCount];
+	for (unsigned int workerIx = 0; workerIx < state.segmentWorkerCount; workerIx++) {
+		SegmentWorker &worker = state.segmentWorkers[workerIx];
+		worker.synth = NULL;
+		worker.quit = false;
+		worker.synthState = NULL;
+		worker.synthStateSize = 0;
+		worker.synthStateBufferSize = 0;
+		worker.stereoSampleBuffer = NULL;
+		worker.floatStereoSampleBuffer = NULL;
+		for (unsigned int i = 0; i < 6; i++) {
+			worker.rawSampleBuffer[i] = NULL;
+		}
+	}
+	for (unsigned int workerIx = 0; workerIx < state.segmentWorkerCount; workerIx++) {
+		SegmentWorker &worker = state.segmentWorkers[workerIx];
+		if (options.rawChannelCount > 0) {
+			for (unsigned int i = 0; i < 6; i++) {
+				worker.rawSampleBuffer[i] = new MT32Emu::Bit16s[state.segmentFrames];
+			}
+		} else if (options.floatSamples) {
+			worker.floatStereoSampleBuffer = new float[state.segmentFrames * 2];
 		} else {
-			unsigned int renderLength = eventFrameIx - renderedFrames;
-			if (state.renderedFrames + renderLength > options.renderMaxFrames) {
-				renderLength = options.renderMaxFrames - state.renderedFrames;
+			worker.stereoSampleBuffer = new MT32Emu::Bit16s[state.segmentFrames * 2];
+		}
+		// The clone comes with the DAC input mode and the reverb disabled
+		worker.synth = state.synth->clone();
+		if (worker.synth == NULL || !worker.thread.start(runSegmentWorker, &worker)) {
+			closeSegmentWorkers(state);
+			return false;
+		}
+	}
+	return true;
+}
+
+// Hands the frames rendered by a worker over to the output, in the same sized passes as renderStereo() and renderRaw()
+static void writeSegment(const SegmentWorker &worker, const Options &options, State &state) {
+	unsigned int frameIx = 0;
+	while (frameIx < worker.frameCount) {
+		unsigned int framesThisPass = MIN(worker.frameCount - frameIx, options.bufferFrameCount);
+		if (options.rawChannelCount > 0) {
+			for (unsigned int i = 0; i < 6; i++) {
+				memcpy(state.rawSampleBuffer[i], worker.rawSampleBuffer[i] + frameIx, framesThisPass * sizeof(MT32Emu::Bit16s));
 			}
-			render(renderLength, options, state);
-			renderedFrames += renderLength;
-			if (state.renderedFrames == options.renderMaxFrames) {
-				break;
+		} else if (options.floatSamples) {
+			memcpy(state.floatStereoSampleBuffer, worker.floatStereoSampleBuffer + frameIx * 2, framesThisPass * 2 * sizeof(float));
+		} else {
+			memcpy(state.stereoSampleBuffer, worker.stereoSampleBuffer + frameIx * 2, framesThisPass * 2 * sizeof(MT32Emu::Bit16s));
+		}
+		state.renderedFrames += framesThisPass;
+		writeRenderedFrames(framesThisPass, options, state);
+		frameIx += framesThisPass;
+	}
+}
+
+// Same as render(), except that the frames are rendered in rounds of segments, one for each worker. The synth chases
+// through each round first, which is much faster than rendering, saving its state at the start of each segment for a
+// worker to render it from. While the workers carry on, the segments are written out in order. The synth ends up where
+// render() would have left it, so what comes after (such as waiting for the partials to end) is rendered as usual.
+// With the reverb disabled, chasing leaves the synth in exactly the state rendering would have, so the output is the same.
+static void renderSegmented(unsigned int frameCount, const Options &options, State &state) {
+	if (state.renderedFrames < options.startFrames) {
+		unsigned int chasedFrames = MIN(frameCount, options.startFrames - state.renderedFrames);
+		render(chasedFrames, options, state);
+		frameCount -= chasedFrames;
+	}
+	unsigned long endFrame = state.renderedFrames + frameCount;
+	while (state.renderedFrames < endFrame) {
+		unsigned long frame = state.renderedFrames;
+		const MT32Emu::MidiEvent *events = state.events;
+		unsigned int eventCount = state.eventCount;
+		unsigned int segmentCount = 0;
+		g_timer_continue(state.synthTimer);
+		while (segmentCount < state.segmentWorkerCount && frame < endFrame) {
+			SegmentWorker &worker = state.segmentWorkers[segmentCount++];
+			MT32Emu::Bit32u synthStateSize = state.synth->getStateSize();
+			if (synthStateSize > worker.synthStateBufferSize) {
+				delete[] worker.synthState;
+				worker.synthState = new MT32Emu::Bit8u[synthStateSize];
+				worker.synthStateBufferSize = synthStateSize;
 			}
+			worker.synthStateSize = state.synth->saveState(worker.synthState, worker.synthStateBufferSize);
+			worker.startFrame = frame;
+			worker.frameCount = MIN(endFrame - frame, state.segmentFrames);
+			worker.events = events;
+			worker.eventCount = eventCount;
+			worker.startSignal.post();
+			unsigned int playedEventCount = state.synth->chaseWithEvents(worker.frameCount, frame, events, eventCount);
+			events += playedEventCount;
+			eventCount -= playedEventCount;
+			frame += worker.frameCount;
 		}
+		g_timer_stop(state.synthTimer);
+		// Should a worker fail, the synth goes back to the start of its segment and renders the rest of the round itself
+		bool renderingSerially = false;
+		for (unsigned int segmentIx = 0; segmentIx < segmentCount; segmentIx++) {
+			SegmentWorker &worker = state.segmentWorkers[segmentIx];
+			g_timer_continue(state.synthTimer);
+			worker.doneSignal.wait();
+			g_timer_stop(state.synthTimer);
+			if (worker.failed && !renderingSerially) {
+				fprintf(stderr, "Error restoring the synth state for a segment - rendering serially\n");
+				renderingSerially = true;
+				state.events = worker.events;
+				state.eventCount = worker.eventCount;
+				if (!state.synth->restoreState(worker.synthState, worker.synthStateSize)) {
+					fprintf(stderr, "Error restoring the synth state - the output will be wrong\n");
+				}
+			}
+			if (renderingSerially) {
+				render(worker.frameCount, options, state);
+			} else {
+				writeSegment(worker, options, state);
+			}
+		}
+		if (!renderingSerially) {
+			state.events = events;
+			state.eventCount = eventCount;
+		}
+	}
+}
+
+// The MIDI of an SMF file compiled ahead of playing it: the events stamped with their frames, and the payloads of all the
+// sysex messages in one arena (with any sysex split over several SMF events put back together).
+struct Timeline {
+	MT32Emu::MidiEvent *events;
+	unsigned int eventCount;
+	MT32Emu::Bit8u *sysexArena;
+};
+
+static void compileTimeline(smf_t *smf, const Options &options, unsigned long startFrame, Timeline &timeline) {
+	// The first pass works out how much room is needed
+	unsigned int maxEventCount = 0;
+	unsigned long maxSysexArenaSize = 0;
+	smf_event_t *event;
+	while ((event = smf_get_next_event(smf)) != NULL) {
+		if (smf_event_is_metadata(event)) {
+			continue;
+		}
+		maxEventCount++;
+		if (smf_event_is_sysex(event) || smf_event_is_sysex_continuation(event)) {
+			maxSysexArenaSize += event->midi_buffer_length;
+		}
+	}
+	smf_rewind(smf);
+	timeline.events = new MT32Emu::MidiEvent[maxEventCount];
+	timeline.eventCount = 0;
+	timeline.sysexArena = new MT32Emu::Bit8u[maxSysexArenaSize];
+	unsigned long sysexArenaUsed = 0;
+	// Where the sysex waiting for its continuation starts in the arena, or -1 if there isn't one
+	long unterminatedSysexStart = -1;
+	unsigned long lastFrame = startFrame;
+	while ((event = smf_get_next_event(smf)) != NULL) {
+		assert(event->track->track_number >= 0);
+
+		unsigned long frame = startFrame + secondsToSamples(event->time_seconds, options.sampleRate);
+		if (frame < lastFrame) {
+			fprintf(stderr, "Event went back in time!\n");
+			frame = lastFrame;
+		}
+		lastFrame = frame;
 
 		if (smf_event_is_metadata(event)) {
 			char *decoded = smf_event_decode(event);
 			if (decoded && !options.quiet) {
-				fprintf(stdout, "Metadata: %s\n", decoded);
+				fprintf(getMessageFile(options), "Metadata: %s\n", decoded);
 			}
+			free(decoded);
 		} else if (smf_event_is_sysex(event) || smf_event_is_sysex_continuation(event))  {
 			bool unterminated = smf_event_is_unterminated_sysex(event);
-			bool addUnterminated = unterminated;
-			bool continuation = smf_event_is_sysex_continuation(event);
-			unsigned char *buf;
+			const unsigned char *buf;
 			int len;
-			if (continuation) {
-				if (unterminatedSysex != NULL) {
-					addUnterminated = true;
-				} else {
+			if (smf_event_is_sysex_continuation(event)) {
+				if (unterminatedSysexStart < 0) {
 					fprintf(stderr, "Sysex continuation received without preceding unterminated sysex - hoping for the best\n");
+					unterminatedSysexStart = sysexArenaUsed;
 				}
 				buf = event->midi_buffer + 1;
 				len = event->midi_buffer_length - 1;
 			} else {
-				if (unterminatedSysex != NULL) {
+				if (unterminatedSysexStart >= 0) {
 					fprintf(stderr, "New sysex received with an unterminated sysex pending - ignoring unterminated\n");
-					delete[] unterminatedSysex;
-					unterminatedSysex = NULL;
-					unterminatedSysexLen = 0;
+					sysexArenaUsed = unterminatedSysexStart;
 				}
+				unterminatedSysexStart = sysexArenaUsed;
 				buf = event->midi_buffer;
 				len = event->midi_buffer_length;
 			}
-			if (addUnterminated) {
-				unsigned char *newUnterminatedSysex = new unsigned char[unterminatedSysexLen + len];
-				if(unterminatedSysex != NULL) {
-					memcpy(newUnterminatedSysex, unterminatedSysex, unterminatedSysexLen);
-					delete[] unterminatedSysex;
-				}
-				memcpy(newUnterminatedSysex + unterminatedSysexLen, buf, len);
-				unterminatedSysex = newUnterminatedSysex;
-				unterminatedSysexLen += len;
-				buf = unterminatedSysex;
-				len = unterminatedSysexLen;
-			}
+			memcpy(timeline.sysexArena + sysexArenaUsed, buf, len);
+			sysexArenaUsed += len;
 			if (!unterminated) {
-				state.synth->playSysex(buf, len);
-				if (addUnterminated) {
-					delete[] unterminatedSysex;
-					unterminatedSysex = NULL;
-					unterminatedSysexLen = 0;
-				}
+				MT32Emu::MidiEvent &midiEvent = timeline.events[timeline.eventCount++];
+				midiEvent.frame = frame;
+				midiEvent.msg = 0;
+				midiEvent.sysex = timeline.sysexArena + unterminatedSysexStart;
+				midiEvent.sysexLen = sysexArenaUsed - unterminatedSysexStart;
+				unterminatedSysexStart = -1;
 			}
 		} else {
 			if (event->midi_buffer_length > 3) {
@@ -520,14 +1170,41 @@ static void playSMF(smf_t *smf, const Options &options, State &state) {
 				}
 				fprintf(stderr, "\n");
 			} else {
-				MT32Emu::Bit32u msg = 0;
+				MT32Emu::MidiEvent &midiEvent = timeline.events[timeline.eventCount++];
+				midiEvent.frame = frame;
+				midiEvent.msg = 0;
 				for (int i = 0; i < event->midi_buffer_length; i++) {
-					msg |= (event->midi_buffer[i] << (8 * i));
+					midiEvent.msg |= (event->midi_buffer[i] << (8 * i));
 				}
-				state.synth->playMsg(msg);
+				midiEvent.sysex = NULL;
+				midiEvent.sysexLen = 0;
 			}
 		}
 	}
+}
+
+static void playSMF(smf_t *smf, const Options &options, State &state) {
+	Timeline timeline;
+	compileTimeline(smf, options, state.renderedFrames, timeline);
+	if (timeline.eventCount > 0) {
+		state.events = timeline.events;
+		state.eventCount = timeline.eventCount;
+		// Events at or beyond renderMaxFrames are never played
+		unsigned long endFrame = MIN(timeline.events[timeline.eventCount - 1].frame, options.renderMaxFrames);
+		if (endFrame > state.renderedFrames) {
+			if (state.segmentWorkers != NULL) {
+				renderSegmented(endFrame - state.renderedFrames, options, state);
+			} else {
+				render(endFrame - state.renderedFrames, options, state);
+			}
+		}
+		// Plays any events due before anything was rendered
+		eventsPlayed(state.synth->chaseWithEvents(0, state.renderedFrames, state.events, state.eventCount), state);
+		state.events = NULL;
+		state.eventCount = 0;
+	}
+	delete[] timeline.events;
+	delete[] timeline.sysexArena;
 	flushSilence(MIDI_ENDED, options, state);
 	if (options.sendAllNotesOff) {
 		for (unsigned int part = 0; part < 9; part++) {
@@ -564,7 +1241,6 @@ static void playSMF(smf_t *smf, const Options &options, State &state) {
 	if (!state.synth->isActive()) {
 		state.unwrittenSilentFrames = 0;
 	}
-	delete[] unterminatedSysex;
 }
 
 static bool playFile(const gchar *inputFilename, const gchar *displayInputFilename, const Options &options, State &state) {
@@ -574,13 +1250,19 @@ static bool playFile(const gchar *inputFilename, const gchar *displayInputFilena
 		return false;
 	}
 	if (fileBuffer[0] == 0xF0) {
-		return playSysexFileBuffer(state.synth, displayInputFilename, fileBuffer, fileBufferLength);
+		// A sysex file is just the raw MIDI stream to send, usually a bank of settings to load in one go
+		state.synth->beginBulkWrite();
+		state.synth->parseStream(fileBuffer, fileBufferLength);
+		state.synth->commitBulkWrite();
+		g_free(fileBuffer);
+		return true;
 	}
 	smf_t *smf = smf_load_from_memory(fileBuffer, fileBufferLength);
+	g_free(fileBuffer);
 	if (smf != NULL) {
 		if (!options.quiet) {
 			char *decoded = smf_decode(smf);
-			fprintf(stdout, "%s.\n", decoded);
+			fprintf(getMessageFile(options), "%s.\n", decoded);
 			free(decoded);
 		}
 		assert(smf->number_of_tracks >= 1);
@@ -592,105 +1274,451 @@ static bool playFile(const gchar *inputFilename, const gchar *displayInputFilena
 	return false;
 }
 
-int main(int argc, char *argv[]) {
-	Options options;
-	if (!parseOptions(argc, argv, &options)) {
-		return -1;
-	}
-	gchar *outputFilename;
-	gchar *displayOutputFilename;
+static gchar *getOutputFilename(const Options &options) {
 	if (options.outputFilename != NULL) {
-		outputFilename = options.outputFilename;
-	} else {
-		gchar *lastInputFilename = options.inputFilenames[g_strv_length(options.inputFilenames) - 1];
-		unsigned long allocLen = strlen(lastInputFilename) + 5;
-		outputFilename = (gchar *)malloc(allocLen);
-		if(outputFilename == NULL) {
-			fprintf(stderr, "Error allocating %lu bytes for destination filename.\n", allocLen);
-			return -1;
-		}
-		if (options.rawChannelCount > 0) {
-			sprintf(outputFilename, "%s.raw", lastInputFilename);
-		} else {
-			sprintf(outputFilename, "%s.wav", lastInputFilename);
-		}
+		return g_strdup(options.outputFilename);
+	}
+	gchar *lastInputFilename = options.inputFilenames[g_strv_length(options.inputFilenames) - 1];
+	switch (options.outputFormat) {
+	case OutputFormat_W64:
+		return g_strconcat(lastInputFilename, ".w64", NULL);
+	case OutputFormat_RAW:
+		return g_strconcat(lastInputFilename, ".raw", NULL);
+	default:
+		return g_strconcat(lastInputFilename, ".wav", NULL);
 	}
-	displayOutputFilename = g_filename_display_name(outputFilename);
+}
 
+// Returns the opened synth, or NULL if it couldn't be opened.
+// If romImage isn't NULL, the ROMs are taken from there instead of being loaded again.
+static MT32Emu::Synth *openSynth(const Options &options, MT32Emu::ROMImage *romImage) {
 	MT32Emu::SynthProperties synthProperties = {0};
 	synthProperties.sampleRate = options.sampleRate;
 	synthProperties.useReverb = true;
 	synthProperties.useDefaultReverb = true;
 	synthProperties.baseDir = options.romDir;
+	synthProperties.renderThreads = options.renderThreads;
+	synthProperties.romImage = romImage;
 	MT32Emu::Synth *synth = new MT32Emu::Synth();
-	if (synth->open(synthProperties)) {
-		synth->setDACInputMode(options.dacInputMode);
-
-		FILE *outputFile;
-		bool outputFileExists = false;
-		if (!options.force) {
-			// FIXME: Lame way of avoiding overwriting an existing file
-			// (since it could theoretically be created between us testing and
-			// opening for writing)
-			if (g_file_test(outputFilename, G_FILE_TEST_EXISTS)) {
-				outputFileExists = true;
-			}
+	if (!synth->open(synthProperties)) {
+		delete synth;
+		return NULL;
+	}
+	return synth;
+}
+
+struct ConvertResult {
+	unsigned long renderedFrames;
+	unsigned long writtenFrames;
+	// Time spent in the synth rendering, and by the writer writing the output
+	double synthSeconds;
+	double writeSeconds;
+	// Time rendering had to wait for the writer
+	double writeWaitSeconds;
+};
+
+// Plays the input files through the synth into the output file.
+// Returns false if the output file couldn't be written or any of the input files couldn't be played.
+static bool convert(const Options &options, const gchar *outputFilename, MT32Emu::Synth *synth, ConvertResult &result) {
+	bool success = false;
+	memset(&result, 0, sizeof(result));
+	gchar *displayOutputFilename = g_filename_display_name(outputFilename);
+	synth->setDACInputMode(options.dacInputMode);
+	synth->setReverbEnabled(options.reverb);
+
+	FILE *outputFile;
+	bool outputFileExists = false;
+	bool standardOutput = writesToStandardOutput(options);
+	if (!options.force && !standardOutput) {
+		// FIXME: Lame way of avoiding overwriting an existing file
+		// (since it could theoretically be created between us testing and
+		// opening for writing)
+		if (g_file_test(outputFilename, G_FILE_TEST_EXISTS)) {
+			outputFileExists = true;
 		}
-		if (outputFileExists) {
-			fprintf(stderr, "Destination file '%s' exists.\n", displayOutputFilename);
-			outputFile = NULL;
+	}
+	if (outputFileExists) {
+		fprintf(stderr, "Destination file '%s' exists.\n", displayOutputFilename);
+		outputFile = NULL;
+	} else if (standardOutput) {
+#ifdef _WIN32
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		outputFile = stdout;
+	} else {
+		outputFile = fopen(outputFilename, "wb");
+	}
+	if (outputFile != NULL) {
+		// Output to a pipe can't be rewound to fill in the sizes in the header at the end, so they're left unknown
+		bool seekable = fseek(outputFile, 0, SEEK_CUR) == 0;
+		OutputWriter output;
+		openOutputWriter(output, outputFile);
+		unsigned char header[MAX_HEADER_SIZE];
+		writeOutput(output, header, makeHeader(header, options, UNKNOWN_DATA_SIZE));
+		State state = {NULL, NULL, {NULL, NULL, NULL, NULL, NULL, NULL}, synth, &output, newStoppedTimer(), NULL, 0, false, false, 0, 0, 0, NULL, 0, 0};
+		if (options.rawChannelCount > 0) {
+			state.rawSampleBuffer[0] = new MT32Emu::Bit16s[options.bufferFrameCount];
+			state.rawSampleBuffer[1] = new MT32Emu::Bit16s[options.bufferFrameCount];
+			state.rawSampleBuffer[2] = new MT32Emu::Bit16s[options.bufferFrameCount];
+			state.rawSampleBuffer[3] = new MT32Emu::Bit16s[options.bufferFrameCount];
+			state.rawSampleBuffer[4] = new MT32Emu::Bit16s[options.bufferFrameCount];
+			state.rawSampleBuffer[5] = new MT32Emu::Bit16s[options.bufferFrameCount];
+		} else if (options.floatSamples) {
+			state.floatStereoSampleBuffer = new float[options.bufferFrameCount * 2];
 		} else {
-			outputFile = fopen(outputFilename, "wb");
-		}
-		if (outputFile != NULL) {
-			if (options.rawChannelCount > 0 || writeWAVEHeader(outputFile, options.sampleRate)) {
-				State state = {NULL, {NULL, NULL, NULL, NULL, NULL, NULL}, synth, outputFile, false, false, 0, 0, 0};
-				state.outputFile = outputFile;
-				if (options.rawChannelCount > 0) {
-					state.rawSampleBuffer[0] = new MT32Emu::Bit16s[options.bufferFrameCount];
-					state.rawSampleBuffer[1] = new MT32Emu::Bit16s[options.bufferFrameCount];
-					state.rawSampleBuffer[2] = new MT32Emu::Bit16s[options.bufferFrameCount];
-					state.rawSampleBuffer[3] = new MT32Emu::Bit16s[options.bufferFrameCount];
-					state.rawSampleBuffer[4] = new MT32Emu::Bit16s[options.bufferFrameCount];
-					state.rawSampleBuffer[5] = new MT32Emu::Bit16s[options.bufferFrameCount];
-				} else {
-					state.stereoSampleBuffer = new MT32Emu::Bit16s[options.bufferFrameCount * 2];
-				}
-				gchar **inputFilename = options.inputFilenames;
-				while (*inputFilename != NULL) {
-					gchar *displayInputFilename = g_filename_display_name(*inputFilename);
-					state.lastInputFile = *(inputFilename + 1) == NULL; // FIXME: This should actually be true if all subsequent files are sysex
-					playFile(*inputFilename, displayInputFilename, options, state);
-					inputFilename++;
-					g_free(displayInputFilename);
-				}
-				delete[] state.stereoSampleBuffer;
-				delete[] state.rawSampleBuffer[0];
-				delete[] state.rawSampleBuffer[1];
-				delete[] state.rawSampleBuffer[2];
-				delete[] state.rawSampleBuffer[3];
-				delete[] state.rawSampleBuffer[4];
-				delete[] state.rawSampleBuffer[5];
-				if (options.rawChannelCount == 0 && !fillWAVESizes(outputFile, state.writtenFrames)) {
-					fprintf(stderr, "Error writing final sizes to WAVE header\n");
-				}
-			} else {
-				fprintf(stderr, "Error writing WAVE header to '%s'\n", displayOutputFilename);
+			state.stereoSampleBuffer = new MT32Emu::Bit16s[options.bufferFrameCount * 2];
+		}
+		if (options.jobCount > 1) {
+			if (!options.reverb && !openSegmentWorkers(options, state)) {
+				fprintf(stderr, "Error starting the segment workers - rendering serially\n");
+			} else if (options.reverb && !options.quiet) {
+				fprintf(getMessageFile(options), "The reverb is enabled, so the segments are rendered serially.\n");
+			}
+		}
+		success = true;
+		gchar **inputFilename = options.inputFilenames;
+		while (*inputFilename != NULL) {
+			gchar *displayInputFilename = g_filename_display_name(*inputFilename);
+			state.lastInputFile = *(inputFilename + 1) == NULL; // FIXME: This should actually be true if all subsequent files are sysex
+			if (!playFile(*inputFilename, displayInputFilename, options, state)) {
+				success = false;
 			}
-			fclose(outputFile);
+			inputFilename++;
+			g_free(displayInputFilename);
+			if (output.failed) {
+				break;
+			}
+		}
+		closeSegmentWorkers(state);
+		delete[] state.stereoSampleBuffer;
+		delete[] state.floatStereoSampleBuffer;
+		delete[] state.rawSampleBuffer[0];
+		delete[] state.rawSampleBuffer[1];
+		delete[] state.rawSampleBuffer[2];
+		delete[] state.rawSampleBuffer[3];
+		delete[] state.rawSampleBuffer[4];
+		delete[] state.rawSampleBuffer[5];
+		if (!finishOutput(output)) {
+			fprintf(stderr, "Error writing to '%s'\n", displayOutputFilename);
+			success = false;
+		} else if (options.outputFormat != OutputFormat_RAW) {
+			guint64 dataSize = (guint64)state.writtenFrames * getFrameSize(options);
+			if (options.outputFormat == OutputFormat_WAVE && dataSize + makeHeader(header, options, 0) - 8 > G_MAXUINT32) {
+				fprintf(stderr, "Output is too long for WAVE - use --format rf64 or w64 instead\n");
+				success = false;
+			}
+			if (seekable && !fillHeaderSizes(outputFile, options, dataSize)) {
+				fprintf(stderr, "Error writing final sizes to header\n");
+				success = false;
+			}
+		}
+		result.renderedFrames = state.renderedFrames;
+		result.writtenFrames = state.writtenFrames;
+		result.synthSeconds = g_timer_elapsed(state.synthTimer, NULL);
+		result.writeSeconds = g_timer_elapsed(output.writeTimer, NULL);
+		result.writeWaitSeconds = g_timer_elapsed(output.waitTimer, NULL);
+		g_timer_destroy(state.synthTimer);
+		closeOutputWriter(output);
+		if ((standardOutput ? fflush(outputFile) : fclose(outputFile)) != 0) {
+			success = false;
+		}
+	} else {
+		fprintf(stderr, "Error opening file '%s' for writing.\n", displayOutputFilename);
+	}
+	g_free(displayOutputFilename);
+	return success;
+}
+
+struct BatchJob {
+	Options options;
+	unsigned int lineNum; // In the manifest, starting from 1
+};
+
+struct Batch {
+	BatchJob *jobs;
+	unsigned int jobCount;
+	// The ROMs shared by the synths of all workers
+	MT32Emu::ROMImage *romImage;
+	FILE *logFile;
+	GTimer *timer;
+
+	// Guards the members below, and writing to logFile
+	MT32Emu::Mutex mutex;
+	unsigned int nextJobIx;
+	unsigned int finishedJobCount;
+	unsigned int failedJobCount;
+};
+
+struct BatchWorker {
+	Batch *batch;
+	unsigned int workerNum;
+	MT32Emu::Thread thread;
+	// Opened with the sample rate and render threads of the first job, and opened again if a later job needs others
+	MT32Emu::Synth *synth;
+	gint synthSampleRate;
+	unsigned int synthRenderThreads;
+	// Taken right after opening the synth, and restored before each job so that it starts from the state of a new synth
+	MT32Emu::SynthCheckpoint initialState;
+};
+
+// Writes str to the log as a quoted JSON string. str should be valid UTF-8, as g_filename_display_name() returns.
+static void logString(FILE *logFile, const gchar *str) {
+	fputc('"', logFile);
+	for (const gchar *c = str; *c != '\0'; c++) {
+		if (*c == '"' || *c == '\\') {
+			fputc('\\', logFile);
+			fputc(*c, logFile);
+		} else if ((unsigned char)*c < 0x20) {
+			fprintf(logFile, "\\u%04x", *c);
 		} else {
-			fprintf(stderr, "Error opening file '%s' for writing.\n", displayOutputFilename);
+			fputc(*c, logFile);
+		}
+	}
+	fputc('"', logFile);
+}
+
+static void runBatchJob(BatchWorker &worker, unsigned int jobIx) {
+	Batch &batch = *worker.batch;
+	const BatchJob &job = batch.jobs[jobIx];
+	const Options &options = job.options;
+	gchar *outputFilename = getOutputFilename(options);
+	gchar *displayOutputFilename = g_filename_display_name(outputFilename);
+
+	batch.mutex.lock();
+	fprintf(batch.logFile, "{\"event\": \"start\", \"job\": %u, \"line\": %u, \"worker\": %u, \"output\": ", jobIx, job.lineNum, worker.workerNum);
+	logString(batch.logFile, displayOutputFilename);
+	fprintf(batch.logFile, ", \"time\": %.3f}\n", g_timer_elapsed(batch.timer, NULL));
+	fflush(batch.logFile);
+	batch.mutex.unlock();
+
+	GTimer *jobTimer = g_timer_new();
+	bool synthReady;
+	if (worker.synth != NULL && worker.synthSampleRate == options.sampleRate && worker.synthRenderThreads == options.renderThreads) {
+		synthReady = worker.synth->restoreCheckpoint(worker.initialState);
+	} else {
+		if (worker.synth != NULL) {
+			worker.synth->close();
+			delete worker.synth;
 		}
+		worker.synth = openSynth(options, batch.romImage);
+		synthReady = worker.synth != NULL && worker.synth->saveCheckpoint(worker.initialState);
+		worker.synthSampleRate = options.sampleRate;
+		worker.synthRenderThreads = options.renderThreads;
+	}
+	ConvertResult result;
+	bool success;
+	if (synthReady) {
+		success = convert(options, outputFilename, worker.synth, result);
 	} else {
 		fprintf(stderr, "Error opening MT32Emu synthesizer.\n");
+		memset(&result, 0, sizeof(result));
+		success = false;
 	}
-	delete synth;
+	double jobSeconds = g_timer_elapsed(jobTimer, NULL);
+	g_timer_destroy(jobTimer);
 
-	if(options.outputFilename == NULL && outputFilename != NULL) {
-		free(outputFilename);
+	batch.mutex.lock();
+	batch.finishedJobCount++;
+	if (!success) {
+		batch.failedJobCount++;
 	}
+	fprintf(batch.logFile, "{\"event\": \"finish\", \"job\": %u, \"line\": %u, \"worker\": %u, \"output\": ", jobIx, job.lineNum, worker.workerNum);
+	logString(batch.logFile, displayOutputFilename);
+	fprintf(batch.logFile, ", \"success\": %s, \"renderedFrames\": %lu, \"writtenFrames\": %lu, \"audioSeconds\": %.3f, \"seconds\": %.3f, \"synthSeconds\": %.3f, \"writeSeconds\": %.3f, \"writeWaitSeconds\": %.3f, \"finishedJobs\": %u, \"jobs\": %u, \"time\": %.3f}\n",
+		success ? "true" : "false", result.renderedFrames, result.writtenFrames, (double)result.renderedFrames / options.sampleRate, jobSeconds,
+		result.synthSeconds, result.writeSeconds, result.writeWaitSeconds,
+		batch.finishedJobCount, batch.jobCount, g_timer_elapsed(batch.timer, NULL));
+	fflush(batch.logFile);
+	batch.mutex.unlock();
+
 	g_free(displayOutputFilename);
+	g_free(outputFilename);
+}
+
+static void runBatchWorker(void *context) {
+	BatchWorker &worker = *(BatchWorker *)context;
+	Batch &batch = *worker.batch;
+	for (;;) {
+		batch.mutex.lock();
+		unsigned int jobIx = batch.nextJobIx;
+		if (jobIx < batch.jobCount) {
+			batch.nextJobIx++;
+		}
+		batch.mutex.unlock();
+		if (jobIx >= batch.jobCount) {
+			break;
+		}
+		runBatchJob(worker, jobIx);
+	}
+}
+
+// Reads the jobs from the manifest, each with the arguments in args (as given on the command line) followed by those on
+// its line. Returns NULL if the manifest couldn't be read, otherwise jobCount is set to the number of valid jobs.
+static BatchJob *readBatchManifest(const Options &options, gchar **args, unsigned int &jobCount, unsigned int &invalidJobCount) {
+	gchar *displayBatchFilename = g_filename_display_name(options.batchFilename);
+	MT32Emu::Bit8u *fileBuffer = NULL;
+	gsize fileBufferLength = 0;
+	if (!loadFile(fileBuffer, fileBufferLength, options.batchFilename, displayBatchFilename)) {
+		g_free(displayBatchFilename);
+		return NULL;
+	}
+	gchar **lines = g_strsplit((const gchar *)fileBuffer, "\n", -1);
+	g_free(fileBuffer);
+	guint lineCount = g_strv_length(lines);
+	guint argCount = g_strv_length(args);
+	BatchJob *jobs = new BatchJob[lineCount];
+	jobCount = 0;
+	invalidJobCount = 0;
+	for (guint lineIx = 0; lineIx < lineCount; lineIx++) {
+		gchar *line = g_strstrip(lines[lineIx]);
+		if (line[0] == '\0' || line[0] == '#') {
+			continue;
+		}
+		gint lineArgCount;
+		gchar **lineArgs;
+		GError *err = NULL;
+		if (!g_shell_parse_argv(line, &lineArgCount, &lineArgs, &err)) {
+			fprintf(stderr, "Error parsing line %u of batch manifest '%s': %s\n", lineIx + 1, displayBatchFilename, err->message);
+			g_error_free(err);
+			invalidJobCount++;
+			continue;
+		}
+		// The option parser rearranges the arguments it's given, but doesn't free or change the strings themselves
+		gchar **jobArgs = g_new(gchar *, argCount + lineArgCount + 1);
+		memcpy(jobArgs, args, argCount * sizeof(gchar *));
+		memcpy(jobArgs + argCount, lineArgs, (lineArgCount + 1) * sizeof(gchar *));
+		if (!parseOptions(argCount + lineArgCount, jobArgs, &jobs[jobCount].options, true)) {
+			fprintf(stderr, "Invalid job on line %u of batch manifest '%s'\n", lineIx + 1, displayBatchFilename);
+			invalidJobCount++;
+		} else if (writesToStandardOutput(jobs[jobCount].options)) {
+			fprintf(stderr, "Job on line %u of batch manifest '%s' can't write to standard output\n", lineIx + 1, displayBatchFilename);
+			freeOptions(&jobs[jobCount].options);
+			invalidJobCount++;
+		} else {
+			// Anything else written to standard output would get mixed up with the log
+			jobs[jobCount].options.quiet = true;
+			jobs[jobCount].lineNum = lineIx + 1;
+			jobCount++;
+		}
+		g_free(jobArgs);
+		g_strfreev(lineArgs);
+	}
+	g_strfreev(lines);
+	g_free(displayBatchFilename);
+	return jobs;
+}
+
+// Converts the jobs in the batch manifest on a pool of workers, each with a synth of its own.
+// Returns false if any job couldn't be converted.
+static bool runBatch(const Options &options, gchar **args) {
+	unsigned int jobCount;
+	unsigned int invalidJobCount;
+	BatchJob *jobs = readBatchManifest(options, args, jobCount, invalidJobCount);
+	if (jobs == NULL) {
+		return false;
+	}
+	FILE *logFile = stdout;
+	if (options.batchLogFilename != NULL) {
+		logFile = fopen(options.batchLogFilename, "w");
+		if (logFile == NULL) {
+			gchar *displayLogFilename = g_filename_display_name(options.batchLogFilename);
+			fprintf(stderr, "Error opening file '%s' for writing.\n", displayLogFilename);
+			g_free(displayLogFilename);
+		}
+	}
+	// Loads the ROMs for all the workers, and keeps them loaded even while a worker opens its synth again
+	MT32Emu::Synth *romSynth = NULL;
+	if (logFile != NULL) {
+		romSynth = openSynth(options, NULL);
+		if (romSynth == NULL) {
+			fprintf(stderr, "Error opening MT32Emu synthesizer.\n");
+		}
+	}
+	bool success = false;
+	if (romSynth != NULL) {
+		Batch batch;
+		batch.jobs = jobs;
+		batch.jobCount = jobCount;
+		batch.romImage = romSynth->getROMImage();
+		batch.logFile = logFile;
+		batch.timer = g_timer_new();
+		batch.nextJobIx = 0;
+		batch.finishedJobCount = 0;
+		batch.failedJobCount = 0;
+
+		unsigned int workerCount = MIN(options.batchWorkerCount, MAX(jobCount, 1U));
+		fprintf(logFile, "{\"event\": \"begin\", \"jobs\": %u, \"invalidJobs\": %u, \"workers\": %u}\n", jobCount, invalidJobCount, workerCount);
+		fflush(logFile);
+		BatchWorker *workers = new BatchWorker[workerCount];
+		for (unsigned int workerIx = 0; workerIx < workerCount; workerIx++) {
+			workers[workerIx].batch = &batch;
+			workers[workerIx].workerNum = workerIx;
+			workers[workerIx].synth = NULL;
+		}
+		// The first worker runs on this thread. Should the others fail to start, it ends up doing their jobs as well.
+		for (unsigned int workerIx = 1; workerIx < workerCount; workerIx++) {
+			if (!workers[workerIx].thread.start(runBatchWorker, &workers[workerIx])) {
+				fprintf(stderr, "Error starting batch worker thread\n");
+			}
+		}
+		runBatchWorker(&workers[0]);
+		for (unsigned int workerIx = 0; workerIx < workerCount; workerIx++) {
+			workers[workerIx].thread.join();
+			if (workers[workerIx].synth != NULL) {
+				workers[workerIx].synth->close();
+				delete workers[workerIx].synth;
+			}
+		}
+		delete[] workers;
+
+		fprintf(logFile, "{\"event\": \"end\", \"jobs\": %u, \"failedJobs\": %u, \"invalidJobs\": %u, \"time\": %.3f}\n", jobCount, batch.failedJobCount, invalidJobCount, g_timer_elapsed(batch.timer, NULL));
+		fflush(logFile);
+		g_timer_destroy(batch.timer);
+		success = batch.failedJobCount == 0 && invalidJobCount == 0;
+		romSynth->close();
+		delete romSynth;
+	}
+	if (logFile != NULL && logFile != stdout) {
+		fclose(logFile);
+	}
+	for (unsigned int jobIx = 0; jobIx < jobCount; jobIx++) {
+		freeOptions(&jobs[jobIx].options);
+	}
+	delete[] jobs;
+	return success;
+}
+
+int main(int argc, char *argv[]) {
+	// The option parser rearranges argv, so the original arguments are kept for the jobs of a batch
+	gchar **args = g_strdupv(argv);
+	Options options;
+	if (!parseOptions(argc, argv, &options, false)) {
+		g_strfreev(args);
+		return -1;
+	}
+	if (options.batchFilename != NULL) {
+		bool batchSuccess = runBatch(options, args);
+		g_strfreev(args);
+		freeOptions(&options);
+		return batchSuccess ? 0 : 1;
+	}
+	g_strfreev(args);
+
+	MT32Emu::Synth *synth = openSynth(options, NULL);
+	if (synth != NULL) {
+		gchar *outputFilename = getOutputFilename(options);
+		ConvertResult result;
+		convert(options, outputFilename, synth, result);
+		if (!options.quiet) {
+			fprintf(getMessageFile(options), "Rendered %.3f seconds of audio: synthesis took %.3f seconds, writing took %.3f seconds (%.3f seconds of which held up synthesis).\n",
+				(double)result.renderedFrames / options.sampleRate, result.synthSeconds, result.writeSeconds, result.writeWaitSeconds);
+		}
+		g_free(outputFilename);
+		delete synth;
+	} else {
+		fprintf(stderr, "Error opening MT32Emu synthesizer.\n");
+	}
+
 	freeOptions(&options);
 	return 0;
 }
-